@@ -49,6 +49,8 @@ void log_backtrace(unsigned level, const char* where)
 
 		free(strs);
 	}
+	/* process may not survive, get queued lines to the disk */
+	LogFlush();
 #else
 	(void)level;
 	(void)where;
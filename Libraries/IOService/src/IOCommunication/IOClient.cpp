@@ -229,3 +229,35 @@ void IOClient::setLimitErrorLogging(bool bLimitErrorLogging)
 	if (m_sockImpl)
 		m_sockImpl->setLimitErrorLogging(bLimitErrorLogging);
 }
+
+void IOClient::setCompressionCodecs(quint32 codecs)
+{
+	if (m_sockImpl)
+		m_sockImpl->setCompressionCodecs(codecs);
+}
+
+void IOClient::setKernelTls(bool enabled)
+{
+	if (m_sockImpl)
+		m_sockImpl->setKernelTls(enabled);
+}
+
+void IOClient::setBinaryEvents(bool enabled)
+{
+	if (m_sockImpl)
+		m_sockImpl->setBinaryEvents(enabled);
+}
+
+bool IOClient::binaryEventsNegotiated() const
+{
+	if (m_sockImpl)
+		return m_sockImpl->binaryEventsNegotiated();
+	return false;
+}
+
+bool IOClient::kernelTlsActive() const
+{
+	if (m_sockImpl)
+		return m_sockImpl->kernelTlsActive();
+	return false;
+}
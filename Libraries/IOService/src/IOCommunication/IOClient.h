@@ -180,6 +180,46 @@ public:
 	 */
 	void setLimitErrorLogging(bool bLimitErrorLogging);
 
+	/**
+	 * Set bitmask of codecs (see IOCompression::Codec), which may be
+	 * used to compress package buffers sent to server. Codec is chosen
+	 * in handshake from codecs supported by both sides.
+	 * Zero (default) disables compression of sent buffers.
+	 * Takes effect on next connection.
+	 */
+	void setCompressionCodecs(quint32 codecs);
+
+	/**
+	 * Enable kernel TLS offload of SSL connection (Linux only).
+	 * If server supports it too, keys of the session are handed to the
+	 * kernel after SSL handshake and SSL route is written as plain one.
+	 * TLS 1.2 and TLS 1.3 sessions with AES-GCM ciphers are offloaded.
+	 * Such connection can't be detached.
+	 * Takes effect on next connection.
+	 */
+	void setKernelTls(bool enabled);
+
+	/**
+	 * Advertise to server in handshake that received events may be
+	 * in binary encoding, i.e. upper layer decodes both binary and XML
+	 * events. Disabled by default.
+	 * Takes effect on next connection.
+	 */
+	void setBinaryEvents(bool enabled);
+
+	/**
+	 * Returns true if both sides advertised binary events decoding
+	 * in last handshake, so events for server may be sent in binary
+	 * encoding instead of XML.
+	 */
+	bool binaryEventsNegotiated() const;
+
+	/**
+	 * Returns true if keys of current SSL connection are handed to
+	 * the kernel, which encrypts and decrypts its records.
+	 */
+	bool kernelTlsActive() const;
+
 signals:
 	/**
 	 * Emited from client thread when this client had been detached by
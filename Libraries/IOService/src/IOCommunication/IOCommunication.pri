@@ -31,3 +31,7 @@ QTCONFIG = core network
 INCLUDEPATH *= $$PWD $$PWD/../ $$PWD/../../
 
 include($$LIBS_LEVEL/OpenSSL/OpenSSL.pri)
+
+# Optional codecs for buffers compression
+contains(DEFINES, ENABLE_LZ4): LIBS += -llz4
+contains(DEFINES, ENABLE_ZSTD): LIBS += -lzstd
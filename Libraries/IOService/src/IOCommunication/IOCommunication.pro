@@ -31,8 +31,10 @@ include(IOCommunication.pri)
 HEADERS = \
           IOClient.h \
           IOClientInterface.h \
+          IOCompression.h \
           IOConnection.h \
           IODataBuffer.h \
+          IOPackagePool.h \
           IOProtocol.h \
           IOProtocolCommon.h \
           IORoutingTable.h \
@@ -46,8 +48,10 @@ HEADERS = \
 	  BlockingQueue.h \
 	  Cancellation.h \
           \
+          Socket/KernelTls_p.h \
           Socket/SocketClient_p.h \
           Socket/SocketListeners_p.h \
+          Socket/SocketReactor_p.h \
           Socket/SocketServer_p.h \
           Socket/Socket_p.h \
           IOSSLInterface.h \
@@ -58,8 +62,10 @@ headers.path = $${PREFIX}/include/prlcommon/IOService/IOCommunication/
 INSTALLS += headers
 
 HEADERS_S = \
+          Socket/KernelTls_p.h \
           Socket/SocketClient_p.h \
           Socket/SocketListeners_p.h \
+          Socket/SocketReactor_p.h \
           Socket/SocketServer_p.h \
           Socket/Socket_p.h \
           IOSSLInterface.h \
@@ -73,7 +79,9 @@ HEADERS += $${HEADERS_S}
 
 SOURCES = \
           IOClient.cpp \
+          IOCompression.cpp \
           IODataBuffer.cpp \
+          IOPackagePool.cpp \
           IOProtocol.cpp \
           IORoutingTable.cpp \
           IORoutingTableHelper.cpp \
@@ -82,7 +90,9 @@ SOURCES = \
           IOServerPool.cpp \
 	  Cancellation.cpp \
           \
+          Socket/KernelTls_p.cpp \
           Socket/SocketClient_p.cpp \
+          Socket/SocketReactor_p.cpp \
           Socket/SocketServer_p.cpp \
           Socket/Socket_p.cpp \
           IOSSLInterface.cpp \
@@ -0,0 +1,352 @@
+/*
+ * IOCompression.cpp
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <string.h>
+
+#ifdef _WIN_
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#ifdef ENABLE_LZ4
+  #include <lz4.h>
+#endif
+#ifdef ENABLE_ZSTD
+  #include <zstd.h>
+#endif
+
+#include "IOCompression.h"
+#include "Libraries/Logging/Logging.h"
+#include "Libraries/Std/AtomicOps.h"
+
+using namespace IOService;
+using namespace IOService::IOCompression;
+
+/*****************************************************************************/
+
+namespace {
+
+enum {
+    // Compressed buffer starts with raw size of the buffer
+    RawSizeHeader = sizeof(quint32),
+    // Fastest zstd level, ratio is still better than lz4 one
+    ZstdLevel = 1
+};
+
+// CPU time of the calling thread, wall time would count preemption too
+quint64 threadCpuUsecs ()
+{
+#ifdef _WIN_
+    FILETIME creation, exit, kernel, user;
+    if ( ! ::GetThreadTimes(::GetCurrentThread(), &creation, &exit,
+                            &kernel, &user) )
+        return 0;
+    quint64 k = (quint64)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+    quint64 u = (quint64)user.dwHighDateTime << 32 | user.dwLowDateTime;
+    // 100-nanosecond intervals
+    return (k + u) / 10;
+#else
+    struct timespec ts;
+    if ( ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0 )
+        return 0;
+    return (quint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifdef ENABLE_ZSTD
+// Contexts are expensive to create, so every thread reuses its own
+struct ZstdContexts
+{
+    ZSTD_CCtx* cctx;
+    ZSTD_DCtx* dctx;
+
+    ZstdContexts () :
+        cctx(ZSTD_createCCtx()),
+        dctx(ZSTD_createDCtx())
+    {}
+    ~ZstdContexts ()
+    {
+        ZSTD_freeCCtx( cctx );
+        ZSTD_freeDCtx( dctx );
+    }
+};
+
+ZstdContexts& zstdContexts ()
+{
+    static thread_local ZstdContexts ctxs;
+    return ctxs;
+}
+#endif
+
+IOPackage::EncodingType encodingOf ( Codec codec )
+{
+    switch ( codec ) {
+    case LZ4Codec:
+        return IOPackage::LZ4Encoding;
+    case ZstdCodec:
+        return IOPackage::ZstdEncoding;
+    default:
+        return IOPackage::RawEncoding;
+    }
+}
+
+quint32 compressBound ( Codec codec, quint32 size )
+{
+    switch ( codec ) {
+#ifdef ENABLE_LZ4
+    case LZ4Codec:
+        return LZ4_compressBound( size );
+#endif
+#ifdef ENABLE_ZSTD
+    case ZstdCodec:
+        return ZSTD_compressBound( size );
+#endif
+    default:
+        (void)size;
+        return 0;
+    }
+}
+
+// Returns compressed size or 0 if buffer can't be compressed
+quint32 compressBuffer ( Codec codec, const char* src, quint32 srcSize,
+                         char* dst, quint32 dstSize )
+{
+    switch ( codec ) {
+#ifdef ENABLE_LZ4
+    case LZ4Codec: {
+        int res = LZ4_compress_default( src, dst, srcSize, dstSize );
+        return res > 0 ? res : 0;
+    }
+#endif
+#ifdef ENABLE_ZSTD
+    case ZstdCodec: {
+        ZSTD_CCtx* cctx = zstdContexts().cctx;
+        if ( cctx == 0 )
+            return 0;
+        size_t res = ZSTD_compressCCtx( cctx, dst, dstSize, src, srcSize,
+                                        ZstdLevel );
+        return ZSTD_isError(res) ? 0 : res;
+    }
+#endif
+    default:
+        (void)src; (void)srcSize; (void)dst; (void)dstSize;
+        return 0;
+    }
+}
+
+bool decompressBuffer ( quint32 enc, const char* src, quint32 srcSize,
+                        char* dst, quint32 dstSize )
+{
+    switch ( enc ) {
+#ifdef ENABLE_LZ4
+    case IOPackage::LZ4Encoding: {
+        int res = LZ4_decompress_safe( src, dst, srcSize, dstSize );
+        return res >= 0 && (quint32)res == dstSize;
+    }
+#endif
+#ifdef ENABLE_ZSTD
+    case IOPackage::ZstdEncoding: {
+        ZSTD_DCtx* dctx = zstdContexts().dctx;
+        if ( dctx == 0 )
+            return false;
+        size_t res = ZSTD_decompressDCtx( dctx, dst, dstSize, src, srcSize );
+        return ! ZSTD_isError(res) && res == dstSize;
+    }
+#endif
+    default:
+        (void)src; (void)srcSize; (void)dst; (void)dstSize;
+        return false;
+    }
+}
+
+} // anonymous namespace
+
+/*****************************************************************************/
+
+quint32 IOCompression::supportedCodecs ()
+{
+    quint32 codecs = NoCodec;
+#ifdef ENABLE_LZ4
+    codecs |= LZ4Codec;
+#endif
+#ifdef ENABLE_ZSTD
+    codecs |= ZstdCodec;
+#endif
+    return codecs;
+}
+
+Codec IOCompression::chooseCodec ( quint32 codecs )
+{
+    codecs &= supportedCodecs();
+    // Prefer better ratio, both codecs are fast enough for network
+    if ( codecs & ZstdCodec )
+        return ZstdCodec;
+    if ( codecs & LZ4Codec )
+        return LZ4Codec;
+    return NoCodec;
+}
+
+bool IOCompression::isCompressible ( const SmartPtr<IOPackage>& p,
+                                     Codec codec )
+{
+    if ( codec == NoCodec || ! p.isValid() )
+        return false;
+
+    const IOPackage::PODData* pkgData = IODATAMEMBERCONST(p);
+    for ( quint32 i = 0; i < p->header.buffersNumber; ++i ) {
+        if ( pkgData[i].bufferSize >= MinCompressSize &&
+             p->buffers[i].isValid() )
+            return true;
+    }
+    return false;
+}
+
+SmartPtr<IOPackage> IOCompression::compressPackage (
+    const SmartPtr<IOPackage>& p,
+    Codec codec,
+    IOSender::Statistics& stat )
+{
+    if ( ! isCompressible(p, codec) )
+        return p;
+
+    const quint64 startUsecs = threadCpuUsecs();
+
+    // Shallow copy: original package stays untouched for its owner
+    SmartPtr<IOPackage> cp = IOPackage::duplicateInstance( p, false );
+    if ( ! cp.isValid() )
+        return p;
+
+    const IOPackage::PODData* pkgData = IODATAMEMBERCONST(p);
+    qint64 rawBytes = 0;
+    qint64 wireBytes = 0;
+
+    for ( quint32 i = 0; i < p->header.buffersNumber; ++i ) {
+        const quint32 size = pkgData[i].bufferSize;
+        if ( size < MinCompressSize || ! p->buffers[i].isValid() )
+            continue;
+
+        IOPackage::PODData desc;
+        desc.bufferEncoding = IOPackage::RawEncoding;
+        desc.bufferSize = RawSizeHeader + compressBound( codec, size );
+        SmartPtr<char> buff = IOPackage::allocPODBuffer( desc );
+        if ( ! buff.isValid() )
+            continue;
+
+        quint32 compressed = compressBuffer( codec, p->buffers[i].getImpl(),
+                                             size,
+                                             buff.getImpl() + RawSizeHeader,
+                                             desc.bufferSize - RawSizeHeader );
+        // Does not pay off, send as is
+        if ( compressed == 0 || RawSizeHeader + compressed >= size )
+            continue;
+
+        ::memcpy( buff.getImpl(), &size, RawSizeHeader );
+        IOPackage::EncodingType enc = static_cast<IOPackage::EncodingType>(
+            pkgData[i].bufferEncoding | encodingOf(codec) );
+        if ( ! cp->setBuffer(i, enc, buff, RawSizeHeader + compressed) )
+            continue;
+
+        rawBytes += size;
+        wireBytes += RawSizeHeader + compressed;
+    }
+
+    AtomicAdd64(&stat.compressionUsecs, threadCpuUsecs() - startUsecs);
+    if ( rawBytes == 0 )
+        return p;
+
+    AtomicAdd64(&stat.compressionRawBytes, rawBytes);
+    AtomicAdd64(&stat.compressionWireBytes, wireBytes);
+    return cp;
+}
+
+bool IOCompression::decompressPackage ( const SmartPtr<IOPackage>& p,
+                                        IOSender::Statistics& stat )
+{
+    IOPackage::PODData* pkgData = IODATAMEMBER(p);
+    bool compressed = false;
+    quint64 startUsecs = 0;
+    qint64 rawBytes = 0;
+    qint64 wireBytes = 0;
+
+    for ( quint32 i = 0; i < p->header.buffersNumber; ++i ) {
+        const quint32 enc = pkgData[i].bufferEncoding;
+        if ( (enc & IOPackage::CompressionEncodingMask) == 0 )
+            continue;
+
+        if ( ! compressed ) {
+            compressed = true;
+            startUsecs = threadCpuUsecs();
+        }
+
+        const quint32 size = pkgData[i].bufferSize;
+        const char* src = p->buffers[i].getImpl();
+        if ( size <= RawSizeHeader || src == 0 ) {
+            WRITE_TRACE(DBG_FATAL, "Compressed buffer #%d is truncated!", i);
+            return false;
+        }
+
+        quint32 rawSize = 0;
+        ::memcpy( &rawSize, src, RawSizeHeader );
+        if ( rawSize == 0 || rawSize > IOPackage::SIZE_LIMIT ) {
+            WRITE_TRACE(DBG_FATAL, "Wrong raw size %u of compressed buffer #%d!",
+                        rawSize, i);
+            return false;
+        }
+
+        IOPackage::PODData desc;
+        desc.bufferEncoding = static_cast<IOPackage::EncodingType>(
+            enc & ~IOPackage::CompressionEncodingMask );
+        desc.bufferSize = rawSize;
+        SmartPtr<char> buff = IOPackage::allocPODBuffer( desc );
+        if ( ! buff.isValid() ) {
+            WRITE_TRACE(DBG_FATAL, "Can't allocate memory!");
+            return false;
+        }
+
+        if ( ! decompressBuffer(enc & IOPackage::CompressionEncodingMask,
+                                src + RawSizeHeader, size - RawSizeHeader,
+                                buff.getImpl(), rawSize) ) {
+            WRITE_TRACE(DBG_FATAL, "Can't decompress buffer #%d "
+                        "(encoding 0x%x)!", i, enc);
+            return false;
+        }
+
+        if ( ! p->setBuffer(i, desc.bufferEncoding, buff, rawSize) )
+            return false;
+
+        rawBytes += rawSize;
+        wireBytes += size;
+    }
+
+    if ( ! compressed )
+        return true;
+
+    AtomicAdd64(&stat.decompressionUsecs, threadCpuUsecs() - startUsecs);
+    AtomicAdd64(&stat.decompressionRawBytes, rawBytes);
+    AtomicAdd64(&stat.decompressionWireBytes, wireBytes);
+    return true;
+}
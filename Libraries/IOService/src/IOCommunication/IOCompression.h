@@ -0,0 +1,92 @@
+/*
+ * IOCompression.h
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#ifndef IOCOMPRESSION_H
+#define IOCOMPRESSION_H
+
+#include "IOProtocol.h"
+
+namespace IOService {
+
+/**
+ * Package buffers compression.
+ *
+ * Compression is negotiated per connection in the handshake, both sides
+ * send bitmask of codecs they are able to decode. Sender compresses each
+ * buffer, which is big enough, just before it is written to the socket,
+ * so compression is transparent for package owners and composes with SSL.
+ * Compressed buffer is prefixed with its raw size and is marked on the
+ * wire with codec encoding flag, which is combined with original buffer
+ * encoding. Receiver restores original buffers before package is passed
+ * to listeners.
+ */
+namespace IOCompression
+{
+    /** Codecs bitmask */
+    enum Codec {
+        NoCodec   = 0,
+        LZ4Codec  = 1 << 0,
+        ZstdCodec = 1 << 1
+    };
+
+    enum {
+        // Buffers smaller than this are sent as is
+        MinCompressSize = 2048
+    };
+
+    /** Returns bitmask of codecs this build is able to use */
+    quint32 supportedCodecs ();
+
+    /**
+     * Returns codec, which should be used for the connection,
+     * if both sides have the @a codecs bitmask in common.
+     */
+    Codec chooseCodec ( quint32 codecs );
+
+    /** Returns true if at least one package buffer will be compressed */
+    bool isCompressible ( const SmartPtr<IOPackage>&, Codec );
+
+    /**
+     * Returns package with compressed buffers for writing to the network.
+     * Returned package shares header and uncompressed buffers with the
+     * original one and has no callbacks. If nothing has been compressed
+     * original package is returned.
+     */
+    SmartPtr<IOPackage> compressPackage ( const SmartPtr<IOPackage>&, Codec,
+                                          IOSender::Statistics& );
+
+    /**
+     * Decompresses received package buffers in place.
+     * @return false if package is malformed and connection must be closed.
+     */
+    bool decompressPackage ( const SmartPtr<IOPackage>&,
+                             IOSender::Statistics& );
+
+} //namespace IOCompression
+
+} //namespace IOService
+
+#endif //IOCOMPRESSION_H
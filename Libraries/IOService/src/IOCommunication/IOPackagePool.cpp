@@ -0,0 +1,421 @@
+/*
+ * IOPackagePool.cpp
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <stdlib.h>
+#include <string.h>
+
+#include "IOPackagePool.h"
+
+using namespace IOService;
+
+/*****************************************************************************/
+
+namespace {
+
+enum {
+    // Smallest class is 64 bytes, largest is 32K
+    MinClassShift = 6,
+    ClassesCount = 10,
+    // Block header keeps size class, size keeps payload aligned
+    HeaderSize = 16,
+    // Size class of blocks, which are allocated from heap
+    UnpooledClass = 0xffffffff,
+    // Blocks cached by one thread per class, no more than ThreadCacheBytes
+    ThreadCacheLimit = 128,
+    ThreadCacheBytes = 512 * 1024,
+    // Blocks moved between thread cache and depot at once
+    BatchSize = 32,
+    // Blocks kept by depot per class, no more than DepotBytes
+    DepotLimit = 4096,
+    DepotBytes = 4 * 1024 * 1024,
+    // Cache operations between trims of unused blocks
+    TrimInterval = 4096
+};
+
+struct BlockHeader
+{
+    quint32 sizeClass;
+};
+
+// Free block, link is placed just after header
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+// Value which is changed by one thread at a time (owner thread or
+// depot mutex holder), but can be read by statistics at any time
+template <typename T>
+struct Gauge : public QAtomicInteger<T>
+{
+    void operator += ( T v )
+    {
+        this->store( this->load() + v );
+    }
+
+    void operator -= ( T v )
+    {
+        this->store( this->load() - v );
+    }
+};
+
+struct FreeList
+{
+    FreeBlock* head;
+    Gauge<quint32> count;
+
+    FreeList () : head(0) {}
+
+    void push ( FreeBlock* b )
+    {
+        b->next = head;
+        head = b;
+        count += 1;
+    }
+
+    FreeBlock* pop ()
+    {
+        FreeBlock* b = head;
+        if ( b ) {
+            head = b->next;
+            count -= 1;
+        }
+        return b;
+    }
+};
+
+struct Counters
+{
+    Gauge<quint64> allocations;
+    Gauge<quint64> deallocations;
+    Gauge<quint64> poolHits;
+    Gauge<quint64> heapAllocations;
+    Gauge<quint64> depotTransfers;
+
+    void addTo ( IOPackage::AllocStatistics& stat ) const
+    {
+        stat.allocations += allocations.load();
+        stat.deallocations += deallocations.load();
+        stat.poolHits += poolHits.load();
+        stat.heapAllocations += heapAllocations.load();
+        stat.depotTransfers += depotTransfers.load();
+    }
+
+    void add ( const Counters& c )
+    {
+        allocations += c.allocations.load();
+        deallocations += c.deallocations.load();
+        poolHits += c.poolHits.load();
+        heapAllocations += c.heapAllocations.load();
+        depotTransfers += c.depotTransfers.load();
+    }
+};
+
+struct ThreadCache;
+
+struct Depot
+{
+    QMutex mutex;
+    FreeList lists[ClassesCount];
+    // Live thread caches, are used for statistics only
+    ThreadCache* caches;
+    // Counters of finished threads and of allocations without cache
+    Counters retired;
+
+    Depot () : caches(0) {}
+};
+
+// Depot is never destroyed: thread caches are flushed to it
+// on thread exit, which can happen after static destructors
+Depot& depot ()
+{
+    static Depot* d = new Depot;
+    return *d;
+}
+
+inline size_t classSize ( quint32 sizeClass )
+{
+    return size_t(1) << (MinClassShift + sizeClass);
+}
+
+inline quint32 sizeClassOf ( size_t blockSize )
+{
+    for ( quint32 c = 0; c < ClassesCount; ++c )
+        if ( blockSize <= classSize(c) )
+            return c;
+    return UnpooledClass;
+}
+
+// Limits are counted in bytes, so large classes keep fewer blocks
+inline quint32 threadCacheLimit ( quint32 sizeClass )
+{
+    return qBound<quint32>( 4, ThreadCacheBytes / classSize(sizeClass),
+                            ThreadCacheLimit );
+}
+
+inline quint32 batchSize ( quint32 sizeClass )
+{
+    return qMin<quint32>( BatchSize, threadCacheLimit(sizeClass) / 2 );
+}
+
+inline quint32 depotLimit ( quint32 sizeClass )
+{
+    return qBound<quint32>( 2 * batchSize(sizeClass),
+                            DepotBytes / classSize(sizeClass), DepotLimit );
+}
+
+inline FreeBlock* toFreeBlock ( BlockHeader* h )
+{
+    return reinterpret_cast<FreeBlock*>( reinterpret_cast<char*>(h) + HeaderSize );
+}
+
+inline BlockHeader* toHeader ( void* ptr )
+{
+    return reinterpret_cast<BlockHeader*>( static_cast<char*>(ptr) - HeaderSize );
+}
+
+// Puts block to depot or frees it if depot is full.
+// NOTE: depot mutex must be locked
+void depotPut ( Depot& d, quint32 sizeClass, FreeBlock* b )
+{
+    if ( d.lists[sizeClass].count.load() >= depotLimit(sizeClass) )
+        ::free( toHeader(b) );
+    else
+        d.lists[sizeClass].push( b );
+}
+
+struct ThreadCache
+{
+    FreeList lists[ClassesCount];
+    // Fewest blocks of class, which were cached since last trim
+    quint32 lowWater[ClassesCount];
+    quint32 ops;
+    Counters counters;
+    ThreadCache* prev;
+    ThreadCache* next;
+
+    ThreadCache ();
+    ~ThreadCache ();
+
+    FreeBlock* get ( quint32 sizeClass );
+    void put ( quint32 sizeClass, FreeBlock* b );
+    void trim ();
+};
+
+// Cache state is POD, so it is valid during thread exit:
+// 0 - not created, 1 - alive, 2 - destroyed
+thread_local int t_cacheState = 0;
+
+ThreadCache::ThreadCache () :
+    ops(0), prev(0), next(0)
+{
+    ::memset( lowWater, 0, sizeof(lowWater) );
+
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+    next = d.caches;
+    if ( next )
+        next->prev = this;
+    d.caches = this;
+    t_cacheState = 1;
+}
+
+ThreadCache::~ThreadCache ()
+{
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+    // Thread is gone, so give other threads a batch at most
+    for ( quint32 c = 0; c < ClassesCount; ++c ) {
+        for ( quint32 i = 0; i < batchSize(c) && lists[c].count.load(); ++i )
+            depotPut( d, c, lists[c].pop() );
+        while ( FreeBlock* b = lists[c].pop() )
+            ::free( toHeader(b) );
+    }
+    d.retired.add( counters );
+    if ( prev )
+        prev->next = next;
+    else
+        d.caches = next;
+    if ( next )
+        next->prev = prev;
+    t_cacheState = 2;
+}
+
+FreeBlock* ThreadCache::get ( quint32 sizeClass )
+{
+    if ( ++ops >= TrimInterval )
+        trim();
+
+    FreeList& list = lists[sizeClass];
+    if ( list.count.load() == 0 ) {
+        lowWater[sizeClass] = 0;
+        // Refill from depot
+        Depot& d = depot();
+        QMutexLocker locker( &d.mutex );
+        FreeList& dlist = d.lists[sizeClass];
+        if ( dlist.count.load() == 0 )
+            return 0;
+        for ( quint32 i = 0; i < batchSize(sizeClass) && dlist.count.load(); ++i )
+            list.push( dlist.pop() );
+        counters.depotTransfers += 1;
+    }
+    FreeBlock* b = list.pop();
+    lowWater[sizeClass] = qMin( lowWater[sizeClass], list.count.load() );
+    return b;
+}
+
+void ThreadCache::put ( quint32 sizeClass, FreeBlock* b )
+{
+    if ( ++ops >= TrimInterval )
+        trim();
+
+    FreeList& list = lists[sizeClass];
+    list.push( b );
+    if ( list.count.load() <= threadCacheLimit(sizeClass) )
+        return;
+
+    // Give a batch to other threads
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+    for ( quint32 i = 0; i < batchSize(sizeClass); ++i )
+        depotPut( d, sizeClass, list.pop() );
+    lowWater[sizeClass] = qMin( lowWater[sizeClass], list.count.load() );
+    counters.depotTransfers += 1;
+}
+
+// Blocks under low water mark were not used since last trim, so half
+// of them is given back. Idle cache keeps what it has, which is bounded
+// by threadCacheLimit() and is returned on thread exit.
+void ThreadCache::trim ()
+{
+    ops = 0;
+
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+    for ( quint32 c = 0; c < ClassesCount; ++c ) {
+        quint32 n = ( lowWater[c] + 1 ) / 2;
+        for ( quint32 i = 0; i < n; ++i )
+            depotPut( d, c, lists[c].pop() );
+        lowWater[c] = lists[c].count.load();
+    }
+}
+
+ThreadCache* threadCache ()
+{
+    // Thread is exiting, cache is already destroyed
+    if ( t_cacheState == 2 )
+        return 0;
+    static thread_local ThreadCache cache;
+    return &cache;
+}
+
+} // anonymous namespace
+
+/*****************************************************************************/
+
+void* IOPackagePool::allocate ( size_t size )
+{
+    const quint32 sizeClass = sizeClassOf( size + HeaderSize );
+    ThreadCache* tc = threadCache();
+    BlockHeader* h = 0;
+
+    if ( sizeClass != UnpooledClass && tc ) {
+        FreeBlock* b = tc->get( sizeClass );
+        if ( b ) {
+            tc->counters.allocations += 1;
+            tc->counters.poolHits += 1;
+            return b;
+        }
+    }
+
+    size_t blockSize = ( sizeClass == UnpooledClass ?
+                         size + HeaderSize : classSize(sizeClass) );
+    h = static_cast<BlockHeader*>( ::malloc(blockSize) );
+    if ( h == 0 )
+        return 0;
+    h->sizeClass = sizeClass;
+
+    if ( tc ) {
+        tc->counters.allocations += 1;
+        tc->counters.heapAllocations += 1;
+    }
+    else {
+        Depot& d = depot();
+        QMutexLocker locker( &d.mutex );
+        d.retired.allocations += 1;
+        d.retired.heapAllocations += 1;
+    }
+    return toFreeBlock( h );
+}
+
+void IOPackagePool::free ( void* ptr )
+{
+    if ( ptr == 0 )
+        return;
+
+    BlockHeader* h = toHeader( ptr );
+    FreeBlock* b = static_cast<FreeBlock*>( ptr );
+    ThreadCache* tc = threadCache();
+
+    if ( tc ) {
+        tc->counters.deallocations += 1;
+        if ( h->sizeClass == UnpooledClass )
+            ::free( h );
+        else
+            tc->put( h->sizeClass, b );
+        return;
+    }
+
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+    d.retired.deallocations += 1;
+    if ( h->sizeClass == UnpooledClass )
+        ::free( h );
+    else
+        depotPut( d, h->sizeClass, b );
+}
+
+void IOPackagePool::getStatistics ( IOPackage::AllocStatistics& stat )
+{
+    Depot& d = depot();
+    QMutexLocker locker( &d.mutex );
+
+    // Alive threads change their counters without the lock, so
+    // values are consistent per counter, but not between counters
+    ::memset( &stat, 0, sizeof(stat) );
+    d.retired.addTo( stat );
+    for ( quint32 c = 0; c < ClassesCount; ++c )
+        stat.cachedBytes += d.lists[c].count.load() * classSize(c);
+    for ( ThreadCache* tc = d.caches; tc; tc = tc->next ) {
+        tc->counters.addTo( stat );
+        for ( quint32 c = 0; c < ClassesCount; ++c )
+            stat.cachedBytes += tc->lists[c].count.load() * classSize(c);
+    }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,59 @@
+/*
+ * IOPackagePool.h
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#ifndef IOPACKAGEPOOL_H
+#define IOPACKAGEPOOL_H
+
+#include "IOProtocol.h"
+
+namespace IOService {
+
+/**
+ * Size-classed memory pool for IO packages and their buffers.
+ *
+ * Every thread caches freed blocks of each size class without locks.
+ * When thread cache grows over the limit, blocks are moved in batches
+ * to the global depot, from which other threads refill their caches,
+ * so block can be freed from any thread. Caches and depot are bounded
+ * in bytes per class, blocks which were not used for a while are trimmed
+ * from thread cache, and exiting thread gives back a batch at most.
+ * Blocks which are bigger than the largest size class are allocated
+ * from heap directly.
+ */
+class IOPackagePool
+{
+public:
+    /** Allocates block, returns 0 if out of memory */
+    static void* allocate ( size_t size );
+    /** Frees block, which was allocated by #allocate, in any thread */
+    static void free ( void* ptr );
+    /** Returns statistics of all threads */
+    static void getStatistics ( IOPackage::AllocStatistics& );
+};
+
+} //namespace IOService
+
+#endif //IOPACKAGEPOOL_H
@@ -28,6 +28,7 @@
 #include <QBuffer>
 
 #include "IOProtocol.h"
+#include "IOPackagePool.h"
 #include "../Build/Current.ver"
 
 #include <time.h>
@@ -58,7 +59,7 @@ const IOSender::Handle IOSender::InvalidHandle;
 const IOCommunication::ProtocolVersion IOService::IOProtocolVersion =
 {
     {'P','R','L','T'}, // Never changes, our 'PRLT' magic string
-    6, 10,              // Protocol version: MAJOR, MINOR
+    6, 11,              // Protocol version: MAJOR, MINOR
     VER_FILEVERSION_STR " (" VER_SPECIAL_BUILD_STR ")" // Build description
 };
 
@@ -533,13 +534,14 @@ IOPackage* IOPackage::allocatePackage ( quint32 buffNum )
             buffNum, MAX_BUFFERS_COUNT);
         return NULL;
     }
-    return reinterpret_cast<IOPackage*>( ::malloc(IOPACKAGESIZE(buffNum)) );
+    return reinterpret_cast<IOPackage*>(
+        IOPackagePool::allocate(IOPACKAGESIZE(buffNum)) );
 }
 
 void IOPackage::freePackage ( IOPackage* pkg )
 {
     if ( pkg ) {
-        ::free( pkg );
+        IOPackagePool::free( pkg );
     }
 }
 
@@ -551,6 +553,27 @@ void IOPackage::destroyPackage ( IOPackage* pkg )
     }
 }
 
+void IOPackage::allocStatistics ( AllocStatistics& stat )
+{
+    IOPackagePool::getStatistics( stat );
+}
+
+/*
+ * Custom free routine for buffers allocated from the package pool
+ */
+static void freePooledBuffer ( char* pointee )
+{
+    IOPackagePool::free( pointee );
+}
+
+static SmartPtr<char> allocPooledBuffer ( quint32 buffSize )
+{
+    char* buff = static_cast<char*>( IOPackagePool::allocate(buffSize) );
+    if ( buff == 0 )
+        return SmartPtr<char>();
+    return SmartPtr<char>( buff, freePooledBuffer );
+}
+
 /*****************************************************************************/
 
 SmartPtr<IOPackage> IOPackage::duplicateHeaderInstance (
@@ -649,7 +672,7 @@ SmartPtr<IOPackage> IOPackage::createInstance (
     SmartPtr<IOPackage> package = createInstance( type, !!size, parent,
                                                   broadcastResponse );
     if ( package.isValid() && size ) {
-        SmartPtr<char> buffer( new(std::nothrow) char[size], SmartPtrPolicy::ArrayStorage );
+        SmartPtr<char> buffer = allocPooledBuffer( size );
         if ( ! buffer.isValid() ) {
             WRITE_TRACE(DBG_FATAL, "Can't allocate memory!");
             return SmartPtr<IOPackage>();
@@ -983,8 +1006,7 @@ bool IOPackage::fillBuffer ( quint32 index, EncodingType enc,
     SmartPtr<char> smartBuff;
 
     if ( size != 0 ) {
-        smartBuff = SmartPtr<char>(new(std::nothrow) char[size],
-                                   SmartPtrPolicy::ArrayStorage);
+        smartBuff = allocPooledBuffer( size );
         if ( ! smartBuff.isValid() ) {
             WRITE_TRACE(DBG_FATAL, "Can't allocate memory!");
             return false;
@@ -1116,8 +1138,7 @@ SmartPtr<char> IOPackage::allocPODBuffer ( const PODData& desc )
     if ( desc.bufferEncoding == RawEncodingAlligned )
         return vallocPOD(desc.bufferSize);
 
-    return SmartPtr<char>( new(std::nothrow) char[ desc.bufferSize ],
-                           SmartPtrPolicy::ArrayStorage );
+    return allocPooledBuffer( desc.bufferSize );
 }
 
 PRL_RESULT IOPackage::setBuffer(quint32 buffer_, const SmartPtr<char>& data_, const PODData& pod_)
@@ -1153,45 +1174,156 @@ qint32 IOPackage::stowBuffer(quint32 buffer_, const void* data_, const PODData&
 	return b.bufferSize;
 }
 
+IOPackage::Budget::Budget(quint64 total_, quint64 minShare_)
+	: used(0), total(0), minShare(0), pauses(0), connections(0), paused(0)
+{
+	setLimits(total_, minShare_);
+}
+
+void IOPackage::Budget::setLimits(quint64 total_, quint64 minShare_)
+{
+	// Connection can't be guaranteed more than the whole budget
+	AtomicWrite64(&total, (qint64)total_);
+	AtomicWrite64(&minShare, (qint64)qMin(minShare_, total_));
+}
+
+void IOPackage::Budget::getStatistics(BudgetStatistics& s) const
+{
+	s.usedBytes = qMax<qint64>(AtomicRead64(&used), 0);
+	s.totalBytes = AtomicRead64(&total);
+	s.minShareBytes = AtomicRead64(&minShare);
+	s.connections = qMax(AtomicRead(&connections), 0);
+	s.pausedConnections = qMax(AtomicRead(&paused), 0);
+	s.pauses = AtomicRead64(&pauses);
+}
+
 IOPackage::Limiter::Limiter()
-	: bytes(0), paused(false)
+	: budget(new Budget(HIGH_MARK, HIGH_MARK)), bytes(0), resumeMark(0),
+	  paused(0), resume(NULL), resumeContext(NULL)
+{
+	AtomicInc(&budget->connections);
+}
+
+IOPackage::Limiter::Limiter(const QSharedPointer<Budget>& budget_)
+	: budget(budget_), bytes(0), resumeMark(0),
+	  paused(0), resume(NULL), resumeContext(NULL)
 {
+	AtomicInc(&budget->connections);
 }
 
 IOPackage::Limiter::~Limiter()
 {
-	if (paused)
+	// Packages, which outlive limiter, won't return their bytes
+	AtomicAdd64(&budget->used, -AtomicRead64(&bytes));
+	AtomicDec(&budget->connections);
+	if (AtomicSwap(&paused, 0)) {
+		AtomicDec(&budget->paused);
 		full.wakeOne();
+	}
 }
 
 void IOPackage::Limiter::put(quint32 size)
 {
-	mutex.lock();
-	bytes += size;
-	mutex.unlock();
+	AtomicAdd64(&bytes, size);
+	AtomicAdd64(&budget->used, size);
 }
 
 void IOPackage::Limiter::get(quint32 size)
 {
-	mutex.lock();
-	bytes -= size;
-	if (paused && bytes < LOW_MARK) {
-		WRITE_TRACE(DBG_DEBUG, "IOPackage::Limiter resume %d %p", bytes, this);
-		paused = false;
-		full.wakeOne();
+	qint64 left = AtomicAdd64(&bytes, -(qint64)size) - size;
+	AtomicAdd64(&budget->used, -(qint64)size);
+	// Locked add above is a full barrier, so either pause() sees
+	// decremented bytes or pause flag is seen here
+	if (!AtomicRead(&paused) || left > AtomicRead64(&resumeMark))
+		return;
+
+	QMutexLocker locker(&mutex);
+	if (!paused || AtomicRead64(&bytes) > resumeMark)
+		return;
+	WRITE_TRACE(DBG_DEBUG, "IOPackage::Limiter resume %lld %p",
+		    AtomicRead64(&bytes), this);
+	AtomicWrite(&paused, 0);
+	AtomicDec(&budget->paused);
+	full.wakeOne();
+	if (resume != NULL) {
+		ResumeCallback cb = resume;
+		resume = NULL;
+		cb(resumeContext);
+	}
+}
+
+bool IOPackage::Limiter::isOverLimit(qint64& share) const
+{
+	const qint64 b = AtomicRead64(&bytes);
+	const qint64 total = AtomicRead64(&budget->total);
+	const qint64 minShare = AtomicRead64(&budget->minShare);
+	const int conns = qMax(AtomicRead(&budget->connections), 1);
+
+	share = qMax(minShare, total / conns);
+	if (b <= minShare)
+		return false;
+	// Free budget may be taken by anybody, fair share is
+	// enforced only when budget is exhausted
+	return b > total ||
+		(b > share && AtomicRead64(&budget->used) > total);
+}
+
+bool IOPackage::Limiter::pause()
+{
+	qint64 share = 0;
+	if (!isOverLimit(share))
+		return false;
+
+	AtomicWrite64(&resumeMark, share >> RESUME_SHIFT);
+	AtomicInc(&budget->paused);
+	// Swap is a full barrier: get() could return bytes
+	// before pause flag was visible
+	AtomicSwap(&paused, 1);
+	if (AtomicRead64(&bytes) <= resumeMark) {
+		AtomicWrite(&paused, 0);
+		AtomicDec(&budget->paused);
+		return false;
 	}
-	mutex.unlock();
+	AtomicInc64(&budget->pauses);
+	return true;
 }
 
 void IOPackage::Limiter::wait()
 {
-	mutex.lock();
-	if (bytes > HIGH_MARK) {
-		WRITE_TRACE(DBG_DEBUG, "IOPackage::Limiter wait %d %p", bytes, this);
-		paused = true;
+	qint64 share = 0;
+	if (!isOverLimit(share))
+		return;
+
+	QMutexLocker locker(&mutex);
+	if (!pause())
+		return;
+	WRITE_TRACE(DBG_DEBUG, "IOPackage::Limiter wait %lld %p",
+		    AtomicRead64(&bytes), this);
+	while (AtomicRead(&paused))
 		full.wait(&mutex);
-	}
-	mutex.unlock();
+}
+
+bool IOPackage::Limiter::waitAsync(ResumeCallback cb, void* context)
+{
+	qint64 share = 0;
+	if (!isOverLimit(share))
+		return false;
+
+	QMutexLocker locker(&mutex);
+	if (!pause())
+		return false;
+	WRITE_TRACE(DBG_DEBUG, "IOPackage::Limiter async wait %lld %p",
+		    AtomicRead64(&bytes), this);
+	resume = cb;
+	resumeContext = context;
+	return true;
+}
+
+void IOPackage::Limiter::cancelWait()
+{
+	QMutexLocker locker(&mutex);
+	resume = NULL;
+	resumeContext = NULL;
 }
 
 /*****************************************************************************/
@@ -174,11 +174,29 @@ namespace IOService {
                                            (i.e. encrypted) bytes */
             qint64 receivedBytes;     /**< Number of read from network,
                                            (i.e. encrypted) bytes */
+            qint64 compressionRawBytes;    /**< Size of sent buffers
+                                                before compression */
+            qint64 compressionWireBytes;   /**< Size of sent buffers
+                                                after compression */
+            qint64 compressionUsecs;       /**< CPU time spent on
+                                                compression */
+            qint64 decompressionRawBytes;  /**< Size of received buffers
+                                                after decompression */
+            qint64 decompressionWireBytes; /**< Size of received buffers
+                                                before decompression */
+            qint64 decompressionUsecs;     /**< CPU time spent on
+                                                decompression */
             Statistics () :
                 sentPackages(0),
                 receivedPackages(0),
                 sentBytes(0),
-                receivedBytes(0)
+                receivedBytes(0),
+                compressionRawBytes(0),
+                compressionWireBytes(0),
+                compressionUsecs(0),
+                decompressionRawBytes(0),
+                decompressionWireBytes(0),
+                decompressionUsecs(0)
             {}
         }
 #if defined(_ARM_)
@@ -198,26 +216,94 @@ namespace IOService {
 		SIZE_LIMIT = (1 << 30)
 	};
 
-	// SocketClient buffer size limiter
+	// Statistics of received, but not processed packages
+	struct BudgetStatistics {
+		quint64 usedBytes;         /**< Bytes of not processed packages */
+		quint64 totalBytes;        /**< Budget of all connections */
+		quint64 minShareBytes;     /**< Guaranteed share of connection */
+		quint32 connections;       /**< Connections sharing the budget */
+		quint32 pausedConnections; /**< Connections paused now */
+		quint64 pauses;            /**< Reading pauses since creation */
+	};
+
+	// Memory budget of received, but not processed packages.
+	// Is shared by limiters of all connections of one server.
+	class Budget {
+	public:
+		enum {
+			DEFAULT_TOTAL     = 512 * (1 << 20),
+			DEFAULT_MIN_SHARE = 4 * (1 << 20)
+		};
+		explicit Budget(quint64 total = DEFAULT_TOTAL,
+				quint64 minShare = DEFAULT_MIN_SHARE);
+
+		// Can be changed at any time, is applied on next pause check
+		void setLimits(quint64 total, quint64 minShare);
+		void getStatistics(BudgetStatistics&) const;
+	private:
+		friend class Limiter;
+		qint64	used;
+		qint64	total;
+		qint64	minShare;
+		qint64	pauses;
+		int	connections;
+		int	paused;
+	};
+
+	// SocketClient buffer size limiter.
+	// Connection may fill the whole free budget, but when budget is
+	// exhausted, connections above their fair share are paused. Reading
+	// is resumed when 1/8 of the share is left. Accounting is lock-free,
+	// mutex is taken only to pause and resume.
 	class Limiter {
 		enum {
 			HIGH_MARK = 64 * (1 << 20),
-			LOW_MARK  = 8 * (1 << 20)
+			RESUME_SHIFT = 3
 		};
 	public:
+		// Limiter with own budget of HIGH_MARK bytes
 		Limiter();
+		explicit Limiter(const QSharedPointer<Budget>& budget);
 		~Limiter();
 
+		// Callback which is called when limiter resumes reading
+		typedef void (*ResumeCallback) (void* context);
+
 		void put(quint32 size);
 		void get(quint32 size);
 		void wait();
+		// Non-blocking variant of wait(): returns true if limit is
+		// exceeded, callback will be called once from get() on resume.
+		bool waitAsync(ResumeCallback cb, void* context);
+		// Forgets callback which was set by waitAsync()
+		void cancelWait();
 	private:
-		quint32		bytes;
-		bool		paused;
+		// Returns true if reading must be paused, share is set to
+		// fair share of the connection
+		bool isOverLimit(qint64& share) const;
+		// Marks limiter as paused. Is called under mutex.
+		bool pause();
+
+		QSharedPointer<Budget>	budget;
+		qint64		bytes;
+		qint64		resumeMark;
+		int		paused;
+		ResumeCallback	resume;
+		void*		resumeContext;
 		QMutex		mutex;
 		QWaitCondition	full;
 	};
 
+	// Statistics of package and buffer allocations
+	struct AllocStatistics {
+		quint64 allocations;     /**< Blocks allocated */
+		quint64 deallocations;   /**< Blocks freed */
+		quint64 poolHits;        /**< Allocations served from pool */
+		quint64 heapAllocations; /**< Allocations served from heap */
+		quint64 depotTransfers;  /**< Batches moved between threads */
+		quint64 cachedBytes;     /**< Bytes kept in pool */
+	};
+
         /** Common package type */
         typedef quint32 Type;
 
@@ -244,7 +330,13 @@ namespace IOService {
             // Raw encoding with page alligned buffers
             RawEncodingAlligned = 8,
             // Final bound
-            EncodingFinalBound
+            EncodingFinalBound,
+
+            // Buffer is compressed by IOCompression. Flags are set only
+            // on the wire and are combined with the original encoding.
+            LZ4Encoding     = 0x100,
+            ZstdEncoding    = 0x200,
+            CompressionEncodingMask = LZ4Encoding | ZstdEncoding
         };
 
         // Package exceptions
@@ -591,6 +683,12 @@ namespace IOService {
 
         static SmartPtr<char> allocPODBuffer(const IOPackage::PODData& desc);
 
+        /**
+         * Returns allocation statistics of packages and buffers pool,
+         * values of working threads are approximate.
+         */
+        static void allocStatistics ( AllocStatistics& );
+
     private: // Special memory alloc/dealloc functions
 	PRL_RESULT setBuffer(quint32 buffer_, const SmartPtr<char>& data_, const PODData& pod_);
 
@@ -743,6 +841,29 @@ namespace IOService {
             Uuid_t           connectionUuid;
 
         } PACKED;
+
+        /**
+         * Handshake features struct, is exchanged after routing table
+         * if both sides support #IOPROTOCOL_COMPRESSION_SUPPORT.
+         */
+        struct HandshakeFeatures
+        {
+            /** Feature flags */
+            enum Flags {
+                KernelTlsFlag = 1 << 0, /**< Sender is able to switch
+                                             to kernel TLS after SSL
+                                             handshake */
+                BinaryEventsFlag = 1 << 1 /**< Sender is able to decode
+                                               events in binary encoding
+                                               instead of XML */
+            };
+
+            quint32          compressionCodecs; /**< Codecs, which
+                                                     sender can decode */
+            quint32          flags;             /**< See #Flags */
+            quint32          reserved[2];
+
+        } PACKED;
 #include "../../Interfaces/unpacked.h"
 
 
@@ -816,6 +937,8 @@ namespace IOService {
  *   ------|-------|-----------------------
  *     6   |   8   | Event identifier in PODHeader
  *   ------|-------|-----------------------
+ *     6   |  11   | Handshake features, buffers compression
+ *   ------|-------|-----------------------
  */
 
 /**
@@ -878,6 +1001,13 @@ namespace IOService {
 #define IOPROTOCOL_NEW_PRODUCT_NAME_SUPPORT(ver) \
 	( (ver).majorNumber > 6 || ((ver).majorNumber == 6 && (ver).minorNumber >= 10) )
 
+/**
+ * Returns true if protocol version supports handshake features
+ * exchange and buffers compression.
+ */
+#define IOPROTOCOL_COMPRESSION_SUPPORT(ver) \
+	( (ver).majorNumber > 6 || ((ver).majorNumber == 6 && (ver).minorNumber >= 11) )
+
 /**
  * IO protocol internal macroses
  */
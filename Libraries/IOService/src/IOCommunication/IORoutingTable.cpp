@@ -25,6 +25,10 @@
  */
 
 
+#include <algorithm>
+#include <atomic>
+#include <QVector>
+
 #include "IORoutingTable.h"
 #include "Libraries/Logging/Logging.h"
 
@@ -39,17 +43,22 @@ IORoutingTable IORoutingTable::NullTable;
 IORoutingTable::IORoutingTable () :
     m_defaultRouteName(UnknownRoute),
     m_defaultRouteRequirement(OptionalRoute),
-    m_onlyDefaultRoute(true)
-{}
+    m_onlyDefaultRoute(true),
+    m_lookupGeneration(0)
+{
+    publishLookup();
+}
 
 IORoutingTable::IORoutingTable (
     RouteName defaultRouteName,
     RouteRequirement defaultRouteRequirement ) :
     m_defaultRouteName(defaultRouteName),
     m_defaultRouteRequirement(defaultRouteRequirement),
-    m_onlyDefaultRoute(true)
+    m_onlyDefaultRoute(true),
+    m_lookupGeneration(0)
 {
     m_routeNameMap[defaultRouteName] = defaultRouteName;
+    publishLookup();
 }
 
 IORoutingTable::IORoutingTable (
@@ -58,17 +67,20 @@ IORoutingTable::IORoutingTable (
     const QList<RouteName>& routeNames ) :
     m_defaultRouteName(defaultRouteName),
     m_defaultRouteRequirement(defaultRouteRequirement),
-    m_onlyDefaultRoute(true)
+    m_onlyDefaultRoute(true),
+    m_lookupGeneration(0)
 {
     m_routeNameMap[defaultRouteName] = defaultRouteName;
     foreach ( RouteName routeName, routeNames )
         m_routeNameMap[routeName] = routeName;
+    publishLookup();
 }
 
 IORoutingTable::IORoutingTable ( const IORoutingTable& table ) :
     m_defaultRouteName(UnknownRoute),
     m_defaultRouteRequirement(OptionalRoute),
-    m_onlyDefaultRoute(true)
+    m_onlyDefaultRoute(true),
+    m_lookupGeneration(0)
 {
     QReadLocker locker( &table.m_rwLock );
 
@@ -77,6 +89,7 @@ IORoutingTable::IORoutingTable ( const IORoutingTable& table ) :
     m_onlyDefaultRoute = table.m_onlyDefaultRoute;
     m_fullRouteMap = table.m_fullRouteMap;
     m_routeNameMap = table.m_routeNameMap;
+    publishLookup();
 }
 
 IORoutingTable& IORoutingTable::operator= ( const IORoutingTable& table )
@@ -98,6 +111,7 @@ IORoutingTable& IORoutingTable::operator= ( const IORoutingTable& table )
     m_onlyDefaultRoute = onlyDefaultRoute;
     m_fullRouteMap = fullRouteMap;
     m_routeNameMap = routeNameMap;
+    publishLookup();
 
     return *this;
 }
@@ -290,21 +304,135 @@ bool IORoutingTable::addRoute ( IOPackage::Type pkgTypeBegin,
     m_fullRouteMap[typeRange] = QPair<RouteName, RouteRequirement>(
                                             routeName, routeRequirement );
     m_routeNameMap[routeName] = routeName;
+    publishLookup();
 
     return true;
 }
 
+void IORoutingTable::publishLookup ()
+{
+    // NOTE: caller of this function must be locked for write
+
+    const int generation = m_lookupGeneration.load();
+    RouteLookup& lookup = m_lookups[(generation + 1) & 1];
+
+    lookup.defaultRouteName = m_defaultRouteName;
+    lookup.overflow = false;
+    lookup.rangesNumber = 0;
+
+    // Split types by bounds of all routes, so each part is
+    // either covered by a route completely or is not covered at all
+    QVector<quint64> bounds;
+    bounds.reserve( m_fullRouteMap.size() * 2 );
+    QHash<TypeRange, RoutePair>::ConstIterator it = m_fullRouteMap.begin();
+    for ( ; it != m_fullRouteMap.end(); ++it ) {
+        bounds.append( it.key().first );
+        bounds.append( (quint64)it.key().second + 1 );
+    }
+    std::sort( bounds.begin(), bounds.end() );
+    bounds.erase( std::unique(bounds.begin(), bounds.end()), bounds.end() );
+
+    for ( int i = 0; i + 1 < bounds.size(); ++i ) {
+        const IOPackage::Type typeBegin = bounds[i];
+        const IOPackage::Type typeEnd = bounds[i + 1] - 1;
+
+        // Accepted table can contain overlapping routes. The narrowest
+        // one wins, so direct route is preferred to range as before.
+        const TypeRange* bestRange = 0;
+        RouteName routeName = UnknownRoute;
+        for ( it = m_fullRouteMap.begin(); it != m_fullRouteMap.end(); ++it ) {
+            const TypeRange& range = it.key();
+            if ( range.first > typeBegin || range.second < typeBegin )
+                continue;
+            if ( bestRange &&
+                 (range.second - range.first >
+                      bestRange->second - bestRange->first ||
+                  (range.second - range.first ==
+                       bestRange->second - bestRange->first &&
+                   range.first > bestRange->first)) )
+                continue;
+            bestRange = &range;
+            routeName = it.value().first;
+        }
+        if ( bestRange == 0 )
+            continue;
+
+        // Merge with adjacent range of the same route
+        if ( lookup.rangesNumber > 0 ) {
+            RouteLookup::Range& prev = lookup.ranges[lookup.rangesNumber - 1];
+            if ( (quint64)prev.typeEnd + 1 == typeBegin &&
+                 prev.routeName == routeName ) {
+                prev.typeEnd = typeEnd;
+                continue;
+            }
+        }
+
+        if ( lookup.rangesNumber == MaxLookupRangesNumber ) {
+            lookup.overflow = true;
+            break;
+        }
+
+        RouteLookup::Range& range = lookup.ranges[lookup.rangesNumber++];
+        range.typeBegin = typeBegin;
+        range.typeEnd = typeEnd;
+        range.routeName = routeName;
+    }
+
+    // Publish. Full barrier also orders these writes before writes
+    // of the next rebuild, which can be read by slow readers.
+    m_lookupGeneration.fetchAndStoreOrdered( generation + 1 );
+}
+
+IORoutingTable::RouteName IORoutingTable::RouteLookup::findRoute (
+    IOPackage::Type pkgType ) const
+{
+    // Lookup can be rebuilt under us, do not trust the number
+    quint32 lo = 0, hi = qMin<quint32>( rangesNumber, MaxLookupRangesNumber );
+
+    // First range which ends at or after the type
+    while ( lo < hi ) {
+        const quint32 mid = lo + (hi - lo) / 2;
+        if ( ranges[mid].typeEnd < pkgType )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if ( lo < qMin<quint32>(rangesNumber, MaxLookupRangesNumber) &&
+         ranges[lo].typeBegin <= pkgType )
+        return ranges[lo].routeName;
+
+    // Default route
+    return defaultRouteName;
+}
+
 IORoutingTable::RouteName IORoutingTable::findRoute (
     IOPackage::Type pkgType ) const
 {
-    // Quick getter for single connection
-    if ( m_onlyDefaultRoute )
-        return m_defaultRouteName;
+    while ( 1 ) {
+        const int generation = m_lookupGeneration.loadAcquire();
+        const RouteLookup& lookup = m_lookups[generation & 1];
+
+        if ( lookup.overflow ) {
+            QReadLocker locker( &m_rwLock );
+            return findRouteInMap( pkgType );
+        }
+        RouteName routeName = lookup.findRoute( pkgType );
+
+        // Lookup reads must be done before generation recheck
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( m_lookupGeneration.load() == generation )
+            return routeName;
+    }
+}
+
+IORoutingTable::RouteName IORoutingTable::findRouteInMap (
+    IOPackage::Type pkgType ) const
+{
+    // NOTE: caller of this function must be locked for read
 
     TypeRange typeRange( pkgType, pkgType );
 
     // Direct search
-    QReadLocker locker( &m_rwLock );
     if ( m_fullRouteMap.contains(typeRange) )
         return m_fullRouteMap[typeRange].first;
 
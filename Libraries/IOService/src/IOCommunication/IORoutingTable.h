@@ -31,6 +31,7 @@
 #include <QPair>
 #include <QReadWriteLock>
 #include <QHash>
+#include <QAtomicInt>
 
 #include "IOProtocol.h"
 
@@ -161,6 +162,7 @@ public:
     /**
      * Finds route by specified package type.
      * Return #UnknownRoute if route was not found.
+     * @note Does not take table lock, see #RouteLookup.
      */
     RouteName findRoute ( IOPackage::Type pkgType ) const;
 
@@ -196,6 +198,39 @@ private:
     typedef QPair<IOPackage::Type, IOPackage::Type> TypeRange;
     typedef QPair<RouteName, RouteRequirement> RoutePair;
 
+    /** Declare lookup constants */
+    enum LookupNumbers {
+        // Accepted table can contain routes of both tables
+        MaxLookupRangesNumber = MaxRoutesNumber * 4
+    };
+
+    /**
+     * Routes compiled into sorted non-overlapping type ranges.
+     * Lookup is rebuilt on each change of the table and is never
+     * changed after it has been published, so it is searched without
+     * locks. Two lookups are kept, one is published and the other one
+     * is rebuilt. Generation is increased on each publish, and reader
+     * rechecks it after search: if it has been changed, the lookup
+     * could be rebuilt under reader, so search is repeated.
+     */
+    struct RouteLookup
+    {
+        struct Range
+        {
+            IOPackage::Type typeBegin;
+            IOPackage::Type typeEnd;
+            RouteName routeName;
+        };
+
+        RouteName defaultRouteName;
+        // Routes do not fit, search in full route map under lock
+        bool overflow;
+        quint32 rangesNumber;
+        Range ranges[MaxLookupRangesNumber];
+
+        RouteName findRoute ( IOPackage::Type ) const;
+    };
+
     /**
      * Returns true if route pair has been accepted.
      * @note Beware: caller must be locked for read before call.
@@ -203,6 +238,18 @@ private:
     bool acceptRoutePair ( const RoutePair&,
                            const RoutePair&, RoutePair& ) const;
 
+    /**
+     * Compiles routes into free lookup and publishes it.
+     * @note Beware: caller must be locked for write before call.
+     */
+    void publishLookup ();
+
+    /**
+     * Searches route in full route map.
+     * @note Beware: caller must be locked for read before call.
+     */
+    RouteName findRouteInMap ( IOPackage::Type ) const;
+
 public:
     /** Static null table */
     static IORoutingTable __attribute__((visibility("hidden"))) NullTable;
@@ -214,6 +261,8 @@ private:
     bool m_onlyDefaultRoute;
     QHash<TypeRange, RoutePair> m_fullRouteMap;
     QHash<RouteName, RouteName> m_routeNameMap;
+    RouteLookup m_lookups[2];
+    QAtomicInt m_lookupGeneration;
 };
 
 } //namespace IOService
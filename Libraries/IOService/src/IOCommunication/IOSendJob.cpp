@@ -31,8 +31,11 @@
 ///
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <QSet>
+
 #include "IOSendJob.h"
 #include "Libraries/Logging/Logging.h"
+#include "Libraries/Std/AtomicOps.h"
 
 using namespace IOService;
 
@@ -231,23 +234,164 @@ quint32 IOSendJob::getResponseWaitingsNumber () const
 
 IOJobManager::Job::Job () :
     sendJob( new IOSendJob ),
-    isActive(false)
+    nextJob( 0 ),
+    queuePos( 0 ),
+    indexed( false ),
+    isActive( false )
 {
     ::memset( &pkgHeader, 0, sizeof(pkgHeader) );
 }
 
 /*****************************************************************************/
 
-IOJobManager::JobPool::JobPool ( const Uuid& u ) :
+IOJobManager::JobRing::JobRing ( quint32 capacity ) :
+    m_cells( new Cell[capacity] ),
+    m_mask( capacity - 1 ),
+    m_pushPos( 0 ),
+    m_popPos( 0 )
+{
+    Q_ASSERT( capacity && (capacity & (capacity - 1)) == 0 );
+
+    // Cell is free for push at position equal to its sequence
+    for ( quint32 i = 0; i < capacity; ++i ) {
+        m_cells[i].seq = i;
+        m_cells[i].job = 0;
+    }
+}
+
+IOJobManager::JobRing::~JobRing ()
+{
+    delete [] m_cells;
+}
+
+bool IOJobManager::JobRing::push ( Job* job )
+{
+    Cell* cell = 0;
+    unsigned pos = AtomicRead( &m_pushPos );
+    for (;;) {
+        cell = &m_cells[pos & m_mask];
+        const int diff = int(AtomicRead(&cell->seq) - pos);
+        if ( diff == 0 ) {
+            const unsigned prev =
+                AtomicCompareSwap( &m_pushPos, pos, pos + 1 );
+            if ( prev == pos )
+                break;
+            pos = prev;
+        }
+        // Cell still holds the job of the previous lap
+        else if ( diff < 0 )
+            return false;
+        else
+            pos = AtomicRead( &m_pushPos );
+    }
+
+    job->queuePos = pos;
+    cell->job = job;
+
+    // Publish. Swap is a full barrier: producer checks if writing
+    // thread sleeps just after it, see SocketWriteThread::sendPackage
+    AtomicSwap( &cell->seq, pos + 1 );
+    return true;
+}
+
+IOJobManager::Job* IOJobManager::JobRing::pop ()
+{
+    Cell* cell = 0;
+    unsigned pos = AtomicRead( &m_popPos );
+    for (;;) {
+        cell = &m_cells[pos & m_mask];
+        const int diff = int(AtomicRead(&cell->seq) - (pos + 1));
+        if ( diff == 0 ) {
+            const unsigned prev =
+                AtomicCompareSwap( &m_popPos, pos, pos + 1 );
+            if ( prev == pos )
+                break;
+            pos = prev;
+        }
+        // Cell is not filled on this lap yet
+        else if ( diff < 0 )
+            return 0;
+        else
+            pos = AtomicRead( &m_popPos );
+    }
+
+    Job* job = cell->job;
+    AtomicWrite( &cell->seq, pos + m_mask + 1 );
+    return job;
+}
+
+IOJobManager::Job* IOJobManager::JobRing::peek ( unsigned pos ) const
+{
+    Cell* cell = &m_cells[pos & m_mask];
+    if ( AtomicRead(&cell->seq) != pos + 1 )
+        return 0;
+    return cell->job;
+}
+
+unsigned IOJobManager::JobRing::front () const
+{
+    return AtomicRead( &m_popPos );
+}
+
+void IOJobManager::JobRing::popFront ()
+{
+    const unsigned pos = AtomicRead( &m_popPos );
+    Cell* cell = &m_cells[pos & m_mask];
+    Q_ASSERT( AtomicRead(&cell->seq) == pos + 1 );
+
+    cell->job = 0;
+    AtomicWrite( &m_popPos, pos + 1 );
+    AtomicWrite( &cell->seq, pos + m_mask + 1 );
+}
+
+/*****************************************************************************/
+
+static QSharedPointer<IOJobManager::Job> createJob ()
+{
+    QSharedPointer<IOJobManager::Job> job( new IOJobManager::Job );
+    job->self = job;
+    return job;
+}
+
+static QSharedPointer<IOJobManager::Job> createPoolJob ()
+{
+    QSharedPointer<IOJobManager::Job> job = createJob();
+    job->owner = job;
+    return job;
+}
+
+static void destroyPoolJob ( IOJobManager::Job* job )
+{
+    // Job is deleted with the last strong reference, which can be
+    // still held by writing thread
+    QSharedPointer<IOJobManager::Job> owner = job->owner;
+    job->owner.clear();
+}
+
+static quint32 ringCapacity ( quint32 size )
+{
+    quint32 capacity = 1;
+    while ( capacity < size )
+        capacity <<= 1;
+    return capacity;
+}
+
+IOJobManager::JobPool::JobPool ( const Uuid& u,
+                                 quint32 activeJobsCapacity ) :
     uuid(u),
+    heartBeatJob( createJob() ),
+    activeJobs( activeJobsCapacity ),
     activeJobsSize(),
-    heartBeatJob( new Job )
+    freeJobs( ringCapacity(IOJobManager::OptimalPoolSize) ),
+    retiredJobs( 0 ),
+    putsSinceScan()
 {
-    jobList.reserve( IOJobManager::OptimalPoolSize );
-
     // Preallocate jobs
-    for ( quint32 i = 0; i < IOJobManager::OptimalPoolSize; ++i )
-        jobList << QSharedPointer<Job>(new Job);
+    for ( quint32 i = 0; i < IOJobManager::OptimalPoolSize; ++i ) {
+        QSharedPointer<Job> job = createPoolJob();
+        if ( ! freeJobs.push(job.data()) )
+            destroyPoolJob( job.data() );
+    }
 
     // Init heartbeat job
     SmartPtr<IOPackage> heartPkg =
@@ -260,13 +404,36 @@ IOJobManager::JobPool::JobPool ( const Uuid& u ) :
     heartBeatJob->pkg = heartPkg;
 }
 
+IOJobManager::JobPool::~JobPool ()
+{
+    // Nobody pushes anymore: producers hold the pool while they push
+    Job* job = 0;
+    while ( (job = activeJobs.pop()) )
+        destroyPoolJob( job );
+    while ( (job = freeJobs.pop()) )
+        destroyPoolJob( job );
+
+    job = retiredJobs.fetchAndStoreOrdered( 0 );
+    while ( job ) {
+        Job* j = job;
+        job = j->nextJob;
+        destroyPoolJob( j );
+    }
+
+    foreach ( Job* j, heldJobs )
+        destroyPoolJob( j );
+}
+
 /*****************************************************************************/
 
 SmartPtr<IOJobManager::JobPool> IOJobManager::initJobPool ()
 {
     Uuid uuid = Uuid::createUuid();
     SmartPtr<JobPool> jobPool;
-    try { jobPool = SmartPtr<JobPool>(new JobPool(uuid)); }
+    // Urgent jobs may exceed the limit, so reserve the same room for them
+    const quint32 capacity =
+        ringCapacity( qMax(m_activeJobsLimit * 2, (unsigned)OptimalPoolSize) );
+    try { jobPool = SmartPtr<JobPool>(new JobPool(uuid, capacity)); }
     catch ( ... ) {}
     return jobPool;
 }
@@ -278,11 +445,18 @@ SmartPtr<IOSendJob> IOJobManager::findJobByResponsePackage (
     Q_ASSERT( jobPool.isValid() );
     Q_ASSERT( p.isValid() );
 
-    // Lock pool
-    QReadLocker rdLocker( &jobPool->rwLock );
+    Uuid parentUuid = Uuid::toUuid( p->header.parentUuid );
+    if ( parentUuid.isNull() )
+        return SmartPtr<IOSendJob>();
 
-    foreach ( const QSharedPointer<Job>& j, jobPool->jobList) {
-        const SmartPtr<IOSendJob>& job = j->sendJob;
+    // Indexed jobs are not reused, so their send jobs are stable
+    QReadLocker rdLocker( &jobPool->indexLock );
+
+    QMultiHash<Uuid, Job*>::const_iterator it =
+        jobPool->uuidIndex.constFind( parentUuid );
+    for ( ; it != jobPool->uuidIndex.constEnd() && it.key() == parentUuid;
+          ++it ) {
+        const SmartPtr<IOSendJob>& job = it.value()->sendJob;
         if ( job.countRefs() > 1 &&
              job->isResponsibleForPackageUuid(p->header.parentUuid) ) {
             return job;
@@ -296,101 +470,57 @@ bool IOJobManager::initActiveJob (
     SmartPtr<JobPool>& jobPool,
     const IOPackage::PODHeader& pkgHeader,
     const SmartPtr<IOPackage>& package,
-    JobRefType& job,
+    QSharedPointer<Job>& job,
+    SmartPtr<IOSendJob>& sendJob,
     bool urgent )
 {
     Q_ASSERT( jobPool.isValid() );
 
-    // Lock
-    QWriteLocker wrLocker( &jobPool->rwLock );
-
+    // Jobs in free ring are returned by writing thread, when their
+    // send jobs are not referenced any more and they are not indexed,
+    // so taken job is owned by this thread only
     QSharedPointer<Job> freeJob;
-
-    qint32 freeJobsNum = -1;
-
-    QVector<QSharedPointer<Job> >::Iterator it = jobPool->jobList.begin();
-    QVector<QSharedPointer<Job> >::Iterator firstFreeJobIter = it;
-    while ( it != jobPool->jobList.end() ) {
-        if ( isJobFree(it->data()) ) {
-            ++freeJobsNum;
-            // Save first job
-            if ( freeJobsNum == 0 ) {
-                freeJob = *it;
-                firstFreeJobIter = it;
-            }
-        }
-        ++it;
+    Job* j = jobPool->freeJobs.pop();
+    if ( j ) {
+        freeJob = j->owner;
+        // Reinit free send job
+        freeJob->sendJob = SmartPtr<IOSendJob>(new IOSendJob());
     }
-
     // Can't find free jobs, so allocate one more time
-    if ( freeJob.isNull() ) {
-        try { freeJob = QSharedPointer<Job>(new Job); }
+    else {
+        try { freeJob = createPoolJob(); }
         catch ( ... ) {}
         if ( freeJob.isNull() ) {
             job.clear();
+            sendJob = SmartPtr<IOSendJob>();
             return false;
         }
-        jobPool->jobList.append( freeJob );
-    }
-    // Try to free
-    else {
-        // Reinit free send job
-        freeJob->sendJob = SmartPtr<IOSendJob>(new IOSendJob());
-
-        // Remove some free elements
-        if ( jobPool->jobList.size() > OptimalPoolSize ) {
-            freeJobsNum = (freeJobsNum == -1 ? 0 : freeJobsNum);
-            const quint32 nonFreeJobsNum =
-                jobPool->jobList.size() - freeJobsNum;
-            if ( OptimalNonFreePoolSize >= nonFreeJobsNum ) {
-                const quint32 toBeFreed =
-                    jobPool->jobList.size() - OptimalPoolSize;
-
-                quint32 freed = 0;
-                QVector<QSharedPointer<Job> >::Iterator it = firstFreeJobIter + 1;
-                while ( it != jobPool->jobList.end() && freed < toBeFreed ) {
-                    if ( isJobFree(it->data()) ) {
-                        it = jobPool->jobList.erase(it);
-                        ++freed;
-                    }
-                    else
-                        ++it;
-                }
-            }
-        }
     }
 
-    // Allocation problems? Must be checked above
-    Q_ASSERT(!freeJob.isNull());
     // Is not active yet
     Q_ASSERT(freeJob->isActive == false);
+    Q_ASSERT(freeJob->indexed == false);
 
-    // Save outer job
+    // Save outer job. Send job is referenced before the job is pushed,
+    // so writing thread can't release the job while caller holds it
     job = freeJob;
-
-    // Check max active jobs size for non urgent init
-    if ( !urgent && jobPool->activeJobsSize >= m_activeJobsLimit )
+    sendJob = freeJob->sendJob;
+
+    // Reserve place in active jobs queue,
+    // check max active jobs size for non urgent init
+    const unsigned activeJobsSize = AtomicInc( &jobPool->activeJobsSize );
+    if ( !urgent && activeJobsSize >= m_activeJobsLimit ) {
+        AtomicDec( &jobPool->activeJobsSize );
+        // Caller owns send job for now, job can be reused later
+        Job* top = 0;
+        do {
+            top = jobPool->retiredJobs;
+            freeJob->nextJob = top;
+        } while ( ! jobPool->retiredJobs.testAndSetOrdered(top,
+                                                           freeJob.data()) );
         return false;
-
-    // Change last job
-    QSharedPointer<Job> h = jobPool->lastActiveJob.toStrongRef();
-    if ( !h.isNull() ) {
-        Q_ASSERT(h->nextJob.isNull());
-        h->nextJob = freeJob;
-        jobPool->lastActiveJob = freeJob;
-    }
-    // Init first/last ptrs
-    else {
-        Q_ASSERT(jobPool->lastActiveJob.isNull());
-        Q_ASSERT(jobPool->firstActiveJob.isNull());
-
-        jobPool->lastActiveJob = freeJob;
-        jobPool->firstActiveJob = freeJob;
     }
 
-    // Increase jobs size
-    ++jobPool->activeJobsSize;
-
     // Mark job as active now
     freeJob->isActive = true;
 
@@ -398,7 +528,23 @@ bool IOJobManager::initActiveJob (
     freeJob->pkgHeader = pkgHeader;
     freeJob->pkg = package;
 
-    return true;
+    // Register package uuid for response matching
+    freeJob->sendJob->registerPackageUuid( freeJob->pkgHeader.uuid );
+
+    // Job becomes visible for writing thread
+    if ( jobPool->activeJobs.push(freeJob.data()) )
+        return true;
+
+    // Even urgent jobs are bounded by the queue capacity
+    freeJob->isActive = false;
+    freeJob->pkg = SmartPtr<IOPackage>();
+    AtomicDec( &jobPool->activeJobsSize );
+    Job* top = 0;
+    do {
+        top = jobPool->retiredJobs;
+        freeJob->nextJob = top;
+    } while ( ! jobPool->retiredJobs.testAndSetOrdered(top, freeJob.data()) );
+    return false;
 }
 
 IOJobManager::JobRefType IOJobManager::getNextActiveJob (
@@ -406,9 +552,21 @@ IOJobManager::JobRefType IOJobManager::getNextActiveJob (
 {
     Q_ASSERT( jobPool.isValid() );
 
-    // Lock
-    QReadLocker rdLocker( &jobPool->rwLock );
-    return jobPool->firstActiveJob;
+    Job* h = frontActiveJob( jobPool );
+    return (h ? h->self : JobRefType());
+}
+
+IOJobManager::JobRefType IOJobManager::getFollowingActiveJob (
+    const SmartPtr<JobPool>& jobPool,
+    const JobRefType& job ) const
+{
+    Q_ASSERT( jobPool.isValid() );
+    QSharedPointer<Job> h = job.toStrongRef();
+    if ( h.isNull() || ! h->isActive )
+        return JobRefType();
+
+    Job* n = followingActiveJob( jobPool, h.data() );
+    return (n ? n->self : JobRefType());
 }
 
 IOJobManager::JobRefType IOJobManager::getHeartBeatJob (
@@ -429,17 +587,14 @@ void IOJobManager::putActiveJob ( SmartPtr<JobPool> jobPool,
         return;
     }
 
-    // Lock
-    QWriteLocker wrLocker( &jobPool->rwLock );
-    Q_ASSERT(jobPool->firstActiveJob == job);
-    Q_ASSERT(jobPool->activeJobsSize > 0);
+    Q_ASSERT(frontActiveJob(jobPool) == h.data());
+    Q_ASSERT(AtomicRead(&jobPool->activeJobsSize) > 0);
 
-    // Decrease jobs size
-    --jobPool->activeJobsSize;
+    // Job could be written without #getNextActiveJob,
+    // response matching must not depend on it
+    indexJob( jobPool, h.data() );
 
-    // Init first active job
-    jobPool->firstActiveJob = h->nextJob;
-    h->nextJob.clear();
+    jobPool->activeJobs.popFront();
 
     // Mark job as inactive
     h->isActive = false;
@@ -447,17 +602,11 @@ void IOJobManager::putActiveJob ( SmartPtr<JobPool> jobPool,
     // Free package
     h->pkg = SmartPtr<IOPackage>();
 
-    // Last active job should be zeroed if this job is the last
-    if ( jobPool->firstActiveJob.isNull() ) {
-        Q_ASSERT(jobPool->activeJobsSize == 0);
-        jobPool->lastActiveJob.clear();
-    }
+    // Decrease jobs size
+    AtomicDec( &jobPool->activeJobsSize );
 
-    // Debug check
-    if ( jobPool->activeJobsSize == 0 ) {
-        Q_ASSERT(jobPool->firstActiveJob.isNull());
-        Q_ASSERT(jobPool->lastActiveJob.isNull());
-    }
+    // Job can be reused, when its send job is released by caller
+    recycleJob( jobPool, h.data() );
 }
 
 QList<IOJobManager::JobRefType> IOJobManager::getBusySendJobs (
@@ -467,29 +616,131 @@ QList<IOJobManager::JobRefType> IOJobManager::getBusySendJobs (
 
     QList<JobRefType> res;
 
-    // Lock
-    QReadLocker rdLocker( &jobPool->rwLock );
-
     // Firstly get correctly ordered active jobs
-    JobRefType w = jobPool->firstActiveJob;
-    for ( QSharedPointer<Job> h;; w = h->nextJob ) {
-        h = w.toStrongRef();
-        if ( h.isNull() ) {
-            break;
-        }
-        res << w;
+    for ( Job* h = frontActiveJob( jobPool ); h;
+          h = followingActiveJob( jobPool, h ) ) {
+        res << h->self;
     }
 
     // Secondary get all not active but externally owned jobs
-    foreach ( const QSharedPointer<Job>& j, jobPool->jobList) {
-        if ( ! isJobFree(j.data()) && ! j->isActive ) {
-            res << j;
+    takeRetiredJobs( jobPool );
+    foreach ( Job* j, jobPool->heldJobs ) {
+        if ( ! isJobFree(j) ) {
+            res << j->self;
         }
     }
 
     return res;
 }
 
+void IOJobManager::indexJob ( const SmartPtr<JobPool>& jobPool,
+                              Job* job ) const
+{
+    // NOTE: must be called from writing thread
+
+    if ( job->indexed )
+        return;
+    job->indexed = true;
+
+    const Uuid& uuid = job->sendJob->getPackageUuid();
+    if ( uuid.isNull() )
+        return;
+
+    QWriteLocker wrLocker( &jobPool->indexLock );
+    jobPool->uuidIndex.insert( uuid, job );
+}
+
+void IOJobManager::takeRetiredJobs ( const SmartPtr<JobPool>& jobPool ) const
+{
+    // NOTE: must be called from writing thread
+
+    // Producers push the stack, and it is taken at once, so there is no ABA
+    Job* retired = jobPool->retiredJobs.fetchAndStoreOrdered( 0 );
+    while ( retired ) {
+        Job* j = retired;
+        retired = j->nextJob;
+        jobPool->heldJobs.append( j );
+    }
+}
+
+void IOJobManager::recycleJob ( const SmartPtr<JobPool>& jobPool,
+                                Job* job ) const
+{
+    // NOTE: must be called from writing thread
+
+    takeRetiredJobs( jobPool );
+
+    if ( isJobFree(job) )
+        releaseJob( jobPool, job );
+    // Send job is still referenced, e.g. caller waits for response
+    else
+        jobPool->heldJobs.append( job );
+
+    // Recheck held jobs not more often than once per their number
+    // of puts, so amortized cost of put stays constant
+    QVector<Job*>& held = jobPool->heldJobs;
+    if ( ++jobPool->putsSinceScan < (quint32)held.size() )
+        return;
+
+    jobPool->putsSinceScan = 0;
+    for ( int i = 0; i < held.size(); ) {
+        if ( isJobFree(held[i]) ) {
+            releaseJob( jobPool, held[i] );
+            held[i] = held.last();
+            held.removeLast();
+        }
+        else
+            ++i;
+    }
+}
+
+void IOJobManager::releaseJob ( const SmartPtr<JobPool>& jobPool,
+                                Job* job ) const
+{
+    // NOTE: must be called from writing thread
+
+    // Forget response matching before job becomes visible for producers
+    if ( job->indexed ) {
+        job->indexed = false;
+        const Uuid& uuid = job->sendJob->getPackageUuid();
+        if ( ! uuid.isNull() ) {
+            QWriteLocker wrLocker( &jobPool->indexLock );
+            jobPool->uuidIndex.remove( uuid, job );
+        }
+    }
+
+    // Free jobs ring is full, so pool is trimmed
+    if ( ! jobPool->freeJobs.push(job) )
+        destroyPoolJob( job );
+}
+
+IOJobManager::Job* IOJobManager::frontActiveJob (
+    const SmartPtr<JobPool>& jobPool ) const
+{
+    // NOTE: must be called from writing thread
+
+    JobRing& ring = jobPool->activeJobs;
+    Job* job = ring.peek( ring.front() );
+    // Job is going to be written, so register it for responses
+    if ( job )
+        indexJob( jobPool, job );
+    return job;
+}
+
+IOJobManager::Job* IOJobManager::followingActiveJob (
+    const SmartPtr<JobPool>& jobPool,
+    Job* job ) const
+{
+    // NOTE: must be called from writing thread
+
+    // Producer which has taken the next position, but has not filled
+    // it yet, hides the rest of queue until it does.
+    Job* next = jobPool->activeJobs.peek( job->queuePos + 1 );
+    if ( next )
+        indexJob( jobPool, next );
+    return next;
+}
+
 bool IOJobManager::isJobFree ( const Job* job ) const
 {
     Q_ASSERT(job);
@@ -501,3 +752,4 @@ bool IOJobManager::isJobFree ( const Job* job ) const
 }
 
 /*****************************************************************************/
+
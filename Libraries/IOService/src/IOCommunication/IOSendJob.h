@@ -38,6 +38,7 @@
 #include <QReadWriteLock>
 #include <QHash>
 #include <QVector>
+#include <QAtomicPointer>
 #include <QWeakPointer>
 #include <QWaitCondition>
 
@@ -161,8 +162,7 @@ class IOJobManager
 public:
     enum MaxSizeType {
         MaxActiveJobsSize = 20,
-        OptimalPoolSize = 50,
-        OptimalNonFreePoolSize = quint32(OptimalPoolSize * 0.75)
+        OptimalPoolSize = 64
     };
 
     class Job;
@@ -176,29 +176,102 @@ public:
         SmartPtr<IOSendJob> sendJob;
         IOPackage::PODHeader pkgHeader;
         SmartPtr<IOPackage> pkg;
-        JobRefType nextJob;
+        // Link in retired jobs stack
+        QAtomicPointer<Job> nextJob;
+        // Weak reference to itself, which is given to callers
+        JobRefType self;
+        // Strong reference to itself, which keeps job alive while
+        // it belongs to pool
+        QSharedPointer<Job> owner;
+        // Position in active jobs queue
+        unsigned queuePos;
+        // Package uuid is in response matching index
+        bool indexed;
         bool isActive;
     };
 
+    /**
+     * Bounded multi-producer/multi-consumer ring of jobs.
+     * Every cell has a sequence number, which tells whether cell is
+     * free or filled on the current lap, so positions are never
+     * reused in flight and there is no ABA.
+     */
+    class JobRing
+    {
+    public:
+        // Capacity must be a power of two
+        explicit JobRing ( quint32 capacity );
+        ~JobRing ();
+
+        /** Returns false if ring is full */
+        bool push ( Job* );
+        /** Returns 0 if ring is empty */
+        Job* pop ();
+
+        /**
+         * Returns job at the position, if it has been pushed already.
+         * @note Must be called from the only consumer.
+         */
+        Job* peek ( unsigned pos ) const;
+        /** Position of the first job. @note Only consumer calls it. */
+        unsigned front () const;
+        /** Pops the first job. @note Only consumer calls it. */
+        void popFront ();
+
+    private:
+        struct Cell
+        {
+            unsigned seq;
+            Job* job;
+        };
+
+        Cell* m_cells;
+        unsigned m_mask;
+        unsigned m_pushPos;
+        unsigned m_popPos;
+    };
+
     class JobPool
     {
     public:
-        JobPool ( const Uuid& );
+        JobPool ( const Uuid&, quint32 activeJobsCapacity );
+        ~JobPool ();
 
         Uuid uuid;
-	mutable QReadWriteLock rwLock;
-        QVector< QSharedPointer<Job> > jobList;
-        quint32 activeJobsSize;
-        JobRefType firstActiveJob;
-        JobRefType lastActiveJob;
         QSharedPointer<Job> heartBeatJob;
+
+        // Any thread pushes active jobs, only writing thread takes them.
+        // Urgent jobs may exceed the limit, but not the ring capacity.
+        JobRing activeJobs;
+        unsigned activeJobsSize;
+        // Writing thread returns jobs, which are free, any thread takes
+        // them. Jobs which do not fit are deleted, so the ring is also
+        // a trim policy of the pool.
+        JobRing freeJobs;
+        // Jobs rejected by #initActiveJob, which are owned by callers
+        // and are taken by writing thread
+        QAtomicPointer<Job> retiredJobs;
+
+        // The rest is owned by writing thread.
+        // Inactive jobs, whose send jobs are still referenced by callers
+        QVector<Job*> heldJobs;
+        quint32 putsSinceScan;
+
+        // Jobs by registered package uuid, for response matching.
+        // Writing thread updates the index before package is written,
+        // reading thread looks responses up.
+        mutable QReadWriteLock indexLock;
+        QMultiHash<Uuid, Job*> uuidIndex;
     };
 
     IOJobManager(): m_activeJobsLimit(MaxActiveJobsSize)
     {
     }
 
-    /** Inits job pool with #MaxPoolSize jobs */
+    /**
+     * Inits job pool with #OptimalPoolSize free jobs. Active jobs queue
+     * is bounded by twice the active jobs limit.
+     */
     SmartPtr<JobPool> initJobPool ();
 
     /** Finds job in pool by response package */
@@ -211,19 +284,28 @@ public:
      * Returns true, if active jobs size is <= #MaxActiveJobsSize,
      * false otherwise.
      * If urgent param is true, always tries to init active job in spite
-     * of active job list size.
+     * of active job list size, but fails if the queue itself is full.
      * Actually, false can be returned and job param inited to 0,
      * if allocation failed.
+     * Package uuid of header is registered for response matching
+     * by #findJobByResponsePackage, so header must be completely
+     * filled before the call: job can be written just after the push.
+     * Send job is taken before the job is pushed: pushed job can be
+     * written and reused by another caller, so job->sendJob must not
+     * be read after the call.
+     * @note Can be called from any thread without external locks.
      *
      * @param jobPool   [in]  job pool object
      * @param pkgHeader [in]  pkg header to write
      * @param package   [in]  pkg to write
      * @param job       [out] output job
+     * @param sendJob   [out] send job of output job
      */
     bool initActiveJob ( SmartPtr<JobPool>& jobPool,
                          const IOPackage::PODHeader& pkgHeader,
                          const SmartPtr<IOPackage>& package,
-                         JobRefType& job,
+                         QSharedPointer<Job>& job,
+                         SmartPtr<IOSendJob>& sendJob,
                          bool urgent );
 
     /**
@@ -234,6 +316,14 @@ public:
      */
     JobRefType getNextActiveJob ( const SmartPtr<JobPool>& ) const;
 
+    /**
+     * Returns active job which follows the specified active job.
+     * If 0 is returned, specified job is the last active one.
+     * @note Must be called from the thread which calls #putActiveJob.
+     */
+    JobRefType getFollowingActiveJob ( const SmartPtr<JobPool>&,
+                                       const JobRefType& ) const;
+
     /**
      * Always returns valid heart beat job
      */
@@ -241,7 +331,8 @@ public:
 
     /**
      * Puts active job back to pool.
-     * Actually makes job inactive.
+     * Actually makes job inactive, the job is reused when its send
+     * job is released by callers.
      * @note #getNextActiveJob and #putActiveJob must be called from the same
      *       thread.
      */
@@ -250,6 +341,7 @@ public:
     /**
      * Returns list of all busy (non free) send jobs and
      * their pacakges in job pool
+     * @note Must be called from the thread which calls #putActiveJob.
      */
     QList<JobRefType>
         getBusySendJobs ( const SmartPtr<JobPool>& ) const;
@@ -266,6 +358,16 @@ public:
 private:
     bool isJobFree ( const Job* ) const;
 
+    // Writing thread side of job reuse
+    void indexJob ( const SmartPtr<JobPool>&, Job* ) const;
+    void takeRetiredJobs ( const SmartPtr<JobPool>& ) const;
+    void recycleJob ( const SmartPtr<JobPool>&, Job* ) const;
+    void releaseJob ( const SmartPtr<JobPool>&, Job* ) const;
+
+    // Active jobs queue
+    Job* frontActiveJob ( const SmartPtr<JobPool>& ) const;
+    Job* followingActiveJob ( const SmartPtr<JobPool>&, Job* ) const;
+
     unsigned m_activeJobsLimit;
 };
 
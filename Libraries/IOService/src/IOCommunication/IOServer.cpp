@@ -151,6 +151,12 @@ bool IOServer::clientProtocolVersion (
     return m_sockImpl->clientProtocolVersion( h, ver );
 }
 
+bool IOServer::clientBinaryEventsNegotiated (
+    const IOSender::Handle& h ) const
+{
+    return m_sockImpl->clientBinaryEventsNegotiated( h );
+}
+
 bool IOServer::detachClient (
     const IOSender::Handle& cliHandle,
     int specificArg,
@@ -199,6 +205,37 @@ void  IOServer::setUserConnectionLimit( unsigned int nLimit )
 	m_sockImpl->setUserConnectionLimit(nLimit);
 }
 
+void IOServer::setReactorThreadsCount( quint32 nThreads )
+{
+	m_sockImpl->setReactorThreadsCount(nThreads);
+}
+
+void IOServer::setCompressionCodecs( quint32 codecs )
+{
+	m_sockImpl->setCompressionCodecs(codecs);
+}
+
+void IOServer::setKernelTls( bool enabled )
+{
+	m_sockImpl->setKernelTls(enabled);
+}
+
+void IOServer::setBinaryEvents( bool enabled )
+{
+	m_sockImpl->setBinaryEvents(enabled);
+}
+
+void IOServer::setReceiveBudget( quint64 totalBytes, quint64 minShareBytes )
+{
+	m_sockImpl->setReceiveBudget(totalBytes, minShareBytes);
+}
+
+void IOServer::getReceiveBudgetStatistics(
+	IOPackage::BudgetStatistics& s ) const
+{
+	m_sockImpl->getReceiveBudgetStatistics(s);
+}
+
 /*****************************************************************************
  * Callbacks
  *****************************************************************************/
@@ -181,6 +181,13 @@ public:
                                  const IOSender::Handle&,
                                  IOCommunication::ProtocolVersion& ) const;
 
+    /**
+     * Returns true if both sides agreed in handshake to send events
+     * in binary encoding. False is returned for unknown handle.
+     */
+    virtual bool clientBinaryEventsNegotiated (
+                                 const IOSender::Handle& ) const;
+
     /**
      * Requests client detaching in asynchronous manner.
      * Use #onDetachClient signal to catch detached state.
@@ -279,6 +286,40 @@ public:
 	 */
 	virtual void setUserConnectionLimit( unsigned int nLimit);
 
+	/**
+	 * Set number of reactor threads, which read all server
+	 * connections. Must be called before server start.
+	 */
+	virtual void setReactorThreadsCount( quint32 nThreads );
+
+	/**
+	 * Set bitmask of codecs, which may be used to compress
+	 * buffers sent to clients.
+	 */
+	virtual void setCompressionCodecs( quint32 codecs );
+
+	/**
+	 * Enable kernel TLS offload of SSL connections.
+	 */
+	virtual void setKernelTls( bool enabled );
+
+	/**
+	 * Advertise binary events decoding to clients.
+	 */
+	virtual void setBinaryEvents( bool enabled );
+
+	/**
+	 * Set memory budget of not processed packages of all clients.
+	 */
+	virtual void setReceiveBudget( quint64 totalBytes,
+	                               quint64 minShareBytes );
+
+	/**
+	 * Returns current usage of receive budget.
+	 */
+	virtual void getReceiveBudgetStatistics(
+	                          IOPackage::BudgetStatistics& ) const;
+
 private:
     /** Just common init routine */
     void init ();
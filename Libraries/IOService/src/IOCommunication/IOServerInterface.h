@@ -268,6 +268,15 @@ public:
                                  const IOSender::Handle&,
                                  IOCommunication::ProtocolVersion& ) const = 0;
 
+    /**
+     * Returns true if both sides advertised binary events decoding
+     * in handshake, so events for this client may be sent in binary
+     * encoding instead of XML (see #setBinaryEvents).
+     * If client is not connected, false will be returned.
+     */
+    virtual bool clientBinaryEventsNegotiated (
+                                 const IOSender::Handle& ) const = 0;
+
     /**
      * Requests client detaching in asynchronous manner.
      * Use #onDetachClient signal to catch detached state.
@@ -416,6 +425,57 @@ public:
 	 */
 	virtual void setUserConnectionLimit(unsigned int nLimit) = 0;
 
+	/**
+	 * Set number of reactor threads, which read all server
+	 * connections after handshake. Zero (default) means
+	 * dedicated read thread for every connection.
+	 * Takes effect on next server start.
+	 */
+	virtual void setReactorThreadsCount(quint32 nThreads) = 0;
+
+	/**
+	 * Set bitmask of codecs (see IOCompression::Codec), which may be
+	 * used to compress package buffers sent to clients. Codec is
+	 * chosen in handshake from codecs supported by both sides.
+	 * Zero (default) disables compression of sent buffers.
+	 * Takes effect on next client connection.
+	 */
+	virtual void setCompressionCodecs(quint32 codecs) = 0;
+
+	/**
+	 * Enable kernel TLS offload of SSL connections (Linux only).
+	 * If both sides support it, keys of the session are handed to the
+	 * kernel after SSL handshake and SSL route is written as plain one.
+	 * Such connections can't be detached.
+	 * Takes effect on next client connection.
+	 */
+	virtual void setKernelTls(bool enabled) = 0;
+
+	/**
+	 * Advertise to clients in handshake that received events may be
+	 * in binary encoding, i.e. upper layer decodes both binary and XML
+	 * events. Encoding of sent events is chosen by upper layer, see
+	 * #clientBinaryEventsNegotiated. Disabled by default.
+	 * Takes effect on next client connection.
+	 */
+	virtual void setBinaryEvents(bool enabled) = 0;
+
+	/**
+	 * Set memory budget of received, but not processed packages of all
+	 * clients. Client may use the whole free budget, but when it is
+	 * exhausted, clients above their fair share (budget divided by
+	 * clients number, but at least minShareBytes) stop reading.
+	 * Takes effect immediately.
+	 */
+	virtual void setReceiveBudget(quint64 totalBytes,
+	                              quint64 minShareBytes) = 0;
+
+	/**
+	 * Returns current usage of receive budget and pauses count.
+	 */
+	virtual void getReceiveBudgetStatistics(
+	                          IOPackage::BudgetStatistics&) const = 0;
+
 protected:
     /** Destructor */
     virtual ~IOServerInterface_ServerSide () {}
@@ -369,6 +369,17 @@ bool IOServerPool::clientProtocolVersion (
     return server->clientProtocolVersion(h, p);
 }
 
+bool IOServerPool::clientBinaryEventsNegotiated (
+    const IOSender::Handle& h ) const
+{
+    const SmartPtr<IOServerInterface> server = m_imp->getServer(h);
+    if (0 == server.get())
+    {
+        return false;
+    }
+    return server->clientBinaryEventsNegotiated(h);
+}
+
 bool IOServerPool::detachClient ( const IOSender::Handle& h,
                                   int specificArg,
                                   const SmartPtr<IOPackage>& additionalPkg,
@@ -89,6 +89,9 @@ public:
                                  const IOSender::Handle&,
                                  IOCommunication::ProtocolVersion& ) const;
 
+    virtual bool clientBinaryEventsNegotiated (
+                                 const IOSender::Handle& ) const;
+
     virtual bool detachClient ( const IOSender::Handle& cliHandle,
                                 int specificArg,
                                 const SmartPtr<IOPackage>& additionalPkg =
@@ -0,0 +1,537 @@
+/*
+ * KernelTls_p.cpp
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <string.h>
+#include <new>
+
+#include <openssl/crypto.h>
+
+#include "Socket/KernelTls_p.h"
+#include "Libraries/Logging/Logging.h"
+
+// Master key, PRF digest and keylog accessors appeared in OpenSSL 1.1.1
+#if defined(_LIN_) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+  #define KERNEL_TLS_OFFLOAD
+#endif
+
+#ifdef KERNEL_TLS_OFFLOAD
+  #include <unistd.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <linux/tls.h>
+  #include <openssl/evp.h>
+  #include <openssl/kdf.h>
+
+  #ifndef SOL_TLS
+    #define SOL_TLS 282
+  #endif
+  #ifndef TCP_ULP
+    #define TCP_ULP 31
+  #endif
+  // Kernel headers older than 5.1 know TLS 1.2 only
+  #ifndef TLS_1_3_VERSION
+    #define TLS_1_3_VERSION 0x0304
+  #endif
+#endif
+
+using namespace IOService;
+using namespace IOService::KernelTls;
+
+/*****************************************************************************/
+
+namespace {
+
+#ifdef KERNEL_TLS_OFFLOAD
+
+enum {
+    TlsRandomSize = 32,
+    TlsSaltSize = 4,
+    TlsSeqSize = 8,
+    TlsMaxKeySize = 32,
+    // Nonce of TLS 1.3 record is salt + 8 bytes of iv
+    Tls13IvSize = 12,
+    // Record content type of application data
+    TlsApplicationData = 23
+};
+
+template <typename Info>
+quint32 fillInfo ( quint16 version, quint16 cipherType,
+                   const unsigned char* key, const unsigned char* salt,
+                   const unsigned char* iv, quint64 seq,
+                   unsigned char* out )
+{
+    Info info;
+    ::memset( &info, 0, sizeof(info) );
+    info.info.version = version;
+    info.info.cipher_type = cipherType;
+    ::memcpy( info.key, key, sizeof(info.key) );
+    ::memcpy( info.salt, salt, sizeof(info.salt) );
+    for ( int i = TlsSeqSize - 1; i >= 0; --i, seq >>= 8 )
+        info.rec_seq[i] = seq & 0xff;
+    // TLS 1.2: explicit nonce of sent records continues the sequence,
+    // as OpenSSL does, receiver takes nonce from every record.
+    // TLS 1.3: nonce is static iv xored with the sequence.
+    ::memcpy( info.iv, iv ? iv : info.rec_seq, sizeof(info.iv) );
+
+    ::memcpy( out, &info, sizeof(info) );
+    OPENSSL_cleanse( &info, sizeof(info) );
+    return sizeof(info);
+}
+
+// Returns size of crypto info of one direction
+quint32 fillCryptoInfo ( quint16 version, Cipher cipher,
+                         const unsigned char* key, const unsigned char* salt,
+                         const unsigned char* iv, quint64 seq,
+                         unsigned char* out )
+{
+    switch ( cipher ) {
+    case AesGcm128:
+        return fillInfo<tls12_crypto_info_aes_gcm_128>(
+            version, TLS_CIPHER_AES_GCM_128, key, salt, iv, seq, out );
+    case AesGcm256:
+        return fillInfo<tls12_crypto_info_aes_gcm_256>(
+            version, TLS_CIPHER_AES_GCM_256, key, salt, iv, seq, out );
+    default:
+        return 0;
+    }
+}
+
+// Application traffic secrets of TLS 1.3 session, which are
+// reported by OpenSSL keylog callback during the handshake
+struct TrafficSecrets
+{
+    unsigned char client[EVP_MAX_MD_SIZE];
+    unsigned char server[EVP_MAX_MD_SIZE];
+    quint32 clientSize;
+    quint32 serverSize;
+};
+
+void freeSecrets ( void*, void* ptr, CRYPTO_EX_DATA*, int, long, void* )
+{
+    TrafficSecrets* secrets = reinterpret_cast<TrafficSecrets*>(ptr);
+    if ( secrets == 0 )
+        return;
+    OPENSSL_cleanse( secrets, sizeof(*secrets) );
+    delete secrets;
+}
+
+int secretsIndex ()
+{
+    static const int s_index = SSL_get_ex_new_index( 0, 0, 0, 0,
+                                                     freeSecrets );
+    return s_index;
+}
+
+int hexValue ( char c )
+{
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Line is "<label> <client random hex> <secret hex>"
+void keylogCallback ( const SSL* ssl, const char* line )
+{
+    TrafficSecrets* secrets = reinterpret_cast<TrafficSecrets*>(
+        SSL_get_ex_data(ssl, secretsIndex()) );
+    if ( secrets == 0 )
+        return;
+
+    static const char ClientLabel[] = "CLIENT_TRAFFIC_SECRET_0 ";
+    static const char ServerLabel[] = "SERVER_TRAFFIC_SECRET_0 ";
+    unsigned char* secret = 0;
+    quint32* size = 0;
+    if ( ::strncmp(line, ClientLabel, sizeof(ClientLabel) - 1) == 0 ) {
+        secret = secrets->client;
+        size = &secrets->clientSize;
+    }
+    else if ( ::strncmp(line, ServerLabel, sizeof(ServerLabel) - 1) == 0 ) {
+        secret = secrets->server;
+        size = &secrets->serverSize;
+    }
+    else
+        return;
+
+    const char* hex = ::strchr( line + sizeof(ClientLabel) - 1, ' ' );
+    if ( hex == 0 )
+        return;
+    ++hex;
+
+    quint32 len = 0;
+    for ( ; hex[0] && hex[1] && len < EVP_MAX_MD_SIZE; hex += 2, ++len ) {
+        int hi = hexValue( hex[0] ), lo = hexValue( hex[1] );
+        if ( hi < 0 || lo < 0 )
+            break;
+        secret[len] = (unsigned char)((hi << 4) | lo);
+    }
+    *size = len;
+}
+
+// HKDF-Expand-Label of TLS 1.3 with empty context
+bool expandLabel ( const EVP_MD* md, const unsigned char* secret,
+                   quint32 secretSize, const char* label,
+                   unsigned char* out, size_t outLen )
+{
+    static const char Prefix[] = "tls13 ";
+    const size_t labelLen = sizeof(Prefix) - 1 + ::strlen(label);
+    unsigned char info[2 + 1 + 255 + 1];
+    if ( labelLen > 255 )
+        return false;
+    info[0] = (unsigned char)(outLen >> 8);
+    info[1] = (unsigned char)outLen;
+    info[2] = (unsigned char)labelLen;
+    ::memcpy( info + 3, Prefix, sizeof(Prefix) - 1 );
+    ::memcpy( info + 3 + sizeof(Prefix) - 1, label, ::strlen(label) );
+    info[3 + labelLen] = 0;
+
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id( EVP_PKEY_HKDF, 0 );
+    bool res = ( pctx != 0 &&
+                 EVP_PKEY_derive_init(pctx) > 0 &&
+                 EVP_PKEY_CTX_hkdf_mode(pctx,
+                     EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+                 EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+                 EVP_PKEY_CTX_set1_hkdf_key(pctx, secret,
+                                            (int)secretSize) > 0 &&
+                 EVP_PKEY_CTX_add1_hkdf_info(pctx, info,
+                                             (int)(4 + labelLen)) > 0 &&
+                 EVP_PKEY_derive(pctx, out, &outLen) > 0 );
+    EVP_PKEY_CTX_free( pctx );
+    return res;
+}
+
+// Returns size of TLS 1.3 crypto info of one direction
+quint32 fillTls13Info ( const EVP_MD* md, Cipher cipher, size_t keyLen,
+                        const unsigned char* secret, quint32 secretSize,
+                        unsigned char* out )
+{
+    unsigned char key[TlsMaxKeySize];
+    unsigned char iv[Tls13IvSize];
+    quint32 size = 0;
+    // Application records of both directions start from 0
+    if ( expandLabel(md, secret, secretSize, "key", key, keyLen) &&
+         expandLabel(md, secret, secretSize, "iv", iv, sizeof(iv)) )
+        size = fillCryptoInfo( TLS_1_3_VERSION, cipher, key, iv,
+                               iv + TlsSaltSize, 0, out );
+    OPENSSL_cleanse( key, sizeof(key) );
+    OPENSSL_cleanse( iv, sizeof(iv) );
+    return size;
+}
+
+// Creates connected loopback TCP socket pair
+bool loopbackPair ( int& a, int& b )
+{
+    a = b = -1;
+    int lsn = ::socket( AF_INET, SOCK_STREAM, 0 );
+    if ( lsn < 0 )
+        return false;
+
+    struct sockaddr_in addr;
+    ::memset( &addr, 0, sizeof(addr) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+
+    if ( ::bind(lsn, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+         ::listen(lsn, 1) == 0 &&
+         ::getsockname(lsn, (struct sockaddr*)&addr, &len) == 0 ) {
+        a = ::socket( AF_INET, SOCK_STREAM, 0 );
+        if ( a >= 0 &&
+             ::connect(a, (struct sockaddr*)&addr, sizeof(addr)) == 0 )
+            b = ::accept( lsn, 0, 0 );
+    }
+    ::close( lsn );
+
+    if ( b < 0 && a >= 0 ) {
+        ::close( a );
+        a = -1;
+    }
+    return b >= 0;
+}
+
+bool probeCipher ( quint16 version, Cipher cipher )
+{
+    int a, b;
+    if ( ! loopbackPair(a, b) )
+        return false;
+
+    const unsigned char key[TlsMaxKeySize] = {0};
+    const unsigned char salt[TlsSaltSize] = {0};
+    SessionKeys keys;
+    keys.size = fillCryptoInfo( version, cipher, key, salt, 0, 0, keys.tx );
+    fillCryptoInfo( version, cipher, key, salt, 0, 0, keys.rx );
+
+    bool res = attachUpperLayer(a) && installKeys(a, keys);
+    ::close( a );
+    ::close( b );
+    return res;
+}
+
+quint32 probeCiphers ( quint16 version )
+{
+    quint32 ciphers = NoCipher;
+    if ( probeCipher(version, AesGcm128) )
+        ciphers |= AesGcm128;
+    if ( probeCipher(version, AesGcm256) )
+        ciphers |= AesGcm256;
+    WRITE_TRACE(DBG_INFO, "Kernel TLS 0x%x offload ciphers: 0x%x",
+                version, ciphers);
+    return ciphers;
+}
+
+
+#endif // KERNEL_TLS_OFFLOAD
+
+} // anonymous namespace
+
+/*****************************************************************************/
+
+KernelTls::SessionKeys::SessionKeys () :
+    size(0)
+{
+    ::memset( tx, 0, sizeof(tx) );
+    ::memset( rx, 0, sizeof(rx) );
+}
+
+KernelTls::SessionKeys::~SessionKeys ()
+{
+    OPENSSL_cleanse( tx, sizeof(tx) );
+    OPENSSL_cleanse( rx, sizeof(rx) );
+}
+
+#ifdef KERNEL_TLS_OFFLOAD
+
+quint32 KernelTls::supportedCiphers ( int sslVersion )
+{
+    // TLS 1.3 is offloaded by kernels since 5.1
+    static const quint32 s_tls12 = probeCiphers( TLS_1_2_VERSION );
+    static const quint32 s_tls13 = probeCiphers( TLS_1_3_VERSION );
+    switch ( sslVersion ) {
+    case 0:
+        return s_tls12 | s_tls13;
+    case TLS1_2_VERSION:
+        return s_tls12;
+    case TLS1_3_VERSION:
+        return s_tls13;
+    default:
+        return NoCipher;
+    }
+}
+
+bool KernelTls::attachUpperLayer ( int sock )
+{
+    return ::setsockopt( sock, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls") ) == 0;
+}
+
+bool KernelTls::prepareSession ( SSL* ssl, bool serverSide )
+{
+    if ( SSL_get_ex_data(ssl, secretsIndex()) != 0 )
+        return true;
+
+    TrafficSecrets* secrets = new (std::nothrow) TrafficSecrets;
+    if ( secrets == 0 )
+        return false;
+    ::memset( secrets, 0, sizeof(*secrets) );
+    if ( ! SSL_set_ex_data(ssl, secretsIndex(), secrets) ) {
+        delete secrets;
+        return false;
+    }
+    SSL_CTX_set_keylog_callback( SSL_get_SSL_CTX(ssl), keylogCallback );
+
+    // Session tickets are sent under application keys after the
+    // handshake, so kernel sequence would start not from 0
+    if ( serverSide )
+        SSL_set_num_tickets( ssl, 0 );
+    return true;
+}
+
+bool KernelTls::deriveKeys ( SSL* ssl, bool serverSide, SessionKeys& keys )
+{
+    const int version = SSL_version( ssl );
+    if ( version != TLS1_2_VERSION && version != TLS1_3_VERSION )
+        return false;
+
+    const SSL_CIPHER* c = SSL_get_current_cipher( ssl );
+    if ( c == 0 )
+        return false;
+
+    Cipher cipher = NoCipher;
+    size_t keyLen = 0;
+    switch ( SSL_CIPHER_get_cipher_nid(c) ) {
+    case NID_aes_128_gcm:
+        cipher = AesGcm128;
+        keyLen = 16;
+        break;
+    case NID_aes_256_gcm:
+        cipher = AesGcm256;
+        keyLen = 32;
+        break;
+    default:
+        return false;
+    }
+    if ( ! (supportedCiphers(version) & cipher) )
+        return false;
+
+    const EVP_MD* md = SSL_CIPHER_get_handshake_digest( c );
+    if ( md == 0 )
+        return false;
+
+    if ( version == TLS1_3_VERSION ) {
+        const TrafficSecrets* secrets =
+            reinterpret_cast<const TrafficSecrets*>(
+                SSL_get_ex_data(ssl, secretsIndex()) );
+        if ( secrets == 0 || secrets->clientSize == 0 ||
+             secrets->serverSize == 0 )
+            return false;
+
+        keys.size = fillTls13Info( md, cipher, keyLen,
+                                   serverSide ? secrets->server :
+                                                secrets->client,
+                                   serverSide ? secrets->serverSize :
+                                                secrets->clientSize,
+                                   keys.tx );
+        quint32 rxSize = fillTls13Info( md, cipher, keyLen,
+                                        serverSide ? secrets->client :
+                                                     secrets->server,
+                                        serverSide ? secrets->clientSize :
+                                                     secrets->serverSize,
+                                        keys.rx );
+        if ( keys.size == 0 || rxSize != keys.size ) {
+            keys.size = 0;
+            return false;
+        }
+        return true;
+    }
+
+    SSL_SESSION* session = SSL_get_session( ssl );
+    if ( session == 0 )
+        return false;
+
+    unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+    size_t masterLen = SSL_SESSION_get_master_key( session, master,
+                                                   sizeof(master) );
+    // Key expansion seed is server random + client random
+    unsigned char seed[2 * TlsRandomSize];
+    SSL_get_server_random( ssl, seed, TlsRandomSize );
+    SSL_get_client_random( ssl, seed + TlsRandomSize, TlsRandomSize );
+
+    // Key block of AEAD cipher:
+    //   client key, server key, client salt, server salt
+    unsigned char block[2 * TlsMaxKeySize + 2 * TlsSaltSize];
+    size_t blockLen = 2 * keyLen + 2 * TlsSaltSize;
+
+    static const char Label[] = "key expansion";
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id( EVP_PKEY_TLS1_PRF, 0 );
+    bool res = ( pctx != 0 &&
+                 masterLen > 0 &&
+                 EVP_PKEY_derive_init(pctx) > 0 &&
+                 EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+                 EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master,
+                                                   (int)masterLen) > 0 &&
+                 EVP_PKEY_CTX_add1_tls1_prf_seed(pctx,
+                     reinterpret_cast<const unsigned char*>(Label),
+                     (int)(sizeof(Label) - 1)) > 0 &&
+                 EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed,
+                                                 (int)sizeof(seed)) > 0 &&
+                 EVP_PKEY_derive(pctx, block, &blockLen) > 0 );
+    EVP_PKEY_CTX_free( pctx );
+    OPENSSL_cleanse( master, sizeof(master) );
+
+    if ( res ) {
+        const unsigned char* cliKey = block;
+        const unsigned char* srvKey = block + keyLen;
+        const unsigned char* cliSalt = block + 2 * keyLen;
+        const unsigned char* srvSalt = cliSalt + TlsSaltSize;
+
+        // Finished message was the only record under the new keys
+        const quint64 seq = 1;
+        keys.size = fillCryptoInfo( TLS_1_2_VERSION, cipher,
+                                    serverSide ? srvKey : cliKey,
+                                    serverSide ? srvSalt : cliSalt,
+                                    0, seq, keys.tx );
+        fillCryptoInfo( TLS_1_2_VERSION, cipher,
+                        serverSide ? cliKey : srvKey,
+                        serverSide ? cliSalt : srvSalt, 0, seq, keys.rx );
+    }
+    OPENSSL_cleanse( block, sizeof(block) );
+    return res;
+}
+
+bool KernelTls::installKeys ( int sock, const SessionKeys& keys )
+{
+    return keys.size != 0 &&
+        ::setsockopt( sock, SOL_TLS, TLS_TX, keys.tx, keys.size ) == 0 &&
+        ::setsockopt( sock, SOL_TLS, TLS_RX, keys.rx, keys.size ) == 0;
+}
+
+bool KernelTls::isControlRecord ( const struct msghdr& msg )
+{
+    struct msghdr* m = const_cast<struct msghdr*>(&msg);
+    for ( struct cmsghdr* c = CMSG_FIRSTHDR(m); c; c = CMSG_NXTHDR(m, c) ) {
+        if ( c->cmsg_level == SOL_TLS && c->cmsg_type == TLS_GET_RECORD_TYPE )
+            return *CMSG_DATA(c) != TlsApplicationData;
+    }
+    return false;
+}
+
+#else // KERNEL_TLS_OFFLOAD
+
+quint32 KernelTls::supportedCiphers ( int )
+{
+    return NoCipher;
+}
+
+bool KernelTls::attachUpperLayer ( int )
+{
+    return false;
+}
+
+bool KernelTls::prepareSession ( SSL*, bool )
+{
+    return false;
+}
+
+bool KernelTls::deriveKeys ( SSL*, bool, SessionKeys& )
+{
+    return false;
+}
+
+bool KernelTls::installKeys ( int, const SessionKeys& )
+{
+    return false;
+}
+
+#ifndef _WIN_
+bool KernelTls::isControlRecord ( const struct msghdr& )
+{
+    return false;
+}
+#endif
+
+#endif // KERNEL_TLS_OFFLOAD
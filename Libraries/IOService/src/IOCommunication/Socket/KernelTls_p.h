@@ -0,0 +1,116 @@
+/*
+ * KernelTls_p.h
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#ifndef KERNELTLSP_H
+#define KERNELTLSP_H
+
+#include <QtGlobal>
+#include <openssl/ssl.h>
+
+#ifndef _WIN_
+  #include <sys/socket.h>
+#endif
+
+namespace IOService {
+
+/**
+ * Kernel TLS offload (Linux only).
+ *
+ * Handshake is done by OpenSSL as usual. Then record keys of the TLS 1.2
+ * or TLS 1.3 session are derived and installed to the socket, so kernel encrypts
+ * everything written to the socket and decrypts everything read from
+ * it. Connection is then written and read as plain one, without
+ * SSL engine and its network BIO copies.
+ */
+namespace KernelTls
+{
+    /** Record ciphers bitmask */
+    enum Cipher {
+        NoCipher  = 0,
+        AesGcm128 = 1 << 0,
+        AesGcm256 = 1 << 1
+    };
+
+    /**
+     * Returns ciphers, which kernel is able to offload in both directions
+     * for SSL protocol version (TLS1_2_VERSION or TLS1_3_VERSION), or for
+     * any of them if version is 0. Kernel is probed once on loopback
+     * socket pair.
+     */
+    quint32 supportedCiphers ( int sslVersion = 0 );
+
+    /**
+     * Attaches TLS upper layer protocol to connected TCP socket.
+     * Socket works as before until keys are installed.
+     */
+    bool attachUpperLayer ( int sock );
+
+    /** Record keys of both directions of the session */
+    struct SessionKeys
+    {
+        quint32 size;
+        unsigned char tx[64];
+        unsigned char rx[64];
+
+        SessionKeys ();
+        ~SessionKeys ();
+    };
+
+    /**
+     * Prepares SSL object, which is going to be offloaded, before the
+     * handshake: TLS 1.3 traffic secrets are recorded, and server sends
+     * no session tickets, which would be records under application keys.
+     */
+    bool prepareSession ( SSL*, bool serverSide );
+
+    /**
+     * Derives record keys of just finished TLS 1.2 or TLS 1.3 handshake.
+     * TLS 1.3 keys are known only if #prepareSession was called.
+     * Must be called before any application record is exchanged,
+     * since record sequence numbers are restored from this point.
+     * Returns false if protocol version or cipher can't be offloaded.
+     */
+    bool deriveKeys ( SSL*, bool serverSide, SessionKeys& );
+
+    /**
+     * Installs keys to the socket with attached upper layer.
+     * After success all socket data is encrypted by kernel.
+     */
+    bool installKeys ( int sock, const SessionKeys& );
+
+#ifndef _WIN_
+    /**
+     * Returns true if received message is alert or handshake record
+     * of offloaded session instead of application data.
+     */
+    bool isControlRecord ( const struct msghdr& );
+#endif
+
+} //namespace KernelTls
+
+} //namespace IOService
+
+#endif //KERNELTLSP_H
@@ -26,7 +26,9 @@
 
 
 #include "Socket/SocketClient_p.h"
+#include "Socket/KernelTls_p.h"
 #include "IOClient.h"
+#include "IOCompression.h"
 #include "IOSSLInterface.h"
 #include "Interfaces/VirtuozzoDispToDispProto.h"
 #include <Libraries/OpenSSL/OpenSSL.h>
@@ -57,8 +59,8 @@ using namespace IOService;
 
 #define CHECK_CURRENT_THR(err_op)                                       \
     do {                                                                \
-        Q_ASSERT(QThread::currentThread() == this);                     \
-        if ( QThread::currentThread() != this )                         \
+        Q_ASSERT(isReadingThread());                                    \
+        if ( ! isReadingThread() )                                      \
             err_op;                                                     \
     } while (0);
 
@@ -171,10 +173,33 @@ SocketClientPrivate::SocketClientPrivate (
     m_encryptedDataToRead(false),
     m_useUnixSockets(useUnixSockets),
     m_lastfd(-1),
+    m_pollSkips(0),
+    m_rawPos(0),
+    m_rawReadAhead(true),
     m_bLimitErrorLogging(false),
     m_peerUid(uid),
     m_peerPid(pid),
-    m_limiter(new IOPackage::Limiter)
+    m_limiter(new IOPackage::Limiter),
+    m_compressionCodecs(0),
+    m_peerCompressionCodecs(0),
+    m_kernelTls(false),
+    m_featureFlags(0),
+    m_peerFeatureFlags(0),
+    m_kernelTlsActive(false),
+    m_binaryEvents(false),
+    m_binaryEventsNegotiated(false),
+    m_reactor(0),
+    m_reactorThr(-1),
+    m_reactorSock(-1),
+    m_reactorPaused(false),
+    m_reactorResumed(0),
+    m_rdDataReceived(false),
+    m_rdBuffIdx(0),
+    m_rdBuffOffset(0),
+    m_rdUnixfd(-1),
+    m_rdHeartBeatSupport(false),
+    m_rdLastHeartBeatMark(0),
+    m_rdSrvDetaching(false)
 {
 	m_rl.rate = 1;
 	m_rl.last = -1;
@@ -328,7 +353,7 @@ bool SocketClientPrivate::srv_getAttachingAdditionalPkg (
 QString SocketClientPrivate::currentConnectionUuid () const
 {
     QMutexLocker locker( &m_eventMutex );
-    if ( QThread::currentThread() != this &&
+    if ( ! isReadingThread() &&
          m_state != IOSender::Connected )
         return QString();
 
@@ -339,7 +364,7 @@ QString SocketClientPrivate::peerHostName () const
 {
     QMutexLocker locker( &m_eventMutex );
 
-    if ( QThread::currentThread() != this &&
+    if ( ! isReadingThread() &&
          m_state != IOSender::Connected )
         return QString();
 
@@ -349,7 +374,7 @@ QString SocketClientPrivate::peerHostName () const
 QString SocketClientPrivate::peerConnectionUuid () const
 {
     QMutexLocker locker( &m_eventMutex );
-    if ( QThread::currentThread() != this &&
+    if ( ! isReadingThread() &&
          m_state != IOSender::Connected )
         return QString();
 
@@ -359,7 +384,7 @@ QString SocketClientPrivate::peerConnectionUuid () const
 IOSender::Type SocketClientPrivate::peerSenderType () const
 {
     QMutexLocker locker( &m_eventMutex );
-    if ( QThread::currentThread() != this &&
+    if ( ! isReadingThread() &&
          m_state != IOSender::Connected )
         return IOSender::UnknownType;
 
@@ -369,7 +394,7 @@ IOSender::Type SocketClientPrivate::peerSenderType () const
 IOSender::SecurityMode SocketClientPrivate::securityMode () const
 {
 	QMutexLocker locker( &m_eventMutex );
-    if ( QThread::currentThread() != this &&
+    if ( ! isReadingThread() &&
          m_state != IOSender::Connected )
         return IOSender::UnknownMode;
 
@@ -420,7 +445,7 @@ IOSender::State SocketClientPrivate::waitForConnection (
     quint32 msecs ) const
 {
     QMutexLocker locker( &m_eventMutex );
-    if ( QThread::currentThread() == this )
+    if ( isReadingThread() )
         return m_state;
     else if ( m_threadState != ThreadIsStarting &&
               m_threadState != ThreadIsStarted )
@@ -516,7 +541,7 @@ IOCommunication::DetachedClient SocketClientPrivate::srv_doDetach ( int sock )
     state->header.clientSocket = newSock;
 #endif
 
-    state->header.readAheadSize = m_rawBuffer.size();
+    state->header.readAheadSize = rawAvailable();
     if ( 0 < state->header.readAheadSize ) {
         state->data.readAhead = SmartPtr<char>( new(std::nothrow)
                                      char[state->header.readAheadSize],
@@ -525,7 +550,7 @@ IOCommunication::DetachedClient SocketClientPrivate::srv_doDetach ( int sock )
             WRITE_TRACE(DBG_FATAL, IO_LOG("Can't allocate memory!"));
             return IOCommunication::DetachedClient();
         }
-        memcpy(state->data.readAhead.getImpl(), m_rawBuffer.constData(),
+        memcpy(state->data.readAhead.getImpl(), rawData(),
                state->header.readAheadSize);
     }
 
@@ -552,6 +577,13 @@ bool SocketClientPrivate::srv_detachClient (
     // Lock
     QMutexLocker locker( &m_eventMutex );
 
+    // Session keys are in the kernel and can't be passed with the socket
+    if ( m_kernelTlsActive ) {
+        WRITE_TRACE(DBG_FATAL,
+                    IO_LOG("Connection with kernel TLS can't be detached."));
+        return false;
+    }
+
     bool sendRes = m_writeThread.sendDetachRequestAndPauseWriting(detachBothSides);
     if ( ! sendRes ) {
         WRITE_TRACE(DBG_FATAL,
@@ -639,13 +671,23 @@ bool SocketClientPrivate::startClient ( quint32 msecsTimeout )
 void SocketClientPrivate::stopClient ()
 {
     // If call from this thread: just mark as finalized
-    if ( QThread::currentThread() == this ) {
+    if ( isReadingThread() ) {
         // Lock
         QMutexLocker locker( &m_eventMutex );
         __finalizeThread();
         return;
     }
 
+    // Reading is driven by the reactor thread, which is busy with
+    // another connection now, so we can't wait: just mark as finalized
+    if ( m_reactorThr >= 0 && m_reactor->isCurrentThread(m_reactorThr) ) {
+        // Lock
+        QMutexLocker locker( &m_eventMutex );
+        if ( m_threadState == ThreadIsStarted )
+            __finalizeThread();
+        return;
+    }
+
     // Main start/stop lock
     QMutexLocker mainLocker( &m_startStopMutex );
 
@@ -788,6 +830,43 @@ IOSendJob::Handle SocketClientPrivate::sendDetachedClient (
     return sendPackage( pkg );
 }
 
+quint32 SocketClientPrivate::rawAvailable () const
+{
+    return m_rawBuffer.size() - m_rawPos;
+}
+
+const char* SocketClientPrivate::rawData () const
+{
+    return m_rawBuffer.constData() + m_rawPos;
+}
+
+void SocketClientPrivate::rawConsume ( quint32 size )
+{
+    Q_ASSERT(size <= rawAvailable());
+    m_rawPos += size;
+    // Everything is consumed: start from the beginning, nothing to move
+    if ( m_rawPos == (quint32)m_rawBuffer.size() ) {
+        m_rawBuffer.data_ptr()->size = 0;
+        m_rawPos = 0;
+    }
+}
+
+void SocketClientPrivate::rawReserve ( quint32 size )
+{
+    m_rawBuffer.reserve( qMax<int>(RawBufferSize, rawAvailable() + size) );
+
+    quint32 tail = m_rawBuffer.capacity() - m_rawBuffer.size();
+    if ( m_rawPos == 0 || (tail >= size && tail >= RawBufferMinRecv) )
+        return;
+
+    // Move not consumed data to the beginning. This happens once
+    // per buffer turn and moves only a tail of the last frame.
+    quint32 avail = rawAvailable();
+    ::memmove( m_rawBuffer.data(), rawData(), avail );
+    m_rawBuffer.data_ptr()->size = avail;
+    m_rawPos = 0;
+}
+
 bool SocketClientPrivate::read ( int sock, char* inBuf, quint32 size,
                                  quint32& wasRead, IOReadMode readMode,
                                  int msecsTimeout, int* unixfd,
@@ -800,8 +879,7 @@ bool SocketClientPrivate::read ( int sock, char* inBuf, quint32 size,
         *timeoutExpired = false;
 
     enum {
-        ErrBuffSize = 1<<8,
-        BUFFER_LIMIT = 1<<18
+        ErrBuffSize = 1<<8
     };
     char errBuff[ ErrBuffSize ];
 
@@ -816,72 +894,89 @@ bool SocketClientPrivate::read ( int sock, char* inBuf, quint32 size,
 
     int lastfd = -1;
     std::swap(lastfd, m_lastfd);
-    m_rawBuffer.reserve(BUFFER_LIMIT);
+    // Socket is non-blocking, so recv is tried first and ppoll is
+    // called only if socket is empty. Stop pipe is checked at least
+    // once per #MaxPollSkips recv calls.
+    bool doPoll = (m_pollSkips >= MaxPollSkips);
     do {
-        quint32 s = m_rawBuffer.size();
+        quint32 s = rawAvailable();
         if ( size <= s ) {
             break;
         }
-        // Create params for select
-        int pipe = m_eventPipes[0];
-        // We can't use FD_ZERO here, because
-        // of not original fd_set size
-        pollfd p[2];
-        p[0].fd = sock;
-        p[0].events = POLLIN;
-        p[1].fd = pipe;
-        p[1].events = 0;
+        // Single read returns what is already received
+        if ( readMode == IOSingleRead && s > 0 ) {
+            break;
+        }
 
-        // Add pipe event
-        if ( readMode != IOGracefulShutdownRead )
-	    p[1].events = POLLIN;
+        if ( doPoll ) {
+            m_pollSkips = 0;
+
+            // Create params for select
+            int pipe = m_eventPipes[0];
+            // We can't use FD_ZERO here, because
+            // of not original fd_set size
+            pollfd p[2];
+            p[0].fd = sock;
+            p[0].events = POLLIN;
+            p[1].fd = pipe;
+            p[1].events = 0;
+
+            // Add pipe event
+            if ( readMode != IOGracefulShutdownRead )
+                p[1].events = POLLIN;
 
-        timespec timeout = {0, 0};
-        timespec* timeo = 0;
+            timespec timeout = {0, 0};
+            timespec* timeo = 0;
 
-        // Calc timeout
-        if ( msecsTimeout > 0 ) {
-            quint32 msecsToWait = 0;
-            CALC_TIMEOUT(msecsTimeout, msecsToWait,
-                         "Wait for read failed: timeout expired",
-                         return false);
+            // Calc timeout
+            if ( msecsTimeout > 0 ) {
+                quint32 msecsToWait = 0;
+                CALC_TIMEOUT(msecsTimeout, msecsToWait,
+                             "Wait for read failed: timeout expired",
+                             return false);
+
+                // Set timeout
+                timeout.tv_sec = msecsToWait / 1000;
+                timeout.tv_nsec = (msecsToWait % 1000) * 1000000;
+                timeo = &timeout;
+            }
+            // Tests read queue state and returns immediately
+            else if ( msecsTimeout < 0 ) {
+                timeout.tv_sec = 0;
+                timeout.tv_nsec = 0;
+                timeo = &timeout;
+            }
 
-            // Set timeout
-            timeout.tv_sec = msecsToWait / 1000;
-            timeout.tv_nsec = (msecsToWait % 1000) * 1000000;
-            timeo = &timeout;
-        }
-        // Tests read queue state and returns immediately
-        else if ( msecsTimeout < 0 ) {
-            timeout.tv_sec = 0;
-            timeout.tv_nsec = 0;
-            timeo = &timeout;
-        }
+            // Do select
+            int res = ::ppoll(p, sizeof(p)/sizeof(p[0]), timeo, NULL);
+            if ( res == 0 ) {
+                WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                               IO_LOG("Wait for read failed: timeout expired!"));
+                if ( timeoutExpired )
+                    *timeoutExpired = true;
+                return false;
+            }
+            else if ( res < 0 && errno == EINTR ) {
+                LOG_MESSAGE(DBG_INFO, IO_LOG("Select has been interrupted"));
+                continue;
+            }
+            else if ( res < 0 ) {
+                WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Select failed (native error: %s)"),
+                               native_strerror(errBuff, ErrBuffSize));
+                return false;
+            }
 
-        // Do select
-        int res = ::ppoll(p, sizeof(p)/sizeof(p[0]), timeo, NULL);
-        if ( res == 0 ) {
-            WRITE_TRACE(DBG_FATAL,
-                        IO_LOG("Wait for read failed: timeout expired!"));
-            if ( timeoutExpired )
-                *timeoutExpired = true;
-            return false;
-        }
-        else if ( res < 0 && errno == EINTR ) {
-            LOG_MESSAGE(DBG_INFO, IO_LOG("Select has been interrupted"));
-            continue;
-        }
-        else if ( res < 0 ) {
-            WRITE_TRACE(DBG_FATAL, IO_LOG("Select failed (native error: %s)"),
-                        native_strerror(errBuff, ErrBuffSize));
-            return false;
+            // Check stop in progress
+            if (readMode != IOGracefulShutdownRead && p[1].revents & POLLIN) {
+                WRITE_TRACE(DBG_INFO, IO_LOG("Stop in progress for read thread"));
+                return false;
+            }
         }
+        else
+            ++m_pollSkips;
 
-        // Check stop in progress
-        if (readMode != IOGracefulShutdownRead && p[1].revents & POLLIN) {
-            WRITE_TRACE(DBG_INFO, IO_LOG("Stop in progress for read thread"));
-            return false;
-        }
+        // Make room in receive buffer
+        rawReserve( size - s );
 
         // Recv msg
         struct iovec iov[1];
@@ -894,8 +989,9 @@ bool SocketClientPrivate::read ( int sock, char* inBuf, quint32 size,
         ::memset( &msg, 0, sizeof(msg) );
 		::memset( cmsg, 0, sizeof(*cmsg));
 
-        iov->iov_base = m_rawBuffer.data() + s;
-        iov->iov_len = m_rawBuffer.capacity() - s;
+        iov->iov_base = m_rawBuffer.data() + m_rawBuffer.size();
+        iov->iov_len = m_rawReadAhead ?
+            m_rawBuffer.capacity() - m_rawBuffer.size() : size - s;
         msg.msg_iov = iov;
         msg.msg_iovlen = 1;
         msg.msg_name = 0;
@@ -916,24 +1012,34 @@ bool SocketClientPrivate::read ( int sock, char* inBuf, quint32 size,
         }
         else if ( readBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
             LOG_MESSAGE(DBG_INFO, IO_LOG("Read would block"));
+            doPoll = true;
             continue;
         }
         else if ( readBytes < 0 ) {
-            WRITE_TRACE(DBG_FATAL, IO_LOG("Read from socket failed "
-                               "(native error: %s)"),
-                        native_strerror(errBuff, ErrBuffSize));
+            WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Read from socket failed "
+                                  "(native error: %s)"),
+                           native_strerror(errBuff, ErrBuffSize));
 
             return false;
         }
+        else if ( KernelTls::isControlRecord(msg) ) {
+            WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("TLS alert or handshake record "
+                                             "has been received from kernel"));
+            return false;
+        }
 	m_rawBuffer.data_ptr()->size = m_rawBuffer.size() + readBytes;
 		if ( msg.msg_controllen == sizeof(*cmsg) ) {
 			lastfd = *(int *)CMSG_DATA(cmsg);
         }
-    } while ( readMode == IOContinuousRead );
-
-    wasRead = qMin((quint32)m_rawBuffer.size(), size);
-    ::memcpy(inBuf, m_rawBuffer.constData(), wasRead);
-    m_rawBuffer.remove(0, wasRead);
+        // Socket is drained, next time wait for data
+        doPoll = ((size_t)readBytes < iov->iov_len ||
+                  m_pollSkips >= MaxPollSkips);
+    } while ( readMode == IOContinuousRead || rawAvailable() == 0 );
+
+    // Consume from receive buffer without moving the rest of data
+    wasRead = qMin(rawAvailable(), size);
+    ::memcpy(inBuf, rawData(), wasRead);
+    rawConsume(wasRead);
     m_lastfd = lastfd;
     // We want to receive descriptor?
     if ( unixfd != 0 && *unixfd < 0 ) {
@@ -1511,6 +1617,143 @@ bool SocketClientPrivate::srv_sendRoutingTable (
     return true;
 }
 
+bool SocketClientPrivate::exchangeHandshakeFeatures (
+    int sock,
+    quint32 msecsTimeout )
+{
+    m_peerCompressionCodecs = 0;
+    m_featureFlags = 0;
+    m_peerFeatureFlags = 0;
+    {
+        QMutexLocker locker( &m_eventMutex );
+        m_binaryEventsNegotiated = false;
+    }
+    if ( ! IOPROTOCOL_COMPRESSION_SUPPORT(m_peerProtoVersion) )
+        return true;
+
+    bool kernelTls;
+    bool binaryEvents;
+    {
+        QMutexLocker locker( &m_eventMutex );
+        kernelTls = m_kernelTls;
+        binaryEvents = m_binaryEvents;
+    }
+    if ( binaryEvents )
+        m_featureFlags |= IOCommunication::HandshakeFeatures::BinaryEventsFlag;
+    // Upper layer does nothing till keys are installed,
+    // so it is attached before anybody relies on it
+    if ( kernelTls && ! m_useUnixSockets &&
+         KernelTls::supportedCiphers() != KernelTls::NoCipher &&
+         KernelTls::attachUpperLayer(sock) )
+        m_featureFlags |= IOCommunication::HandshakeFeatures::KernelTlsFlag;
+
+    // Both sides send features first, struct is small enough
+    // to fit socket buffer, so nobody blocks
+    {
+        IOCommunication::HandshakeFeatures features;
+        ::memset( &features, 0, sizeof(features) );
+        features.compressionCodecs = IOCompression::supportedCodecs();
+        features.flags = m_featureFlags;
+        IOSendJob::Result res = writeData( sock, &features, sizeof(features), msecsTimeout );
+        if ( res != IOSendJob::Success ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Handshake error: features send "
+                               "has been failed!"));
+            m_error = IOSender::HandshakeError;
+            return false;
+        }
+    }
+
+    // Read peer features
+    {
+        IOCommunication::HandshakeFeatures features;
+        bool res = readData( sock, reinterpret_cast<char*>(&features),
+                             sizeof(features), msecsTimeout );
+        if ( ! res ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Handshake error: features "
+                               "read failed!"));
+            m_error = IOSender::HandshakeError;
+            return false;
+        }
+        m_peerCompressionCodecs = features.compressionCodecs;
+        m_peerFeatureFlags = features.flags;
+    }
+
+    const quint32 flag = IOCommunication::HandshakeFeatures::BinaryEventsFlag;
+    if ( (m_featureFlags & flag) && (m_peerFeatureFlags & flag) ) {
+        QMutexLocker locker( &m_eventMutex );
+        m_binaryEventsNegotiated = true;
+    }
+
+    // SSL handshake follows, so TLS 1.3 secrets must be caught by it
+    const quint32 tlsFlag = IOCommunication::HandshakeFeatures::KernelTlsFlag;
+    if ( (m_featureFlags & tlsFlag) && (m_peerFeatureFlags & tlsFlag) &&
+         ! KernelTls::prepareSession(m_ssl, m_ctx == Cli_ServerContext) )
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS: can't prepare SSL "
+                                      "session, SSL is used"));
+
+    return true;
+}
+
+bool SocketClientPrivate::switchToKernelTls ( int sock, quint32 msecsTimeout )
+{
+    const quint32 flag = IOCommunication::HandshakeFeatures::KernelTlsFlag;
+    if ( ! (m_featureFlags & flag) || ! (m_peerFeatureFlags & flag) )
+        return true;
+
+    // Everything SSL has buffered must be consumed,
+    // otherwise record sequence numbers are unknown
+    KernelTls::SessionKeys keys;
+    bool localOk = ( BIO_pending(m_sslNetworkBio) == 0 &&
+                     BIO_ctrl_pending(m_sslBio) == 0 &&
+                     ! m_pendingInSSL &&
+                     SSL_pending(m_ssl) == 0 &&
+                     KernelTls::deriveKeys(m_ssl, m_ctx == Cli_ServerContext,
+                                           keys) );
+
+    // Agreement byte is the last plain byte on the wire in both
+    // directions, so it is read without read ahead: peer may start
+    // writing records just after it
+    const char agreement = localOk ? 1 : 0;
+    IOSendJob::Result res = writeData( sock, &agreement, sizeof(agreement),
+                                       msecsTimeout );
+    if ( res != IOSendJob::Success ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS: agreement send "
+                                      "has been failed!"));
+        m_error = IOSender::SSLHandshakeError;
+        return false;
+    }
+
+    char peerAgreement = 0;
+    quint32 wasRead = 0;
+    m_rawReadAhead = false;
+    bool readRes = read( sock, &peerAgreement, sizeof(peerAgreement),
+                         wasRead, IOContinuousRead, msecsTimeout );
+    m_rawReadAhead = true;
+    if ( ! readRes || wasRead != sizeof(peerAgreement) ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS: agreement read failed!"));
+        m_error = IOSender::SSLHandshakeError;
+        return false;
+    }
+
+    if ( ! localOk || ! peerAgreement ) {
+        LOG_MESSAGE(DBG_INFO, IO_LOG("Kernel TLS is not agreed, "
+                                     "SSL is used"));
+        return true;
+    }
+
+    // Peer has switched already, there is no way back
+    if ( rawAvailable() != 0 || ! KernelTls::installKeys(sock, keys) ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS: keys install failed "
+                                      "(native error: %d)"), errno);
+        m_error = IOSender::SSLHandshakeError;
+        return false;
+    }
+
+    QMutexLocker locker( &m_eventMutex );
+    m_kernelTlsActive = true;
+    return true;
+}
+
 bool SocketClientPrivate::connectToHost ( int& outSockHandle, quint32 connTimeout )
 {
     const size_t ErrBuffSize = 256;
@@ -2070,6 +2313,12 @@ void SocketClientPrivate::doJob ()
     AtomicWrite64(&m_stat.receivedPackages, 0);
     AtomicWrite64(&m_stat.sentBytes, 0);
     AtomicWrite64(&m_stat.receivedBytes, 0);
+    AtomicWrite64(&m_stat.compressionRawBytes, 0);
+    AtomicWrite64(&m_stat.compressionWireBytes, 0);
+    AtomicWrite64(&m_stat.compressionUsecs, 0);
+    AtomicWrite64(&m_stat.decompressionRawBytes, 0);
+    AtomicWrite64(&m_stat.decompressionWireBytes, 0);
+    AtomicWrite64(&m_stat.decompressionUsecs, 0);
 
     // Check if this client ctx can be reused:
     //   sock handle must be droped after first start, but
@@ -2325,6 +2574,13 @@ void SocketClientPrivate::doJob ()
                 goto cleanup_and_disconnect;
             }
 
+            handshaked = exchangeHandshakeFeatures( sockHandle, msecsToWait );
+            if ( ! handshaked ) {
+                WRITE_TRACE(DBG_FATAL, IO_LOG("Handshake is wrong! "
+                                   "Connection will be closed!"));
+                goto cleanup_and_disconnect;
+            }
+
             // Calc timeout
             CALC_TIMEOUT(m_connTimeout, msecsToWait,
                          "Connection timeout expired!",
@@ -2336,6 +2592,12 @@ void SocketClientPrivate::doJob ()
                 WRITE_TRACE(DBG_FATAL, IO_LOG("SSL handshake failed!"));
                 goto cleanup_and_disconnect;
             }
+
+            handshaked = switchToKernelTls( sockHandle, msecsToWait );
+            if ( ! handshaked ) {
+                WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS switch failed!"));
+                goto cleanup_and_disconnect;
+            }
         }
     }
     // Client context
@@ -2382,6 +2644,12 @@ void SocketClientPrivate::doJob ()
             goto cleanup_and_disconnect;
         }
 
+        handshaked = exchangeHandshakeFeatures( sockHandle, msecsToWait );
+        if ( ! handshaked ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Handshake failed!"));
+            goto cleanup_and_disconnect;
+        }
+
         // Calc timeout
         CALC_TIMEOUT(m_connTimeout, msecsToWait,
                      "Connection timeout expired!",
@@ -2393,6 +2661,12 @@ void SocketClientPrivate::doJob ()
             WRITE_TRACE(DBG_FATAL, IO_LOG("SSL handshake failed!"));
             goto cleanup_and_disconnect;
         }
+
+        handshaked = switchToKernelTls( sockHandle, msecsToWait );
+        if ( ! handshaked ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Kernel TLS switch failed!"));
+            goto cleanup_and_disconnect;
+        }
         }
     }
     else
@@ -2416,11 +2690,21 @@ void SocketClientPrivate::doJob ()
 
         // Start write thread
         {
+            IOCompression::Codec codec;
+            bool kernelTls;
+            {
+                QMutexLocker locker( &m_eventMutex );
+                codec = IOCompression::chooseCodec( m_compressionCodecs &
+                                                    m_peerCompressionCodecs );
+                kernelTls = m_kernelTlsActive;
+            }
             bool wrStarted = m_writeThread.startWriteThread( sockHandle,
                                                              m_currConnectionUuid,
                                                              m_peerConnectionUuid,
                                                              m_peerProtoVersion,
-                                                             m_peerRoutingTable
+                                                             m_peerRoutingTable,
+                                                             codec,
+                                                             kernelTls
 #ifndef _WIN_ // Unix
                                                              , m_eventPipes
 #endif
@@ -2479,6 +2763,13 @@ void SocketClientPrivate::doJob ()
         }
     }
 
+    //
+    // Server connection can be read by the reactor: all further
+    // reading is driven by reactor events and this thread is finished.
+    //
+    if ( reactorAttach(sockHandle, heartBeatSupport, lastHeartBeatMark) )
+        return;
+
     ///////////////////////////////////////////////////////////////////////////
     //
     // Main client/server context job loop
@@ -2488,6 +2779,14 @@ void SocketClientPrivate::doJob ()
         if ( cli_doSSLRehandshake ) {
             cli_doSSLRehandshake = false;
 
+            // Peer must not detach connection with kernel TLS
+            if ( m_kernelTlsActive ) {
+                WRITE_TRACE(DBG_FATAL,
+                            IO_LOG("Detach of connection with kernel TLS "
+                                   "is requested. Stop connection."));
+                goto cleanup_and_disconnect;
+            }
+
             // Send detach response and pause writing
             bool res = m_writeThread.sendDetachResponseAndPauseWriting();
             if ( ! res ) {
@@ -2691,157 +2990,197 @@ void SocketClientPrivate::doJob ()
             }
         }
 
-        LOG_MESSAGE(DBG_DEBUG,
-                    IO_LOG("Package recieved from server : packageType=%d"),
-                    p->header.type);
+        // Restore compressed buffers
+        if ( ! IOCompression::decompressPackage(p, m_stat) ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Can't decompress package! "
+                               "Connection will be closed!"));
+            goto cleanup_and_disconnect;
+        }
+
+        handleReceivedPackage( p, unixfd, sockHandle, heartBeatSupport,
+                               lastHeartBeatMark, cli_doSSLRehandshake,
+                               cli_detach, srv_detaching );
+
+        // Stop client if detaching
+        if ( m_ctx == Cli_ServerContext && srv_detaching )
+            goto cleanup_and_disconnect;
+
+	if (!p->limiter.isNull()) {
+		p.reset(NULL);
+		m_limiter->wait();
+	}
+    }
+
+cleanup_and_disconnect:
+    finalizeJob( sockHandle, srv_detaching, cli_detach );
+}
 
-        // Increment statistics value
-        AtomicInc64(&m_stat.receivedPackages);
+void SocketClientPrivate::handleReceivedPackage (
+    const SmartPtr<IOPackage>& p,
+    int unixfd,
+    int sockHandle,
+    bool heartBeatSupport,
+    IOService::TimeMark& lastHeartBeatMark,
+    bool& cli_doSSLRehandshake,
+    bool& cli_detach,
+    bool& srv_detaching )
+{
+    LOG_MESSAGE(DBG_DEBUG,
+                IO_LOG("Package recieved from server : packageType=%d"),
+                p->header.type);
 
-        // Check that is not a management pkg
-        if ( p->header.type != IOCommunicationMngPackage::HeartBeat &&
-             ( (m_ctx == Cli_ClientContext &&
+    // Increment statistics value
+    AtomicInc64(&m_stat.receivedPackages);
+
+    // Check that is not a management pkg
+    if ( p->header.type != IOCommunicationMngPackage::HeartBeat &&
+         ( (m_ctx == Cli_ClientContext &&
 		p->header.type != IOCommunicationMngPackage::DetachClientRequest &&
 		p->header.type != IOCommunicationMngPackage::AttachClient &&
-        	p->header.type != IOCommunicationMngPackage::DetachBothSidesRequest) ||
-               (m_ctx == Cli_ServerContext && p->header.type !=
-                IOCommunicationMngPackage::DetachClientResponse) ) ) {
+    	p->header.type != IOCommunicationMngPackage::DetachBothSidesRequest) ||
+           (m_ctx == Cli_ServerContext && p->header.type !=
+            IOCommunicationMngPackage::DetachClientResponse) ) ) {
 
-            // Package callback
-            {
-                if (p->limiter.isNull())
-                        p->limiter = m_limiter.toWeakRef();
+        // Package callback
+        {
+            if (p->limiter.isNull())
+                    p->limiter = m_limiter.toWeakRef();
 
-                m_limiter->put(p->buffersSize());
+            m_limiter->put(p->buffersSize());
 
-                CALLBACK_MARK;
+            CALLBACK_MARK;
 
-                m_rcvSndListener->onPackageReceived( this,
-                                                     m_peerConnectionUuid, p );
+            m_rcvSndListener->onPackageReceived( this,
+                                                 m_peerConnectionUuid, p );
 
-                WARN_IF_CALLBACK_TOOK_MUCH_TIME;
-            }
+            WARN_IF_CALLBACK_TOOK_MUCH_TIME;
         }
+    }
 
-        //
-        // Check some internal types
-        //
+    //
+    // Check some internal types
+    //
 
-        if ( p->header.type == IOCommunicationMngPackage::HeartBeat ) {
-            LOG_MESSAGE(DBG_DEBUG, IO_LOG("Heart beat has been received!"));
-            if ( ! heartBeatSupport )
-                WRITE_TRACE(DBG_WARNING,
-                            IO_LOG("Warning: heart beat package has been "
-                                   "received, but peer does not support it!"));
-            else
-                IOService::timeMark(lastHeartBeatMark);
+    if ( p->header.type == IOCommunicationMngPackage::HeartBeat ) {
+        LOG_MESSAGE(DBG_DEBUG, IO_LOG("Heart beat has been received!"));
+        if ( ! heartBeatSupport )
+            WRITE_TRACE(DBG_WARNING,
+                        IO_LOG("Warning: heart beat package has been "
+                               "received, but peer does not support it!"));
+        else
+            IOService::timeMark(lastHeartBeatMark);
+    }
+    else if ( p->header.type == IOCommunicationMngPackage::AttachClient ) {
+        IOCommunication::DetachedClient detachedClient =
+            IOCommunication::parseAttachClientPackage( p, unixfd );
+        if ( ! detachedClient.isValid() ) {
+            LOG_MESSAGE(DBG_WARNING,
+                        IO_LOG("Can't parse attach client package"));
         }
-        else if ( p->header.type == IOCommunicationMngPackage::AttachClient ) {
-            IOCommunication::DetachedClient detachedClient =
-                IOCommunication::parseAttachClientPackage( p, unixfd );
-            if ( ! detachedClient.isValid() ) {
-                LOG_MESSAGE(DBG_WARNING,
-                            IO_LOG("Can't parse attach client package"));
-            }
-            else {
-                DetachedClientState* state =
-                    reinterpret_cast<DetachedClientState*>(
-                                                     detachedClient->m_state);
+        else {
+            DetachedClientState* state =
+                reinterpret_cast<DetachedClientState*>(
+                                                 detachedClient->m_state);
 
-                // Detach client callback
-                {
-                    CALLBACK_MARK;
-                    m_rcvSndListener->onDetachedClientReceived(
-                                                     this,
-                                                     m_peerConnectionUuid,
-                                                     state->data.additionalPkg,
-                                                     detachedClient );
-                    WARN_IF_CALLBACK_TOOK_MUCH_TIME;
-                }
+            // Detach client callback
+            {
+                CALLBACK_MARK;
+                m_rcvSndListener->onDetachedClientReceived(
+                                                 this,
+                                                 m_peerConnectionUuid,
+                                                 state->data.additionalPkg,
+                                                 detachedClient );
+                WARN_IF_CALLBACK_TOOK_MUCH_TIME;
             }
         }
-        else if ( p->header.type ==
-                  IOCommunicationMngPackage::DetachClientRequest ) {
-            if ( m_ctx != Cli_ClientContext )
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Error: received client management package! "
-                                   "Running in not client context!"));
-            else
-                cli_doSSLRehandshake = true;
+    }
+    else if ( p->header.type ==
+              IOCommunicationMngPackage::DetachClientRequest ) {
+        if ( m_ctx != Cli_ClientContext )
+            WRITE_TRACE(DBG_FATAL,
+                        IO_LOG("Error: received client management package! "
+                               "Running in not client context!"));
+        else
+            cli_doSSLRehandshake = true;
+    }
+    else if ( p->header.type ==
+              IOCommunicationMngPackage::DetachBothSidesRequest ) {
+        if ( m_ctx != Cli_ClientContext )
+            WRITE_TRACE(DBG_FATAL,
+                        IO_LOG("Error: received client management package! "
+                               "Running in not client context!"));
+        else {
+            cli_doSSLRehandshake = true;
+            cli_detach = true;
+            m_srvCtx.m_isDetaching = true;
         }
-        else if ( p->header.type ==
-                  IOCommunicationMngPackage::DetachBothSidesRequest ) {
-            if ( m_ctx != Cli_ClientContext )
+    }
+    else if ( p->header.type ==
+              IOCommunicationMngPackage::DetachClientResponse ) {
+        if ( m_ctx != Cli_ServerContext )
+            WRITE_TRACE(DBG_FATAL,
+                        IO_LOG("Received server management package! "
+                               "Running in not server context!"));
+        else {
+            IOCommunication::DetachedClient detachedClient =
+                srv_doDetach( sockHandle );
+
+            if ( ! detachedClient.isValid() )
                 WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Error: received client management package! "
-                                   "Running in not client context!"));
+                            IO_LOG("Can't create detached state! "
+                                   "Close connecion"));
             else {
-                cli_doSSLRehandshake = true;
-                cli_detach = true;
-                m_srvCtx.m_isDetaching = true;
+                // Detach client callback
+                CALLBACK_MARK;
+                m_rcvSndListener->srv_onDetachClient( this,
+                                                      m_peerConnectionUuid,
+                                                      detachedClient );
+                WARN_IF_CALLBACK_TOOK_MUCH_TIME;
             }
-        }
-        else if ( p->header.type ==
-                  IOCommunicationMngPackage::DetachClientResponse ) {
-            if ( m_ctx != Cli_ServerContext )
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Received server management package! "
-                                   "Running in not server context!"));
-            else {
-                IOCommunication::DetachedClient detachedClient =
-                    srv_doDetach( sockHandle );
 
-                if ( ! detachedClient.isValid() )
-                    WRITE_TRACE(DBG_FATAL,
-                                IO_LOG("Can't create detached state! "
-                                       "Close connecion"));
-                else {
-                    // Detach client callback
-                    CALLBACK_MARK;
-                    m_rcvSndListener->srv_onDetachClient( this,
-                                                          m_peerConnectionUuid,
-                                                          detachedClient );
-                    WARN_IF_CALLBACK_TOOK_MUCH_TIME;
-                }
-
-                // Client must be stopped
-                srv_detaching = true;
-            }
+            // Client must be stopped
+            srv_detaching = true;
         }
+    }
 
-        // Check if response and not rehandshake
-        if ( ! cli_doSSLRehandshake && p->isResponsePackage() ) {
-            SmartPtr<IOSendJob> job = m_jobManager->findJobByResponsePackage(
-                                                     m_writeThread.getJobPool(),
-                                                     p );
+    // Check if response and not rehandshake
+    if ( ! cli_doSSLRehandshake && p->isResponsePackage() ) {
+        SmartPtr<IOSendJob> job = m_jobManager->findJobByResponsePackage(
+                                                 m_writeThread.getJobPool(),
+                                                 p );
 
-            // Find valid job
-            if ( job.isValid() ) {
-                // Response package callback
-                CALLBACK_MARK;
-                m_rcvSndListener->onResponsePackageReceived(
-                                                     this,
-                                                     m_peerConnectionUuid,
-                                                     job, p );
-                WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+        // Find valid job
+        if ( job.isValid() ) {
+            // Response package callback
+            CALLBACK_MARK;
+            m_rcvSndListener->onResponsePackageReceived(
+                                                 this,
+                                                 m_peerConnectionUuid,
+                                                 job, p );
+            WARN_IF_CALLBACK_TOOK_MUCH_TIME;
 
-                job->wakeResponseWaitings( IOSendJob::Success,
-                                           m_peerConnectionUuid,
-                                           p );
-            }
+            job->wakeResponseWaitings( IOSendJob::Success,
+                                       m_peerConnectionUuid,
+                                       p );
         }
+    }
+}
 
-        // Stop client if detaching
-        if ( m_ctx == Cli_ServerContext && srv_detaching )
-            goto cleanup_and_disconnect;
-
-	if (!p->limiter.isNull()) {
-		p.reset(NULL);
-		m_limiter->wait();
-	}
+void SocketClientPrivate::finalizeJob ( int& sockHandle,
+                                       bool srv_detaching,
+                                       bool cli_detach )
+{
+    //
+    // Reading is driven by the reactor: stop events and resume callbacks
+    //
+    if ( m_reactorThr >= 0 ) {
+        m_limiter->cancelWait();
+        m_reactor->detach( m_reactorThr, this );
+        m_reactorThr = -1;
+        m_plainBuffer.clear();
+        m_rdPkg = SmartPtr<IOPackage>();
     }
 
-cleanup_and_disconnect:
     //
     // Finalize client thread
     //
@@ -2858,6 +3197,9 @@ cleanup_and_disconnect:
         m_state = IOSender::Disconnected;
         m_ioStateWait.wakeAll();
 
+        // Socket is closed together with installed keys
+        m_kernelTlsActive = false;
+
         // Mark as stopping
         m_threadState = ThreadIsStopping;
 
@@ -2931,6 +3273,7 @@ cleanup_and_disconnect:
         sockHandle = -1;
         m_lastfd = -1;
         m_rawBuffer.clear();
+        m_rawPos = 0;
     }
 
 #endif
@@ -2996,7 +3339,579 @@ cleanup_and_disconnect:
     // Unlock
     m_eventMutex.unlock();
 
-    return;
+}
+
+void SocketClientPrivate::setReactor ( SocketReactor* reactor )
+{
+    QMutexLocker locker( &m_eventMutex );
+    m_reactor = reactor;
+}
+
+void SocketClientPrivate::setCompressionCodecs ( quint32 codecs )
+{
+    QMutexLocker locker( &m_eventMutex );
+    m_compressionCodecs = codecs;
+}
+
+void SocketClientPrivate::setKernelTls ( bool enabled )
+{
+    QMutexLocker locker( &m_eventMutex );
+    m_kernelTls = enabled;
+}
+
+void SocketClientPrivate::setBinaryEvents ( bool enabled )
+{
+    QMutexLocker locker( &m_eventMutex );
+    m_binaryEvents = enabled;
+}
+
+bool SocketClientPrivate::binaryEventsNegotiated () const
+{
+    QMutexLocker locker( &m_eventMutex );
+    return m_binaryEventsNegotiated;
+}
+
+bool SocketClientPrivate::kernelTlsActive () const
+{
+    QMutexLocker locker( &m_eventMutex );
+    return m_kernelTlsActive;
+}
+
+void SocketClientPrivate::setLimiterBudget (
+    const QSharedPointer<IOPackage::Budget>& budget )
+{
+    QMutexLocker locker( &m_eventMutex );
+    m_limiter = QSharedPointer<IOPackage::Limiter>(
+        new IOPackage::Limiter(budget) );
+}
+
+bool SocketClientPrivate::isReadingThread () const
+{
+    return QThread::currentThread() == this ||
+        SocketReactor::currentHandler() ==
+            static_cast<const SocketReactorHandler*>(this);
+}
+
+bool SocketClientPrivate::reactorAttach ( int sock,
+                                          bool heartBeatSupport,
+                                          IOService::TimeMark lastHeartBeatMark )
+{
+#ifndef _WIN_
+    if ( m_ctx != Cli_ServerContext || m_reactor == 0 ||
+         ! m_reactor->isStarted() )
+        return false;
+
+    // Reading state is taken from the reading thread
+    m_reactorSock = sock;
+    m_reactorPaused = false;
+    AtomicWrite( &m_reactorResumed, 0 );
+    m_plainBuffer.clear();
+    m_rdPkg = SmartPtr<IOPackage>();
+    m_rdHeartBeatSupport = heartBeatSupport;
+    m_rdLastHeartBeatMark = lastHeartBeatMark;
+    m_rdSrvDetaching = false;
+
+    // Thread index must be known before the first event
+    m_reactorThr = m_reactor->selectThread();
+    const int fds[] = { sock, m_eventPipes[0] };
+    if ( ! m_reactor->attach(m_reactorThr, this, fds,
+                             sizeof(fds)/sizeof(fds[0])) ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't attach connection to the "
+                                      "reactor, continue reading in own "
+                                      "thread"));
+        m_reactorThr = -1;
+        return false;
+    }
+
+    LOG_MESSAGE(DBG_INFO, IO_LOG("Reading is driven by reactor thread #%d"),
+                m_reactorThr);
+
+    // Handshake could read ahead some data: parse it at once
+    m_reactor->kick( m_reactorThr, sock );
+    return true;
+#else
+    Q_UNUSED(sock);
+    Q_UNUSED(heartBeatSupport);
+    Q_UNUSED(lastHeartBeatMark);
+    return false;
+#endif
+}
+
+void SocketClientPrivate::reactorResume ( void* context )
+{
+    // Is called from IOPackage::Limiter::get, i.e. from any thread.
+    // Socket is enabled again by the reactor thread itself.
+    SocketClientPrivate* d = reinterpret_cast<SocketClientPrivate*>(context);
+    AtomicWrite( &d->m_reactorResumed, 1 );
+    d->m_reactor->kick( d->m_reactorThr, d->m_reactorSock );
+}
+
+void SocketClientPrivate::onReactorEvent ( int fd )
+{
+#ifndef _WIN_
+    bool res = true;
+
+    if ( fd == m_eventPipes[0] ) {
+        WRITE_TRACE(DBG_INFO, IO_LOG("Stop in progress for reactor reading"));
+        res = false;
+    }
+    else if ( m_reactorPaused ) {
+        // Limiter has been drained, continue reading
+        if ( AtomicSwap(&m_reactorResumed, 0) ) {
+            m_reactorPaused = false;
+            res = m_reactor->enable( m_reactorThr, m_reactorSock, true ) &&
+                reactorRead();
+        }
+    }
+    else
+        res = reactorRead();
+
+    if ( res && ! m_rdSrvDetaching && m_threadState == ThreadIsStarted )
+        return;
+
+    // Connection is finished.
+    // NOTE: this can be destroyed just after this call
+    finalizeJob( m_reactorSock, m_rdSrvDetaching, false );
+#else
+    Q_UNUSED(fd);
+#endif
+}
+
+void SocketClientPrivate::onReactorTimer ()
+{
+#ifndef _WIN_
+    // Paused connection is not read, so heart beats wait in the socket
+    if ( ! m_rdHeartBeatSupport || m_reactorPaused )
+        return;
+
+    IOService::TimeMark nowMark = 0;
+    IOService::timeMark(nowMark);
+    if ( IOService::msecsDiffTimeMark(m_rdLastHeartBeatMark, nowMark) <
+         (quint32)IOCommunication::IOHeartBeatReceiveTimeout )
+        return;
+
+    // As the read thread does, read everything pending without blocking:
+    // connection is dropped only if there is nothing to read
+    qint64 receivedBytes = AtomicRead64( &m_stat.receivedBytes );
+    bool res = reactorRead();
+    if ( res && ! m_rdSrvDetaching && m_threadState == ThreadIsStarted &&
+         AtomicRead64(&m_stat.receivedBytes) == receivedBytes ) {
+        m_error = IOSender::HeartBeatTimeoutError;
+        WRITE_TRACE(DBG_FATAL,
+                    IO_LOG("Error: no heart beat was received for "
+                           "%d msecs. Connection problems?"),
+                    IOCommunication::IOHeartBeatReceiveTimeout);
+        res = false;
+    }
+
+    if ( res && ! m_rdSrvDetaching && m_threadState == ThreadIsStarted )
+        return;
+
+    // Connection is finished.
+    // NOTE: this can be destroyed just after this call
+    finalizeJob( m_reactorSock, m_rdSrvDetaching, false );
+#endif
+}
+
+bool SocketClientPrivate::reactorRead ()
+{
+#ifndef _WIN_
+    enum {
+        ErrBuffSize = 1<<8,
+        // Give a chance to other connections of the reactor thread
+        MaxRecvIterations = 16
+    };
+    char errBuff[ ErrBuffSize ];
+
+    bool drained = false;
+    for ( int i = 0; ; ++i ) {
+        // Parse everything what was received
+        bool suspended = false;
+        if ( ! reactorProcess(suspended) )
+            return false;
+        // Socket is still readable, so level-triggered
+        // reactor will dispatch it again
+        if ( suspended || drained || i == MaxRecvIterations )
+            return true;
+
+        // Make room in receive buffer
+        rawReserve( RawBufferMinRecv );
+        quint32 s = m_rawBuffer.size();
+
+        // Recv msg
+        struct iovec iov[1];
+        struct msghdr msg;
+
+        char cmsg_data[sizeof(struct cmsghdr) + sizeof(int) ];
+
+        struct cmsghdr *cmsg = (struct cmsghdr*)cmsg_data;
+
+        ::memset( &msg, 0, sizeof(msg) );
+        ::memset( cmsg, 0, sizeof(*cmsg));
+
+        iov->iov_base = m_rawBuffer.data() + s;
+        iov->iov_len = m_rawBuffer.capacity() - s;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 1;
+        msg.msg_name = 0;
+        msg.msg_namelen = 0;
+        msg.msg_control = (caddr_t)cmsg;
+        msg.msg_controllen = sizeof(cmsg_data);
+
+        ssize_t readBytes = ::recvmsg( m_reactorSock, &msg, MSG_DONTWAIT );
+
+        if ( readBytes == 0 ) {
+            WRITE_TRACE(DBG_INFO, IO_LOG("Socket graceful shutdown detected. "
+                                         "No worries, everything goes fine."));
+            return false;
+        }
+        else if ( readBytes < 0 && errno == EINTR ) {
+            LOG_MESSAGE(DBG_INFO, IO_LOG("Read has been interrupted"));
+            continue;
+        }
+        else if ( readBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+            return true;
+        }
+        else if ( readBytes < 0 ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Read from socket failed "
+                               "(native error: %s)"),
+                        native_strerror(errBuff, ErrBuffSize));
+            return false;
+        }
+        else if ( KernelTls::isControlRecord(msg) ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("TLS alert or handshake record "
+                                          "has been received from kernel"));
+            return false;
+        }
+        m_rawBuffer.data_ptr()->size = m_rawBuffer.size() + readBytes;
+        if ( msg.msg_controllen == sizeof(*cmsg) ) {
+            m_lastfd = *(int *)CMSG_DATA(cmsg);
+        }
+        drained = ((size_t)readBytes < iov->iov_len);
+
+        // Append read bytes to statistics
+        AtomicAdd64(&m_stat.receivedBytes, readBytes);
+    }
+#else
+    return false;
+#endif
+}
+
+bool SocketClientPrivate::reactorProcess ( bool& suspended )
+{
+    bool res = true;
+    suspended = false;
+
+    // Decode frames one by one: detaching must leave
+    // not decoded data in raw buffer
+    while ( 1 ) {
+        if ( ! reactorParse(suspended) ) {
+            res = false;
+            break;
+        }
+        if ( suspended )
+            break;
+
+        bool progress = false;
+        if ( ! reactorDecode(progress) ) {
+            res = false;
+            break;
+        }
+        if ( ! progress )
+            break;
+    }
+
+    // Rewind receive buffer if everything is consumed
+    rawConsume( 0 );
+    return res;
+}
+
+bool SocketClientPrivate::reactorDecode ( bool& progress )
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+
+    progress = false;
+
+    const char* raw = m_rawBuffer.constData() + m_rawPos;
+    quint32 rawSize = m_rawBuffer.size() - m_rawPos;
+
+    // Read SSL header
+    if ( m_remainToRead == 0 ) {
+        if ( rawSize < sizeof(m_header) )
+            return true;
+
+        ::memcpy( &m_header, raw, sizeof(m_header) );
+        raw += sizeof(m_header);
+        rawSize -= sizeof(m_header);
+        m_rawPos += sizeof(m_header);
+        progress = true;
+
+        m_remainToRead = ntohs(m_header.sslDataLength);
+        m_encryptedDataToRead = (m_header.type != 0xff);
+        m_newHeader = m_encryptedDataToRead;
+
+        if ( ! sslHeaderCheck(m_header) ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("SSL header is wrong!"));
+            return false;
+        }
+    }
+
+    quint32 toDecode = qMin( (quint32)m_remainToRead, rawSize );
+    if ( toDecode == 0 )
+        return true;
+
+    // Plain data
+    if ( ! m_encryptedDataToRead ) {
+        m_plainBuffer.append( raw, toDecode );
+        m_rawPos += toDecode;
+        m_remainToRead -= toDecode;
+        progress = true;
+        return true;
+    }
+
+    // SSL data
+
+    // Write header to SSL
+    if ( m_newHeader ) {
+        qint32 written = BIO_write( m_sslNetworkBio,
+                                    &m_header, sizeof(m_header));
+        if ( written <= 0 ) {
+            ERR_error_string_n( ERR_get_error(), errBuff,
+                                ErrBuffSize );
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Write to SSL failed "
+                               "(SSL error: %s"), errBuff);
+            return false;
+        }
+        else if ( written != (qint32)sizeof(m_header) ) {
+            WRITE_TRACE(DBG_FATAL,
+                        IO_LOG("Write to SSL failed: must be "
+                               "written: %d, but was %d"),
+                        (qint32)sizeof(m_header), written);
+            return false;
+        }
+        m_newHeader = false;
+    }
+
+    // Get pointer to buffer
+    char* buff = 0;
+    qint32 wrGuarantee = BIO_nwrite0(m_sslNetworkBio, &buff);
+    if ( wrGuarantee <= 0 ) {
+        // SSL input is full, decode what is there and try again
+        if ( ! reactorDrainSSL(progress) )
+            return false;
+        wrGuarantee = BIO_nwrite0(m_sslNetworkBio, &buff);
+        if ( wrGuarantee <= 0 ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Write to SSL failed: "
+                                          "SSL buffer is full"));
+            return false;
+        }
+    }
+
+    toDecode = qMin( toDecode, (quint32)wrGuarantee );
+    ::memcpy( buff, raw, toDecode );
+
+    // Advance buffer
+    qint32 written = BIO_nwrite(m_sslNetworkBio, &buff, toDecode);
+    Q_ASSERT((quint32)written == toDecode);
+    Q_UNUSED(written);
+
+    m_rawPos += toDecode;
+    m_remainToRead -= toDecode;
+    progress = true;
+
+    return reactorDrainSSL( progress );
+}
+
+bool SocketClientPrivate::reactorDrainSSL ( bool& progress )
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+    // Max size of SSL record
+    enum { ChunkSize = 16384 };
+
+    // Lock
+    QMutexLocker locker( m_writeThread.getSSLMutex() );
+
+    while ( 1 ) {
+        int size = m_plainBuffer.size();
+        m_plainBuffer.resize( size + ChunkSize );
+        qint32 readBytes = BIO_read( m_sslSSLBio, m_plainBuffer.data() + size,
+                                     ChunkSize );
+        m_plainBuffer.resize( size + qMax(readBytes, 0) );
+
+        if ( readBytes > 0 ) {
+            progress = true;
+            continue;
+        }
+        else if ( readBytes == 0 ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("SSL startup failed"));
+            return false;
+        }
+
+        unsigned long err = ERR_get_error();
+        if ( !BIO_should_retry(m_sslSSLBio) ) {
+            ERR_error_string_n( err, errBuff, ErrBuffSize );
+            WRITE_TRACE(DBG_FATAL,
+                        IO_LOG("Error in SSL (SSL error: %s)"),
+                        errBuff);
+            return false;
+        }
+
+        // If we have smth to write -- write!
+        if ( BIO_pending(m_sslNetworkBio) > 0 )
+            // Wake up writer
+            m_writeThread.wakeSSLWriter();
+
+        break;
+    }
+
+    m_pendingInSSL = false;
+    return true;
+}
+
+bool SocketClientPrivate::reactorParse ( bool& suspended )
+{
+    const char* data = m_plainBuffer.constData();
+    quint32 size = m_plainBuffer.size();
+    quint32 pos = 0;
+    bool res = true;
+
+    suspended = false;
+
+    while ( 1 ) {
+        // Create empty package with received header
+        if ( ! m_rdPkg.isValid() ) {
+            if ( size - pos < sizeof(IOPackage::PODHeader) )
+                break;
+
+            IOPackage::PODHeader header;
+            ::memcpy( &header, data + pos, sizeof(header) );
+
+            // Check header CRC16
+            if ( header.crc16 != IOPackage::headerChecksumCRC16(header) ) {
+                WRITE_TRACE(DBG_FATAL, IO_LOG("Package header CRC16 is wrong! "
+                                   "Connection will be closed!"));
+                res = false;
+                break;
+            }
+
+            m_rdPkg = IOPackage::createInstance( header.type,
+                                                 header.buffersNumber );
+            if ( ! m_rdPkg.isValid() ) {
+                WRITE_TRACE(DBG_FATAL, IO_LOG("Can't allocate memory!"));
+                res = false;
+                break;
+            }
+            ::memcpy( &m_rdPkg->header, &header, sizeof(header) );
+            pos += sizeof(header);
+
+            m_rdDataReceived = (header.buffersNumber == 0);
+            m_rdBuffIdx = 0;
+            m_rdBuffOffset = 0;
+            m_rdUnixfd = m_lastfd;
+        }
+
+        // Read data for buffers
+        if ( ! m_rdDataReceived ) {
+            if ( size - pos < IODATASIZE(m_rdPkg) )
+                break;
+
+            ::memcpy( IODATAMEMBER(m_rdPkg), data + pos,
+                      IODATASIZE(m_rdPkg) );
+            pos += IODATASIZE(m_rdPkg);
+
+            if (IOPackage::SIZE_LIMIT < m_rdPkg->fullPackageSize()) {
+                m_error = IOSender::PacketTooLong;
+                WRITE_TRACE(DBG_FATAL,
+                            IO_LOG("Error: packet length %d "
+                                   "exceeds the limit %d"),
+                            m_rdPkg->fullPackageSize(), IOPackage::SIZE_LIMIT);
+                res = false;
+                break;
+            }
+            m_rdDataReceived = true;
+        }
+
+        // Read buffers
+        IOPackage::PODData* pkgData = IODATAMEMBER(m_rdPkg);
+        for ( ; m_rdBuffIdx < m_rdPkg->header.buffersNumber; ++m_rdBuffIdx ) {
+            quint32 bufferSize = pkgData[m_rdBuffIdx].bufferSize;
+            if ( bufferSize == 0 )
+                continue;
+
+            SmartPtr<char>& buff = m_rdPkg->buffers[m_rdBuffIdx];
+            if ( ! buff.isValid() ) {
+                buff = IOPackage::allocPODBuffer( pkgData[m_rdBuffIdx] );
+                if ( ! buff.isValid() ) {
+                    WRITE_TRACE(DBG_FATAL, IO_LOG("Can't allocate memory!"));
+                    res = false;
+                    break;
+                }
+            }
+
+            quint32 toCopy = qMin( bufferSize - m_rdBuffOffset, size - pos );
+            ::memcpy( buff.getImpl() + m_rdBuffOffset, data + pos, toCopy );
+            pos += toCopy;
+            m_rdBuffOffset += toCopy;
+
+            // Wait for the rest
+            if ( m_rdBuffOffset < bufferSize )
+                break;
+            m_rdBuffOffset = 0;
+        }
+        if ( ! res || m_rdBuffIdx < m_rdPkg->header.buffersNumber )
+            break;
+
+        // Package is completely received
+        SmartPtr<IOPackage> p = m_rdPkg;
+        m_rdPkg = SmartPtr<IOPackage>();
+
+#ifndef _WIN_
+        if ( p->header.type == IOCommunicationMngPackage::AttachClient ) {
+            if ( m_rdUnixfd == -1 ) {
+                WRITE_TRACE(DBG_FATAL,
+                            IO_LOG("Attach client package was recieved, "
+                                   "but unix file descriptor is invalid!"));
+            }
+        }
+#endif
+
+        // Restore compressed buffers
+        if ( ! IOCompression::decompressPackage(p, m_stat) ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Can't decompress package! "
+                               "Connection will be closed!"));
+            res = false;
+            break;
+        }
+
+        bool cli_doSSLRehandshake = false;
+        bool cli_detach = false;
+        handleReceivedPackage( p, m_rdUnixfd, m_reactorSock,
+                               m_rdHeartBeatSupport, m_rdLastHeartBeatMark,
+                               cli_doSSLRehandshake, cli_detach,
+                               m_rdSrvDetaching );
+
+        // Stop client if detaching or stop is in progress
+        if ( m_rdSrvDetaching || m_threadState != ThreadIsStarted ) {
+            suspended = true;
+            break;
+        }
+
+        // Pause reading until package consumers catch up
+        if ( ! p->limiter.isNull() ) {
+            p.reset(NULL);
+            if ( m_limiter->waitAsync(reactorResume, this) ) {
+                m_reactorPaused = true;
+                m_reactor->enable( m_reactorThr, m_reactorSock, false );
+                suspended = true;
+                break;
+            }
+        }
+    }
+
+    m_plainBuffer.remove( 0, pos );
+    return res;
 }
 
 void SocketClientPrivate::__gracefulShutdown ( int sock,
@@ -3616,6 +4531,10 @@ bool SocketClientPrivate::srv_setHandshakeFromState ()
     m_peerConnectionUuid = clientConnectionUuid;
     m_peerSenderType = senderType;
     m_peerRoutingTable = acceptedTable;
+    // Features were exchanged by detached process, do not compress
+    m_peerCompressionCodecs = 0;
+    m_featureFlags = 0;
+    m_peerFeatureFlags = 0;
 
     // Unlock
     locker.unlock();
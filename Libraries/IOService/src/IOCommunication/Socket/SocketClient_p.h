@@ -30,6 +30,7 @@
 
 #include <boost/optional.hpp>
 #include "Socket_p.h"
+#include "SocketReactor_p.h"
 #include "../../../Logging/Logging.h"
 
 namespace IOService {
@@ -38,7 +39,8 @@ class SSLHelper;
 
 /** IO client implementation */
 class SocketClientPrivate : protected QThread,
-                            protected SocketWriteListenerInterface
+                            protected SocketWriteListenerInterface,
+                            protected SocketReactorHandler
 {
 public:
     SocketClientPrivate (
@@ -97,6 +99,34 @@ public:
 
 	void setLimitErrorLogging(bool bLimitErrorLogging);
 
+    // Server context connection will be read by the reactor
+    // after handshake. Must be set before client start.
+    void setReactor ( SocketReactor* );
+
+    // Codecs which may be used to compress sent buffers,
+    // see IOCompression::Codec. Is applied on next handshake.
+    void setCompressionCodecs ( quint32 codecs );
+
+    // Allows to hand SSL session keys to the kernel after handshake.
+    // Is applied on next handshake.
+    void setKernelTls ( bool enabled );
+
+    // Advertises that upper layer decodes binary events.
+    // Is applied on next handshake.
+    void setBinaryEvents ( bool enabled );
+
+    // Returns true if both sides advertised binary events
+    // in last handshake
+    bool binaryEventsNegotiated () const;
+
+    // Returns true if keys of current connection are installed
+    // to the kernel
+    bool kernelTlsActive () const;
+
+    // Received packages are accounted in the budget shared with
+    // other connections. Must be set before client start.
+    void setLimiterBudget ( const QSharedPointer<IOPackage::Budget>& );
+
 private:
     enum IOReadMode {
         IOSingleRead = 0,
@@ -113,6 +143,21 @@ private:
                 IOReadMode readMode, int msecsTimeout,
                 int* unixfd = 0, bool* timeoutExpired = 0);
 
+    // Receive buffer is read by large chunks and consumed from
+    // #m_rawPos position, so frames are parsed without moving data
+    enum {
+        RawBufferSize = 1<<18,
+        // Free space which is enough for recv call
+        RawBufferMinRecv = 1<<14,
+        // Recv calls without checking stop pipe
+        MaxPollSkips = 16
+    };
+    quint32 rawAvailable () const;
+    const char* rawData () const;
+    void rawConsume ( quint32 size );
+    // Makes room for at least size bytes after received data
+    void rawReserve ( quint32 size );
+
     bool cli_sendHandshake ( int sock, const Uuid& currConnUuid,
                                      quint32 msecsTimeout );
     bool cli_parseHandshake ( int sock, quint32 msecsTimeout );
@@ -120,6 +165,13 @@ private:
     bool srv_sendHandshake ( int sock, const Uuid& currConnUuid,
                                      quint32 msecsTimeout );
     bool srv_sendRoutingTable (int sock, quint32 msecsTimeout );
+    // Exchanges features with 6.11+ peer, is called by both sides
+    // just after routing table
+    bool exchangeHandshakeFeatures ( int sock, quint32 msecsTimeout );
+    // Installs keys of just finished SSL handshake to the socket
+    // if both sides advertised kernel TLS. Sides exchange one plain
+    // byte to agree and to find the point where kernel records start.
+    bool switchToKernelTls ( int sock, quint32 msecsTimeout );
 
 
     IOCommunication::DetachedClient srv_doDetach ( int sock );
@@ -137,6 +189,21 @@ private:
     // Backtrace will show us what context is used
     void doProxyMngCtxJob ();
     void doJob ();
+    // Finalizes connection: emits disconnected state, stops writing
+    // and frees all resources
+    void finalizeJob ( int& sockHandle, bool srv_detaching, bool cli_detach );
+    // Handles received package. Is used by both thread and reactor reading.
+    void handleReceivedPackage ( const SmartPtr<IOPackage>& p,
+                                 int unixfd,
+                                 int sockHandle,
+                                 bool heartBeatSupport,
+                                 IOService::TimeMark& lastHeartBeatMark,
+                                 bool& cli_doSSLRehandshake,
+                                 bool& cli_detach,
+                                 bool& srv_detaching );
+
+    // True if called from read thread or from reactor handler of this client
+    bool isReadingThread () const;
 
     // Mark thread as finalized.
     // NOTE: not thread-safe
@@ -168,6 +235,22 @@ private:
                                                     quint32 msecsTimeout );
 
 	bool getDetachedSocket(int& sock, char *errBuff, size_t ErrBuffSize);
+
+    // Reactor routines
+    bool reactorAttach ( int sock, bool heartBeatSupport,
+                         IOService::TimeMark lastHeartBeatMark );
+    virtual void onReactorEvent ( int fd );
+    virtual void onReactorTimer ();
+    // Receives from socket till it would block
+    bool reactorRead ();
+    // Decodes and parses all received data
+    bool reactorProcess ( bool& suspended );
+    // Decodes next portion of one SSL frame to plain buffer
+    bool reactorDecode ( bool& progress );
+    bool reactorDrainSSL ( bool& progress );
+    // Parses packages from plain buffer
+    bool reactorParse ( bool& suspended );
+    static void reactorResume ( void* context );
 	//
 	// SocketWriteListenerInterface
     //
@@ -256,6 +339,12 @@ private:
     bool m_useUnixSockets;
     QByteArray m_rawBuffer;
     qint32 m_lastfd;
+    quint32 m_pollSkips;
+    // Raw data before this position is already consumed
+    quint32 m_rawPos;
+    // Receive more than requested. Is dropped while data after
+    // requested bytes must stay in socket.
+    bool m_rawReadAhead;
     // Statistics structure
     IOSender::Statistics m_stat;
 
@@ -269,6 +358,39 @@ private:
 
 	// data size limiter for all not processed IOPackage'es
 	QSharedPointer<IOPackage::Limiter>	m_limiter;
+
+    // Codecs allowed by user and codecs peer can decode
+    quint32 m_compressionCodecs;
+    quint32 m_peerCompressionCodecs;
+
+    // Kernel TLS: allowed by user, advertised features flags of both
+    // sides and keys installed state
+    bool m_kernelTls;
+    quint32 m_featureFlags;
+    quint32 m_peerFeatureFlags;
+    bool m_kernelTlsActive;
+
+    // Binary events: allowed by user and agreed with peer
+    bool m_binaryEvents;
+    bool m_binaryEventsNegotiated;
+
+    // Reactor members (server context only)
+    SocketReactor* m_reactor;
+    int m_reactorThr;
+    int m_reactorSock;
+    bool m_reactorPaused;
+    int m_reactorResumed;
+    // Decoded data, which is not parsed yet
+    QByteArray m_plainBuffer;
+    // Package which is being received
+    SmartPtr<IOPackage> m_rdPkg;
+    bool m_rdDataReceived;
+    quint32 m_rdBuffIdx;
+    quint32 m_rdBuffOffset;
+    int m_rdUnixfd;
+    bool m_rdHeartBeatSupport;
+    IOService::TimeMark m_rdLastHeartBeatMark;
+    bool m_rdSrvDetaching;
 };
 
 } //namespace IOService
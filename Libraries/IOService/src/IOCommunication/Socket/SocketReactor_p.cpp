@@ -0,0 +1,600 @@
+/*
+ * SocketReactor_p.cpp
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+
+#include "Socket/SocketReactor_p.h"
+#include "Libraries/Std/AtomicOps.h"
+#ifndef _WIN_
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif // _WIN_
+
+using namespace IOService;
+
+/*****************************************************************************/
+
+#ifndef _WIN_
+
+namespace {
+
+// Handler which is being dispatched by current reactor thread
+__thread SocketReactorHandler* g_currentHandler = 0;
+
+} // anonymous namespace
+
+class SocketReactor::ReactorThread : public QThread
+{
+public:
+    ReactorThread ( int index );
+    ~ReactorThread ();
+
+    bool init ();
+    void finalize ();
+
+    bool add ( SocketReactorHandler*, const int* fds, quint32 fdsNum );
+    void remove ( SocketReactorHandler* );
+    bool enable ( int fd, bool enabled );
+    void kick ( int fd );
+
+    quint32 countDescriptors () const;
+    quint64 countEvents () const;
+
+private:
+    struct Registration
+    {
+        SocketReactorHandler* handler;
+        int fd;
+        bool enabled;
+        // Is read by reactor thread without lock
+        int alive;
+    };
+
+    void run ();
+    void dispatch ( Registration* );
+    void processKicks ();
+    void processTimers ();
+    void freeDeadRegistrations ();
+
+private:
+    DEFINE_IO_LOG
+
+    int m_epollFd;
+    int m_eventFd;
+    volatile bool m_stopping;
+    quint64 m_events;
+    mutable QMutex m_mutex;
+    // All registrations by descriptor, guarded by m_mutex
+    QHash<int, Registration*> m_regs;
+    // Removed registrations, which can be referenced by pending events.
+    // Are freed by reactor thread only, guarded by m_mutex
+    QList<Registration*> m_dead;
+    // Descriptors to be dispatched without event, guarded by m_mutex
+    QList<int> m_kicks;
+};
+
+SocketReactor::ReactorThread::ReactorThread ( int index ) :
+    m_epollFd(-1),
+    m_eventFd(-1),
+    m_stopping(false),
+    m_events(0)
+{
+    INIT_IO_LOG(QString("IO reactor [thr %1]: ").arg(index));
+}
+
+SocketReactor::ReactorThread::~ReactorThread ()
+{
+    if ( m_epollFd >= 0 )
+        ::close(m_epollFd);
+    if ( m_eventFd >= 0 )
+        ::close(m_eventFd);
+    qDeleteAll(m_regs);
+    qDeleteAll(m_dead);
+}
+
+bool SocketReactor::ReactorThread::init ()
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if ( m_epollFd < 0 ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't create epoll (native error: %s)"),
+                    native_strerror(errBuff, ErrBuffSize) );
+        return false;
+    }
+    m_eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ( m_eventFd < 0 ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't create eventfd (native error: %s)"),
+                    native_strerror(errBuff, ErrBuffSize) );
+        return false;
+    }
+    // Null data pointer marks reactor own event
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = 0;
+    if ( ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &ev) < 0 ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't add eventfd to epoll "
+                                      "(native error: %s)"),
+                    native_strerror(errBuff, ErrBuffSize) );
+        return false;
+    }
+    return true;
+}
+
+void SocketReactor::ReactorThread::finalize ()
+{
+    m_stopping = true;
+    if ( m_eventFd < 0 )
+        return;
+    quint64 val = 1;
+    if ( ::write(m_eventFd, &val, sizeof(val)) < 0 && errno != EAGAIN ) {
+        const size_t ErrBuffSize = 256;
+        char errBuff[ ErrBuffSize ];
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't write to eventfd "
+                                      "(native error: %s)"),
+                    native_strerror(errBuff, ErrBuffSize) );
+    }
+}
+
+bool SocketReactor::ReactorThread::add ( SocketReactorHandler* handler,
+                                         const int* fds, quint32 fdsNum )
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+    QList<Registration*> added;
+
+    // Registrations are published only when all descriptors are added:
+    // until then events are skipped by reactor thread and, as epoll is
+    // level-triggered, are reported again after publishing.
+    QMutexLocker locker( &m_mutex );
+    for ( quint32 i = 0; i < fdsNum; ++i ) {
+        Registration* reg = new(std::nothrow) Registration;
+        if ( reg == 0 ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Can't allocate memory!"));
+            goto rollback;
+        }
+        reg->handler = handler;
+        reg->fd = fds[i];
+        reg->enabled = true;
+        reg->alive = 0;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = reg;
+        if ( ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, reg->fd, &ev) < 0 ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Can't add descriptor %d to epoll "
+                                          "(native error: %s)"),
+                        reg->fd, native_strerror(errBuff, ErrBuffSize) );
+            delete reg;
+            goto rollback;
+        }
+        added.append( reg );
+    }
+    foreach ( Registration* reg, added ) {
+        m_regs.insert( reg->fd, reg );
+        AtomicWrite( &reg->alive, 1 );
+    }
+    return true;
+
+rollback:
+    // Reactor thread can hold skipped events of added descriptors,
+    // so registrations are freed by it between batches
+    foreach ( Registration* reg, added ) {
+        ::epoll_ctl( m_epollFd, EPOLL_CTL_DEL, reg->fd, 0 );
+        m_dead.append( reg );
+    }
+    return false;
+}
+
+void SocketReactor::ReactorThread::remove ( SocketReactorHandler* handler )
+{
+    Q_ASSERT(QThread::currentThread() == this);
+
+    QMutexLocker locker( &m_mutex );
+    QMutableHashIterator<int, Registration*> it( m_regs );
+    while ( it.hasNext() ) {
+        Registration* reg = it.next().value();
+        if ( reg->handler != handler )
+            continue;
+        if ( reg->enabled )
+            ::epoll_ctl( m_epollFd, EPOLL_CTL_DEL, reg->fd, 0 );
+        // Events of current batch can still point to registration
+        AtomicWrite( &reg->alive, 0 );
+        m_dead.append( reg );
+        it.remove();
+    }
+}
+
+bool SocketReactor::ReactorThread::enable ( int fd, bool enabled )
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+
+    QMutexLocker locker( &m_mutex );
+    Registration* reg = m_regs.value( fd );
+    if ( reg == 0 )
+        return false;
+    if ( reg->enabled == enabled )
+        return true;
+
+    // Disabled descriptor is removed from epoll completely, otherwise
+    // hangup of paused connection will be reported again and again
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = reg;
+    if ( ::epoll_ctl(m_epollFd, enabled ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                     fd, &ev) < 0 ) {
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't %s descriptor %d "
+                                      "(native error: %s)"),
+                    (enabled ? "enable" : "disable"), fd,
+                    native_strerror(errBuff, ErrBuffSize) );
+        return false;
+    }
+    reg->enabled = enabled;
+    return true;
+}
+
+void SocketReactor::ReactorThread::kick ( int fd )
+{
+    {
+        QMutexLocker locker( &m_mutex );
+        m_kicks.append( fd );
+    }
+    quint64 val = 1;
+    if ( ::write(m_eventFd, &val, sizeof(val)) < 0 && errno != EAGAIN ) {
+        const size_t ErrBuffSize = 256;
+        char errBuff[ ErrBuffSize ];
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't write to eventfd "
+                                      "(native error: %s)"),
+                    native_strerror(errBuff, ErrBuffSize) );
+    }
+}
+
+quint32 SocketReactor::ReactorThread::countDescriptors () const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_regs.size();
+}
+
+quint64 SocketReactor::ReactorThread::countEvents () const
+{
+    return AtomicRead64U( const_cast<quint64*>(&m_events) );
+}
+
+void SocketReactor::ReactorThread::dispatch ( Registration* reg )
+{
+    AtomicInc64U( &m_events );
+
+    CALLBACK_MARK;
+    g_currentHandler = reg->handler;
+    reg->handler->onReactorEvent( reg->fd );
+    g_currentHandler = 0;
+    WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+}
+
+void SocketReactor::ReactorThread::processKicks ()
+{
+    quint64 val = 0;
+    while ( ::read(m_eventFd, &val, sizeof(val)) < 0 && errno == EINTR )
+        ;
+
+    QList<int> kicks;
+    {
+        QMutexLocker locker( &m_mutex );
+        kicks.swap( m_kicks );
+    }
+    foreach ( int fd, kicks ) {
+        if ( m_stopping )
+            return;
+        // Kick can outlive registration: then descriptor is skipped,
+        // or, if it was reused, new handler gets spurious event
+        // and simply finds nothing to read.
+        m_mutex.lock();
+        Registration* reg = m_regs.value( fd );
+        m_mutex.unlock();
+        if ( reg == 0 || ! AtomicRead(&reg->alive) )
+            continue;
+        dispatch( reg );
+    }
+}
+
+void SocketReactor::ReactorThread::processTimers ()
+{
+    // One registration of every handler. Registrations are freed by
+    // this thread only, so they are valid even if handlers detach.
+    QList<Registration*> regs;
+    {
+        QSet<SocketReactorHandler*> handlers;
+        QMutexLocker locker( &m_mutex );
+        foreach ( Registration* reg, m_regs ) {
+            if ( ! AtomicRead(&reg->alive) || handlers.contains(reg->handler) )
+                continue;
+            handlers.insert( reg->handler );
+            regs.append( reg );
+        }
+    }
+    foreach ( Registration* reg, regs ) {
+        if ( m_stopping )
+            return;
+        if ( ! AtomicRead(&reg->alive) )
+            continue;
+
+        CALLBACK_MARK;
+        g_currentHandler = reg->handler;
+        reg->handler->onReactorTimer();
+        g_currentHandler = 0;
+        WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+    }
+}
+
+void SocketReactor::ReactorThread::freeDeadRegistrations ()
+{
+    // Is called between batches, so nobody references dead registrations
+    QMutexLocker locker( &m_mutex );
+    qDeleteAll( m_dead );
+    m_dead.clear();
+}
+
+void SocketReactor::ReactorThread::run ()
+{
+    const size_t ErrBuffSize = 256;
+    char errBuff[ ErrBuffSize ];
+    enum { MaxEvents = 64 };
+    struct epoll_event events[ MaxEvents ];
+    QElapsedTimer timer;
+    timer.start();
+
+    while ( ! m_stopping ) {
+        qint64 elapsed = timer.elapsed();
+        int timeout = elapsed >= TimerPeriod ? 0 : TimerPeriod - elapsed;
+        int n = ::epoll_wait( m_epollFd, events, MaxEvents, timeout );
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            WRITE_TRACE(DBG_FATAL, IO_LOG("epoll_wait failed "
+                                          "(native error: %s)"),
+                        native_strerror(errBuff, ErrBuffSize) );
+            break;
+        }
+        for ( int i = 0; i < n && ! m_stopping; ++i ) {
+            Registration* reg =
+                reinterpret_cast<Registration*>(events[i].data.ptr);
+            if ( reg == 0 )
+                processKicks();
+            else if ( AtomicRead(&reg->alive) )
+                dispatch( reg );
+        }
+        if ( ! m_stopping && timer.elapsed() >= TimerPeriod ) {
+            timer.restart();
+            processTimers();
+        }
+        freeDeadRegistrations();
+    }
+}
+
+/*****************************************************************************/
+
+SocketReactor::SocketReactor ()
+{}
+
+SocketReactor::~SocketReactor ()
+{
+    stop();
+}
+
+bool SocketReactor::start ( quint32 threadsCount )
+{
+    if ( isStarted() || threadsCount == 0 )
+        return false;
+
+    for ( quint32 i = 0; i < threadsCount; ++i ) {
+        ReactorThread* thr = new(std::nothrow) ReactorThread( i );
+        if ( thr == 0 ) {
+            WRITE_TRACE(DBG_FATAL, "IO reactor: Can't allocate memory!");
+            stop();
+            return false;
+        }
+        m_threads.append( thr );
+        if ( ! thr->init() ) {
+            stop();
+            return false;
+        }
+        thr->start();
+    }
+    return true;
+}
+
+void SocketReactor::stop ()
+{
+    foreach ( ReactorThread* thr, m_threads ) {
+        thr->finalize();
+        thr->wait();
+        delete thr;
+    }
+    m_threads.clear();
+}
+
+bool SocketReactor::isStarted () const
+{
+    return ! m_threads.isEmpty();
+}
+
+quint32 SocketReactor::threadsCount () const
+{
+    return m_threads.size();
+}
+
+int SocketReactor::selectThread () const
+{
+    int thr = -1;
+    quint32 minLoad = 0;
+    for ( int i = 0; i < m_threads.size(); ++i ) {
+        quint32 load = m_threads[i]->countDescriptors();
+        if ( thr < 0 || load < minLoad ) {
+            thr = i;
+            minLoad = load;
+        }
+    }
+    return thr;
+}
+
+bool SocketReactor::attach ( int thr, SocketReactorHandler* handler,
+                             const int* fds, quint32 fdsNum )
+{
+    if ( thr < 0 || thr >= m_threads.size() )
+        return false;
+    return m_threads[thr]->add( handler, fds, fdsNum );
+}
+
+void SocketReactor::detach ( int thr, SocketReactorHandler* handler )
+{
+    if ( thr < 0 || thr >= m_threads.size() )
+        return;
+    m_threads[thr]->remove( handler );
+}
+
+bool SocketReactor::enable ( int thr, int fd, bool enabled )
+{
+    if ( thr < 0 || thr >= m_threads.size() )
+        return false;
+    return m_threads[thr]->enable( fd, enabled );
+}
+
+void SocketReactor::kick ( int thr, int fd )
+{
+    if ( thr < 0 || thr >= m_threads.size() )
+        return;
+    m_threads[thr]->kick( fd );
+}
+
+bool SocketReactor::isCurrentThread ( int thr ) const
+{
+    if ( thr < 0 || thr >= m_threads.size() )
+        return false;
+    return QThread::currentThread() == m_threads[thr];
+}
+
+SocketReactorHandler* SocketReactor::currentHandler ()
+{
+    return g_currentHandler;
+}
+
+quint32 SocketReactor::countDescriptors () const
+{
+    quint32 count = 0;
+    foreach ( ReactorThread* thr, m_threads )
+        count += thr->countDescriptors();
+    return count;
+}
+
+quint64 SocketReactor::countEvents () const
+{
+    quint64 count = 0;
+    foreach ( ReactorThread* thr, m_threads )
+        count += thr->countEvents();
+    return count;
+}
+
+#else // _WIN_
+
+/*****************************************************************************/
+
+// Reactor is not implemented for Windows: every connection is read
+// by its own thread.
+
+SocketReactor::SocketReactor ()
+{}
+
+SocketReactor::~SocketReactor ()
+{}
+
+bool SocketReactor::start ( quint32 )
+{
+    WRITE_TRACE(DBG_FATAL, "IO reactor: is not supported on this platform");
+    return false;
+}
+
+void SocketReactor::stop ()
+{}
+
+bool SocketReactor::isStarted () const
+{
+    return false;
+}
+
+quint32 SocketReactor::threadsCount () const
+{
+    return 0;
+}
+
+int SocketReactor::selectThread () const
+{
+    return -1;
+}
+
+bool SocketReactor::attach ( int, SocketReactorHandler*, const int*, quint32 )
+{
+    return false;
+}
+
+void SocketReactor::detach ( int, SocketReactorHandler* )
+{}
+
+bool SocketReactor::enable ( int, int, bool )
+{
+    return false;
+}
+
+void SocketReactor::kick ( int, int )
+{}
+
+bool SocketReactor::isCurrentThread ( int ) const
+{
+    return false;
+}
+
+SocketReactorHandler* SocketReactor::currentHandler ()
+{
+    return 0;
+}
+
+quint32 SocketReactor::countDescriptors () const
+{
+    return 0;
+}
+
+quint64 SocketReactor::countEvents () const
+{
+    return 0;
+}
+
+#endif // _WIN_
+
+/*****************************************************************************/
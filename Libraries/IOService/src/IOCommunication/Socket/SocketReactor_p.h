@@ -0,0 +1,100 @@
+/*
+ * SocketReactor_p.h
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#ifndef SOCKETREACTORP_H
+#define SOCKETREACTORP_H
+
+#include <QVector>
+
+#include "Socket_p.h"
+
+namespace IOService {
+
+/**
+ * Receiver of socket events, which are dispatched by reactor.
+ * All events of one handler are dispatched from the same reactor
+ * thread, so handler is never called concurrently.
+ */
+class SocketReactorHandler
+{
+public:
+    virtual ~SocketReactorHandler () {}
+    virtual void onReactorEvent ( int fd ) = 0;
+    // Is called every SocketReactor::TimerPeriod msecs to check timeouts
+    virtual void onReactorTimer () {}
+};
+
+/**
+ * Fixed pool of epoll threads, which drives reading of many server
+ * connections instead of one blocking read thread per connection.
+ * Every connection is pinned to one reactor thread for its lifetime.
+ */
+class SocketReactor
+{
+public:
+    // Period of handler timers (msecs)
+    enum { TimerPeriod = 1000 };
+
+    SocketReactor ();
+    ~SocketReactor ();
+
+    bool start ( quint32 threadsCount );
+    void stop ();
+    bool isStarted () const;
+    quint32 threadsCount () const;
+
+    // Returns index of the least loaded reactor thread
+    int selectThread () const;
+    // Registers descriptors of handler in specified thread.
+    // Events are dispatched as soon as this call returns.
+    bool attach ( int thr, SocketReactorHandler*,
+                  const int* fds, quint32 fdsNum );
+    // Removes all descriptors of handler.
+    // NOTE: must be called from the reactor thread of the handler
+    void detach ( int thr, SocketReactorHandler* );
+    // Enables or disables events for descriptor
+    bool enable ( int thr, int fd, bool enabled );
+    // Dispatches event for descriptor even if nothing is pending
+    void kick ( int thr, int fd );
+
+    bool isCurrentThread ( int thr ) const;
+    // Returns handler which is being dispatched in the current thread
+    static SocketReactorHandler* currentHandler ();
+
+    // Number of registered descriptors in all threads
+    quint32 countDescriptors () const;
+    // Number of dispatched events in all threads
+    quint64 countEvents () const;
+
+private:
+    class ReactorThread;
+
+    QVector<ReactorThread*> m_threads;
+};
+
+} //namespace IOService
+
+#endif //SOCKETREACTORP_H
@@ -48,7 +48,12 @@ SocketServerPrivate::SocketServerPrivate ( IOServer* imp,
 #endif
 	, m_localCredentials(credentials),
 	m_useUnixSockets(useUnixSockets),
-	m_nUserSessionLimit(0)
+	m_nUserSessionLimit(0),
+	m_nReactorThreads(0),
+	m_compressionCodecs(0),
+	m_kernelTls(false),
+	m_binaryEvents(false),
+	m_budget(new IOPackage::Budget)
 {
     INIT_IO_LOG(QString("IO server ctx [accept thr] (sender %1): ").
                 arg(imp->senderType()));
@@ -225,6 +230,21 @@ bool SocketServerPrivate::clientProtocolVersion (
     return client->peerProtocolVersion( ver );
 }
 
+bool SocketServerPrivate::clientBinaryEventsNegotiated (
+    const IOSender::Handle& h ) const
+{
+    QMutexLocker locker( &m_eventMutex );
+
+    const SmartPtr<SocketClientPrivate> client = m_sockClients.value(h);
+    if ( ! client )
+        return false;
+
+    // Unlock
+    locker.unlock();
+
+    return client->binaryEventsNegotiated();
+}
+
 bool SocketServerPrivate::detachClient (
     const IOSender::Handle& h,
     int specificArg,
@@ -286,6 +306,47 @@ void SocketServerPrivate::setUserConnectionLimit( unsigned int nLimit )
 	m_nUserSessionLimit = nLimit;
 }
 
+void SocketServerPrivate::setReactorThreadsCount( quint32 nThreads )
+{
+	QMutexLocker locker( &m_eventMutex );
+
+	m_nReactorThreads = nThreads;
+}
+
+void SocketServerPrivate::setCompressionCodecs( quint32 codecs )
+{
+	QMutexLocker locker( &m_eventMutex );
+
+	m_compressionCodecs = codecs;
+}
+
+void SocketServerPrivate::setKernelTls( bool enabled )
+{
+	QMutexLocker locker( &m_eventMutex );
+
+	m_kernelTls = enabled;
+}
+
+void SocketServerPrivate::setBinaryEvents( bool enabled )
+{
+	QMutexLocker locker( &m_eventMutex );
+
+	m_binaryEvents = enabled;
+}
+
+void SocketServerPrivate::setReceiveBudget( quint64 totalBytes,
+                                            quint64 minShareBytes )
+{
+	// Budget is lock-free and is shared with running clients
+	m_budget->setLimits(totalBytes, minShareBytes);
+}
+
+void SocketServerPrivate::getReceiveBudgetStatistics(
+	IOPackage::BudgetStatistics& s ) const
+{
+	m_budget->getStatistics(s);
+}
+
 IOCommunication::SocketHandle
 SocketServerPrivate::createDetachedClientSocket ()
 {
@@ -501,6 +562,9 @@ Prl::Expected<SmartPtr<SocketClientPrivate>, bool> SocketServerPrivate::createAn
 	// Make copy to reduce mutex lock time.
 	QMutexLocker locker( &m_eventMutex );
 	IOCredentials credentialsCopy( m_localCredentials );
+	quint32 compressionCodecs = m_compressionCodecs;
+	bool kernelTls = m_kernelTls;
+	bool binaryEvents = m_binaryEvents;
 	locker.unlock();
 
 	SocketClientContext ctx = Cli_ServerContext;
@@ -535,6 +599,14 @@ Prl::Expected<SmartPtr<SocketClientPrivate>, bool> SocketServerPrivate::createAn
         return false;
     }
 
+    // Connection will be read by the reactor after handshake
+    if ( m_reactor.isStarted() )
+        client->setReactor( &m_reactor );
+    client->setCompressionCodecs( compressionCodecs );
+    client->setKernelTls( kernelTls );
+    client->setBinaryEvents( binaryEvents );
+    client->setLimiterBudget( m_budget );
+
     // Atomic start
 	locker.relock();
 
@@ -1143,6 +1215,17 @@ void SocketServerPrivate::run ()
     else
         Q_ASSERT(0);
 
+    //
+    // Start reactor, which will read connected clients instead of
+    // their own read threads. Server works without reactor on failure.
+    //
+    m_eventMutex.lock();
+    if ( m_nReactorThreads > 0 && ! m_reactor.start(m_nReactorThreads) )
+        WRITE_TRACE(DBG_FATAL, IO_LOG("Can't start reactor with %d threads, "
+                                      "clients will be read by own threads"),
+                    m_nReactorThreads);
+    m_eventMutex.unlock();
+
     //
     // Great. We are absolutely connected now.
     // We can't handle errors from here, because after connected state emition
@@ -1500,6 +1583,9 @@ void SocketServerPrivate::run ()
         cleanAllClients();
     }
 
+    // All clients are stopped, nobody is attached to reactor
+    m_reactor.stop();
+
     // Atomic stop. Actually, we do not need any locks for
     // sock handle close (we need locks only for closing event objects)
     // but in such case we will have more code.
@@ -85,6 +85,7 @@ public:
 
     bool clientProtocolVersion ( const IOSender::Handle&,
                                  IOCommunication::ProtocolVersion& ) const;
+    bool clientBinaryEventsNegotiated ( const IOSender::Handle& ) const;
     bool detachClient ( const IOSender::Handle& cliHandle,
                         int specificArg,
                         const SmartPtr<IOPackage>& additionalPkg,
@@ -100,6 +101,23 @@ public:
 
 	void setUserConnectionLimit( unsigned int nLimit );
 
+	// Number of reactor threads, which read all clients.
+	// Zero means own read thread for every client.
+	void setReactorThreadsCount( quint32 nThreads );
+
+	// Codecs which may be used to compress buffers sent to clients
+	void setCompressionCodecs( quint32 codecs );
+
+	// Kernel TLS offload of clients SSL connections
+	void setKernelTls( bool enabled );
+
+	// Binary events decoding advertised to clients
+	void setBinaryEvents( bool enabled );
+
+	// Memory budget of not processed packages of all clients
+	void setReceiveBudget( quint64 totalBytes, quint64 minShareBytes );
+	void getReceiveBudgetStatistics( IOPackage::BudgetStatistics& ) const;
+
 private:
     void run ();
 
@@ -166,6 +184,12 @@ private:
     // Use unix sockets for connection
     bool m_useUnixSockets;
 	unsigned int m_nUserSessionLimit;
+	quint32 m_nReactorThreads;
+	quint32 m_compressionCodecs;
+	bool m_kernelTls;
+	bool m_binaryEvents;
+	QSharedPointer<IOPackage::Budget> m_budget;
+	SocketReactor m_reactor;
 };
 
 } //namespace IOService
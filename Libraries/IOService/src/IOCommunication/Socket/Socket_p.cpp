@@ -28,6 +28,7 @@
 #include "Socket_p.h"
 
 #include "Libraries/Logging/Logging.h"
+#include "Libraries/Std/AtomicOps.h"
 #include <limits>
 #ifndef _WIN_
 #include <poll.h>
@@ -329,6 +330,18 @@ bool IOService::setSocketOptions ( int sock )
     return true;
 }
 
+bool IOService::setSocketCork ( int sock, bool cork )
+{
+#ifdef _LIN_
+    int val = (cork ? 1 : 0);
+    return ::setsockopt( sock, IPPROTO_TCP, TCP_CORK, &val, sizeof(val) ) == 0;
+#else
+    Q_UNUSED(sock);
+    Q_UNUSED(cork);
+    return false;
+#endif
+}
+
 bool IOService::getFullNameInfo ( const struct sockaddr *sa, socklen_t salen,
                                   QString& hostNameStr,
                                   quint16& portNumber,
@@ -522,14 +535,22 @@ SocketWriteThread::SocketWriteThread (
     m_wrListener(wrListener),
     m_state(IOSender::Disconnected),
     m_peerProtoVersion(IOService::IOProtocolVersion),
+    m_compressionCodec(IOCompression::NoCodec),
+    m_kernelTls(false),
 #ifdef _WIN_ // Windows
     m_writeEventHandle(WSA_INVALID_EVENT),
 #endif // Unix
     m_threadState(ThreadIsStopped),
     m_stopReason(IOSendJob::ConnClosedByUser),
     m_sockHandle(-1),
+    m_writerSleeps(0),
+    m_pushingJobs(0),
     m_inPause(false),
     m_isDetaching(false),
+#ifndef _WIN_
+    m_canCork(true),
+    m_corked(false),
+#endif
     m_ssl(0),
     m_sslSSLBio(0),
     m_sslNetworkBio(0),
@@ -581,7 +602,9 @@ bool SocketWriteThread::startWriteThread ( int sock,
                                            const Uuid& currConnUuid,
                                            const Uuid& peerConnUuid,
                                            const IOCommunication::ProtocolVersion& protoVer,
-                                           const IORoutingTable& routingTable
+                                           const IORoutingTable& routingTable,
+                                           IOCompression::Codec compressionCodec,
+                                           bool kernelTls
 #ifndef _WIN_ // Unix
                                            , int eventPipes[2]
 #endif
@@ -636,6 +659,10 @@ bool SocketWriteThread::startWriteThread ( int sock,
         m_peerProtoVersion = protoVer;
         // Set route table
         m_routingTable = routingTable;
+        // Set negotiated codec
+        m_compressionCodec = compressionCodec;
+        // Set kernel TLS state
+        m_kernelTls = kernelTls;
 
 #ifndef _WIN_ // Unix
         m_eventPipes[0] = eventPipes[0];
@@ -745,15 +772,15 @@ void SocketWriteThread::__finalizeThread ()
     m_wait.wakeOne();
 }
 
-void SocketWriteThread::setUuidsToPkgHeaderAndRegisterJob (
+void SocketWriteThread::setUuidsToPkgHeader (
     IOPackage::PODHeader& pkgHeader,
-    SmartPtr<IOSendJob>& sendJob ) const
+    const Uuid& currConnUuid ) const
 {
     Uuid senderUuid = Uuid::toUuid(pkgHeader.senderUuid);
 
     // If sender uuid is empty, fill it by connection uuid
     if ( senderUuid.isNull() ) {
-        m_currConnUuid.dump(pkgHeader.senderUuid);
+        currConnUuid.dump(pkgHeader.senderUuid);
     }
     else {
         LOG_MESSAGE(DBG_INFO, IO_LOG("Package sender uuid is not empty! "
@@ -773,9 +800,6 @@ void SocketWriteThread::setUuidsToPkgHeaderAndRegisterJob (
 
     // Calculate CRC16
     pkgHeader.crc16 = IOPackage::headerChecksumCRC16( pkgHeader );
-
-    // Register package uuid
-    sendJob->registerPackageUuid( pkgHeader.uuid );
 }
 
 #ifndef _WIN_ // non-Windows
@@ -816,7 +840,7 @@ IOSendJob::Result SocketWriteThread::write ( int sock,
 			qint32 msecsToWait = msecsTimeout - elapsed;
 
 			if ( msecsToWait <= 0 ) {
-				WRITE_TRACE(DBG_FATAL, IO_LOG("Wait for write failed: timeout expired!"));
+				WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Wait for write failed: timeout expired!"));
 				return IOSendJob::Fail;
 			}
 
@@ -829,7 +853,7 @@ IOSendJob::Result SocketWriteThread::write ( int sock,
 		// Do select
 		int res = ::ppoll(p, sizeof(p)/sizeof(p[0]), timeo, NULL);
 		if ( res == 0 ) {
-			WRITE_TRACE(DBG_FATAL, IO_LOG("Wait for write failed: timeout expired!"));
+			WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Wait for write failed: timeout expired!"));
 			return IOSendJob::Timeout;
 		}
 		else if ( res < 0 && errno == EINTR ) {
@@ -837,7 +861,7 @@ IOSendJob::Result SocketWriteThread::write ( int sock,
 			continue;
 		}
 		else if ( res < 0 ) {
-			WRITE_TRACE(DBG_FATAL, IO_LOG("Select failed (native error: %s)"),
+			WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Select failed (native error: %s)"),
 			native_strerror(errBuff, ErrBuffSize));
 			return IOSendJob::Fail;
 		}
@@ -875,7 +899,7 @@ IOSendJob::Result SocketWriteThread::write ( int sock,
 		ssize_t written = ::sendmsg( sock, &msg, 0 );
 
 		if ( written == 0 ) {
-			WRITE_TRACE(DBG_FATAL, IO_LOG("Connection was closed unexpectedly"));
+			WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Connection was closed unexpectedly"));
 			return IOSendJob::Fail;
 		}
 		else if ( written < 0 && errno == EINTR ) {
@@ -892,12 +916,12 @@ IOSendJob::Result SocketWriteThread::write ( int sock,
 				err == ECONNRESET);// connection reset
 
 			if ( knownErr ) {
-				WRITE_TRACE(DBG_INFO,
+				WRITE_TRACE_TB(1, 10, DBG_INFO,
 					IO_LOG("Write to socket failed because of known "
 					"err (native error: %s)"),
 					native_strerror(errBuff, ErrBuffSize));
 			} else {
-				WRITE_TRACE(DBG_FATAL, IO_LOG("Write to socket failed (native error: %s)"),
+				WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Write to socket failed (native error: %s)"),
 				native_strerror(errBuff, ErrBuffSize));
 			}
 
@@ -992,15 +1016,15 @@ IOSendJob::Result SocketWriteThread::write (
                                  err == WSAECONNRESET);
 
                 if ( knownErr )
-                    WRITE_TRACE(DBG_INFO,
-                                IO_LOG("Write to socket failed because of "
-                                       "known err (native error: %s)"),
-                                native_strerror(err, errBuff, ErrBuffSize));
+                    WRITE_TRACE_TB(1, 10, DBG_INFO,
+                                   IO_LOG("Write to socket failed because of "
+                                          "known err (native error: %s)"),
+                                   native_strerror(err, errBuff, ErrBuffSize));
                 else
-                    WRITE_TRACE(DBG_FATAL,
-                                IO_LOG("Write to socket failed (native "
-                                       "error: %s)"),
-                                native_strerror(err, errBuff, ErrBuffSize));
+                    WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                                   IO_LOG("Write to socket failed (native "
+                                          "error: %s)"),
+                                   native_strerror(err, errBuff, ErrBuffSize));
 
                 if ( err == WSAEFAULT )
                     return IOSendJob::InvalidPackage;
@@ -1032,8 +1056,8 @@ IOSendJob::Result SocketWriteThread::write (
             qint32 msecsToWait = msecsTimeout - elapsed;
 
             if ( msecsToWait <= 0 ) {
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Wait for write failed: timeout expired!"));
+                WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                               IO_LOG("Wait for write failed: timeout expired!"));
                 return IOSendJob::Fail;
             }
             dwTimeout = msecsToWait;
@@ -1061,14 +1085,14 @@ IOSendJob::Result SocketWriteThread::write (
         // Still pending
         else {
             if ( dwWait == WSA_WAIT_TIMEOUT ) {
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Wait for write failed: timeout expired!"));
+                WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                               IO_LOG("Wait for write failed: timeout expired!"));
                 return IOSendJob::Timeout;
             }
             else {
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Wait for write failed (native error: %s)"),
-                            native_strerror(errBuff, ErrBuffSize));
+                WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                               IO_LOG("Wait for write failed (native error: %s)"),
+                               native_strerror(errBuff, ErrBuffSize));
                 return IOSendJob::Fail;
             }
         }
@@ -1080,15 +1104,15 @@ IOSendJob::Result SocketWriteThread::write (
                              err == WSAECONNRESET);
 
             if ( knownErr )
-                WRITE_TRACE(DBG_INFO,
-                            IO_LOG("Overlapped result: write to socket failed "
-                                   "because of known err (native error: %s)"),
-                            native_strerror(errBuff, ErrBuffSize));
+                WRITE_TRACE_TB(1, 10, DBG_INFO,
+                               IO_LOG("Overlapped result: write to socket failed "
+                                      "because of known err (native error: %s)"),
+                               native_strerror(errBuff, ErrBuffSize));
             else
-                WRITE_TRACE(DBG_FATAL,
-                            IO_LOG("Overlapped result: write to socket failed "
-                                   "(native error: %s)"),
-                            native_strerror(errBuff, ErrBuffSize));
+                WRITE_TRACE_TB(1, 10, DBG_FATAL,
+                               IO_LOG("Overlapped result: write to socket failed "
+                                      "(native error: %s)"),
+                               native_strerror(errBuff, ErrBuffSize));
 
             if ( err == WSAEFAULT )
                 return IOSendJob::InvalidPackage;
@@ -1103,7 +1127,7 @@ IOSendJob::Result SocketWriteThread::write (
 
     send_is_done:
         if ( written == 0 ) {
-            WRITE_TRACE(DBG_FATAL, IO_LOG("Connection was closed unexpectedly"));
+            WRITE_TRACE_TB(1, 10, DBG_FATAL, IO_LOG("Connection was closed unexpectedly"));
             return IOSendJob::Fail;
         }
 
@@ -1349,51 +1373,73 @@ SmartPtr<IOSendJob> SocketWriteThread::sendPackage (
         return SmartPtr<IOSendJob>();
     }
 
-    // Lock
-    QMutexLocker locker( &m_jobMutex );
+    SmartPtr<IOJobManager::JobPool> jobPool;
+    Uuid currConnUuid;
+    {
+        // Lock
+        QMutexLocker locker( &m_jobMutex );
 
-    // Check if write thread is ready
-    if ( m_threadState != ThreadIsStarted ) {
-        WRITE_TRACE(DBG_FATAL, IO_LOG("Error: write thread is not started!"));
-        return SmartPtr<IOSendJob>();
-    }
+        // Check if write thread is ready and is not finalizing
+        if ( m_threadState != ThreadIsStarted ||
+             m_state != IOSender::Connected ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Error: write thread is not started!"));
+            return SmartPtr<IOSendJob>();
+        }
 
-    // Check that it is not in detaching state
-    if ( m_isDetaching && ! urgentSend ) {
-        WRITE_TRACE(DBG_FATAL, IO_LOG("Error: write thread is detaching! "
-                                      "It  can be only stopped!"));
-        return SmartPtr<IOSendJob>();
-    }
+        // Check that it is not in detaching state
+        if ( m_isDetaching && ! urgentSend ) {
+            WRITE_TRACE(DBG_FATAL, IO_LOG("Error: write thread is detaching! "
+                                          "It  can be only stopped!"));
+            return SmartPtr<IOSendJob>();
+        }
 
-    Q_ASSERT(m_jobPool.isValid());
+        Q_ASSERT(m_jobPool.isValid());
+        jobPool = m_jobPool;
+        currConnUuid = m_currConnUuid;
 
-    // Init job
-    IOJobManager::JobRefType job;
-    bool initRes = m_jobManager->initActiveJob( m_jobPool, p->header,
-                                                p, job, urgentSend );
+        // Writing thread waits for us before finalization
+        AtomicInc( &m_pushingJobs );
+    }
+
+    // Init header uuids. Job is visible for writing thread just after
+    // init, so header must be ready before
+    IOPackage::PODHeader pkgHeader = p->header;
+    setUuidsToPkgHeader( pkgHeader, currConnUuid );
+
+    // Init job. Producers do not serialize on job mutex here,
+    // active jobs queue is lock free
+    // Job can be reused just after the push, so only send job
+    // returned by init belongs to this package
+    QSharedPointer<IOJobManager::Job> h;
+    SmartPtr<IOSendJob> sendJob;
+    bool initRes = m_jobManager->initActiveJob( jobPool, pkgHeader,
+                                                p, h, sendJob, urgentSend );
+    AtomicDec( &m_pushingJobs );
     // If success, wake up writing thread
-    QSharedPointer<IOJobManager::Job> h = job.toStrongRef();
     if ( initRes ) {
-        Q_ASSERT(h.data());
-        // Init header uuids
-        setUuidsToPkgHeaderAndRegisterJob( h->pkgHeader, h->sendJob );
-        // Wake writing thread
-        m_wait.wakeOne();
+        Q_ASSERT(sendJob.isValid());
+        // Wake writing thread if it sleeps or is going to sleep.
+        // Push has been a full barrier, writing thread rechecks
+        // the queue after it has marked itself sleeping.
+        if ( AtomicRead(&m_writerSleeps) ) {
+            QMutexLocker locker( &m_jobMutex );
+            m_wait.wakeOne();
+        }
     }
     // Can't init, queue is full
     else {
-        if ( h.isNull() ) {
+        if ( ! sendJob.isValid() ) {
             WRITE_TRACE(DBG_FATAL, IO_LOG("Error: can't allocate new job!"));
             return SmartPtr<IOSendJob>();
         }
 
-        h->sendJob->wakeSendWaitings( IOSendJob::SendQueueIsFull );
-        h->sendJob->wakeResponseWaitings( IOSendJob::SendQueueIsFull,
-                                            IOSender::Handle(),
-                                            SmartPtr<IOPackage>() );
+        sendJob->wakeSendWaitings( IOSendJob::SendQueueIsFull );
+        sendJob->wakeResponseWaitings( IOSendJob::SendQueueIsFull,
+                                       IOSender::Handle(),
+                                       SmartPtr<IOPackage>() );
     }
 
-    return h->sendJob;
+    return sendJob;
 }
 
 void SocketWriteThread::run ()
@@ -1476,6 +1522,11 @@ void SocketWriteThread::doJob ()
     m_inPause = false;
     m_pausePkg = SmartPtr<IOPackage>();
 
+#ifndef _WIN_ // Unix
+    m_canCork = true;
+    m_corked = false;
+#endif
+
     // Init job pool
     m_jobPool = jobPool;
 
@@ -1528,7 +1579,14 @@ void SocketWriteThread::doJob ()
             jobPtr = m_jobManager->getNextActiveJob( m_jobPool );
 
         if ( jobPtr.isNull() && pending <= 0 ) {
-            bool waitRes = m_wait.wait( &m_jobMutex, heartBeatTimeout );
+            // Jobs are pushed without job mutex, so mark thread as
+            // sleeping and recheck the queue. Swap is a full barrier.
+            AtomicSwap( &m_writerSleeps, 1u );
+            bool waitRes = true;
+            jobPtr = m_jobManager->getNextActiveJob( m_jobPool );
+            if ( jobPtr.isNull() )
+                waitRes = m_wait.wait( &m_jobMutex, heartBeatTimeout );
+            AtomicWrite( &m_writerSleeps, 0u );
 
             // Stop in progress
             if ( m_threadState == ThreadIsStopping )
@@ -1590,6 +1648,31 @@ void SocketWriteThread::doJob ()
         if ( jobPtr == m_jobManager->getHeartBeatJob(m_jobPool) )
             LOG_MESSAGE(DBG_DEBUG, IO_LOG("Heart beat has been sent!"));
 
+#ifndef _WIN_ // Unix
+        // Plain packages are coalesced and written by one sendmsg call
+        if ( isPlainBatchable(h->pkg) ) {
+            JobBatch batch;
+            collectPlainBatch( jobPtr, batch );
+            jobPtr.clear();
+            h.clear();
+
+            // Jobs drop their packages when are put back to pool
+            SmartPtr<IOPackage> lastPkg = batch.last()->pkg;
+
+            writeRes = plainWriteBatch( batch, lastHeartBeatMark );
+            if ( writeRes != IOSendJob::Success )
+                goto cleanup_and_disconnect;
+
+            // Check if want to send and pause
+            if ( m_inPause && ! waitWhilePaused(lastPkg) )
+                goto cleanup_and_disconnect;
+            continue;
+        }
+
+        // Flush corked burst before unbatched package
+        setCork( false );
+#endif
+
         // Increment package reference, to be sure it can't
         // be freed in job destruction
         SmartPtr<IOPackage> p = h->pkg;
@@ -1612,6 +1695,9 @@ void SocketWriteThread::doJob ()
         // Find route name
         IORoutingTable::RouteName routeName =
             m_routingTable.findRoute( p->header.type );
+        // Kernel encrypts everything written to the socket
+        if ( m_kernelTls )
+            routeName = IORoutingTable::PlainRoute;
 
         // Unix fd (works only on Unix)
         int unixfd = -1;
@@ -1685,7 +1771,11 @@ void SocketWriteThread::doJob ()
         // Send buffers if exist
         if ( p->header.buffersNumber ) {
 
-            const IOPackage::PODData* pkgData = IODATAMEMBER(p);
+            // Buffers are compressed just before write, callbacks and
+            // pause check still get the package of the sender
+            SmartPtr<IOPackage> wp =
+                IOCompression::compressPackage( p, m_compressionCodec, m_stat );
+            const IOPackage::PODData* pkgData = IODATAMEMBER(wp);
 
             if ( routeName == IORoutingTable::SSLRoute )
                 // Write secured buffers data
@@ -1697,10 +1787,10 @@ void SocketWriteThread::doJob ()
 #else // Unix
                                      m_eventPipes[0],
 #endif
-                                     pkgData, IODATASIZE(p) );
+                                     pkgData, IODATASIZE(wp) );
             else
                 // Write plain buffers data
-                writeRes = plainWrite( m_sockHandle, pkgData, IODATASIZE(p) );
+                writeRes = plainWrite( m_sockHandle, pkgData, IODATASIZE(wp) );
 
             // Error
             if ( writeRes != IOSendJob::Success ) {
@@ -1735,7 +1825,7 @@ void SocketWriteThread::doJob ()
                 goto cleanup_and_disconnect;
             }
 
-			sent_sz += IODATASIZE(p);
+			sent_sz += IODATASIZE(wp);
 
             // Write buffers
             for ( quint32 i = 0; i < p->header.buffersNumber; ++i ) {
@@ -1758,12 +1848,12 @@ void SocketWriteThread::doJob ()
 #else // Unix
                                          m_eventPipes[0],
 #endif
-                                         p->buffers[i].getImpl(),
+                                         wp->buffers[i].getImpl(),
                                          pkgData[i].bufferSize );
                 else
                     // Write plain buffers
                     writeRes = plainWrite( m_sockHandle,
-                                           p->buffers[i].getImpl(),
+                                           wp->buffers[i].getImpl(),
                                            pkgData[i].bufferSize );
 
                 // Error
@@ -1836,22 +1926,8 @@ void SocketWriteThread::doJob ()
         //       by another SmartPtr instance.
 
         // Check if want to send and pause
-        if ( m_inPause ) {
-            // Lock
-            QMutexLocker locker( &m_jobMutex );
-            // Only `continue writing` and `stop write` calls
-            // can wake us, e.g. read thread can wake up write
-            // thread in case of SSL reading, but flags will be
-            // the same.
-            while ( m_threadState == ThreadIsStarted &&
-                    m_inPause && m_pausePkg.isValid() && m_pausePkg == p ) {
-                m_wait.wait( &m_jobMutex );
-            }
-
-            // Stop in progress
-            if ( m_threadState == ThreadIsStopping )
-                goto cleanup_and_disconnect;
-        }
+        if ( m_inPause && ! waitWhilePaused(p) )
+            goto cleanup_and_disconnect;
     }
 
  cleanup_and_disconnect:
@@ -1874,6 +1950,11 @@ void SocketWriteThread::doJob ()
         m_state = IOSender::Disconnected;
     }
 
+    // New jobs are not accepted from now, wait for jobs
+    // which are being pushed to the queue
+    while ( AtomicRead(&m_pushingJobs) )
+        QThread::yieldCurrentThread();
+
     // If we were successfully started:
     //   check write result,
     //   wake up all active jobs
@@ -1949,6 +2030,8 @@ void SocketWriteThread::doJob ()
     m_peerConnUuid = Uuid();
     m_peerProtoVersion = IOService::IOProtocolVersion;
     m_routingTable = IORoutingTable();
+    m_compressionCodec = IOCompression::NoCodec;
+    m_kernelTls = false;
     m_ssl = 0;
     m_sslSSLBio = 0;
     m_sslNetworkBio = 0;
@@ -2027,6 +2110,243 @@ bool SocketWriteThread::sendAndPauseWriting ( const SmartPtr<IOPackage>& p,
     return false;
 }
 
+bool SocketWriteThread::waitWhilePaused ( const SmartPtr<IOPackage>& p )
+{
+    // Lock
+    QMutexLocker locker( &m_jobMutex );
+    // Only `continue writing` and `stop write` calls
+    // can wake us, e.g. read thread can wake up write
+    // thread in case of SSL reading, but flags will be
+    // the same.
+    while ( m_threadState == ThreadIsStarted &&
+            m_inPause && m_pausePkg.isValid() && m_pausePkg == p ) {
+        m_wait.wait( &m_jobMutex );
+    }
+
+    // Stop in progress
+    return m_threadState != ThreadIsStopping;
+}
+
+#ifndef _WIN_ // Unix
+
+// Appends records with SSL header of plain data to iovec list.
+// NOTE: tails must have enough capacity, pointers to its items are kept
+static void appendPlainRecords ( QVector<struct iovec>& d,
+                                 QVector<SSLv3Header>& tails,
+                                 const SSLv3Header& full,
+                                 const void* buff, quint32 size )
+{
+    const char* outBuff = reinterpret_cast<const char*>(buff);
+    while ( size > 0 ) {
+        quint32 z = qMin<quint32>(SSLMaxDataLength, size);
+        d.push_back(iovec());
+        d.last().iov_len = sizeof(SSLv3Header);
+        if ( z == SSLMaxDataLength )
+            d.last().iov_base = const_cast<SSLv3Header*>(&full);
+        else {
+            Q_ASSERT(tails.size() < tails.capacity());
+            tails.push_back( full );
+            tails.last().sslDataLength = htons(z);
+            d.last().iov_base = &tails.last();
+        }
+
+        d.push_back(iovec());
+        d.last().iov_len = z;
+        d.last().iov_base = const_cast<char*>(outBuff);
+
+        size -= z;
+        outBuff += z;
+    }
+}
+
+bool SocketWriteThread::isPlainBatchable ( const SmartPtr<IOPackage>& p ) const
+{
+    // Unix descriptor is passed with the package, so it goes alone.
+    // Compressed package is written by the common path as well.
+    // SSL route is plain one if kernel encrypts the socket.
+    return p.isValid() &&
+        p->header.type != IOCommunicationMngPackage::AttachClient &&
+        (m_kernelTls ||
+         m_routingTable.findRoute(p->header.type) != IORoutingTable::SSLRoute) &&
+        ! IOCompression::isCompressible(p, m_compressionCodec);
+}
+
+void SocketWriteThread::collectPlainBatch ( const IOJobManager::JobRefType& first,
+                                            JobBatch& batch )
+{
+    QSharedPointer<IOJobManager::Job> h = first.toStrongRef();
+    Q_ASSERT(h.data());
+    batch.append( h );
+
+    // Heart beat job is not in active list, so take the head of the list
+    IOJobManager::JobRefType next =
+        ( first == m_jobManager->getHeartBeatJob(m_jobPool) ?
+          m_jobManager->getNextActiveJob(m_jobPool) :
+          m_jobManager->getFollowingActiveJob(m_jobPool, first) );
+
+    quint64 bytes = IOPACKAGESIZE(h->pkg->header.buffersNumber);
+
+    // Lock, pause package can't be changed while collecting
+    QMutexLocker locker( &m_jobMutex );
+
+    // Writing is paused after pause package, so it must be the last
+    if ( m_inPause && m_pausePkg == h->pkg )
+        return;
+
+    while ( batch.size() < MaxBatchPackages && bytes < MaxBatchBytes ) {
+        QSharedPointer<IOJobManager::Job> n = next.toStrongRef();
+        if ( n.isNull() || ! isPlainBatchable(n->pkg) )
+            break;
+
+        batch.append( n );
+        bytes += IOPACKAGESIZE(n->pkg->header.buffersNumber);
+        const IOPackage::PODData* pkgData = IODATAMEMBER(n->pkg);
+        for ( quint32 i = 0; i < n->pkg->header.buffersNumber; ++i )
+            bytes += pkgData[i].bufferSize;
+
+        if ( m_inPause && m_pausePkg == n->pkg )
+            break;
+
+        next = m_jobManager->getFollowingActiveJob( m_jobPool, next );
+    }
+}
+
+void SocketWriteThread::setCork ( bool cork )
+{
+    if ( m_corked == cork || ! m_canCork )
+        return;
+    if ( ! IOService::setSocketCork(m_sockHandle, cork) ) {
+        // Local sockets can't be corked, do not try again
+        m_canCork = false;
+        m_corked = false;
+        return;
+    }
+    m_corked = cork;
+}
+
+IOSendJob::Result SocketWriteThread::plainWriteBatch (
+    const JobBatch& batch,
+    IOService::TimeMark& lastHeartBeatMark )
+{
+    Q_ASSERT(! batch.isEmpty());
+
+    QList< SmartPtr<IOPackage> > pkgs;
+    quint32 segmentsNum = 0;
+    foreach ( const QSharedPointer<IOJobManager::Job>& h, batch ) {
+        // Increment package reference, to be sure it can't
+        // be freed in job destruction
+        SmartPtr<IOPackage> p = h->pkg;
+        Q_ASSERT( p.isValid() );
+        pkgs.append( p );
+        segmentsNum += 1 + (p->header.buffersNumber ?
+                            1 + p->header.buffersNumber : 0);
+
+        // Before write call
+        CALLBACK_MARK;
+        if ( p->callback.beforeSendCall ) {
+            p->callback.beforeSendCall( false, p->callback.sendContext,
+                                        m_currConnUuid,
+                                        m_peerConnUuid,
+                                        IOSendJob::Success, p );
+            WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+        }
+        m_wrListener->onBeforeWrite( this, p );
+        WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+    }
+
+    // Every segment is split to records with SSL header of plain data,
+    // exactly as #plainWrite does. Headers of full records are shared,
+    // each segment has its own header of the tail record.
+    SSLv3Header full;
+    full.type = 0xff;
+    full.sslVersion = 3;
+    full.sslDataLength = htons(SSLMaxDataLength);
+
+    QVector<SSLv3Header> tails;
+    tails.reserve( segmentsNum );
+    QVector<struct iovec> d;
+    d.reserve( segmentsNum * 2 );
+
+    for ( int n = 0; n < batch.size(); ++n ) {
+        const SmartPtr<IOPackage>& p = pkgs[n];
+        appendPlainRecords( d, tails, full, &batch[n]->pkgHeader,
+                            sizeof(IOPackage::PODHeader) );
+        if ( p->header.buffersNumber == 0 )
+            continue;
+
+        const IOPackage::PODData* pkgData = IODATAMEMBER(p);
+        appendPlainRecords( d, tails, full, pkgData, IODATASIZE(p) );
+        for ( quint32 i = 0; i < p->header.buffersNumber; ++i )
+            appendPlainRecords( d, tails, full, p->buffers[i].getImpl(),
+                                pkgData[i].bufferSize );
+    }
+
+    // Hold partial frames while burst continues
+    bool moreJobs = ! m_jobManager->getFollowingActiveJob(
+                                    m_jobPool, batch.last()).isNull();
+    if ( moreJobs || d.size() > MaxBatchIovecs )
+        setCork( true );
+
+    IOSendJob::Result writeRes = IOSendJob::Success;
+    for ( int i = 0; i < d.size() && writeRes == IOSendJob::Success;
+          i += MaxBatchIovecs ) {
+        writeRes = write( m_sockHandle, m_eventPipes[0],
+                          d.mid(i, MaxBatchIovecs), 0 );
+    }
+
+    // Flush if burst is over or writing is going to be paused
+    if ( ! moreJobs || m_inPause || writeRes != IOSendJob::Success )
+        setCork( false );
+
+    // NOTE: for now 'writeRes' is not used for detecting the reason
+    //       of write thread stop! will be implemented in future ...
+    IOSendJob::Result wrRes = writeRes;
+    if ( wrRes == IOSendJob::ConnClosedByPeer ||
+         wrRes == IOSendJob::ConnClosedByUser )
+        wrRes = IOSendJob::Fail;
+
+    for ( int n = 0; n < batch.size(); ++n ) {
+        const QSharedPointer<IOJobManager::Job>& h = batch[n];
+        const SmartPtr<IOPackage>& p = pkgs[n];
+
+        // Increment statistics value
+        if ( wrRes == IOSendJob::Success )
+            AtomicInc64(&m_stat.sentPackages);
+
+        // After write call
+        {
+            CALLBACK_MARK;
+            if ( p->callback.afterSendCall ) {
+                p->callback.afterSendCall( true, p->callback.sendContext,
+                                           m_currConnUuid,
+                                           m_peerConnUuid,
+                                           wrRes, p );
+                WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+            }
+            m_wrListener->onAfterWrite( this, wrRes, p );
+            WARN_IF_CALLBACK_TOOK_MUCH_TIME;
+        }
+
+        h->sendJob->wakeSendWaitings( wrRes );
+        if ( wrRes != IOSendJob::Success )
+            h->sendJob->wakeResponseWaitings( wrRes,
+                                              IOSender::Handle(),
+                                              SmartPtr<IOPackage>() );
+
+        // Heart beat has been sent! Mark this timestamp
+        if ( h == m_jobManager->getHeartBeatJob(m_jobPool).toStrongRef() &&
+             wrRes == IOSendJob::Success )
+            IOService::timeMark(lastHeartBeatMark);
+
+        // Mark as not active just after all access to this job.
+        m_jobManager->putActiveJob( m_jobPool, h );
+    }
+
+    return writeRes;
+}
+
+#endif // Unix
+
 void SocketWriteThread::continueWriting ()
 {
     // Lock
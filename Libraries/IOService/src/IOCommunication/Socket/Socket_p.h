@@ -54,6 +54,7 @@
 #include <QVector>
 
 #include "../IOConnection.h"
+#include "../IOCompression.h"
 #include "SocketListeners_p.h"
 #include "SslHelper.h"
 
@@ -147,6 +148,12 @@ bool setCloseOnExec ( int );
  */
 bool setSocketOptions ( int );
 
+/**
+ * Holds (cork is true) or flushes (cork is false) partial frames
+ * of TCP socket. Returns false if socket can't be corked.
+ */
+bool setSocketCork ( int, bool cork );
+
 /**
  * Returns numeric host name and numeric port number of the sockaddr
  */
@@ -262,7 +269,9 @@ public:
                             const Uuid& currConnUuid,
                             const Uuid& peerConnUuid,
                             const IOCommunication::ProtocolVersion& protoVer,
-                            const IORoutingTable& routingTable
+                            const IORoutingTable& routingTable,
+                            IOCompression::Codec compressionCodec,
+                            bool kernelTls
 #ifndef _WIN_ // Unix
                             , int eventPipes[2]
 #endif
@@ -330,8 +339,8 @@ private:
     // NOTE: not thread-safe
     void __finalizeThread ();
 
-    void setUuidsToPkgHeaderAndRegisterJob ( IOPackage::PODHeader&,
-                                             SmartPtr<IOSendJob>& ) const;
+    void setUuidsToPkgHeader ( IOPackage::PODHeader&,
+                               const Uuid& currConnUuid ) const;
     IOSendJob::Result sslWriteFromNetworkBio ( int sock,
 #ifdef _WIN_ // Windows
                                                volatile ThreadState& threadState,
@@ -343,6 +352,28 @@ private:
                                                quint32 msecsTimeout = 0,
                                                int* unixfd = 0 );
     bool sendAndPauseWriting ( const SmartPtr<IOPackage>&, bool isDetaching );
+    // Waits while writing is paused after the package.
+    // Returns false if stop is in progress.
+    bool waitWhilePaused ( const SmartPtr<IOPackage>& );
+
+#ifndef _WIN_ // Unix
+    typedef QList< QSharedPointer<IOJobManager::Job> > JobBatch;
+
+    // Plain packages batching limits
+    enum {
+        MaxBatchPackages = 64,
+        MaxBatchBytes = 1 << 20,
+        MaxBatchIovecs = 512
+    };
+
+    bool isPlainBatchable ( const SmartPtr<IOPackage>& ) const;
+    // Collects consecutive plain active jobs, starting from specified one
+    void collectPlainBatch ( const IOJobManager::JobRefType&, JobBatch& );
+    // Writes all packages of batch and puts their jobs back to pool
+    IOSendJob::Result plainWriteBatch ( const JobBatch&,
+                                        IOService::TimeMark& lastHeartBeatMark );
+    void setCork ( bool );
+#endif
 
 private:
     DEFINE_IO_LOG
@@ -357,6 +388,9 @@ private:
     Uuid m_peerConnUuid;
     IOCommunication::ProtocolVersion m_peerProtoVersion;
     IORoutingTable m_routingTable;
+    IOCompression::Codec m_compressionCodec;
+    // Kernel encrypts the socket, SSL route is written as plain
+    bool m_kernelTls;
     SmartPtr<IOJobManager::JobPool> m_jobPool;
 #ifdef _WIN_
     WSAOVERLAPPED m_sockOverlappedWrite;
@@ -370,6 +404,9 @@ private:
     QWaitCondition m_wait;
     QWaitCondition m_threadStateWait;
     mutable QMutex m_jobMutex;
+    // Jobs are pushed without m_jobMutex, see #sendPackage
+    unsigned m_writerSleeps;
+    unsigned m_pushingJobs;
     QMutex m_startStopMutex;
 
     // Pause and detach members
@@ -377,6 +414,12 @@ private:
     bool m_inPause;
     bool m_isDetaching;
 
+#ifndef _WIN_ // Unix
+    // Socket is corked during burst of plain packages
+    bool m_canCork;
+    bool m_corked;
+#endif
+
     // SSL members
     SSL* m_ssl;
     BIO* m_sslSSLBio;
@@ -396,6 +396,12 @@ int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 	return 0; // error
 }
 
+// Peer identity is checked after handshake, see #postHandshakeCheck
+static int accept_peer_callback(int, X509_STORE_CTX *)
+{
+	return 1;
+}
+
 bool SSLHelper::SSL_CTX_set_credentials(SSL_CTX* ctx, const IOCredentials& cert)
 {
 	SmartPtr< X509> peerCert (QByteArrayToX509(cert.certificate.toByteArray()), X509_free);
@@ -517,6 +523,10 @@ bool SSLHelper::SetLocalCredentials(const IOCredentials& credentials)
 	if (!SSL_CTX_set_credentials(s_serverSSLCtx, credentials))
 		return false;
 
+	// Client certificate is requested for the post connection check,
+	// as client gets the server one
+	SSL_CTX_set_verify(s_serverSSLCtx, SSL_VERIFY_PEER, accept_peer_callback);
+
 	s_localCert = QByteArrayToX509(credentials.certificate.toByteArray());
 
 	return (s_localCert);
@@ -578,6 +588,13 @@ QString SSLHelper::GetConnectionChipher(SSL* ssl)
 {
 	char buff[256];
 
+#ifdef TLS1_3_VERSION
+	// TLS 1.3 suites do not name key exchange (Kx=any): it is ephemeral
+	// DH, and the session is always authenticated by RSA certificate
+	if (SSL_version(ssl) == TLS1_3_VERSION)
+		return SSL_TXT_RSA;
+#endif
+
 	const char* desc = SSL_CIPHER_description(SSL_get_current_cipher(ssl), buff, sizeof(buff));
 
 	if (!desc)
@@ -64,6 +64,7 @@
  */
 
 #include "Logging.h"
+#include "LoggingBinary.h"
 #include "Build/Current.ver"
 
 #include <stdio.h>
@@ -103,6 +104,8 @@
 	#include <unistd.h>
 	#include <pwd.h>
 	#include <pthread.h>
+	#include <sys/uio.h>
+	#include <sched.h>
 #endif
 
 #if defined(_LIN_)
@@ -322,6 +325,56 @@ int LogCheckModifyRate(struct LogRateLimit *rl)
 }
 
 
+/**
+ * Take one message token from the call site bucket.
+ * Return 1 if the message should be written, number of messages
+ * suppressed at the site since the previous written one is returned
+ * in *suppressed then.
+ */
+int LogTakeToken(struct LogTokenBucket *tb, unsigned *suppressed)
+{
+	LogStateSaver saver;
+	int res = 0;
+
+	UINT64 now = (UINT64)(
+#ifndef _WIN_
+		PrlGetTickCount64() * 1000 / PrlGetTicksPerSecond()
+#else
+		/* FIXME: Windows tools can not have dependency from Libraries/Std */
+		GetTickCount()
+#endif
+		);
+
+	/* The bucket is contended only while the site floods the log,
+	 * so the thread which can't take it just counts the message */
+	if (AtomicCompareSwap(&tb->lock, 0, 1) != 0) {
+		AtomicInc(&tb->suppressed);
+		return 0;
+	}
+
+	UINT64 full = (UINT64)tb->burst * LOG_TOKEN_SCALE;
+	if (!tb->primed) {
+		tb->tokens = full;
+		tb->primed = 1;
+	} else if (now > tb->last) {
+		/* rate is per second, token is scaled by 1000 - so per msec */
+		UINT64 refill = (now - tb->last) * tb->rate;
+		tb->tokens = (refill >= full - tb->tokens) ? full : tb->tokens + refill;
+	}
+	tb->last = now;
+
+	if (tb->tokens >= LOG_TOKEN_SCALE) {
+		tb->tokens -= LOG_TOKEN_SCALE;
+		*suppressed = (unsigned)AtomicSwap(&tb->suppressed, 0);
+		res = 1;
+	} else
+		AtomicInc(&tb->suppressed);
+
+	AtomicWrite(&tb->lock, 0);
+	return res;
+}
+
+
 /**
  * Perform actual output of the log message.
  */
@@ -677,9 +730,366 @@ static void log_write(const char *msg, int length)
 	write(fd, msg, length);
 }
 
+#ifndef _WIN_
+/**
+ * Asynchronous logging backend.
+ *
+ * Logging threads copy formatted lines to the bounded MPSC ring and
+ * return, single writer thread drains the ring with writev(), so disk
+ * I/O and log rotation checks are done out of the callers.
+ *
+ * Ring consists of fixed size slots, each slot keeps its sequence:
+ *   seq == ticket      - slot is free for the line with this ticket
+ *   seq == ticket + 1  - slot is filled and can be written out
+ * Line occupies several consecutive slots, which are reserved at once by
+ * moving the head over them. Writer frees slots strictly in ticket order,
+ * so if the last slot of the range is free, all the others are free too.
+ *
+ * If there is no room in the ring line is dropped, never waited for,
+ * dropped lines are counted and reported to the log by the writer.
+ *
+ * Records of the binary logging mode share the ring, every slot tells
+ * which file it goes to.
+ */
+#define LOG_ASYNC_SLOT_SIZE		256
+#define LOG_ASYNC_SLOTS			4096	/* power of 2 */
+#define LOG_ASYNC_BATCH			256		/* slots per writev() */
+#define LOG_ASYNC_IDLE_MS		100
+#define LOG_ASYNC_WAKE_SLOTS	(LOG_ASYNC_SLOTS / 8)
+#define LOG_ASYNC_FLUSH_SPINS	100
+
+struct LogAsyncSlot
+{
+	UINT64 seq;
+	unsigned len;
+	int binary;
+	char data[LOG_ASYNC_SLOT_SIZE];
+};
+
+struct PRL_ALIGN(64) LogAsyncData
+{
+	/* reserved by logging threads */
+	UINT64 head;
+	char __pad1[64 - sizeof(UINT64)];
+	/* written out by the writer */
+	UINT64 tail;
+	UINT64 dropped;
+	UINT64 reported;
+	int enabled;
+	int producers;
+	int sleeping;
+	int draining;
+	int stop;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_mutex_t control;
+	struct LogAsyncSlot *slots;
+};
+
+static struct LogAsyncData __log_async = {
+	0, { 0 }, 0, 0, 0,
+	0, 0, 0, 0, 0,
+	0,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,
+	NULL
+};
+
+static FILE_HANDLE log_bin_current_fd();
+
+static void log_async_reset(struct LogAsyncData *a)
+{
+	UINT64 i;
+
+	a->head = a->tail = 0;
+	for (i = 0; i < LOG_ASYNC_SLOTS; ++i) {
+		a->slots[i].seq = i;
+		a->slots[i].len = 0;
+	}
+}
+
+/**
+ * Reserve consecutive slots for the line or the binary record and fill them.
+ * Return 0 if asynchronous logging is off and line should be written
+ * synchronously, 1 if line is queued or dropped.
+ */
+static int log_async_put(const char *msg, int length, int binary)
+{
+	struct LogAsyncData *a = &__log_async;
+	UINT64 pos, last, seq;
+	unsigned n, i;
+
+	if (!a->enabled)
+		return 0;
+
+	AtomicInc(&a->producers);
+	if (!AtomicRead(&a->enabled)) {
+		AtomicDec(&a->producers);
+		return 0;
+	}
+
+	n = (length + LOG_ASYNC_SLOT_SIZE - 1) / LOG_ASYNC_SLOT_SIZE;
+	pos = AtomicRead(&a->head);
+	for (;;) {
+		last = pos + n - 1;
+		seq = AtomicRead(&a->slots[last & (LOG_ASYNC_SLOTS - 1)].seq);
+		if (seq == last) {
+			UINT64 cur = AtomicCompareSwap(&a->head, pos, pos + n);
+			if (cur == pos)
+				break;
+			pos = cur;
+		} else if ((LONG64)(seq - last) < 0) {
+			/* slot is still busy with the line of the previous lap */
+			AtomicInc(&a->dropped);
+			AtomicDec(&a->producers);
+			return 1;
+		} else
+			pos = AtomicRead(&a->head);
+	}
+
+	for (i = 0; i < n; ++i, length -= LOG_ASYNC_SLOT_SIZE) {
+		struct LogAsyncSlot *s = &a->slots[(pos + i) & (LOG_ASYNC_SLOTS - 1)];
+
+		s->len = length < LOG_ASYNC_SLOT_SIZE ? length : LOG_ASYNC_SLOT_SIZE;
+		s->binary = binary;
+		memcpy(s->data, msg + i * LOG_ASYNC_SLOT_SIZE, s->len);
+		WriteMemoryBarrier();
+		AtomicWrite(&s->seq, pos + i + 1);
+	}
+
+	/* Idle writer wakes up by itself every LOG_ASYNC_IDLE_MS, so it is
+	 * woken up early only if the ring is filling up. Wake up is not ordered
+	 * with the writer going to sleep, lost one just costs some latency */
+	if (pos + n - AtomicRead(&a->tail) >= LOG_ASYNC_WAKE_SLOTS &&
+		AtomicRead(&a->sleeping) && AtomicSwap(&a->sleeping, 0)) {
+		pthread_mutex_lock(&a->lock);
+		pthread_cond_signal(&a->wake);
+		pthread_mutex_unlock(&a->lock);
+	}
+
+	AtomicDec(&a->producers);
+	return 1;
+}
+
+/**
+ * Write out filled slots. Slots are freed only if release is set, caller
+ * must own draining flag then. Otherwise slots are just written, since
+ * a late store of the slot sequence would free it once more after
+ * a producer has filled it for the next lap.
+ * Return number of slots written.
+ */
+static unsigned log_async_drain(struct LogAsyncData *a, int release)
+{
+	struct iovec iov[LOG_ASYNC_BATCH];
+	UINT64 tail = AtomicRead(&a->tail), t;
+	unsigned n = 0, total = 0;
+	FILE_HANDLE fd;
+
+	for (;;) {
+		int binary = 0;
+
+		/* batch goes to one file, it ends where the other file begins */
+		for (n = 0; n < LOG_ASYNC_BATCH; ++n) {
+			struct LogAsyncSlot *s = &a->slots[(tail + n) & (LOG_ASYNC_SLOTS - 1)];
+			if (AtomicRead(&s->seq) != tail + n + 1)
+				break;
+			ReadMemoryBarrier();
+			if (n == 0)
+				binary = s->binary;
+			else if (s->binary != binary)
+				break;
+			iov[n].iov_base = s->data;
+			iov[n].iov_len = s->len;
+		}
+		if (n == 0)
+			break;
+		/* writer may free slots meanwhile and producers refill them,
+		 * do not write more than one lap */
+		if (!release && total + n > LOG_ASYNC_SLOTS)
+			break;
+
+		fd = binary ? log_bin_current_fd() : log_get_fd();
+		if (fd >= 0)
+			writev(fd, iov, n);
+		total += n;
+		if (!release) {
+			tail += n;
+			continue;
+		}
+
+		for (t = tail; t < tail + n; ++t)
+			AtomicWrite(&a->slots[t & (LOG_ASYNC_SLOTS - 1)].seq,
+						t + LOG_ASYNC_SLOTS);
+		tail += n;
+		AtomicWrite(&a->tail, tail);
+	}
+
+	UINT64 dropped = AtomicRead(&a->dropped);
+	if (release && dropped != a->reported) {
+		char buf[256];
+		int len = GetDateTimeString(buf);
+		len += snprintf(buf + len, sizeof(buf) - len,
+						"W /%u/ %llu log messages dropped, log ring is full\n",
+						(unsigned)getpid(),
+						(unsigned long long)(dropped - a->reported));
+		a->reported = dropped;
+		fd = log_get_fd();
+		if (fd >= 0)
+			write(fd, buf, len);
+	}
+
+	return total;
+}
+
+static void *log_async_writer(void *arg)
+{
+	struct LogAsyncData *a = (struct LogAsyncData *)arg;
+
+	for (;;) {
+		while (AtomicCompareSwap(&a->draining, 0, 1) != 0)
+			Sleep(1);
+		unsigned written = log_async_drain(a, 1);
+		AtomicWrite(&a->draining, 0);
+
+		if (written != 0)
+			continue;
+		if (AtomicRead(&a->stop))
+			break;
+
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_ASYNC_IDLE_MS * 1000000;
+		ts.tv_sec += ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+
+		pthread_mutex_lock(&a->lock);
+		AtomicSwap(&a->sleeping, 1);
+		/* recheck after sleeping flag is visible to producers */
+		if (AtomicRead(&a->slots[a->tail & (LOG_ASYNC_SLOTS - 1)].seq) !=
+				a->tail + 1 && !AtomicRead(&a->stop))
+			pthread_cond_timedwait(&a->wake, &a->lock, &ts);
+		AtomicWrite(&a->sleeping, 0);
+		pthread_mutex_unlock(&a->lock);
+	}
+	return NULL;
+}
+
+/* Writer thread is not inherited by the child, log there synchronously */
+static void log_async_atfork_child()
+{
+	struct LogAsyncData *a = &__log_async;
+
+	a->enabled = 0;
+	a->producers = 0;
+	a->sleeping = 0;
+	a->draining = 0;
+	a->stop = 0;
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->wake, NULL);
+	pthread_mutex_init(&a->control, NULL);
+	if (a->slots != NULL)
+		log_async_reset(a);
+}
+#endif
+
+/**
+ * Enable/disable asynchronous writing of the log file
+ */
+int SetAsyncLogging(int enable)
+{
+#ifndef _WIN_
+	static int atfork_registered;
+	struct LogAsyncData *a = &__log_async;
+	int prev;
+
+	pthread_mutex_lock(&a->control);
+	prev = a->enabled;
+	if (!!enable == prev)
+		goto out;
+
+	if (enable) {
+		if (a->slots == NULL) {
+			/* never freed: late producers may still look at it */
+			a->slots = (struct LogAsyncSlot *)calloc(LOG_ASYNC_SLOTS,
+													 sizeof(*a->slots));
+			if (a->slots == NULL)
+				goto out;
+			log_async_reset(a);
+		}
+		if (!atfork_registered) {
+			pthread_atfork(NULL, NULL, log_async_atfork_child);
+			atfork_registered = 1;
+		}
+		a->stop = 0;
+		if (pthread_create(&a->writer, NULL, log_async_writer, a) != 0)
+			goto out;
+		AtomicWrite(&a->enabled, 1);
+	} else {
+		AtomicSwap(&a->enabled, 0);
+		/* lines being queued now must reach the writer before it exits */
+		while (AtomicRead(&a->producers) != 0)
+			Sleep(1);
+		AtomicWrite(&a->stop, 1);
+		pthread_mutex_lock(&a->lock);
+		pthread_cond_signal(&a->wake);
+		pthread_mutex_unlock(&a->lock);
+		pthread_join(a->writer, NULL);
+	}
+out:
+	pthread_mutex_unlock(&a->control);
+	return prev;
+#else
+	(void)enable;
+	return 0;
+#endif
+}
+
+/**
+ * Write out all queued lines from the calling thread
+ */
+void LogFlush()
+{
+#ifndef _WIN_
+	struct LogAsyncData *a = &__log_async;
+	int i;
+
+	if (a->slots == NULL)
+		return;
+
+	/* Writer may be the crashed thread itself, so do not wait forever,
+	 * duplicated lines are better than lost ones. Without the flag
+	 * slots are only written, the writer may be still draining them */
+	for (i = 0; i < LOG_ASYNC_FLUSH_SPINS; ++i) {
+		if (AtomicCompareSwap(&a->draining, 0, 1) == 0)
+			break;
+		Sleep(1);
+	}
+	log_async_drain(a, i < LOG_ASYNC_FLUSH_SPINS);
+	if (i < LOG_ASYNC_FLUSH_SPINS)
+		AtomicWrite(&a->draining, 0);
+#endif
+}
+
+/**
+ * Return number of lines dropped due to full ring of asynchronous logging
+ */
+unsigned long long GetLogDroppedMessages()
+{
+#ifndef _WIN_
+	return AtomicRead(&__log_async.dropped);
+#else
+	return 0;
+#endif
+}
+
 void Logger::PutMessage(const char* const msg, int length)
 {
-	log_write(msg, length);
+#ifndef _WIN_
+	if (!log_async_put(msg, length, 0))
+#endif
+		log_write(msg, length);
 
 #ifndef EXTERNALLY_AVAILABLE_BUILD
 	if (g_d()->is_console_enabled)
@@ -687,6 +1097,450 @@ void Logger::PutMessage(const char* const msg, int length)
 #endif
 }
 
+int __log_binary = 0;
+
+#ifndef _WIN_
+/**
+ * Binary logging mode, see LoggingBinary.h for the stream format.
+ *
+ * Generation of the binary file is changed on every (re)open, call site
+ * is described again in the new file before its next message. Messages
+ * logged right at the moment of reopen may refer to site described in
+ * the previous file, decoder prints them without format.
+ */
+#define LOG_SITE_BUSY	((unsigned)-1)
+
+struct PRL_ALIGN(8) LogBinData
+{
+	UINT64 timestamp;
+	FILE_HANDLE fd;
+	unsigned gen;
+	unsigned sites;
+};
+
+static struct LogBinData __log_bin = {
+	0,						/* timestamp */
+	INVALID_FILE_HANDLE,	/* fd */
+	0,						/* gen */
+	0						/* sites */
+};
+
+/* File for the binary records written by the asynchronous writer */
+static FILE_HANDLE log_bin_current_fd()
+{
+	return AtomicRead(&__log_bin.fd);
+}
+
+/* Thread id is cached, gettid() costs more than the whole record */
+static __thread UINT32 __log_bin_pid;
+static __thread UINT32 __log_bin_tid;
+
+static void log_bin_header(struct LogBinHeader *h, UINT16 type, UINT32 size)
+{
+	if (__log_bin_tid == 0) {
+		__log_bin_pid = (UINT32)getpid();
+		__log_bin_tid = (UINT32)syscall(__NR_gettid);
+	}
+	h->magic = LOG_BIN_MAGIC;
+	h->type = type;
+	h->size = size;
+	h->pid = __log_bin_pid;
+	h->tid = __log_bin_tid;
+}
+
+static void log_bin_atfork_child()
+{
+	__log_bin_pid = 0;
+	__log_bin_tid = 0;
+}
+
+static void log_bin_clock(FILE_HANDLE fd)
+{
+	struct LogBinClock c;
+	struct timeval tv;
+	struct tm t;
+
+	memset(&c, 0, sizeof(c));
+	log_bin_header(&c.h, LOG_BIN_CLOCK, sizeof(c));
+	c.ticks = PrlTicks();
+	c.frequency = PrlTicksFrequency();
+	gettimeofday(&tv, NULL);
+	c.usecs = (UINT64)tv.tv_sec * 1000000 + tv.tv_usec;
+	time_t stamp_time = tv.tv_sec;
+	c.utc_offset = localtime_r(&stamp_time, &t) ? (INT32)t.tm_gmtoff : 0;
+	write(fd, &c, sizeof(c));
+}
+
+/**
+ * Same as log_get_fd() for the binary file, also returns its generation.
+ */
+static FILE_HANDLE log_bin_get_fd(unsigned *gen)
+{
+	struct LogBinData *b = &__log_bin;
+	UINT64 timestamp = (UINT64)time(NULL);
+	char filename[sizeof(g_d()->logFileName) + sizeof(LOG_BIN_SUFFIX)];
+	struct stat st1, st2;
+	FILE_HANDLE fd = b->fd;
+
+	*gen = b->gen;
+	if (fd != INVALID_FILE_HANDLE) {
+		if (timestamp == b->timestamp)
+			return fd;
+		if (timestamp == AtomicSwap(&b->timestamp, timestamp))
+			return fd;
+	}
+
+	snprintf(filename, sizeof(filename), "%s" LOG_BIN_SUFFIX, GetLogFileName());
+	if (fd != INVALID_FILE_HANDLE &&
+		stat(filename, &st1) == 0 && fstat(fd, &st2) == 0 &&
+		st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) {
+		/* ticks may drift from the wall time, resync them once a second */
+		log_bin_clock(fd);
+		return fd;
+	}
+
+	fd = __log_open(filename);
+	if (fd == INVALID_FILE_HANDLE)
+		return fd;
+	log_bin_clock(fd);
+
+	AtomicInc(&b->gen);
+	fd = AtomicSwap(&b->fd, fd);
+	if (fd != INVALID_FILE_HANDLE)
+		/* the same race with other threads as in log_get_fd() */
+		close(fd);
+
+	*gen = b->gen;
+	return b->fd;
+}
+
+/**
+ * Collect argument kinds of the printf format.
+ * Return 0 if format has conversions which can't be deferred.
+ */
+static int log_bin_parse(const char *fmt, unsigned char *kinds,
+						 unsigned char *nargs)
+{
+	unsigned n = 0;
+	const char *p;
+
+	for (p = fmt; *p; ++p) {
+		int len = 0;
+
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+
+		while (*p && strchr("-+ #0'I", *p)) {
+			/* MSVC I32/I64 size is the width of glibc I flag, let
+			 * vsnprintf() decide what the argument is */
+			if (*p == 'I' && p[1] >= '0' && p[1] <= '9')
+				return 0;
+			++p;
+		}
+		if (*p == '*') {
+			if (n == LOG_BIN_MAX_ARGS)
+				return 0;
+			kinds[n++] = LOG_ARG_INT;
+			++p;
+		} else
+			while (*p >= '0' && *p <= '9')
+				++p;
+		/* positional arguments */
+		if (*p == '$')
+			return 0;
+		if (*p == '.') {
+			if (*++p == '*') {
+				if (n == LOG_BIN_MAX_ARGS)
+					return 0;
+				kinds[n++] = LOG_ARG_INT;
+				++p;
+			} else
+				while (*p >= '0' && *p <= '9')
+					++p;
+		}
+
+		switch (*p) {
+		case 'h':
+			if (*++p == 'h')
+				++p;
+			break;
+		case 'l':
+			len = LOG_ARG_LONG;
+			if (*++p == 'l') {
+				len = LOG_ARG_LLONG;
+				++p;
+			}
+			break;
+		case 'q':
+			len = LOG_ARG_LLONG;
+			++p;
+			break;
+		case 'j':
+		case 'z':
+		case 't':
+			len = LOG_ARG_SIZE;
+			++p;
+			break;
+		}
+
+		if (n == LOG_BIN_MAX_ARGS)
+			return 0;
+
+		switch (*p) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			kinds[n++] = len ? len : LOG_ARG_INT;
+			break;
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			kinds[n++] = LOG_ARG_DOUBLE;
+			break;
+		case 'c':
+			if (len)
+				return 0;
+			kinds[n++] = LOG_ARG_INT;
+			break;
+		case 's':
+			if (len)
+				return 0;
+			kinds[n++] = LOG_ARG_STRING;
+			break;
+		case 'p':
+			kinds[n++] = LOG_ARG_PTR;
+			break;
+		default:
+			/* %n, %m, long double, wide chars and garbage */
+			return 0;
+		}
+	}
+
+	*nargs = (unsigned char)n;
+	return 1;
+}
+
+static const char *log_basename(const char *file)
+{
+	const char *p = file;
+
+	for (; *file; ++file)
+		if (*file == '\\' || *file == '/')
+			p = file + 1;
+	return p;
+}
+
+static const char *log_funcname(const char *func)
+{
+	const char *p = func;
+
+	for (; *func; ++func)
+		if (*func == ':')
+			p = func + 1;
+	return p;
+}
+
+static UINT16 log_bin_string(char *rec, UINT32 *size, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	if (len > LOG_BIN_MAX_RECORD - *size)
+		len = LOG_BIN_MAX_RECORD - *size;
+	if (len != 0)
+		memcpy(rec + *size, str, len);
+	*size += len;
+	return (UINT16)len;
+}
+
+/**
+ * Describe call site in the current generation of the binary file,
+ * only one thread writes site record, the others wait for it.
+ */
+static void log_bin_define(struct LogSite *site, FILE_HANDLE fd, unsigned gen,
+						   const char *file, int line, const char *function,
+						   const char *prefix, const char *target,
+						   const char *fmt)
+{
+	unsigned cur = AtomicRead(&site->gen);
+
+	while (cur != gen) {
+		if (cur == LOG_SITE_BUSY ||
+			AtomicCompareSwap(&site->gen, cur, LOG_SITE_BUSY) != cur) {
+			sched_yield();
+			cur = AtomicRead(&site->gen);
+			continue;
+		}
+
+		if (site->id == 0) {
+			if (!log_bin_parse(fmt, site->kinds, &site->nargs)) {
+				site->text = 1;
+				site->nargs = 1;
+				site->kinds[0] = LOG_ARG_STRING;
+			}
+			site->id = AtomicAdd(&__log_bin.sites, 1) + 1;
+		}
+
+		char rec[LOG_BIN_MAX_RECORD];
+		struct LogBinSite *s = (struct LogBinSite *)rec;
+		UINT32 size = sizeof(*s);
+
+		memset(s, 0, sizeof(*s));
+		s->id = site->id;
+		s->line = line;
+		s->nargs = site->nargs;
+		memcpy(s->kinds, site->kinds, sizeof(s->kinds));
+		s->format_len = log_bin_string(rec, &size, site->text ? "%s" : fmt);
+		if (file && function) {
+			s->file_len = log_bin_string(rec, &size, log_basename(file));
+			s->function_len = log_bin_string(rec, &size,
+											 log_funcname(function));
+		}
+		s->prefix_len = log_bin_string(rec, &size, prefix);
+		s->target_len = log_bin_string(rec, &size, target);
+		log_bin_header(&s->h, LOG_BIN_SITE, size);
+		write(fd, rec, size);
+
+		AtomicWrite(&site->gen, gen);
+		break;
+	}
+}
+
+static void log_bin_arg(char *rec, UINT32 *size, UINT64 v)
+{
+	if (*size + sizeof(v) > LOG_BIN_MAX_RECORD)
+		return;
+	memcpy(rec + *size, &v, sizeof(v));
+	*size += sizeof(v);
+}
+
+static void log_bin_string_arg(char *rec, UINT32 *size, const char *str)
+{
+	UINT32 len;
+
+	if (*size + sizeof(len) > LOG_BIN_MAX_RECORD)
+		return;
+	if (str == NULL) {
+		len = LOG_BIN_NULL_STR;
+		memcpy(rec + *size, &len, sizeof(len));
+		*size += sizeof(len);
+		return;
+	}
+
+	*size += sizeof(len);
+	len = log_bin_string(rec, size, str);
+	memcpy(rec + *size - len - sizeof(len), &len, sizeof(len));
+}
+#endif
+
+/**
+ * Write the message in binary, or format it as usual if binary file
+ * can't be used.
+ */
+void log_binary(struct LogSite *site,
+				const char *file, int line, const char *function,
+				const char *prefix, const char *target,
+				int level, const char* fmt, ...)
+{
+	LogStateSaver saver;
+	va_list args;
+
+	va_start(args, fmt);
+#ifndef _WIN_
+	FILE_HANDLE fd = INVALID_FILE_HANDLE;
+	unsigned gen = 0;
+
+	if (log_cb == Logger::PutMessage
+#ifndef EXTERNALLY_AVAILABLE_BUILD
+		&& !g_d()->is_console_enabled
+#endif
+		)
+		fd = log_bin_get_fd(&gen);
+
+	if (fd != INVALID_FILE_HANDLE) {
+		char rec[LOG_BIN_MAX_RECORD];
+		struct LogBinMessage *m = (struct LogBinMessage *)rec;
+		UINT32 size = sizeof(*m);
+		unsigned i;
+
+		log_bin_define(site, fd, gen, file, line, function,
+					   prefix, target, fmt);
+
+		m->id = site->id;
+		m->level = level;
+		m->ticks = PrlTicks();
+
+		if (site->text) {
+			char message[4096];
+			/* %m needs errno of the caller */
+			errno = saver.m_LastError;
+			vsnprintf(message, sizeof(message), fmt, args);
+			log_bin_string_arg(rec, &size, message);
+		} else {
+			for (i = 0; i < site->nargs; ++i) {
+				switch (site->kinds[i]) {
+				case LOG_ARG_INT:
+					log_bin_arg(rec, &size, (UINT64)va_arg(args, int));
+					break;
+				case LOG_ARG_LONG:
+					log_bin_arg(rec, &size, (UINT64)va_arg(args, long));
+					break;
+				case LOG_ARG_LLONG:
+					log_bin_arg(rec, &size, (UINT64)va_arg(args, long long));
+					break;
+				case LOG_ARG_SIZE:
+					log_bin_arg(rec, &size, (UINT64)va_arg(args, size_t));
+					break;
+				case LOG_ARG_DOUBLE: {
+					double d = va_arg(args, double);
+					UINT64 v;
+					memcpy(&v, &d, sizeof(v));
+					log_bin_arg(rec, &size, v);
+					break;
+				}
+				case LOG_ARG_PTR:
+					log_bin_arg(rec, &size,
+								(UINT64)(ULONG_PTR)va_arg(args, void *));
+					break;
+				case LOG_ARG_STRING:
+					log_bin_string_arg(rec, &size, va_arg(args, const char *));
+					break;
+				}
+			}
+		}
+
+		log_bin_header(&m->h, LOG_BIN_MESSAGE, size);
+		if (!log_async_put(rec, size, 1))
+			write(fd, rec, size);
+		va_end(args);
+		return;
+	}
+#else
+	(void)site;
+#endif
+
+	Logger logger(file, line, function, prefix, target);
+	logger.ParseMessage(level, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Enable/disable binary logging mode
+ */
+int SetBinaryLogging(int enable)
+{
+#ifndef _WIN_
+	static int atfork_registered;
+
+	if (enable && !atfork_registered) {
+		pthread_atfork(NULL, NULL, log_bin_atfork_child);
+		atfork_registered = 1;
+	}
+	return AtomicSwap(&__log_binary, !!enable);
+#else
+	(void)enable;
+	return 0;
+#endif
+}
+
 
 /**
  * Set base path to the log file.
@@ -706,6 +1560,12 @@ void SetLogFileName(const char* path, const char *filename)
 	d->fd = INVALID_FILE_HANDLE;
 	if (fd != INVALID_FILE_HANDLE)
 		close(fd);
+
+#ifndef _WIN_
+	fd = AtomicSwap(&__log_bin.fd, INVALID_FILE_HANDLE);
+	if (fd != INVALID_FILE_HANDLE)
+		close(fd);
+#endif
 }
 
 
@@ -865,6 +1725,8 @@ static void __attribute__((destructor)) parkLogger()
 {
 	struct LoggerData* d = g_d();
 	int h = INVALID_FILE_HANDLE;
+
+	LogFlush();
 	h = AtomicSwap(&d->fd, h);
 	if (INVALID_FILE_HANDLE != h)
 	{
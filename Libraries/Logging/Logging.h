@@ -263,6 +263,25 @@ typedef void (*LogMsgFunc_t)(const char *const msg, int length);
  */
 extern int SetConsoleLogging(int enable);
 
+/**
+ * Enable/disable asynchronous writing of the log file: lines are queued
+ * to the bounded ring and written by the separate thread. Lines which do
+ * not fit the ring are dropped. Console output is always synchronous.
+ * return previous value
+ */
+extern int SetAsyncLogging(int enable);
+
+/**
+ * Write out all lines queued by asynchronous logging.
+ * Safe to be called from crash handlers.
+ */
+extern void LogFlush();
+
+/**
+ * Return number of lines dropped by asynchronous logging
+ */
+extern unsigned long long GetLogDroppedMessages();
+
 /**
  * Set path and name of the log file.
  */
@@ -297,6 +316,62 @@ struct LogRateLimit
 
 int LogCheckModifyRate(struct LogRateLimit *rl);
 
+/**
+ * Token bucket of the rate limited call site, to be used
+ * with WRITE_TRACE_TB() macro.
+ *
+ *	Example:
+ *		// 10 messages at once, then 1 per second
+ *		WRITE_TRACE_TB(1, 10, DBG_FATAL, "...");
+ */
+#define LOG_TOKEN_SCALE	1000
+
+struct LogTokenBucket
+{
+	unsigned rate;		// tokens per second
+	unsigned burst;		// size of the bucket
+	int lock;
+	int primed;			// bucket is filled up on the first use
+	int suppressed;		// messages dropped since the last written one
+	unsigned long long tokens;	// in 1/LOG_TOKEN_SCALE of token
+	unsigned long long last;	// in msecs, last refill timestamp
+};
+
+int LogTakeToken(struct LogTokenBucket *tb, unsigned *suppressed);
+
+/**
+ * State of the WRITE_TRACE call site in binary logging mode.
+ * Every call site has its own static zero initialized instance.
+ */
+struct LogSite
+{
+	unsigned gen;	// generation of the binary file site is described in
+	unsigned id;
+	int text;		// format can't be deferred, message is formatted
+	unsigned char nargs;
+	unsigned char kinds[LOG_BIN_MAX_ARGS];
+};
+
+extern int __log_binary;	/* binary logging mode is on */
+
+extern void log_binary(struct LogSite *site,
+					   const char *file, int line, const char *function,
+					   const char *prefix, const char *target,
+					   int level, const char* fmt, ...)
+#if defined(__GNUC__)
+	__attribute__ ((format(printf, 8, 9)))
+#endif
+	;
+
+/**
+ * Enable/disable binary logging mode: messages with literal format
+ * strings are written to the log file name + ".bin" as format id, ticks
+ * and raw arguments, and formatted offline by prllogdecode utility.
+ * Mode is not used while console logging or message callback is set.
+ * return previous value
+ */
+extern int SetBinaryLogging(int enable);
+
 /**
  * Return current file path to which logs are written.
  */
@@ -418,15 +493,69 @@ static __inline int __dummy_log_message__(int xxx, ...)
 #endif
 
 
+/**
+ * Message of the level is not written: it is less important than both
+ * forced level of the module and either compile-time minimum level
+ * (see LOG_COMPILE_LEVEL) or current level of the application.
+ * For constant level below LOG_COMPILE_LEVEL the call is compiled out.
+ */
+#define __LOG_LEVEL_OFF(level)											\
+	((int)((level) % DBG_GROUP_SIZE) > FORCE_LOGGING_LEVEL &&			\
+	 ((int)((level) % DBG_GROUP_SIZE) > LOG_COMPILE_LEVEL ||			\
+	  (int)((level) % DBG_GROUP_SIZE) > __log_level))
+
+
 /** Write trace with rate limitator */
 #define WRITE_TRACE_RL(rate, level, ...) do {						\
 	static struct LogRateLimit lrl = {rate, (unsigned)-1};			\
+	if (__LOG_LEVEL_OFF(level))										\
+		break;														\
 	if (!LogCheckModifyRate(&lrl))									\
 		break;														\
 	WRITE_TRACE(level, __VA_ARGS__);								\
 } while (0)
 
 
+/**
+ * Write trace not more often than `rate` messages per second on average,
+ * up to `burst` messages may be written at once. Number of messages
+ * suppressed at the call site is written before the next passed one.
+ */
+#define WRITE_TRACE_TB(rate, burst, level, ...) do {					\
+	static struct LogTokenBucket __log_tb = {rate, burst, 0, 0, 0, 0, 0};	\
+	unsigned __log_suppressed = 0;										\
+	if (__LOG_LEVEL_OFF(level))											\
+		break;															\
+	if (!LogTakeToken(&__log_tb, &__log_suppressed))					\
+		break;															\
+	if (__log_suppressed != 0)											\
+		WRITE_TRACE(level, "%u similar messages were suppressed",		\
+					__log_suppressed);									\
+	WRITE_TRACE(level, __VA_ARGS__);									\
+} while (0)
+
+
+/**
+ * Binary mode defers formatting, so only literal format strings,
+ * which stay the same for the call site, are written in binary.
+ */
+#define __LOG_FIRST_ARG(first, ...)	first
+#if defined(__GNUC__)
+#define __LOG_LITERAL_FORMAT(...)	\
+	__builtin_constant_p(__LOG_FIRST_ARG(__VA_ARGS__, 0))
+#else
+#define __LOG_LITERAL_FORMAT(...)	0
+#endif
+
+#define __LOG_BINARY(file, line, function, level, ...)					\
+	if (__log_binary && __LOG_LITERAL_FORMAT(__VA_ARGS__)) {			\
+		static struct LogSite __log_site;								\
+		log_binary(&__log_site, file, line, function,					\
+				   FORCE_LOGGING_PREFIX, TO_STR(PRINTABLE_TARGET),		\
+				   (level), __VA_ARGS__);								\
+		break;															\
+	}
+
 /**
  * WRITE_TRACE interface definition
  *
@@ -439,9 +568,9 @@ static __inline int __dummy_log_message__(int xxx, ...)
 #if defined(LOGGING_ON) || defined(_DEBUG)
 
 #define WRITE_TRACE(level, ...)	do {										\
-	if ((int)((level) % DBG_GROUP_SIZE) > FORCE_LOGGING_LEVEL &&			\
-			(int)((level) % DBG_GROUP_SIZE) > __log_level)					\
+	if (__LOG_LEVEL_OFF(level))												\
 		break;																\
+	__LOG_BINARY(__FILE__, __LINE__, __PRL_FUNCTION__, level, __VA_ARGS__)	\
 	log_debug(__FILE__, __LINE__, __PRL_FUNCTION__, FORCE_LOGGING_PREFIX,	\
 			  TO_STR(PRINTABLE_TARGET), (level), __VA_ARGS__);				\
 } while (0)
@@ -449,9 +578,9 @@ static __inline int __dummy_log_message__(int xxx, ...)
 #else
 
 #define WRITE_TRACE(level, ...)		do {									\
-	if ((int)((level) % DBG_GROUP_SIZE) > FORCE_LOGGING_LEVEL &&			\
-			(int)((level) % DBG_GROUP_SIZE) > __log_level)					\
+	if (__LOG_LEVEL_OFF(level))												\
 		break;																\
+	__LOG_BINARY(0, 0, 0, level, __VA_ARGS__)								\
 	log_release(FORCE_LOGGING_PREFIX, TO_STR(PRINTABLE_TARGET),				\
 				(level), __VA_ARGS__);										\
 } while (0)
@@ -30,4 +30,4 @@ include(../../Build/qmake/staticlib.pri)
 # dependency from Libraries/Std can't be added thanks to cross-dependency
 
 win32: LIBS *= -lshell32 -lAdvapi32
-linux-*: LIBS += -lrt
+linux-*: LIBS += -lrt -lpthread
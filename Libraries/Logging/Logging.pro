@@ -36,6 +36,7 @@ contains( DEFINES, ENABLE_LOG4CXX ) {
 
 HEADERS += Logging.h
 HEADERS += LoggingConfig.h
+HEADERS += LoggingBinary.h
 SOURCES += Logging.cpp
 
 linux-*: QMAKE_CXXFLAGS = -Wno-unused-result
@@ -0,0 +1,133 @@
+/*
+ * LoggingBinary.h: Binary log stream format.
+ *
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+/*
+ * In binary mode messages are not formatted by the logging thread.
+ * Instead of the text line the following records are appended to the
+ * log file name + LOG_BIN_SUFFIX, every record with the single write():
+ *
+ *  - clock record binds ticks of the process to the wall time, it is
+ *    written on file open and once a second then;
+ *  - site record describes WRITE_TRACE call site: format string, file,
+ *    line, function, prefix, target and types of the format arguments.
+ *    It is written once before the first message of the site;
+ *  - message record keeps site id, level, ticks and raw arguments.
+ *
+ * With asynchronous logging message records are queued to the log ring
+ * as a whole and written by its writer thread, clock and site records
+ * are still written by the logging thread, before messages they describe.
+ *
+ * Several processes may share the file, so records keep pid and site
+ * ids are unique inside the process only. All fields are in the host
+ * byte order. Text is restored offline by prllogdecode utility.
+ */
+
+#ifndef __LOGGING_BINARY_H__
+#define __LOGGING_BINARY_H__
+
+#include "LoggingConfig.h"
+#include "Interfaces/VirtuozzoTypes.h"
+
+#define LOG_BIN_SUFFIX		".bin"
+#define LOG_BIN_MAGIC		0x4c42	/* "BL" */
+#define LOG_BIN_MAX_RECORD	4096
+
+enum LogBinRecordType
+{
+	LOG_BIN_CLOCK	= 1,
+	LOG_BIN_SITE	= 2,
+	LOG_BIN_MESSAGE	= 3
+};
+
+/**
+ * Types of format arguments. Every argument takes 8 bytes in the message
+ * record except of string, which is 4 bytes of length (LOG_BIN_NULL_STR
+ * for NULL pointer) followed by the bytes without trailing zero.
+ */
+enum LogBinArgKind
+{
+	LOG_ARG_INT		= 1,	/* int and promoted smaller types */
+	LOG_ARG_LONG	= 2,
+	LOG_ARG_LLONG	= 3,
+	LOG_ARG_SIZE	= 4,	/* size_t, ptrdiff_t, intmax_t */
+	LOG_ARG_DOUBLE	= 5,
+	LOG_ARG_PTR		= 6,
+	LOG_ARG_STRING	= 7
+};
+
+#define LOG_BIN_NULL_STR	((UINT32)-1)
+
+struct LogBinHeader
+{
+	UINT16 magic;
+	UINT16 type;
+	UINT32 size;		/* whole record including header */
+	UINT32 pid;
+	UINT32 tid;
+};
+
+struct LogBinClock
+{
+	struct LogBinHeader h;
+	UINT64 ticks;
+	UINT64 frequency;	/* ticks per second */
+	UINT64 usecs;		/* wall time since the Epoch */
+	INT32 utc_offset;	/* seconds east of UTC, to render local time */
+	UINT32 reserved;
+};
+
+/**
+ * Site record is followed by format, file, function, prefix and target
+ * strings without trailing zeroes. Empty file means that message has no
+ * location, as it is in release build.
+ */
+struct LogBinSite
+{
+	struct LogBinHeader h;
+	UINT32 id;
+	INT32 line;
+	UINT8 nargs;
+	UINT8 kinds[LOG_BIN_MAX_ARGS];
+	UINT8 reserved;
+	UINT16 format_len;
+	UINT16 file_len;
+	UINT16 function_len;
+	UINT16 prefix_len;
+	UINT16 target_len;
+};
+
+/**
+ * Message record is followed by arguments of site kinds.
+ */
+struct LogBinMessage
+{
+	struct LogBinHeader h;
+	UINT32 id;
+	INT32 level;
+	UINT64 ticks;
+};
+
+#endif // __LOGGING_BINARY_H__
@@ -85,6 +85,20 @@
 // Logging level (by default)
 #define DBG_LEVEL	(DBG_INFO)
 
+/**
+ * Compile-time minimum logging level: WRITE_TRACE calls with constant level
+ * less important than this one are removed from the build entirely, so the
+ * arguments are never evaluated. Release builds drop DBG_TRACE calls.
+ * Could be overridden with -DLOG_COMPILE_LEVEL=<level> for the module.
+ */
+#ifndef LOG_COMPILE_LEVEL
+	#if defined(_DEBUG) || defined(LOGGING_ON) || defined(FORCE_LOGGING_ON)
+		#define LOG_COMPILE_LEVEL	(DBG_TRACE)
+	#else
+		#define LOG_COMPILE_LEVEL	(DBG_DEBUG)
+	#endif
+#endif
+
 
 /**
  * Log buffer size.
@@ -102,6 +116,13 @@
 #define LOG_BUFF_SIZE	((LOG_BUFF_PAGES) * 0x1000)
 
 
+/**
+ * Max number of format arguments of the message in binary logging mode,
+ * messages with more arguments are formatted by the caller.
+ */
+#define LOG_BIN_MAX_ARGS	16
+
+
 /**
  * Default log file names.
  */
@@ -104,3 +104,9 @@ const QByteArray &CVmBinaryEventParameter::GetByteArray() const
 	return (m_ByteArray);
 }
 
+void CVmBinaryEventParameter::SetByteArray(const QByteArray &baData)
+{
+	m_ByteArray = baData;
+	m_Buffer.reset();
+}
+
@@ -65,6 +65,11 @@ public:
 	 * Returns internal binary buffer
 	 */
 	const QByteArray &GetByteArray() const;
+	/**
+	 * Replaces internal binary buffer
+	 * @param new buffer contents
+	 */
+	void SetByteArray(const QByteArray &baData);
 
 public:
 	/**
@@ -26,7 +26,11 @@
  */
 
 
+#include <limits>
 #include <QTextStream>
+#include <QtEndian>
+#include <QHash>
+#include <QVector>
 #include "../PrlUuid/Uuid.h"
 #include "CVmEvent.h"
 #include "CVmEventParameter.h"
@@ -36,6 +40,361 @@
 #include "../Logging/Logging.h"
 #include "../PrlDataSerializer/CPrlStringDataSerializer.h"
 
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+// Binary encoding of event (all integers are little-endian):
+//
+//   u8[4] signature "\0EVB", u16 version, u16 reserved,
+//   u32 type, u32 level, u32 code, u32 need response, u32 issuer type,
+//   u64 event id, str issuer id, str source, str initial request id,
+//   u32 parameters count, parameters.
+//
+// Parameter:
+//
+//   u8 class type, u8 is list, u32 type, str name, str value, str data,
+//   [u32 count, str * count] list values if is list flag is set,
+//   [str] raw data of binary parameter.
+//
+// Where str is u32 size followed by size bytes (UTF-8 for strings).
+
+const char BINARY_SIGNATURE[4] = { '\0', 'E', 'V', 'B' };
+enum { BINARY_HEADER_SIZE = 8 };
+
+// Parameters of smaller events are searched without index
+enum { PARAM_INDEX_MIN_SIZE = 8 };
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Writer
+
+struct Writer
+{
+	explicit Writer(QByteArray& output): m_output(output)
+	{
+	}
+
+	void put(const void* pData, quint32 nSize)
+	{
+		m_output.append(static_cast<const char* >(pData), nSize);
+	}
+	void put8(quint8 nValue)
+	{
+		m_output.append(char(nValue));
+	}
+	void put16(quint16 nValue)
+	{
+		uchar b[sizeof(nValue)];
+		qToLittleEndian(nValue, b);
+		put(b, sizeof(b));
+	}
+	void put32(quint32 nValue)
+	{
+		uchar b[sizeof(nValue)];
+		qToLittleEndian(nValue, b);
+		put(b, sizeof(b));
+	}
+	void put64(quint64 nValue)
+	{
+		uchar b[sizeof(nValue)];
+		qToLittleEndian(nValue, b);
+		put(b, sizeof(b));
+	}
+	void put(const QByteArray& baValue)
+	{
+		put32(baValue.size());
+		put(baValue.constData(), baValue.size());
+	}
+	void put(const QString& sValue)
+	{
+		put(sValue.toUtf8());
+	}
+
+private:
+	QByteArray& m_output;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Reader
+
+struct Reader
+{
+	Reader(const char* pData, quint32 nSize): m_data(pData), m_left(nSize)
+	{
+	}
+
+	bool get(const char*& pData, quint32 nSize)
+	{
+		if (nSize > m_left)
+			return false;
+		pData = m_data;
+		m_data += nSize;
+		m_left -= nSize;
+		return true;
+	}
+	bool get8(quint8& nValue)
+	{
+		const char* p;
+		if (!get(p, sizeof(nValue)))
+			return false;
+		nValue = quint8(*p);
+		return true;
+	}
+	bool get16(quint16& nValue)
+	{
+		const char* p;
+		if (!get(p, sizeof(nValue)))
+			return false;
+		nValue = qFromLittleEndian<quint16>(reinterpret_cast<const uchar* >(p));
+		return true;
+	}
+	bool get32(quint32& nValue)
+	{
+		const char* p;
+		if (!get(p, sizeof(nValue)))
+			return false;
+		nValue = qFromLittleEndian<quint32>(reinterpret_cast<const uchar* >(p));
+		return true;
+	}
+	bool get64(quint64& nValue)
+	{
+		const char* p;
+		if (!get(p, sizeof(nValue)))
+			return false;
+		nValue = qFromLittleEndian<quint64>(reinterpret_cast<const uchar* >(p));
+		return true;
+	}
+	bool get(QByteArray& baValue)
+	{
+		quint32 n;
+		const char* p;
+		if (!get32(n) || !get(p, n))
+			return false;
+		baValue = QByteArray(p, n);
+		return true;
+	}
+	bool get(QString& sValue)
+	{
+		quint32 n;
+		const char* p;
+		if (!get32(n) || !get(p, n))
+			return false;
+		sValue = n ? UTF8SZ_2QSTR(p, n) : QString();
+		return true;
+	}
+	// Every element takes 4 bytes at least, so count must fit the rest
+	bool getCount(quint32& nValue)
+	{
+		return get32(nValue) && nValue <= m_left / sizeof(quint32);
+	}
+	bool atEnd() const
+	{
+		return m_left == 0;
+	}
+
+private:
+	const char* m_data;
+	quint32 m_left;
+};
+
+void putParameter(Writer& w, const CVmEventParameter& param)
+{
+	w.put8(param.getEventParameterClassType());
+	w.put8(param.isIsList());
+	w.put32(param.getParamType());
+	w.put(param.getParamName());
+	w.put(param.getParamValue());
+	w.put(param.getData());
+	if (param.isIsList())
+	{
+		QList<QString> lstValues;
+		if (CVmEventValue* pValue = param.getValue())
+			lstValues = pValue->getListItem();
+		w.put32(lstValues.size());
+		foreach(const QString& s, lstValues)
+			w.put(s);
+	}
+	if (param.getEventParameterClassType() == CVmEventParameter::Binary)
+		w.put(static_cast<const CVmBinaryEventParameter& >(param).GetByteArray());
+}
+
+CVmEventParameter* getParameter(Reader& r)
+{
+	quint8 nClassType, nIsList;
+	quint32 nType;
+	QString sName, sValue;
+	QByteArray baData;
+	if (!r.get8(nClassType) || !r.get8(nIsList) || !r.get32(nType) ||
+		!r.get(sName) || !r.get(sValue) || !r.get(baData))
+		return NULL;
+
+	QList<QString> lstValues;
+	if (nIsList)
+	{
+		quint32 nCount;
+		if (!r.getCount(nCount))
+			return NULL;
+		lstValues.reserve(nCount);
+		for (quint32 i = 0; i < nCount; ++i)
+		{
+			QString s;
+			if (!r.get(s))
+				return NULL;
+			lstValues += s;
+		}
+	}
+
+	QByteArray baBinary;
+	CVmEventParameter* pParam;
+	switch (nClassType)
+	{
+	case CVmEventParameter::BaseType:
+		pParam = new CVmEventParameter;
+		break;
+	case CVmEventParameter::List:
+		pParam = new CVmEventParameterList;
+		break;
+	case CVmEventParameter::Binary:
+		if (!r.get(baBinary))
+			return NULL;
+		pParam = new CVmBinaryEventParameter;
+		static_cast<CVmBinaryEventParameter* >(pParam)->SetByteArray(baBinary);
+		break;
+	default:
+		WRITE_TRACE(DBG_FATAL, "Unknown event parameter class type: %u", nClassType);
+		return NULL;
+	}
+	pParam->setIsList(nIsList != 0);
+	pParam->setParamType((PVE::ParamFieldDataType)nType);
+	pParam->setParamName(sName);
+	pParam->setParamValue(sValue);
+	pParam->setData(baData);
+	if (nIsList && pParam->getValue())
+		pParam->getValue()->setListItem(lstValues);
+	return pParam;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// struct CVmEvent::ParamIndex
+//
+// Index of event parameters by name. Instead of tracking every change of the
+// public parameters list, the index keeps a copy of the list, which shares
+// data with it until the list is changed, so a stale index is detected by
+// single pointer comparison.
+
+struct CVmEvent::ParamIndex
+{
+	struct Name
+	{
+		// positions of the first and the last parameter with the name
+		int first;
+		int last;
+		int count;
+	};
+
+	struct Number
+	{
+		// parameter value the number is converted from
+		QString source;
+		qulonglong value;
+		bool ok;
+	};
+
+	bool isActual(const QList<CVmEventParameter* >& list_) const
+	{
+		return list.isSharedWith(list_);
+	}
+	void build(const QList<CVmEventParameter* >& list_);
+	void append(const QList<CVmEventParameter* >& list_);
+	CVmEventParameter* find(const QString& name_, int index_) const;
+	int count(const QString& name_) const;
+	qulonglong number(const CVmEventParameter* param_, bool* ok_);
+
+	QList<CVmEventParameter* > list;
+	// keys share data with names of parameters
+	QHash<QString, Name> names;
+	// position of the next parameter with the same name or -1
+	QVector<int> next;
+	QHash<const CVmEventParameter*, Number> numbers;
+
+private:
+	void add(int pos_);
+};
+
+void CVmEvent::ParamIndex::build(const QList<CVmEventParameter* >& list_)
+{
+	list = list_;
+	names.clear();
+	names.reserve(list.size());
+	next.clear();
+	next.reserve(list.size());
+	numbers.clear();
+	for (int i = 0; i < list.size(); ++i)
+		add(i);
+}
+
+void CVmEvent::ParamIndex::append(const QList<CVmEventParameter* >& list_)
+{
+	list = list_;
+	add(list.size() - 1);
+}
+
+void CVmEvent::ParamIndex::add(int pos_)
+{
+	next.append(-1);
+	const CVmEventParameter* pParam = list.at(pos_);
+	if (NULL == pParam)
+		return;
+
+	QString sName = pParam->getParamName();
+	QHash<QString, Name>::iterator it = names.find(sName);
+	if (it == names.end())
+	{
+		Name n = { pos_, pos_, 1 };
+		names.insert(sName, n);
+		return;
+	}
+	next[it->last] = pos_;
+	it->last = pos_;
+	++it->count;
+}
+
+CVmEventParameter* CVmEvent::ParamIndex::find(const QString& name_, int index_) const
+{
+	QHash<QString, Name>::const_iterator it = names.constFind(name_);
+	if (it == names.constEnd() || index_ < 0 || index_ >= it->count)
+		return NULL;
+
+	int nPos = it->first;
+	while (index_-- > 0)
+		nPos = next.at(nPos);
+	return list.at(nPos);
+}
+
+int CVmEvent::ParamIndex::count(const QString& name_) const
+{
+	QHash<QString, Name>::const_iterator it = names.constFind(name_);
+	return it == names.constEnd() ? 0 : it->count;
+}
+
+qulonglong CVmEvent::ParamIndex::number(const CVmEventParameter* param_, bool* ok_)
+{
+	QString sValue = param_->getParamValue();
+	QHash<const CVmEventParameter*, Number>::iterator it = numbers.find(param_);
+	// New value of parameter never shares data with the cached one
+	if (it == numbers.end() || !it->source.isSharedWith(sValue))
+	{
+		Number n;
+		n.source = sValue;
+		n.value = sValue.toULongLong(&n.ok);
+		it = numbers.insert(param_, n);
+	}
+	if (ok_)
+		*ok_ = it->ok;
+	return it->value;
+}
+
 /**
  * @brief Standard class constructor.
  * @param parent
@@ -163,8 +522,17 @@ CVmEvent::CVmEvent(QString source_string)
 	fromString(source_string);
 }
 
+CVmEvent::~CVmEvent()
+{
+}
+
 void CVmEvent::cleanupClassProperties()
 {
+	{
+		QMutexLocker lock(&m_mutexParamIndex);
+		m_pParamIndex.reset();
+	}
+
 	m_lstBaseEventParameters[0]->ClearLists();
 	m_lstBaseEventParameters[0]->InitLists();
 	m_lstBaseEventParameters[0]->setDefaults();
@@ -178,10 +546,28 @@ void CVmEvent::cleanupClassProperties()
  */
 void CVmEvent::addEventParameter(CVmEventParameter* item)
 {
-	m_lstEventParameters.append( item );
+	QMutexLocker lock(&m_mutexParamIndex);
+	if (m_pParamIndex.isNull() || !m_pParamIndex->isActual(m_lstEventParameters))
+	{
+		m_pParamIndex.reset();
+		m_lstEventParameters.append( item );
+		return;
+	}
 
+	// Keep index actual, the list is released not to be copied on append
+	m_pParamIndex->list.clear();
+	m_lstEventParameters.append( item );
+	m_pParamIndex->append(m_lstEventParameters);
 }
 
+CVmEvent::ParamIndex* CVmEvent::getParamIndex() const
+{
+	if (m_pParamIndex.isNull())
+		m_pParamIndex.reset(new ParamIndex);
+	if (!m_pParamIndex->isActual(m_lstEventParameters))
+		m_pParamIndex->build(m_lstEventParameters);
+	return m_pParamIndex.data();
+}
 
 /**
  * @brief Get event parameter from the list.
@@ -189,30 +575,28 @@ void CVmEvent::addEventParameter(CVmEventParameter* item)
  */
 CVmEventParameter* CVmEvent::getEventParameter(QString param_name) const
 {
-	QList<CVmEventParameter*>::const_iterator i;
-
-	for (i = m_lstEventParameters.begin(); i != m_lstEventParameters.end(); ++i)
-	{
-		if ( (*i)->getParamName() == param_name )
-			return *i;
-	}
-
-	return NULL;
-
+	return getEventParameter(param_name, 0);
 }
 
 // Get named event parameter by index of list with same name
 CVmEventParameter* CVmEvent::getEventParameter(QString param_name, int name_index ) const
 {
-	QList<CVmEventParameter*>::const_iterator i;
-	int currIndexOfName = -1;
-	for (i = m_lstEventParameters.begin(); i != m_lstEventParameters.end(); ++i)
+	const QList<CVmEventParameter*>& lstParams = m_lstEventParameters;
+	if (lstParams.size() < PARAM_INDEX_MIN_SIZE)
 	{
-		if ( (*i)->getParamName() == param_name && ++currIndexOfName == name_index)
-			return *i;
+		QList<CVmEventParameter*>::const_iterator i;
+		int currIndexOfName = -1;
+		for (i = lstParams.constBegin(); i != lstParams.constEnd(); ++i)
+		{
+			if ( (*i)->getParamName() == param_name && ++currIndexOfName == name_index)
+				return *i;
+		}
+
+		return NULL;
 	}
 
-	return NULL;
+	QMutexLocker lock(&m_mutexParamIndex);
+	return getParamIndex()->find(param_name, name_index);
 }
 
 /**
@@ -221,17 +605,74 @@ CVmEventParameter* CVmEvent::getEventParameter(QString param_name, int name_inde
  */
 int CVmEvent::GetParamsCount(QString param_name) const
 {
-	QList<CVmEventParameter*>::const_iterator i;
-	int nCount = 0;
+	const QList<CVmEventParameter*>& lstParams = m_lstEventParameters;
+	if (lstParams.size() < PARAM_INDEX_MIN_SIZE)
+	{
+		QList<CVmEventParameter*>::const_iterator i;
+		int nCount = 0;
+
+		for (i = lstParams.constBegin(); i != lstParams.constEnd(); ++i)
+		{
+			if ( (*i)->getParamName() == param_name )
+				nCount++;
+		}
 
-	for (i = m_lstEventParameters.begin(); i != m_lstEventParameters.end(); ++i)
+		return nCount;
+	}
+
+	QMutexLocker lock(&m_mutexParamIndex);
+	return getParamIndex()->count(param_name);
+}
+
+qulonglong CVmEvent::getEventParameterNumber(const QString& param_name, bool* ok) const
+{
+	if (m_lstEventParameters.size() < PARAM_INDEX_MIN_SIZE)
 	{
-		if ( (*i)->getParamName() == param_name )
-			nCount++;
+		CVmEventParameter* pParam = getEventParameter(param_name);
+		if (pParam)
+			return pParam->getParamValue().toULongLong(ok);
+	}
+	else
+	{
+		QMutexLocker lock(&m_mutexParamIndex);
+		ParamIndex* pIndex = getParamIndex();
+		CVmEventParameter* pParam = pIndex->find(param_name, 0);
+		if (pParam)
+			return pIndex->number(pParam, ok);
 	}
 
-	return nCount;
+	if (ok)
+		*ok = false;
+	return 0;
+}
 
+/**
+ * @brief Get event parameter value as QString::toUInt() does.
+ * @param param_name
+ * @param ok
+ */
+quint32 CVmEvent::getEventParameterUInt(const QString& param_name, bool* ok) const
+{
+	bool bOk = false;
+	qulonglong nValue = getEventParameterNumber(param_name, &bOk);
+	if (nValue > std::numeric_limits<quint32>::max())
+	{
+		bOk = false;
+		nValue = 0;
+	}
+	if (ok)
+		*ok = bOk;
+	return quint32(nValue);
+}
+
+/**
+ * @brief Get event parameter value as QString::toULongLong() does.
+ * @param param_name
+ * @param ok
+ */
+quint64 CVmEvent::getEventParameterUInt64(const QString& param_name, bool* ok) const
+{
+	return getEventParameterNumber(param_name, ok);
 }
 
 void CVmEvent::Serialize(QDataStream &_stream)
@@ -283,3 +724,82 @@ void CVmEvent::Deserialize(QDataStream &_stream)
 			WRITE_TRACE(DBG_FATAL, "Unknown event parameter class type: %u", nClassType);
 	}
 }
+
+QByteArray CVmEvent::toBinary() const
+{
+	QByteArray output;
+	Writer w(output);
+	w.put(BINARY_SIGNATURE, sizeof(BINARY_SIGNATURE));
+	w.put16(BinaryVersion);
+	w.put16(0);
+	w.put32(m_ctEventType);
+	w.put32(m_ctEventLevel);
+	w.put32(m_ctEventCode);
+	w.put32(m_ctEventNeedResponse);
+	w.put32(m_ctEventIssuerType);
+	w.put64(m_ullEventId);
+	w.put(m_qsEventIssuerId);
+	w.put(m_qsEventSource);
+	w.put(m_qsEventInitialRequestId);
+	w.put32(m_lstEventParameters.size());
+	foreach(const CVmEventParameter* pParam, m_lstEventParameters)
+		putParameter(w, *pParam);
+	return output;
+}
+
+int CVmEvent::fromBinary(const char *pData, quint32 nSize)
+{
+	cleanupClassProperties();
+	m_uiRcInit = PRL_ERR_PARSE_VM_CONFIG;
+	m_iParseRc = PRL_ERR_PARSE_VM_CONFIG;
+
+	Reader r(pData, nSize);
+	const char* pSignature;
+	quint16 nVersion, nReserved;
+	if (!r.get(pSignature, sizeof(BINARY_SIGNATURE)) ||
+		::memcmp(pSignature, BINARY_SIGNATURE, sizeof(BINARY_SIGNATURE)) ||
+		!r.get16(nVersion) || !r.get16(nReserved))
+		return PRL_ERR_PARSE_VM_CONFIG;
+	if (nVersion != BinaryVersion)
+	{
+		WRITE_TRACE(DBG_FATAL, "Unsupported binary event version: %u", nVersion);
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	quint32 nType, nLevel, nCode, nNeedResponse, nIssuerType;
+	if (!r.get32(nType) || !r.get32(nLevel) || !r.get32(nCode) ||
+		!r.get32(nNeedResponse) || !r.get32(nIssuerType) ||
+		!r.get64(m_ullEventId) || !r.get(m_qsEventIssuerId) ||
+		!r.get(m_qsEventSource) || !r.get(m_qsEventInitialRequestId))
+		return PRL_ERR_PARSE_VM_CONFIG;
+	m_ctEventType = (PRL_EVENT_TYPE)nType;
+	m_ctEventLevel = (PVE::VmEventLevel)nLevel;
+	m_ctEventCode = (PRL_RESULT)nCode;
+	m_ctEventNeedResponse = (PVE::VmEventRespOption)nNeedResponse;
+	m_ctEventIssuerType = (PRL_EVENT_ISSUER_TYPE)nIssuerType;
+
+	quint32 nListSize;
+	if (!r.getCount(nListSize))
+		return PRL_ERR_PARSE_VM_CONFIG;
+	m_lstEventParameters.reserve(nListSize);
+	for (quint32 k = 0; k < nListSize; ++k)
+	{
+		CVmEventParameter* pParam = getParameter(r);
+		if (NULL == pParam)
+			return PRL_ERR_PARSE_VM_CONFIG;
+		m_lstEventParameters.append(pParam);
+	}
+	if (!r.atEnd())
+		return PRL_ERR_PARSE_VM_CONFIG;
+
+	syncItemIds();
+	m_uiRcInit = PRL_ERR_SUCCESS;
+	m_iParseRc = PRL_ERR_SUCCESS;
+	return PRL_ERR_SUCCESS;
+}
+
+bool CVmEvent::isBinary(const char *pData, quint32 nSize)
+{
+	return pData != NULL && nSize >= BINARY_HEADER_SIZE &&
+		0 == ::memcmp(pData, BINARY_SIGNATURE, sizeof(BINARY_SIGNATURE));
+}
@@ -33,6 +33,8 @@
 #include "CVmEventBase.h"
 #include "CVmEventParameter.h"
 #include <QObjectList>
+#include <QMutex>
+#include <QScopedPointer>
 
 
 /**
@@ -43,7 +45,9 @@ class CVmEvent : public CVmEventBase, public QEvent
 {
 
 public:
-	// List of event parameters
+	// List of event parameters. Direct changes of the list are allowed,
+	// parameters lookup index notices them and is rebuilt on next lookup.
+	// Renaming of parameter which is already in the list is not noticed.
 	QList<CVmEventParameter* >& m_lstEventParameters;
 
 	virtual void cleanupClassProperties();
@@ -64,6 +68,8 @@ public:
 			 PVE::VmEventLevel event_level = PVE::EventLevel0);
 	// Initializing constructor
 	CVmEvent(QString source_string);
+	// Class destructor
+	~CVmEvent();
 
 	// return m_uiRcInit ( initialization RC )
 	PRL_RESULT getInternalRcInit() { return m_uiRcInit; }
@@ -76,6 +82,11 @@ public:
 	CVmEventParameter* getEventParameter(QString param_name, int name_index ) const;
 	// Get count of params token
 	int GetParamsCount(QString param_name) const;
+	// Get event parameter value converted to unsigned integer, conversion
+	// result is cached until parameter value is changed
+	quint32 getEventParameterUInt(const QString& param_name, bool* ok = NULL) const;
+	// Get event parameter value converted to 64-bit unsigned integer
+	quint64 getEventParameterUInt64(const QString& param_name, bool* ok = NULL) const;
 
 public:
 	/**
@@ -89,8 +100,44 @@ public:
 	 */
 	void Deserialize(QDataStream &_stream);
 
+public:
+	/**
+	 * Current version of binary encoding, see #toBinary
+	 */
+	enum { BinaryVersion = 1 };
+
+	/**
+	 * Returns event in compact binary encoding, which is used on the wire
+	 * instead of XML if both peers support it. Unlike #Serialize it is
+	 * versioned and carries all event fields including event id, list
+	 * values and raw data of binary parameters.
+	 */
+	QByteArray toBinary() const;
+	/**
+	 * Replaces event contents with binary encoded one.
+	 * @param encoded buffer
+	 * @param buffer size
+	 * @return 0 on success, PRL_ERR_PARSE_VM_CONFIG if buffer is truncated,
+	 *         malformed or has unknown version (as #fromString does)
+	 */
+	int fromBinary(const char *pData, quint32 nSize);
+	/**
+	 * Returns true if buffer starts with binary encoding signature.
+	 * Encoded buffer starts with zero byte, so it never looks like XML.
+	 */
+	static bool isBinary(const char *pData, quint32 nSize);
+
 private:
+	struct ParamIndex;
+
+	// Returns lookup index of parameters, should be called under m_mutexParamIndex
+	ParamIndex* getParamIndex() const;
+	qulonglong getEventParameterNumber(const QString& param_name, bool* ok) const;
 
+	// Lazily built index of parameters by name, it is used for large events
+	// only as linear search is cheaper for a few parameters
+	mutable QMutex m_mutexParamIndex;
+	mutable QScopedPointer<ParamIndex> m_pParamIndex;
 };
 
 
@@ -1006,6 +1006,317 @@ int CVmEventBase::readXml(QDomElement* RootElement, QString ext_tag_name, bool u
 
 
 
+	return 0;
+}
+
+void CVmEventBase::writeXmlStream(QXmlStreamWriter* Writer, const QXmlStreamAttributes& Attributes, bool no_save_option) const
+{
+	Q_UNUSED(no_save_option);
+	int i = -1;
+	Q_UNUSED(i);
+	int nElemIdx = 0;
+	QStringList dyn_lists;
+
+	Writer->writeStartElement(m_qsExtRootTagName.isEmpty() ? getLegacyProductTag("VirtuozzoEvent") : m_qsExtRootTagName);
+	Writer->writeAttributes(Attributes);
+	Writer->writeAttribute("dyn_lists", dyn_lists.join(" "));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventType", QString::number(getEventType()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventLevel", QString::number(getEventLevel()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventCode", QString::number(getEventCode()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventNeedResponse", QString::number(getRespRequired()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventIssuerType", QString::number(getEventIssuerType()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventIssuerId", getEventIssuerId());
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventSource", getEventSource());
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventInitialRequestId", getInitRequestId());
+
+	for(i = 0; i < m_lstBaseEventParameters.size() && (true); ++i)
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		const CVmEventParameters* object = m_lstBaseEventParameters[i];
+		if ( ! object ) continue;
+		object->writeXmlStream(Writer, QXmlStreamAttributes(), no_save_option);
+	}
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("EventId", QString::number(getEventId()));
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+
+	Writer->writeEndElement();
+}
+
+int CVmEventBase::readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name)
+{
+	QString tag_name;
+
+	tag_name = Reader->qualifiedName().toString();
+	m_qsTagName = tag_name;
+	m_qsExtRootTagName = ext_tag_name;
+	if (!eqName(tag_name, (ext_tag_name.isEmpty() ? getLegacyProductTag("VirtuozzoEvent") : ext_tag_name), true))
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': wrong root element with tag name '" + tag_name + "'";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	QXmlStreamAttributes attributes = Reader->attributes();
+	bool bSupportDynList = attributes.hasAttribute("dyn_lists");
+	QStringList dyn_lists = attributes.value("dyn_lists").toString().split(" ");
+	initMaxItemIds(dyn_lists);
+
+	m_qsErrorMessage.clear();
+	m_lstWarningList.clear();
+	ClearListsInReadXml(false, dyn_lists, bSupportDynList);
+	setDefaults();
+	m_mapPatchedFields.clear();
+
+	int BaseEventParameters_count = 1;
+	int EventType_count = 1;
+	int EventLevel_count = 1;
+	int EventCode_count = 1;
+	int EventNeedResponse_count = 1;
+	int EventIssuerType_count = 1;
+	int EventIssuerId_count = 1;
+	int EventSource_count = 1;
+	int EventInitialRequestId_count = 1;
+	int EventId_count = 0;
+
+	int nElemIdx = 0;
+	m_mapExtDoc.clear();
+	m_doc = QDomDocument();
+	while(Reader->readNextStartElement())
+	{
+		tag_name = Reader->qualifiedName().toString();
+
+		// Fields given as attributes of the root or of this element are
+		// taken once, as readXml() does, and the element is not kept
+		QXmlStreamAttributes element_attributes = Reader->attributes();
+		QString value;
+
+		bool EventType_attribute = EventType_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventType", value);
+		if (EventType_attribute)
+		{
+			setEventType((PRL_EVENT_TYPE )value.toLongLong());
+			--EventType_count;
+		}
+
+		bool EventLevel_attribute = EventLevel_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventLevel", value);
+		if (EventLevel_attribute)
+		{
+			setEventLevel((PVE::VmEventLevel )value.toLongLong());
+			--EventLevel_count;
+		}
+
+		bool EventCode_attribute = EventCode_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventCode", value);
+		if (EventCode_attribute)
+		{
+			setEventCode((PRL_RESULT )value.toLongLong());
+			--EventCode_count;
+		}
+
+		bool EventNeedResponse_attribute = EventNeedResponse_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventNeedResponse", value);
+		if (EventNeedResponse_attribute)
+		{
+			setRespRequired((PVE::VmEventRespOption )value.toLongLong());
+			--EventNeedResponse_count;
+		}
+
+		bool EventIssuerType_attribute = EventIssuerType_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventIssuerType", value);
+		if (EventIssuerType_attribute)
+		{
+			setEventIssuerType((PRL_EVENT_ISSUER_TYPE )value.toLongLong());
+			--EventIssuerType_count;
+		}
+
+		bool EventIssuerId_attribute = EventIssuerId_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventIssuerId", value);
+		if (EventIssuerId_attribute)
+		{
+			setEventIssuerId(value);
+			--EventIssuerId_count;
+		}
+
+		bool EventSource_attribute = EventSource_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventSource", value);
+		if (EventSource_attribute)
+		{
+			setEventSource(value);
+			--EventSource_count;
+		}
+
+		bool EventInitialRequestId_attribute = EventInitialRequestId_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "EventInitialRequestId", value);
+		if (EventInitialRequestId_attribute)
+		{
+			setInitRequestId(value);
+			--EventInitialRequestId_count;
+		}
+
+		bool EventId_attribute = EventId_count == 0 &&
+			readFieldAttribute(attributes, element_attributes, "EventId", value);
+		if (EventId_attribute)
+		{
+			setEventId(value.toULongLong());
+			--EventId_count;
+		}
+
+		bool used = EventType_attribute || EventLevel_attribute ||
+			EventCode_attribute || EventNeedResponse_attribute ||
+			EventIssuerType_attribute || EventIssuerId_attribute ||
+			EventSource_attribute || EventInitialRequestId_attribute ||
+			EventId_attribute;
+
+		if (eqName(tag_name, "EventType") && !EventType_attribute)
+		{
+			setEventType((PRL_EVENT_TYPE )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--EventType_count;
+		}
+		else if (eqName(tag_name, "EventLevel") && !EventLevel_attribute)
+		{
+			setEventLevel((PVE::VmEventLevel )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--EventLevel_count;
+		}
+		else if (eqName(tag_name, "EventCode") && !EventCode_attribute)
+		{
+			setEventCode((PRL_RESULT )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--EventCode_count;
+		}
+		else if (eqName(tag_name, "EventNeedResponse") && !EventNeedResponse_attribute)
+		{
+			setRespRequired((PVE::VmEventRespOption )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--EventNeedResponse_count;
+		}
+		else if (eqName(tag_name, "EventIssuerType") && !EventIssuerType_attribute)
+		{
+			setEventIssuerType((PRL_EVENT_ISSUER_TYPE )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--EventIssuerType_count;
+		}
+		else if (eqName(tag_name, "EventIssuerId") && !EventIssuerId_attribute)
+		{
+			setEventIssuerId(Reader->readElementText(QXmlStreamReader::SkipChildElements));
+			--EventIssuerId_count;
+		}
+		else if (eqName(tag_name, "EventSource") && !EventSource_attribute)
+		{
+			setEventSource(Reader->readElementText(QXmlStreamReader::SkipChildElements));
+			--EventSource_count;
+		}
+		else if (eqName(tag_name, "EventInitialRequestId") && !EventInitialRequestId_attribute)
+		{
+			setInitRequestId(Reader->readElementText(QXmlStreamReader::SkipChildElements));
+			--EventInitialRequestId_count;
+		}
+		else if (eqName(tag_name, "EventId") && !EventId_attribute)
+		{
+			setEventId(Reader->readElementText(QXmlStreamReader::SkipChildElements).toULongLong());
+			--EventId_count;
+		}
+		else if (eqName(tag_name, "EventParameters") && BaseEventParameters_count > 0)
+		{
+			CVmEventParameters* object = m_lstBaseEventParameters[1 - BaseEventParameters_count];
+			object->makeFullItemId(getFullItemId(), "EventParameters");
+			if (object->readXmlStream(Reader, tag_name))
+			{
+				m_qsErrorMessage = object->GetErrorMessage();
+				return PRL_ERR_PARSE_VM_CONFIG;
+			}
+			--BaseEventParameters_count;
+			object->setSectionFakeFlag(false);
+			m_lstWarningList += object->GetWarningList();
+		}
+		else if (used)
+			Reader->skipCurrentElement();
+		else
+			readExtDocElement(Reader, nElemIdx);
+		nElemIdx++;
+	}
+
+	if (Reader->hasError())
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': " + Reader->errorString();
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (BaseEventParameters_count >= 1)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventBase': tag 'EventParameters' is absent";
+	}
+
+	if (EventType_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventType' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventLevel_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventLevel' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventCode_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventCode' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventNeedResponse_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventNeedResponse' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventIssuerType_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventIssuerType' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventIssuerId_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventIssuerId' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventSource_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventSource' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventInitialRequestId_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventBase': tag 'EventInitialRequestId' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (EventId_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventBase': tag 'EventId' is absent";
+	}
+
+
+
 	return 0;
 }
 
@@ -775,6 +775,245 @@ int CVmEventParameter::readXml(QDomElement* RootElement, QString ext_tag_name, b
 
 
 
+	return 0;
+}
+
+void CVmEventParameter::writeXmlStream(QXmlStreamWriter* Writer, const QXmlStreamAttributes& Attributes, bool no_save_option) const
+{
+	Q_UNUSED(no_save_option);
+	int i = -1;
+	Q_UNUSED(i);
+	int nElemIdx = 0;
+	QStringList dyn_lists;
+
+	Writer->writeStartElement(m_qsExtRootTagName.isEmpty() ? QString("EventParameter") : m_qsExtRootTagName);
+	Writer->writeAttributes(Attributes);
+	Writer->writeAttribute("dyn_lists", dyn_lists.join(" "));
+
+	if (isList())
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		Writer->writeTextElement("IsList", QString::number(isIsList()));
+	}
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("Name", getParamName());
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+	Writer->writeTextElement("Type", QString::number(getParamType()));
+
+	if (!isList())
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		Writer->writeTextElement("Value", getParamValue());
+	}
+
+	for(i = 0; i < m_lstValues.size() && (isList()); ++i)
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		const CVmEventValue* object = m_lstValues[i];
+		if ( ! object ) continue;
+		object->writeXmlStream(Writer, QXmlStreamAttributes(), no_save_option);
+	}
+
+	if (getParamType() == PVE::CData || getParamType() == PVE::VmConfiguration)
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		Writer->writeTextElement("Data", QString::fromLatin1(getData().toBase64()));
+	}
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+
+	Writer->writeEndElement();
+}
+
+int CVmEventParameter::readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name)
+{
+	QString tag_name;
+
+	tag_name = Reader->qualifiedName().toString();
+	m_qsTagName = tag_name;
+	m_qsExtRootTagName = ext_tag_name;
+	if (!eqName(tag_name, (ext_tag_name.isEmpty() ? QString("EventParameter") : ext_tag_name), true))
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameter': wrong root element with tag name '" + tag_name + "'";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	QXmlStreamAttributes attributes = Reader->attributes();
+	bool bSupportDynList = attributes.hasAttribute("dyn_lists");
+	QStringList dyn_lists = attributes.value("dyn_lists").toString().split(" ");
+	initMaxItemIds(dyn_lists);
+
+	m_qsErrorMessage.clear();
+	m_lstWarningList.clear();
+	ClearListsInReadXml(false, dyn_lists, bSupportDynList);
+	setDefaults();
+	m_mapPatchedFields.clear();
+
+	int Values_count = 1;
+	int IsList_count = 0;
+	int Name_count = 1;
+	int Type_count = 1;
+	int Value_count = 0;
+	int Data_count = 0;
+
+	int nElemIdx = 0;
+	m_mapExtDoc.clear();
+	m_doc = QDomDocument();
+	while(Reader->readNextStartElement())
+	{
+		tag_name = Reader->qualifiedName().toString();
+
+		// Fields given as attributes of the root or of this element are
+		// taken once, as readXml() does, and the element is not kept
+		QXmlStreamAttributes element_attributes = Reader->attributes();
+		QString value;
+
+		bool IsList_attribute = IsList_count == 0 &&
+			readFieldAttribute(attributes, element_attributes, "IsList", value);
+		if (IsList_attribute)
+		{
+			setIsList(value.toInt() != 0);
+			--IsList_count;
+		}
+
+		bool Name_attribute = Name_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "Name", value);
+		if (Name_attribute)
+		{
+			setParamName(value);
+			--Name_count;
+		}
+
+		bool Type_attribute = Type_count == 1 &&
+			readFieldAttribute(attributes, element_attributes, "Type", value);
+		if (Type_attribute)
+		{
+			setParamType((PVE::ParamFieldDataType )value.toLongLong());
+			--Type_count;
+		}
+
+		bool Value_attribute = Value_count == 0 &&
+			readFieldAttribute(attributes, element_attributes, "Value", value);
+		if (Value_attribute)
+		{
+			setParamValue(value);
+			--Value_count;
+		}
+
+		bool Data_attribute = Data_count == 0 &&
+			readFieldAttribute(attributes, element_attributes, "Data", value);
+		if (Data_attribute)
+		{
+			setData(QByteArray::fromBase64( value.toLatin1() ));
+			--Data_count;
+		}
+
+		bool used = IsList_attribute || Name_attribute || Type_attribute ||
+			Value_attribute || Data_attribute;
+
+		if (eqName(tag_name, "IsList") && !IsList_attribute)
+		{
+			setIsList(Reader->readElementText(QXmlStreamReader::SkipChildElements).toInt() != 0);
+			--IsList_count;
+		}
+		else if (eqName(tag_name, "Name") && !Name_attribute)
+		{
+			setParamName(Reader->readElementText(QXmlStreamReader::SkipChildElements));
+			--Name_count;
+		}
+		else if (eqName(tag_name, "Type") && !Type_attribute)
+		{
+			setParamType((PVE::ParamFieldDataType )Reader->readElementText(QXmlStreamReader::SkipChildElements).toLongLong());
+			--Type_count;
+		}
+		else if (eqName(tag_name, "Value"))
+		{
+			// 'Value' is either the text of the plain parameter or the list
+			// of values, 'IsList' is written ahead of it
+			if (isIsList() && Values_count > 0)
+			{
+				CVmEventValue* object = m_lstValues[1 - Values_count];
+				object->makeFullItemId(getFullItemId(), "Value");
+				if (object->readXmlStream(Reader, tag_name))
+				{
+					m_qsErrorMessage = object->GetErrorMessage();
+					return PRL_ERR_PARSE_VM_CONFIG;
+				}
+				--Values_count;
+				object->setSectionFakeFlag(false);
+				m_lstWarningList += object->GetWarningList();
+				if (!Value_attribute)
+					setParamValue();
+			}
+			else
+			{
+				if (Value_attribute)
+					Reader->skipCurrentElement();
+				else
+					setParamValue(Reader->readElementText(QXmlStreamReader::SkipChildElements));
+				if (Values_count > 0)
+				{
+					m_lstValues[1 - Values_count]->setSectionFakeFlag(false);
+					--Values_count;
+				}
+			}
+			if (!Value_attribute)
+				--Value_count;
+		}
+		else if (eqName(tag_name, "Data") && !Data_attribute)
+		{
+			setData(QByteArray::fromBase64( Reader->readElementText(QXmlStreamReader::SkipChildElements).toLatin1() ));
+			--Data_count;
+		}
+		else if (used)
+			Reader->skipCurrentElement();
+		else
+			readExtDocElement(Reader, nElemIdx);
+		nElemIdx++;
+	}
+
+	if (Reader->hasError())
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameter': " + Reader->errorString();
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (Values_count >= 1)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventParameter': tag 'Value' is absent";
+	}
+
+	if (IsList_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventParameter': tag 'IsList' is absent";
+	}
+
+	if (Name_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameter': tag 'Name' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (Type_count > 0)
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameter': tag 'Type' does not satisfy 'minOccurs = 1' condition";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (Value_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventParameter': tag 'Value' is absent";
+	}
+
+	if (Data_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventParameter': tag 'Data' is absent";
+	}
+
+
+
 	return 0;
 }
 
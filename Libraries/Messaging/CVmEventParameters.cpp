@@ -343,6 +343,146 @@ int CVmEventParameters::readXml(QDomElement* RootElement, QString ext_tag_name,
 	return 0;
 }
 
+void CVmEventParameters::writeXmlStream(QXmlStreamWriter* Writer, const QXmlStreamAttributes& Attributes, bool no_save_option) const
+{
+	Q_UNUSED(no_save_option);
+	int i = -1;
+	Q_UNUSED(i);
+	int nMaxItemId = -1;
+	int nElemIdx = 0;
+	QStringList dyn_lists;
+	QSet<int > setItemIds;
+	QMap<QString , int > mapMaxDynListIds = m_mapMaxDynListIds;
+
+	// Item ids go to 'dyn_lists' attribute, so they are assigned ahead
+	QList<int > lstEventParameterIds;
+	nMaxItemId = getMaxItemId<CVmEventParameter>(m_lstEventParameter, "EventParameter", mapMaxDynListIds);
+	for(i = 0; i < m_lstEventParameter.size(); ++i)
+	{
+		const CVmEventParameter* object = m_lstEventParameter[i];
+		lstEventParameterIds += -1;
+		if ( ! object ) continue;
+		int nItemId = object->getItemId();
+		do {
+			nItemId = nItemId == -1 ? nMaxItemId++ : nItemId;
+			if ( ! setItemIds.contains(nItemId) ) break;
+			nItemId = -1;
+		} while(1);
+		setItemIds.insert(nItemId);
+		lstEventParameterIds[i] = nItemId;
+	}
+	dyn_lists += "EventParameter";
+	dyn_lists += QString::number(syncMaxItemId(nMaxItemId, "EventParameter", mapMaxDynListIds));
+
+	Writer->writeStartElement(m_qsExtRootTagName.isEmpty() ? QString("EventParameters") : m_qsExtRootTagName);
+	Writer->writeAttributes(Attributes);
+	Writer->writeAttribute("dyn_lists", dyn_lists.join(" "));
+
+	for(i = 0; i < m_lstEventParameter.size(); ++i)
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		const CVmEventParameter* object = m_lstEventParameter[i];
+		if ( ! object ) continue;
+		QXmlStreamAttributes item_attributes;
+		item_attributes.append("id", QString::number(lstEventParameterIds[i]));
+		object->writeXmlStream(Writer, item_attributes, no_save_option);
+	}
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+
+	Writer->writeEndElement();
+}
+
+int CVmEventParameters::readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name)
+{
+	QString tag_name;
+
+	tag_name = Reader->qualifiedName().toString();
+	m_qsTagName = tag_name;
+	m_qsExtRootTagName = ext_tag_name;
+	if (!eqName(tag_name, (ext_tag_name.isEmpty() ? QString("EventParameters") : ext_tag_name), true))
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameters': wrong root element with tag name '" + tag_name + "'";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	QXmlStreamAttributes attributes = Reader->attributes();
+	bool bSupportDynList = attributes.hasAttribute("dyn_lists");
+	QStringList dyn_lists = attributes.value("dyn_lists").toString().split(" ");
+	initMaxItemIds(dyn_lists);
+
+	m_qsErrorMessage.clear();
+	m_lstWarningList.clear();
+	ClearListsInReadXml(false, dyn_lists, bSupportDynList);
+	setDefaults();
+	m_mapPatchedFields.clear();
+
+	// Items without id are numbered after the maximum one as in readXml(),
+	// which is known at the end of the section only
+	int nMaxItemId_EventParameter = -1;
+	QList<CVmEventParameter* > lstEventParameterNoId;
+
+	int EventParameter_count = 0;
+
+	int nElemIdx = 0;
+	m_mapExtDoc.clear();
+	m_doc = QDomDocument();
+	while(Reader->readNextStartElement())
+	{
+		tag_name = Reader->qualifiedName().toString();
+
+		if (eqName(tag_name, "EventParameter"))
+		{
+			QXmlStreamAttributes item_attributes = Reader->attributes();
+			int nItemId = item_attributes.hasAttribute("id")
+				? item_attributes.value("id").toString().toInt() : -1;
+			CVmEventParameter* object = new CVmEventParameter();
+			object->setItemId(nItemId);
+			object->makeFullItemId(getFullItemId(), "EventParameter", object->getItemId());
+			if (object->readXmlStream(Reader, tag_name))
+			{
+				m_qsErrorMessage = object->GetErrorMessage();
+				delete object;
+				return PRL_ERR_PARSE_VM_CONFIG;
+			}
+			m_lstEventParameter += object;
+			if (nItemId == -1)
+				lstEventParameterNoId += object;
+			else if (nItemId > nMaxItemId_EventParameter)
+				nMaxItemId_EventParameter = nItemId;
+			--EventParameter_count;
+			m_lstWarningList += object->GetWarningList();
+		}
+		else
+			readExtDocElement(Reader, nElemIdx);
+		nElemIdx++;
+	}
+
+	if (Reader->hasError())
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventParameters': " + Reader->errorString();
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	nMaxItemId_EventParameter = syncMaxItemId(++nMaxItemId_EventParameter, "EventParameter");
+	foreach(CVmEventParameter* object, lstEventParameterNoId)
+	{
+		object->setItemId(nMaxItemId_EventParameter++);
+		object->makeFullItemId(getFullItemId(), "EventParameter", object->getItemId());
+		object->syncItemIds();
+	}
+
+	if (EventParameter_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventParameters': tag 'EventParameter' is absent";
+	}
+
+	syncMaxItemId(nMaxItemId_EventParameter, "EventParameter");
+
+
+	return 0;
+}
+
 void CVmEventParameters::syncItemIds()
 {
 	int i = -1;
@@ -58,6 +58,8 @@ public:
 
 	virtual QDomElement getXml(QDomDocument* Document, bool no_save_option = false) const;
 	virtual int readXml(QDomElement* RootElement, QString ext_tag_name = QString(), bool unite_with_loaded = false);
+	virtual void writeXmlStream(QXmlStreamWriter* Writer, const QXmlStreamAttributes& Attributes = QXmlStreamAttributes(), bool no_save_option = false) const;
+	virtual int readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name = QString());
 	virtual void syncItemIds();
 
 	bool merge(CVmEventParameters* pCur, CVmEventParameters* pPrev, MergeOptions nOptions);
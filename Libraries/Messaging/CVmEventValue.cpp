@@ -278,6 +278,90 @@ int CVmEventValue::readXml(QDomElement* RootElement, QString ext_tag_name, bool
 
 
 
+	return 0;
+}
+
+void CVmEventValue::writeXmlStream(QXmlStreamWriter* Writer, const QXmlStreamAttributes& Attributes, bool no_save_option) const
+{
+	Q_UNUSED(no_save_option);
+	int i = -1;
+	Q_UNUSED(i);
+	int nElemIdx = 0;
+	QStringList dyn_lists;
+
+	Writer->writeStartElement(m_qsExtRootTagName.isEmpty() ? QString("Value") : m_qsExtRootTagName);
+	Writer->writeAttributes(Attributes);
+
+	dyn_lists += "ListItem";
+	Writer->writeAttribute("dyn_lists", dyn_lists.join(" "));
+
+	for(i = 0; i < m_lstListItem.size(); ++i)
+	{
+		checkAndWriteExtDocElement(Writer, nElemIdx);
+		Writer->writeTextElement("ListItem", m_lstListItem[i]);
+	}
+
+	checkAndWriteExtDocElement(Writer, nElemIdx);
+
+	Writer->writeEndElement();
+}
+
+int CVmEventValue::readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name)
+{
+	QString tag_name;
+
+	tag_name = Reader->qualifiedName().toString();
+	m_qsTagName = tag_name;
+	m_qsExtRootTagName = ext_tag_name;
+	if (!eqName(tag_name, (ext_tag_name.isEmpty() ? QString("Value") : ext_tag_name), true))
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventValue': wrong root element with tag name '" + tag_name + "'";
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	QXmlStreamAttributes attributes = Reader->attributes();
+	bool bSupportDynList = attributes.hasAttribute("dyn_lists");
+	QStringList dyn_lists = attributes.value("dyn_lists").toString().split(" ");
+	initMaxItemIds(dyn_lists);
+
+	m_qsErrorMessage.clear();
+	m_lstWarningList.clear();
+	ClearListsInReadXml(false, dyn_lists, bSupportDynList);
+	setDefaults();
+	m_mapPatchedFields.clear();
+
+	int ListItem_count = 0;
+
+	int nElemIdx = 0;
+	m_mapExtDoc.clear();
+	m_doc = QDomDocument();
+	while(Reader->readNextStartElement())
+	{
+		tag_name = Reader->qualifiedName().toString();
+
+		if (eqName(tag_name, "ListItem"))
+		{
+			m_lstListItem += Reader->readElementText(QXmlStreamReader::SkipChildElements);
+			--ListItem_count;
+		}
+		else
+			readExtDocElement(Reader, nElemIdx);
+		nElemIdx++;
+	}
+
+	if (Reader->hasError())
+	{
+		m_qsErrorMessage = "Error in class 'CVmEventValue': " + Reader->errorString();
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (ListItem_count >= 0)
+	{
+		m_lstWarningList += "Warning in class 'CVmEventValue': tag 'ListItem' is absent";
+	}
+
+
+
 	return 0;
 }
 
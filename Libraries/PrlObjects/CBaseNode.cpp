@@ -112,18 +112,73 @@ QDomDocument CBaseNode::getXml(bool IncludeXmlNode, bool no_save_option) const
 }
 
 
+/**
+ * @brief Write XML element to stream
+ * @note Default implementation goes through getXml(), classes with large
+ * documents should override it to avoid building of DOM
+ * @param[in] Writer XML stream writer
+ * @param[in] Attributes additional attributes of the element (item id etc.)
+ */
+void CBaseNode::writeXmlStream(QXmlStreamWriter* Writer,
+	const QXmlStreamAttributes& Attributes, bool no_save_option) const
+{
+	QDomDocument document;
+	QDomElement element = getXml(&document, no_save_option);
+	foreach(const QXmlStreamAttribute& a, Attributes)
+		element.setAttribute(a.qualifiedName().toString(), a.value().toString());
+
+	writeDomElement(Writer, element);
+}
+
+
+/**
+ * @brief Read XML element from stream
+ * @note Default implementation builds DOM of the element and calls readXml(),
+ * classes with large documents should override it to fill themselves in one pass
+ * @param[in] Reader XML stream reader positioned at the start of the element,
+ * on success it is left at the end of the element
+ * @return int value: 0 - success, otherwise error
+ */
+int CBaseNode::readXmlStream(QXmlStreamReader* Reader, QString ext_tag_name)
+{
+	QDomDocument document;
+	QDomElement element = readDomElement(Reader, &document);
+	if (Reader->hasError())
+		return PRL_ERR_PARSE_VM_CONFIG;
+
+	document.appendChild(element);
+	return readXml(&element, ext_tag_name);
+}
+
+
+void CBaseNode::writeXmlDocument(QXmlStreamWriter* Writer, bool IncludeXmlNode, bool no_save_option) const
+{
+	Writer->setAutoFormatting(true);
+	Writer->setAutoFormattingIndent(1);
+
+	if (IncludeXmlNode)
+		Writer->writeProcessingInstruction(XML_DOC_VERSION_TAG, XML_DOC_VERSION_DATA);
+
+	QXmlStreamAttributes attributes;
+	if ( ! no_save_option )
+		attributes.append("id", QString::number(getItemId()));
+	if (IncludeXmlNode)
+		attributes.append(XML_VM_ATTR_SCHEMA_VERSION, XML_VM_CONFIG_SCHEMA_VERSION);
+
+	writeXmlStream(Writer, attributes, no_save_option);
+	Writer->writeEndDocument();
+}
+
+
 /**
  * @brief Serialization XML to string stream
  * @return string XML as string stream
  */
 QString CBaseNode::toString(bool IncludeXmlNode, bool no_save_option) const
 {
-	QDomDocument document = getXml(IncludeXmlNode, no_save_option);
-
 	QString str;
-	QTextStream out( &str );
-	document.save( out, 1 );
-	out.flush();
+	QXmlStreamWriter writer( &str );
+	writeXmlDocument( &writer, IncludeXmlNode, no_save_option );
 
 	if (str.contains(QChar('\0')))
 	{
@@ -168,6 +223,19 @@ int CBaseNode::fromString(QString SourceString,
 						  int * errorLine,
 						  int * errorColumn)
 {
+	// Uniting takes defaults from the whole loaded document, so only plain
+	// loading goes through the stream parser
+	if ( ! unite_with_loaded )
+	{
+		if (pFile)
+		{
+			QXmlStreamReader reader(pFile);
+			return fromStream(&reader, extTagName, errorMsg, errorLine, errorColumn);
+		}
+		QXmlStreamReader reader(SourceString);
+		return fromStream(&reader, extTagName, errorMsg, errorLine, errorColumn);
+	}
+
 	QDomDocument document;
 
 	QString error_message;
@@ -194,27 +262,7 @@ int CBaseNode::fromString(QString SourceString,
 
 	if (!res)
 	{
-		m_qsErrorMessage = QString("Error: %1, line: %2, column: %3.\n")
-							.arg(error_message).arg(line).arg(column);
-		if (errorMsg)
-		{
-			*errorMsg = error_message;
-		}
-		if (errorLine)
-		{
-			*errorLine = line;
-		}
-		if (errorColumn)
-		{
-			*errorColumn = column;
-		}
-
-		m_szErrMsg = error_message;
-		m_iErrLine = line;
-		m_iErrCol = column;
-
-//		Trace();
-
+		setParseError(error_message, line, column, errorMsg, errorLine, errorColumn);
 		return PRL_ERR_PARSE_VM_CONFIG;
 	}
 
@@ -253,6 +301,95 @@ int CBaseNode::fromString(QString SourceString,
 	return ret;
 }
 
+int CBaseNode::fromStream(QXmlStreamReader* Reader,
+						  QString extTagName,
+						  QString * errorMsg,
+						  int * errorLine,
+						  int * errorColumn)
+{
+	m_qsErrorMessage.clear();
+
+	m_szErrMsg.clear();
+	m_iErrLine = 0;
+	m_iErrCol = 0;
+
+	m_uiRcInit = PRL_ERR_PARSE_VM_CONFIG;
+	m_iParseRc = PRL_ERR_PARSE_VM_CONFIG;
+
+	Reader->setNamespaceProcessing(false);
+
+	int ret = PRL_ERR_PARSE_VM_CONFIG;
+	int nItemId = -1;
+	if (Reader->readNextStartElement())
+	{
+		QXmlStreamAttributes attributes = Reader->attributes();
+		if (attributes.hasAttribute("id"))
+			nItemId = attributes.value("id").toString().toInt();
+
+		m_uiRcInit = 0;
+		m_iParseRc = 0;
+
+		ret = readXmlStream(Reader, extTagName);
+		// The rest of document must be well-formed as well
+		while (!ret && !Reader->atEnd())
+			Reader->readNext();
+	}
+
+	if (Reader->hasError())
+	{
+		setParseError(Reader->errorString(), Reader->lineNumber(), Reader->columnNumber(),
+					  errorMsg, errorLine, errorColumn);
+		m_uiRcInit = PRL_ERR_PARSE_VM_CONFIG;
+		m_iParseRc = PRL_ERR_PARSE_VM_CONFIG;
+		return PRL_ERR_PARSE_VM_CONFIG;
+	}
+
+	if (ret)
+	{
+		ret = PRL_ERR_PARSE_VM_CONFIG;
+		m_uiRcInit = (PRL_RESULT )ret;
+		m_iParseRc = ret;
+		return ret;
+	}
+
+	setItemId(nItemId);
+
+	foreach(QString qsField, m_lstDiagnosticFields)
+	{
+		WRITE_TRACE( DBG_WARNING, "LoadedDoc: path: '%s', value: '%s'",
+			QSTR2UTF8(qsField), QSTR2UTF8(getPropertyValue(qsField).toString()) );
+	}
+
+	return 0;
+}
+
+void CBaseNode::setParseError(const QString& error_message,
+							  int line,
+							  int column,
+							  QString * errorMsg,
+							  int * errorLine,
+							  int * errorColumn)
+{
+	m_qsErrorMessage = QString("Error: %1, line: %2, column: %3.\n")
+						.arg(error_message).arg(line).arg(column);
+	if (errorMsg)
+	{
+		*errorMsg = error_message;
+	}
+	if (errorLine)
+	{
+		*errorLine = line;
+	}
+	if (errorColumn)
+	{
+		*errorColumn = column;
+	}
+
+	m_szErrMsg = error_message;
+	m_iErrLine = line;
+	m_iErrCol = column;
+}
+
 void CBaseNode::CopyBase(const CBaseNode* pBN)
 {
 	if (pBN)
@@ -415,7 +552,16 @@ int CBaseNode::saveToFile(QFile* pOrigFile, bool , bool )
 	// check on possibility save file
 	// bug #128539
 	// new data size
-	QByteArray data = toString( true, true ).toUtf8();
+	QByteArray data;
+	{
+		QXmlStreamWriter writer( &data );
+		writeXmlDocument( &writer, true, true );
+	}
+	if (data.contains('\0'))
+	{
+		WRITE_TRACE(DBG_FATAL, "WARNING: problem document was generated contains null symbols - will be patched");
+		data.replace('\0', ' ');
+	}
 	int iDataSize = data.size();
 	bool bRes = pFile->resize( iDataSize );
 	int iResult = PRL_ERR_SUCCESS;
@@ -573,6 +719,122 @@ void CBaseNode::checkAndInsertExtDocElement(QDomElement root_element, int& nElem
 	++nElemIdx;
 }
 
+void CBaseNode::checkAndWriteExtDocElement(QXmlStreamWriter* Writer, int& nElemIdx) const
+{
+	while(m_mapExtDoc.contains(nElemIdx))
+	{
+		writeDomElement(Writer, m_mapExtDoc.value(nElemIdx));
+		++nElemIdx;
+	}
+	++nElemIdx;
+}
+
+void CBaseNode::readExtDocElement(QXmlStreamReader* Reader, int nElemIdx)
+{
+	m_mapExtDoc.insert(nElemIdx, readDomElement(Reader, &m_doc));
+}
+
+/**
+ * Read a field given as an attribute, the same way readXml() does.
+ * @param Root [in] Attributes of the root element of the object.
+ * @param Element [in] Attributes of the current child element.
+ * @param Name [in] Field name.
+ * @param Value [out] Attribute value, the root one wins.
+ * @return Whether the attribute was found.
+ */
+bool CBaseNode::readFieldAttribute(const QXmlStreamAttributes& Root,
+	const QXmlStreamAttributes& Element, const QString& Name, QString& Value)
+{
+	if (Root.hasAttribute(Name))
+		Value = Root.value(Name).toString();
+	else if (Element.hasAttribute(Name))
+		Value = Element.value(Name).toString();
+	else
+		return false;
+
+	return true;
+}
+
+/**
+ * Read current element of the stream with its subtree to DOM.
+ * @param Reader [in] A stream positioned at the start of the element,
+ * it is left at the end of the element.
+ * @param Document [in] An owner document of the result.
+ * @return Element which is not appended to the document.
+ */
+QDomElement CBaseNode::readDomElement(QXmlStreamReader* Reader, QDomDocument* Document)
+{
+	QDomElement root_element = Document->createElement(Reader->qualifiedName().toString());
+	foreach(const QXmlStreamAttribute& a, Reader->attributes())
+		root_element.setAttribute(a.qualifiedName().toString(), a.value().toString());
+
+	QDomElement parent_element = root_element;
+	while(!Reader->atEnd())
+	{
+		switch(Reader->readNext())
+		{
+		case QXmlStreamReader::StartElement:
+		{
+			QDomElement element = Document->createElement(Reader->qualifiedName().toString());
+			foreach(const QXmlStreamAttribute& a, Reader->attributes())
+				element.setAttribute(a.qualifiedName().toString(), a.value().toString());
+			parent_element.appendChild(element);
+			parent_element = element;
+			break;
+		}
+		case QXmlStreamReader::EndElement:
+			if (parent_element == root_element)
+				return root_element;
+			parent_element = parent_element.parentNode().toElement();
+			break;
+		case QXmlStreamReader::Characters:
+			// Whitespace is dropped as QDomDocument::setContent() does
+			if (Reader->isCDATA())
+				parent_element.appendChild(Document->createCDATASection(Reader->text().toString()));
+			else if (!Reader->isWhitespace())
+				parent_element.appendChild(Document->createTextNode(Reader->text().toString()));
+			break;
+		case QXmlStreamReader::Comment:
+			parent_element.appendChild(Document->createComment(Reader->text().toString()));
+			break;
+		default:
+			break;
+		}
+	}
+	return root_element;
+}
+
+/**
+ * Write DOM element with its subtree to the stream.
+ * @param Writer [in] A stream.
+ * @param Element [in] An element.
+ */
+void CBaseNode::writeDomElement(QXmlStreamWriter* Writer, const QDomElement& Element)
+{
+	Writer->writeStartElement(Element.tagName());
+
+	QDomNamedNodeMap attributes = Element.attributes();
+	for(int i = 0; i < attributes.count(); ++i)
+	{
+		QDomAttr attribute = attributes.item(i).toAttr();
+		Writer->writeAttribute(attribute.name(), attribute.value());
+	}
+
+	for(QDomNode node = Element.firstChild(); !node.isNull(); node = node.nextSibling())
+	{
+		if (node.isElement())
+			writeDomElement(Writer, node.toElement());
+		else if (node.isCDATASection())
+			Writer->writeCDATA(node.toCDATASection().data());
+		else if (node.isText())
+			Writer->writeCharacters(node.toText().data());
+		else if (node.isComment())
+			Writer->writeComment(node.toComment().data());
+	}
+
+	Writer->writeEndElement();
+}
+
 QString CBaseNode::getLegacyProductTag(const QString& xml_name) const
 {
 	static const char *v = "Virtuozzo";
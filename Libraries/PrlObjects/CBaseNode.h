@@ -69,6 +69,14 @@ public:
 						bool unite_with_loaded = false);// = 0;
 	virtual void syncItemIds();// = 0
 
+	// Write XML element to stream
+	virtual void writeXmlStream(QXmlStreamWriter* Writer,
+						const QXmlStreamAttributes& Attributes = QXmlStreamAttributes(),
+						bool no_save_option = false) const;
+	// Read XML element from stream in one pass
+	virtual int readXmlStream(QXmlStreamReader* Reader,
+						QString ext_tag_name = QString());
+
 	// Set default values
 	virtual void setDefaults(QDomElement* RootElement = 0);// = 0;
 	// Custom initialization
@@ -124,14 +132,9 @@ public:
 		pNew->syncItemIds();
 
 		T cur;
-		m_iParseRc = cur.fromString(pCur->toString());
-		if (PRL_FAILED(m_iParseRc))
-			return m_iParseRc;
-
+		copyDocument(cur, *pCur);
 		T prev;
-		m_iParseRc = prev.fromString(pPrev->toString());
-		if (PRL_FAILED(m_iParseRc))
-			return m_iParseRc;
+		copyDocument(prev, *pPrev);
 
 		bool bRes = pNew->merge(&cur, &prev, nOptions);
 		if (bRes)
@@ -152,15 +155,24 @@ public:
 			return PRL_ERR_FAILURE;
 
 		T diff_new;
-		diff_new.fromString(pNew->toString());
+		copyDocument(diff_new, *pNew);
 		T diff_old;
-		diff_old.fromString(pOld->toString());
+		copyDocument(diff_old, *pOld);
 
 		diff_new.diff(&diff_old, lstDiffFullItemIds);
 
 		return PRL_ERR_SUCCESS;
 	}
 
+	// Deep copy of the object graph with item ids synchronized the same way
+	// as serializing to XML and parsing back does, but without the round trip
+	template<class T>
+	static void copyDocument( T& dst, const T& src )
+	{
+		dst = src;
+		dst.syncItemIds();
+	}
+
 	// Load from file
 	virtual int loadFromFile(QFile* File, bool BNeedLoadAbsolutePath = true);
 	virtual int loadFromFile(QString FileName, bool BNeedLoadAbsolutePath = true);
@@ -456,20 +468,22 @@ protected:
 		QMap<int , T* > mapCur = getItemMap<T>(lstCur);
 		QMap<int , T* > mapPrev = getItemMap<T>(lstPrev);
 
-		if (mapNew.keys() != mapCur.keys() && mapNew.keys() != mapPrev.keys() && mapCur.keys() != mapPrev.keys())
+		QList<int > lstNewIds = mapNew.keys();
+		QList<int > lstCurIds = mapCur.keys();
+		QList<int > lstPrevIds = mapPrev.keys();
+
+		if (lstNewIds != lstCurIds && lstNewIds != lstPrevIds && lstCurIds != lstPrevIds)
 		{
 			m_qsErrorMessage += "." + tag_name;
 			return false;
 		}
 
-		if (mapNew.keys() != mapCur.keys() && mapNew.keys() == mapPrev.keys())
+		if (lstNewIds != lstCurIds && lstNewIds == lstPrevIds)
 		{
 			foreach(T* object, lstCur)
 			{
 				if ( mapNew.contains(object->getItemId()) ) continue;
-				lstNew += new T();
-				lstNew.last()->setItemId(object->getItemId());
-				lstNew.last()->fromString(object->toString());
+				lstNew += new T(*object);
 			}
 			foreach(T* object, lstNew)
 			{
@@ -517,6 +531,14 @@ protected:
 	}
 
 	void checkAndInsertExtDocElement(QDomElement root_element, int& nElemIdx) const;
+	void checkAndWriteExtDocElement(QXmlStreamWriter* Writer, int& nElemIdx) const;
+	void readExtDocElement(QXmlStreamReader* Reader, int nElemIdx);
+	static bool readFieldAttribute(const QXmlStreamAttributes& Root,
+		const QXmlStreamAttributes& Element, const QString& Name, QString& Value);
+
+	// Stream <-> DOM helpers for classes without stream serialization
+	static QDomElement readDomElement(QXmlStreamReader* Reader, QDomDocument* Document);
+	static void writeDomElement(QXmlStreamWriter* Writer, const QDomElement& Element);
 
 	bool eqName(QString& tag_name, const QString xml_name, const bool replace_name = false);
 
@@ -559,6 +581,18 @@ private:
 					QString * errorMsg = 0,
 					int * errorLine = 0,
 					int * errorColumn = 0 );
+	int fromStream( QXmlStreamReader* Reader,
+					QString extTagName,
+					QString * errorMsg,
+					int * errorLine,
+					int * errorColumn );
+	void setParseError( const QString& error_message,
+					int line,
+					int column,
+					QString * errorMsg,
+					int * errorLine,
+					int * errorColumn );
+	void writeXmlDocument(QXmlStreamWriter* Writer, bool IncludeXmlNode, bool no_save_option) const;
 
 	bool			m_flgCrashSafeSaving;
 
@@ -30,12 +30,16 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include <random>
+
 #ifdef _WIN_
 #include <windows.h>
 #else
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "libuuid_unix/uuid.h"
 #endif
-#include <boost/uuid/uuid.hpp>
 
 
 /*****************************************************************************
@@ -269,6 +273,162 @@ static inline void helper_uuid_from_str(Uuid_t uid, const char* str)
 	}
 }
 
+/*****************************************************************************
+ * Random uuid generator.
+ *
+ * Every thread has its own ChaCha20 keystream generator seeded once from
+ * the OS entropy source. Keystream is produced by blocks, the first bytes of
+ * each block become the key of the next one ("fast key erasure"), so bytes
+ * already given out can not be recovered from the generator state. Child
+ * process after fork() reseeds not to repeat uuids of the parent.
+ *****************************************************************************/
+
+#define HELPER_CHACHA_BLOCK_SIZE 64
+#define HELPER_RNG_BUF_BLOCKS 16
+#define HELPER_RNG_KEY_SIZE 32
+
+struct helper_rng_t {
+    UINT32 key[8];
+    UINT8  buf[HELPER_CHACHA_BLOCK_SIZE * HELPER_RNG_BUF_BLOCKS];
+    size_t pos;
+    // Seeded state has generation equal to g_rng_generation
+    UINT32 generation;
+};
+
+// Is changed in child process after fork()
+static volatile UINT32 g_rng_generation = 1;
+
+static thread_local helper_rng_t t_rng;
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QR(a, b, c, d) \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 16); \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 12); \
+    a += b; d ^= a; d = CHACHA_ROTL(d, 8); \
+    c += d; b ^= c; b = CHACHA_ROTL(b, 7);
+
+static void helper_chacha20_block ( const UINT32 key[8], UINT32 counter, UINT8 *out )
+{
+    UINT32 in[16], x[16];
+    int i;
+
+    in[0] = 0x61707865;
+    in[1] = 0x3320646e;
+    in[2] = 0x79622d32;
+    in[3] = 0x6b206574;
+    for (i = 0; i < 8; i++)
+        in[4 + i] = key[i];
+    // Nonce is not needed as key is never reused
+    in[12] = counter;
+    in[13] = in[14] = in[15] = 0;
+
+    memcpy(x, in, sizeof(x));
+    for (i = 0; i < 10; i++) {
+        CHACHA_QR(x[0], x[4], x[8],  x[12]);
+        CHACHA_QR(x[1], x[5], x[9],  x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8],  x[13]);
+        CHACHA_QR(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (i = 0; i < 16; i++) {
+        UINT32 v = x[i] + in[i];
+        out[4 * i] = (UINT8) v;
+        out[4 * i + 1] = (UINT8) (v >> 8);
+        out[4 * i + 2] = (UINT8) (v >> 16);
+        out[4 * i + 3] = (UINT8) (v >> 24);
+    }
+}
+
+static void helper_rng_refill ( helper_rng_t *rng )
+{
+    int i;
+
+    for (i = 0; i < HELPER_RNG_BUF_BLOCKS; i++)
+        helper_chacha20_block(rng->key, i, rng->buf + i * HELPER_CHACHA_BLOCK_SIZE);
+
+    for (i = 0; i < 8; i++) {
+        const UINT8 *p = rng->buf + 4 * i;
+        rng->key[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32) p[3] << 24);
+    }
+    memset(rng->buf, 0, HELPER_RNG_KEY_SIZE);
+    rng->pos = HELPER_RNG_KEY_SIZE;
+}
+
+#ifndef _WIN_
+static void helper_rng_atfork_child ( void )
+{
+    g_rng_generation = g_rng_generation + 1;
+}
+
+static bool helper_rng_read_urandom ( UINT8 *out, size_t size )
+{
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    while (size > 0) {
+        ssize_t n = read(fd, out, size);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        out += n;
+        size -= n;
+    }
+    close(fd);
+    return true;
+}
+#endif
+
+static void helper_rng_seed ( helper_rng_t *rng )
+{
+    bool seeded = false;
+#ifndef _WIN_
+    static int atfork_registered = pthread_atfork(NULL, NULL, helper_rng_atfork_child);
+    (void)atfork_registered;
+
+    seeded = helper_rng_read_urandom((UINT8 *)rng->key, sizeof(rng->key));
+#endif
+    if (!seeded) {
+        std::random_device rd;
+        for (int i = 0; i < 8; i++)
+            rng->key[i] = rd();
+    }
+    rng->generation = g_rng_generation;
+    helper_rng_refill(rng);
+}
+
+static void helper_rng_bytes ( UINT8 *out, size_t size )
+{
+    helper_rng_t *rng = &t_rng;
+
+    if (rng->generation != g_rng_generation)
+        helper_rng_seed(rng);
+
+    while (size > 0) {
+        if (rng->pos == sizeof(rng->buf))
+            helper_rng_refill(rng);
+
+        size_t n = qMin(size, sizeof(rng->buf) - rng->pos);
+        memcpy(out, rng->buf + rng->pos, n);
+        memset(rng->buf + rng->pos, 0, n);
+        rng->pos += n;
+        out += n;
+        size -= n;
+    }
+}
+
+static inline void helper_uuid_set_v4 ( Uuid_t uu )
+{
+    // RFC 4122 version 4 (random), variant 10xx
+    uu[6] = (uu[6] & 0x0F) | 0x40;
+    uu[8] = (uu[8] & 0x3F) | 0x80;
+}
+
 PrlUuid::PrlUuid()
 {
 	helper_uuid_clear(m_uuid);
@@ -348,11 +508,16 @@ void PrlUuid::generate()
 }
 
 void PrlUuid::generate(Uuid_t uuid)
-{	
-	s_generator = boost::uuids::random_generator();
+{
+	helper_rng_bytes(uuid, sizeof(Uuid_t));
+	helper_uuid_set_v4(uuid);
+}
 
-	boost::uuids::uuid u = s_generator();
-	std::copy(u.begin(), u.end(), uuid);
+void PrlUuid::generate(Uuid_t* uuids, size_t count)
+{
+	helper_rng_bytes((UINT8 *)uuids, count * sizeof(Uuid_t));
+	for (size_t i = 0; i < count; ++i)
+		helper_uuid_set_v4(uuids[i]);
 }
 
 void PrlUuid::toGuid(PRL_GUID * pGUID ) const
@@ -33,7 +33,6 @@
 #include <QThreadStorage>
 #include <prlsdk/PrlTypes.h>
 #include "PrlUuidCommon.h"
-#include <boost/uuid/uuid_generators.hpp>
 
 /**
  * Hash a uuid by internal 128 bits.
@@ -75,6 +74,8 @@ public:
 	void clear();
 	void generate();
 	static void generate(Uuid_t uuid);
+	// Generates count random uuids at once
+	static void generate(Uuid_t* uuids, size_t count);
 	bool isNull() const;
 	static bool isUuid(const std::string & strUuid);
 	UINT32 hash() const { return qHash(m_uuid); }
@@ -92,9 +93,6 @@ public:
 
 protected:
 	Uuid_t m_uuid;
-
-private:
-	static thread_local boost::uuids::random_generator s_generator;
 };
 
 
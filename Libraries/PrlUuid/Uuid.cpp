@@ -26,6 +26,7 @@
 
 
 #include <QDataStream>
+#include <QVarLengthArray>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -99,6 +100,22 @@ Uuid Uuid::createUuid ()
     return uuid;
 }
 
+QList<Uuid> Uuid::createUuids ( int count )
+{
+    QList<Uuid> res;
+    if ( count <= 0 )
+        return res;
+
+    QVarLengthArray<UINT8, 64 * sizeof(Uuid_t)> buf(count * sizeof(Uuid_t));
+    Uuid_t* uuids = reinterpret_cast<Uuid_t*>(buf.data());
+    PrlUuid::generate(uuids, count);
+
+    res.reserve(count);
+    for ( int i = 0; i < count; ++i )
+        res.append(toUuid(uuids[i]));
+    return res;
+}
+
 bool Uuid::dump ( const QString& uuidStr, Uuid_t uuidT )
 {
     Uuid uuid( uuidStr );
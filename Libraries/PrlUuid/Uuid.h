@@ -29,6 +29,7 @@
 #define UUID_H
 
 #include <QString>
+#include <QList>
 #include <prlsdk/PrlTypes.h>
 #include "PrlUuid.h"
 
@@ -61,6 +62,7 @@ public:
     inline void dump ( Uuid_t uuidDst ) const { PrlUuid::dump(uuidDst); }
     static Uuid createUuid ();
     inline static void createUuid ( Uuid_t uuid) { PrlUuid::generate(uuid); }
+    static QList<Uuid> createUuids ( int count );
     static bool dump ( const QString& uuidSrc, Uuid_t uuidDst );
     static QString toString ( const Uuid_t );
     static Uuid toUuid ( const Uuid_t );
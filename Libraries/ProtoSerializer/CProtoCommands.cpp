@@ -65,6 +65,17 @@ const SmartPtr<CVmEvent>& CProtoCommandBase::GetCommand() const
 void CProtoCommandBase::ParsePackage(const QString &sCmdBuffer)
 {
 	m_pProtoPackage->fromString(sCmdBuffer);
+	AddAbsentCommonParams();
+}
+
+void CProtoCommandBase::ParsePackage(const char *pCmdBuffer, quint32 nSize)
+{
+	m_pProtoPackage->fromBinary(pCmdBuffer, nSize);
+	AddAbsentCommonParams();
+}
+
+void CProtoCommandBase::AddAbsentCommonParams()
+{
 	CVmEventParameter *pParam = m_pProtoPackage->getEventParameter(EVT_PARAM_PROTO_FORCE_QUESTIONS_SIGN);
 	if (!pParam)
 		m_pProtoPackage->addEventParameter(new CVmEventParameter(PVE::UnsignedInt,
@@ -104,18 +115,12 @@ QString CProtoCommandBase::GetStringParamValue(const QString &sParamName) const
 
 quint32 CProtoCommandBase::GetUnsignedIntParamValue(const QString &sParamName) const
 {
-	CVmEventParameter *pParam = m_pProtoPackage->getEventParameter(sParamName);
-	if (pParam)
-		return (pParam->getParamValue().toUInt());
-	return (0);
+	return (m_pProtoPackage->getEventParameterUInt(sParamName));
 }
 
 quint64 CProtoCommandBase::GetUnsignedInt64ParamValue(const QString &sParamName) const
 {
-	CVmEventParameter *pParam = m_pProtoPackage->getEventParameter(sParamName);
-	if (pParam)
-		return (pParam->getParamValue().toULongLong());
-	return (0);
+	return (m_pProtoPackage->getEventParameterUInt64(sParamName));
 }
 
 QStringList CProtoCommandBase::GetStringListParamValue(const QString &sParamName) const
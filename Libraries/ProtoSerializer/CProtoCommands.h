@@ -79,6 +79,14 @@ public:
 	 */
 	void ParsePackage(const QString &sCmdBuffer);
 
+	/**
+	 * Parses specified binary encoded command buffer (see CVmEvent::toBinary)
+	 * in internal proto package container
+	 * @param command buffer
+	 * @param command buffer size
+	 */
+	void ParsePackage(const char *pCmdBuffer, quint32 nSize);
+
 	/** Returns sign whether task questions need to be forced */
 	bool GetForceQuestionsSign();
 
@@ -152,6 +160,10 @@ protected:
 protected:
 	/** Pointer to proto package */
 	SmartPtr<CVmEvent> m_pProtoPackage;
+
+private:
+	/** Adds common parameters which are absent at parsed proto package */
+	void AddAbsentCommonParams();
 };
 
 /**
@@ -341,6 +341,13 @@ CProtoCommandPtr CProtoSerializer::CreateUpdateSnapshotDataProtoCommand(
 }
 
 CProtoCommandPtr CProtoSerializer::ParseCommand(PVE::IDispatcherCommands nCmdIdentifier, const QString &sPackage)
+{
+	CProtoCommand* pCommand = CreateCommand(nCmdIdentifier);
+	pCommand->ParsePackage(sPackage);
+	return CProtoCommandPtr(pCommand);
+}
+
+CProtoCommand *CProtoSerializer::CreateCommand(PVE::IDispatcherCommands nCmdIdentifier)
 {
 	CProtoCommand* pCommand;
 	switch (nCmdIdentifier)
@@ -614,8 +621,7 @@ CProtoCommandPtr CProtoSerializer::ParseCommand(PVE::IDispatcherCommands nCmdIde
 			break;
 		default: pCommand = static_cast<CProtoCommand *>(new CProtoCommandIllegalCommand); break;
 	}
-	pCommand->ParsePackage(sPackage);
-	return CProtoCommandPtr(pCommand);
+	return pCommand;
 }
 
 CProtoCommandPtr CProtoSerializer::ParseCommand(
@@ -624,14 +630,43 @@ CProtoCommandPtr CProtoSerializer::ParseCommand(
     if ( ! p.isValid() )
         return CProtoCommandPtr(new CProtoCommandIllegalCommand());
 
+	PVE::IDispatcherCommands nCmdIdentifier =
+		(PVE::IDispatcherCommands)p->header.type;
+	IOService::IOPackage::EncodingType nEncoding;
+	SmartPtr<char> pBuffer;
+	quint32 nSize = 0;
+	if (p->getBuffer(0, nEncoding, pBuffer, nSize) &&
+		CVmEvent::isBinary(pBuffer.getImpl(), nSize))
+	{
+		CProtoCommand* pCommand = CreateCommand(nCmdIdentifier);
+		pCommand->ParsePackage(pBuffer.getImpl(), nSize);
+		return CProtoCommandPtr(pCommand);
+	}
+
 	QString x = UTF8_2QSTR(p->buffers[0].getImpl());
 	BOOST_SCOPE_EXIT(&x)
 	{
 		x.fill(0);
 	}
 	BOOST_SCOPE_EXIT_END;
-    return ParseCommand( (PVE::IDispatcherCommands)p->header.type,
-						 UTF8_2QSTR( p->buffers[0].getImpl() ) );
+	return ParseCommand(nCmdIdentifier, x);
+}
+
+int CProtoSerializer::ParseEvent(
+	const SmartPtr<IOService::IOPackage>& p, CVmEvent& evt )
+{
+	if ( ! p.isValid() )
+		return PRL_ERR_PARSE_VM_CONFIG;
+
+	IOService::IOPackage::EncodingType nEncoding;
+	SmartPtr<char> pBuffer;
+	quint32 nSize = 0;
+	if (!p->getBuffer(0, nEncoding, pBuffer, nSize))
+		return PRL_ERR_PARSE_VM_CONFIG;
+	if (CVmEvent::isBinary(pBuffer.getImpl(), nSize))
+		return evt.fromBinary(pBuffer.getImpl(), nSize);
+
+	return evt.fromString(UTF8_2QSTR(pBuffer.getImpl()));
 }
 
 CProtoCommandPtr CProtoSerializer::CreateDspCmdFsGenerateEntryNameCommand(
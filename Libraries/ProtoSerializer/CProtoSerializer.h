@@ -191,6 +191,38 @@ inline SmartPtr<IOService::IOPackage> createInstance (
                            parent, broadcastResponse );
 }
 
+/**
+ * Creates package with event in binary encoding (see CVmEvent::toBinary).
+ * Use it only for peers which have negotiated binary events, see
+ * IOClient::binaryEventsNegotiated and
+ * IOServerInterface::clientBinaryEventsNegotiated, otherwise create
+ * package with XML event.
+ */
+inline SmartPtr<IOService::IOPackage> createBinaryInstance (
+    int cmdNumber,
+    const CVmEvent& evt,
+    const SmartPtr<IOService::IOPackage>& parent = SmartPtr<IOService::IOPackage>(),
+    bool broadcastResponse = false )
+{
+    QByteArray baBinary = evt.toBinary();
+
+    SmartPtr<IOService::IOPackage> p =
+        IOService::IOPackage::createInstance( cmdNumber, 1, parent, broadcastResponse );
+    p->fillBuffer( 0, IOService::IOPackage::RawEncoding,
+                   baBinary.constData(), baBinary.size() );
+    return p;
+}
+
+inline SmartPtr<IOService::IOPackage> createBinaryInstance (
+    int cmdNumber,
+    const CProtoCommandPtr& cmd,
+    const SmartPtr<IOService::IOPackage>& parent = SmartPtr<IOService::IOPackage>(),
+    bool broadcastResponse = false )
+{
+    return createBinaryInstance( cmdNumber, *cmd->GetCommand(),
+                                 parent, broadcastResponse );
+}
+
 inline SmartPtr<IOService::IOPackage> createInstance (
 	int cmdNumber,
 	QDataStream& out,
@@ -251,6 +283,15 @@ public:
 	 */
 	static CProtoCommandPtr ParseCommand( const SmartPtr<IOService::IOPackage>& );
 
+	/**
+	 * Parses event from first package buffer, which may be in XML or
+	 * in binary encoding (see DispatcherPackage::createBinaryInstance)
+	 * @param package
+	 * @param event to fill
+	 * @return 0 on success or parse error code
+	 */
+	static int ParseEvent( const SmartPtr<IOService::IOPackage>&, CVmEvent& );
+
 	/**
 	 * Template class method that let to casting base proto command pointer to necessary command type
 	 */
@@ -1014,6 +1055,13 @@ public:
 		const quint32 nHeight,
 		PRL_UINT32 nFlags
     );
+
+private:
+	/**
+	 * Creates empty proto command object of corresponding type
+	 * @param proto command type identifier
+	 */
+	static CProtoCommand *CreateCommand(PVE::IDispatcherCommands nCmdIdentifier);
 };
 
 }//namespace Virtuozzo
@@ -0,0 +1,277 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// @file BitOps.c
+///
+/// Word kernels of the bit array operations with SSE4.2 and AVX2 variants
+/// selected by the CPU at the first call
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core Libraries. Virtuozzo Core
+/// Libraries is free software; you can redistribute it and/or modify it
+/// under the terms of the GNU Lesser General Public License as published
+/// by the Free Software Foundation; either version 2.1 of the License, or
+/// (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this library.  If not, see
+/// <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+/// 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef BITOPS_KERNELS
+#define BITOPS_KERNELS
+#endif
+#include "BitOps.h"
+
+// target attribute with intrinsics needs gcc 4.9
+#if defined(__x86_64__) && (defined(__clang__) || \
+	(defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define BITOPS_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// portable
+
+#define merge_scalar BitMergeWords64Scalar
+#define count_scalar BitCountWords64Scalar
+#define find_not_scalar BitFindWordNot64Scalar
+
+#ifdef BITOPS_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE4.2
+
+__attribute__((target("sse4.2")))
+static void merge_sse42(UINT64 *dest, const UINT64 *src, SIZE_T words)
+{
+	SIZE_T i = 0;
+
+	for (; i + 4 <= words; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 2));
+		__m128i c = _mm_loadu_si128((const __m128i *)(dest + i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dest + i + 2));
+
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_or_si128(a, c));
+		_mm_storeu_si128((__m128i *)(dest + i + 2), _mm_or_si128(b, d));
+	}
+	merge_scalar(dest + i, src + i, words - i);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static SIZE_T count_sse42(const UINT64 *bmap, SIZE_T words)
+{
+	// independent sums let popcnt run on several ports
+	UINT64 c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+	SIZE_T i = 0;
+
+	for (; i + 4 <= words; i += 4) {
+		c0 += _mm_popcnt_u64(bmap[i]);
+		c1 += _mm_popcnt_u64(bmap[i + 1]);
+		c2 += _mm_popcnt_u64(bmap[i + 2]);
+		c3 += _mm_popcnt_u64(bmap[i + 3]);
+	}
+	for (; i < words; ++i)
+		c0 += _mm_popcnt_u64(bmap[i]);
+	return (SIZE_T)(c0 + c1 + c2 + c3);
+}
+
+__attribute__((target("sse4.2")))
+static SIZE_T find_not_sse42(const UINT64 *bmap, SIZE_T words, UINT64 pattern)
+{
+	__m128i p = _mm_set1_epi64x((long long)pattern);
+	SIZE_T i = 0;
+
+	for (; i + 4 <= words; i += 4) {
+		__m128i a = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(bmap + i)), p);
+		__m128i b = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(bmap + i + 2)), p);
+
+		if (_mm_movemask_epi8(_mm_and_si128(a, b)) != 0xffff)
+			break;
+	}
+	return i + find_not_scalar(bmap + i, words - i, pattern);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AVX2
+
+__attribute__((target("avx2")))
+static void merge_avx2(UINT64 *dest, const UINT64 *src, SIZE_T words)
+{
+	SIZE_T i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 4));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(dest + i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dest + i + 4));
+
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_or_si256(a, c));
+		_mm256_storeu_si256((__m256i *)(dest + i + 4), _mm256_or_si256(b, d));
+	}
+	merge_scalar(dest + i, src + i, words - i);
+}
+
+// Nibble lookup with pshufb, bytes are summed with psadbw
+__attribute__((target("avx2,popcnt")))
+static SIZE_T count_avx2(const UINT64 *bmap, SIZE_T words)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i acc = _mm256_setzero_si256();
+	UINT64 sum[4];
+	SIZE_T i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(bmap + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(bmap + i + 4));
+		__m256i ca = _mm256_add_epi8(
+				_mm256_shuffle_epi8(table, _mm256_and_si256(a, low)),
+				_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(a, 4), low)));
+		__m256i cb = _mm256_add_epi8(
+				_mm256_shuffle_epi8(table, _mm256_and_si256(b, low)),
+				_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(b, 4), low)));
+
+		// at most 16 per byte, no overflow
+		acc = _mm256_add_epi64(acc,
+				_mm256_sad_epu8(_mm256_add_epi8(ca, cb), _mm256_setzero_si256()));
+	}
+
+	_mm256_storeu_si256((__m256i *)sum, acc);
+	return (SIZE_T)(sum[0] + sum[1] + sum[2] + sum[3]) + count_sse42(bmap + i, words - i);
+}
+
+__attribute__((target("avx2")))
+static SIZE_T find_not_avx2(const UINT64 *bmap, SIZE_T words, UINT64 pattern)
+{
+	__m256i p = _mm256_set1_epi64x((long long)pattern);
+	SIZE_T i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		__m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(bmap + i)), p);
+		__m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(bmap + i + 4)), p);
+
+		if (_mm256_movemask_epi8(_mm256_and_si256(a, b)) != -1)
+			break;
+	}
+	return i + find_not_scalar(bmap + i, words - i, pattern);
+}
+
+static unsigned int xgetbv0(void)
+{
+	unsigned int eax, edx;
+
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+}
+
+#endif // BITOPS_X86
+
+///////////////////////////////////////////////////////////////////////////////
+// dispatch
+
+struct Kernels
+{
+	void (*merge)(UINT64 *, const UINT64 *, SIZE_T);
+	SIZE_T (*count)(const UINT64 *, SIZE_T);
+	SIZE_T (*find_not)(const UINT64 *, SIZE_T, UINT64);
+};
+
+static const struct Kernels s_kernels[] = {
+	{ merge_scalar, count_scalar, find_not_scalar },
+#ifdef BITOPS_X86
+	{ merge_sse42, count_sse42, find_not_sse42 },
+	{ merge_avx2, count_avx2, find_not_avx2 },
+#endif
+};
+
+// Level is a single word, so all kernels are switched at once.
+// -1 until the CPU is probed.
+static int s_level = -1;
+
+int BitOpsGetCpuLevel(void)
+{
+#ifdef BITOPS_X86
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return BITOPS_LEVEL_SCALAR;
+
+	if (!(ecx & bit_SSE4_2) || !(ecx & bit_POPCNT))
+		return BITOPS_LEVEL_SCALAR;
+
+	// ymm state must be saved by the OS
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || (xgetbv0() & 6) != 6)
+		return BITOPS_LEVEL_SSE42;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return BITOPS_LEVEL_SSE42;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (ebx & bit_AVX2)
+		return BITOPS_LEVEL_AVX2;
+
+	return BITOPS_LEVEL_SSE42;
+#else
+	return BITOPS_LEVEL_SCALAR;
+#endif
+}
+
+int BitOpsSetLevel(int level)
+{
+	int cpu = BitOpsGetCpuLevel();
+
+	if (level < 0 || level > cpu)
+		level = cpu;
+
+	AtomicWrite(&s_level, level);
+	return level;
+}
+
+int BitOpsGetLevel(void)
+{
+	int level = AtomicRead(&s_level);
+
+	if (level >= 0)
+		return level;
+
+	// the first caller wins, BitOpsSetLevel() may have been faster
+	level = BitOpsGetCpuLevel();
+	AtomicCompareSwap(&s_level, -1, level);
+	return AtomicRead(&s_level);
+}
+
+static __inline const struct Kernels *kernels(void)
+{
+	int level = AtomicRead(&s_level);
+
+	return &s_kernels[level >= 0 ? level : BitOpsGetLevel()];
+}
+
+void BitMergeWords64(UINT64 *dest, const UINT64 *src, SIZE_T words)
+{
+	kernels()->merge(dest, src, words);
+}
+
+SIZE_T BitCountWords64(const UINT64 *bmap, SIZE_T words)
+{
+	return kernels()->count(bmap, words);
+}
+
+SIZE_T BitFindWordNot64(const UINT64 *bmap, SIZE_T words, UINT64 pattern)
+{
+	return kernels()->find_not(bmap, words, pattern);
+}
@@ -35,6 +35,96 @@
 #include "../Interfaces/VirtuozzoTypes.h"
 #include "AtomicOps.h"
 
+// Portable word kernels
+static __inline void BitMergeWords64Scalar(UINT64 *dest, const UINT64 *src, SIZE_T words)
+{
+	SIZE_T i;
+
+	for (i = 0; i < words; ++i)
+		dest[i] |= src[i];
+}
+
+static __inline SIZE_T BitCountWords64Scalar(const UINT64 *bmap, SIZE_T words)
+{
+	SIZE_T i, cnt = 0;
+
+	for (i = 0; i < words; ++i) {
+		UINT64 v = bmap[i];
+
+		v = v - ((v >> 1) & 0x5555555555555555ull);
+		v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+		v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+		cnt += (SIZE_T)((v * 0x0101010101010101ull) >> 56);
+	}
+	return cnt;
+}
+
+static __inline SIZE_T BitFindWordNot64Scalar(const UINT64 *bmap, SIZE_T words, UINT64 pattern)
+{
+	SIZE_T i;
+
+	for (i = 0; i < words; ++i) {
+		if (bmap[i] != pattern)
+			break;
+	}
+	return i;
+}
+
+// SSE4.2/AVX2 kernels are in BitOps.c of libStd, Std.pri defines
+// BITOPS_KERNELS for its users. Others get the portable kernels inline
+// and need no library.
+#ifdef BITOPS_KERNELS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernels of BitOps.c, the best level of the CPU is used by default
+enum
+{
+	BITOPS_LEVEL_SCALAR,
+	BITOPS_LEVEL_SSE42,
+	BITOPS_LEVEL_AVX2
+};
+
+// Best level supported by the CPU and the OS
+int BitOpsGetCpuLevel(void);
+// Level in use
+int BitOpsGetLevel(void);
+// Use kernels of the level, not above the CPU one, -1 for the best.
+// Returns the level set.
+int BitOpsSetLevel(int level);
+
+// OR src words into dest
+void BitMergeWords64(UINT64 *dest, const UINT64 *src, SIZE_T words);
+// Number of set bits in words
+SIZE_T BitCountWords64(const UINT64 *bmap, SIZE_T words);
+// Index of the first word which differs from pattern, words if none
+SIZE_T BitFindWordNot64(const UINT64 *bmap, SIZE_T words, UINT64 pattern);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else // BITOPS_KERNELS
+
+static __inline void BitMergeWords64(UINT64 *dest, const UINT64 *src, SIZE_T words)
+{
+	BitMergeWords64Scalar(dest, src, words);
+}
+
+static __inline SIZE_T BitCountWords64(const UINT64 *bmap, SIZE_T words)
+{
+	return BitCountWords64Scalar(bmap, words);
+}
+
+static __inline SIZE_T BitFindWordNot64(const UINT64 *bmap, SIZE_T words, UINT64 pattern)
+{
+	return BitFindWordNot64Scalar(bmap, words, pattern);
+}
+
+#endif // BITOPS_KERNELS
+
 
 // Get UINT-aligned size of a bitmap in bytes
 #define BMAP_SZ(bits)		((((bits) + 31) >> 5) << 2)
@@ -84,10 +174,7 @@ static __inline void BMAP_SET_BLOCK(void* bmap, unsigned int Start, unsigned int
 static __inline void BMAP_MERGE(void* dest, void* src, unsigned int Size)
 {
 	unsigned i, n = Size >> 6;
-	UINT64 *d = (UINT64 *)dest, *s = (UINT64 *)src;
-	for (i = 0; i < n; ++i) {
-		*d++ |= *s++;
-	}
+	BitMergeWords64((UINT64 *)dest, (const UINT64 *)src, n);
 
 	for (i = n << 6; i < Size; ++i)
 		if (BMAP_GET(src, i))
@@ -128,6 +215,13 @@ static __inline SIZE_T BMAP_COUNT_IN_BYTES(void const* bmap, SIZE_T len)
 {
 	SIZE_T cnt = 0;
 	unsigned char const* ptr = (unsigned char const*)bmap, *end = ptr + len;
+	for (; ptr < end && ((ULONG_PTR)ptr & 7); ++ptr)
+		cnt += BMAP_COUNT_TBL()[*ptr];
+	if (ptr < end) {
+		SIZE_T n = (end - ptr) >> 3;
+		cnt += BitCountWords64((UINT64 const*)ptr, n);
+		ptr += n << 3;
+	}
 	for (; ptr < end; ++ptr)
 		cnt += BMAP_COUNT_TBL()[*ptr];
 	return cnt;
@@ -355,12 +449,15 @@ static __inline LONG64 BitFindNextSet64(UINT64 const* bmap,
 		pos += BITS_PER_UINT64;
 	}
 
-	while (size & ~BIT_MASK_UINT64) {
-		val = *(p++);
-		if (val != 0)
+	if (size & ~BIT_MASK_UINT64) {
+		SIZE_T n = size >> 6, i = BitFindWordNot64(p, n, 0);
+		pos += (UINT32)i << 6;
+		if (i < n) {
+			val = p[i];
 			goto found;
-		pos += BITS_PER_UINT64;
-		size -= BITS_PER_UINT64;
+		}
+		p += n;
+		size &= BIT_MASK_UINT64;
 	}
 
 	if (!size)
@@ -415,12 +512,15 @@ static __inline LONG64 BitFindNextClear64(UINT64 const* bmap,
 		pos += BITS_PER_UINT64;
 	}
 
-	while (size & ~BIT_MASK_UINT64) {
-		val = *(p++);
-		if (val != BIT_ALL_SET64)
+	if (size & ~BIT_MASK_UINT64) {
+		SIZE_T n = size >> 6, i = BitFindWordNot64(p, n, BIT_ALL_SET64);
+		pos += (UINT32)i << 6;
+		if (i < n) {
+			val = p[i];
 			goto found;
-		pos += BITS_PER_UINT64;
-		size -= BITS_PER_UINT64;
+		}
+		p += n;
+		size &= BIT_MASK_UINT64;
 	}
 
 	if (!size)
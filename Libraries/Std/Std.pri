@@ -1,6 +1,8 @@
 LIBTARGET = Std
 PROJ_FILE = $$PWD/Std.pro
 QTCONFIG = core
+# BitOps.h calls SSE4.2/AVX2 kernels of the library
+DEFINES += BITOPS_KERNELS
 include(../../Build/qmake/staticlib.pri)
 
 win32: LIBS	+= -lshell32 -lAdvapi32 -lole32
@@ -16,7 +16,9 @@ INCLUDEPATH += ../../..
 
 	SOURCES += \
 		PrlTime.cpp    \
+		BitOps.c \
 
 	linux-*:SOURCES += \
 			PrlTime_lin.cpp \
-			sparse_bitmap.c
+			sparse_bitmap.c \
+			sparse_bitmap64.c
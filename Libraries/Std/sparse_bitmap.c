@@ -547,8 +547,8 @@ int sp_bitmap_clear_range(struct sp_bitmap *bmap,
 				bmap->data[pageIdx] = SP_BMAP_CLEAR_PAGE;
 				goto ok;
 			}
-			// whole mixed page will set
-			sp_bitmap_sparse_page(bmap, pageIdx, SP_BMAP_SET_PAGE);
+			// whole mixed page will clear
+			sp_bitmap_sparse_page(bmap, pageIdx, SP_BMAP_CLEAR_PAGE);
 			goto ok;
 		}
 		// here we process first or last or single page.
@@ -0,0 +1,1406 @@
+/* Copyright (c) 2026 Virtuozzo International GmbH.  All rights reserved.
+ *
+ * This file is part of OpenVZ. OpenVZ is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation;
+ * either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "Libraries/Std/BitOps.h"
+#include "Libraries/Std/sparse_bitmap64.h"
+
+#define SP_CHUNK_SHIFT		15
+#define SP_CHUNK_BITS		(1u << SP_CHUNK_SHIFT)
+#define SP_CHUNK_BYTES		(SP_CHUNK_BITS >> 3)
+#define SP_CHUNK_WORDS		(SP_CHUNK_BITS >> 6)
+
+#define SP_LEAF_SHIFT		10
+#define SP_LEAF_CHUNKS		(1u << SP_LEAF_SHIFT)
+#define SP_LEAF_BITS_SHIFT	(SP_CHUNK_SHIFT + SP_LEAF_SHIFT)
+#define SP_LEAF_BITS		((UINT64)1 << SP_LEAF_BITS_SHIFT)
+
+// runs list longer than the page is kept as the page,
+// the page is turned back to runs when they fit in a half of it
+#define SP_RUNS_MAX			(SP_CHUNK_BYTES / sizeof(struct sp_run))
+#define SP_RUNS_MIN			(SP_RUNS_MAX / 2)
+
+#define SP_CHUNK_CLEAR		((struct sp_chunk *)0u)
+#define SP_CHUNK_SET		((struct sp_chunk *)1u)
+#define SP_LEAF_CLEAR		((struct sp_leaf *)0u)
+#define SP_LEAF_SET			((struct sp_leaf *)1u)
+
+#define SP_MIXED(p)			((uintptr_t)(p) > 1u)
+
+#if SP_LEAF_BITS_SHIFT != 25
+#error SP_BITMAP64_PART_BITS must be the leaf size
+#endif
+
+enum
+{
+	SP_CHUNK_RUNS,
+	SP_CHUNK_PAGE
+};
+
+// stream record tags
+enum
+{
+	SP_REC_CLEAR,
+	SP_REC_SET,
+	SP_REC_RUNS,
+	SP_REC_PAGE
+};
+
+// inclusive range of set bits inside the chunk
+struct sp_run
+{
+	UINT16 first;
+	UINT16 last;
+};
+
+struct sp_chunk
+{
+	UINT32 kind;
+	// runs in use and allocated
+	UINT32 count;
+	UINT32 capacity;
+	UINT32 reserved;
+	union {
+		UINT64 bits[1];
+		struct sp_run runs[1];
+	} u;
+};
+
+#define SP_CHUNK_HDR		offsetof(struct sp_chunk, u)
+
+struct sp_leaf
+{
+	// slots inside the bitmap, others are never touched
+	UINT32 chunks;
+	UINT32 nclear;
+	UINT32 nset;
+	struct sp_chunk *slot[SP_LEAF_CHUNKS];
+};
+
+struct sp_bitmap64
+{
+	UINT64 size;
+	UINT64 leaves;
+	struct sp_leaf *leaf[1];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// plain bits
+
+static void bits_fill(UINT64 *w, UINT32 lo, UINT32 hi, int value)
+{
+	UINT32 i = lo >> 6, j = (hi - 1) >> 6;
+	UINT64 head = BIT_ALL_SET64 << (lo & BIT_MASK_UINT64);
+	UINT64 tail = BIT_ALL_SET64 >> (BIT_MASK_UINT64 - ((hi - 1) & BIT_MASK_UINT64));
+
+	if (i == j)
+		head &= tail;
+
+	if (value)
+		w[i] |= head;
+	else
+		w[i] &= ~head;
+
+	if (i == j)
+		return;
+
+	for (++i; i < j; ++i)
+		w[i] = value ? BIT_ALL_SET64 : 0;
+
+	if (value)
+		w[j] |= tail;
+	else
+		w[j] &= ~tail;
+}
+
+static int bits_test(const UINT64 *w, UINT32 lo, UINT32 hi, int value)
+{
+	if (value)
+		return BitFindNextClear64(w, hi, lo) == -1;
+	return BitFindNextSet64(w, hi, lo) == -1;
+}
+
+// Runs of set bits among the first bits, counting stops past limit
+static UINT32 bits_runs(const UINT64 *w, UINT32 bits, UINT32 limit)
+{
+	UINT32 i, n = (bits + BIT_MASK_UINT64) >> 6, runs = 0;
+	UINT64 carry = 0;
+
+	for (i = 0; i < n && runs <= limit; ++i) {
+		UINT64 v = w[i];
+
+		if (i == n - 1 && (bits & BIT_MASK_UINT64))
+			v &= BIT_ALL_SET64 >> (BITS_PER_UINT64 - (bits & BIT_MASK_UINT64));
+
+		runs += __builtin_popcountll(v & ~((v << 1) | carry));
+		carry = v >> 63;
+	}
+	return runs;
+}
+
+// -1 if bytes differ, 0 or 1 if all of them are 0x00 or 0xff
+static int bytes_uniform(const UINT8 *buf, UINT32 size)
+{
+	UINT32 i;
+	UINT8 b = buf[0];
+
+	if (b != 0 && b != 0xff)
+		return -1;
+
+	for (i = 1; i < size; ++i) {
+		if (buf[i] != b)
+			return -1;
+	}
+	return b != 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// chunks
+
+static UINT64 chunk_mem(const struct sp_chunk *c)
+{
+	if (c->kind == SP_CHUNK_PAGE)
+		return SP_CHUNK_HDR + SP_CHUNK_BYTES;
+	return SP_CHUNK_HDR + (UINT64)c->capacity * sizeof(struct sp_run);
+}
+
+static void chunk_free(struct sp_chunk *c)
+{
+	if (SP_MIXED(c))
+		free(c);
+}
+
+static struct sp_chunk *runs_alloc(UINT32 capacity)
+{
+	struct sp_chunk *c;
+
+	if (capacity < 4)
+		capacity = 4;
+
+	c = malloc(SP_CHUNK_HDR + capacity * sizeof(struct sp_run));
+	if (c == NULL)
+		return NULL;
+
+	c->kind = SP_CHUNK_RUNS;
+	c->count = 0;
+	c->capacity = capacity;
+	c->reserved = 0;
+	return c;
+}
+
+static int runs_reserve(struct sp_chunk **pc, UINT32 count)
+{
+	struct sp_chunk *c = *pc;
+	UINT32 capacity = c->capacity * 2;
+
+	if (count <= c->capacity)
+		return 0;
+
+	if (capacity < count)
+		capacity = count;
+
+	c = realloc(c, SP_CHUNK_HDR + capacity * sizeof(struct sp_run));
+	if (c == NULL)
+		return -ENOMEM;
+
+	c->capacity = capacity;
+	*pc = c;
+	return 0;
+}
+
+static void runs_push(struct sp_chunk *c, UINT32 first, UINT32 last)
+{
+	c->u.runs[c->count].first = (UINT16)first;
+	c->u.runs[c->count].last = (UINT16)last;
+	c->count++;
+}
+
+// First run ending at key or later
+static UINT32 runs_lower(const struct sp_chunk *c, UINT32 key)
+{
+	UINT32 lo = 0, hi = c->count;
+
+	while (lo < hi) {
+		UINT32 mid = (lo + hi) / 2;
+
+		if (c->u.runs[mid].last < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int runs_set(struct sp_chunk **pc, UINT32 lo, UINT32 hi)
+{
+	struct sp_chunk *c = *pc;
+	struct sp_run *r = c->u.runs;
+	// adjacent runs are joined too
+	UINT32 i = runs_lower(c, lo ? lo - 1 : 0), j = i;
+
+	while (j < c->count && r[j].first <= hi)
+		++j;
+
+	if (i == j) {
+		if (runs_reserve(pc, c->count + 1) != 0)
+			return -ENOMEM;
+
+		c = *pc;
+		r = c->u.runs;
+		memmove(r + i + 1, r + i, (c->count - i) * sizeof(*r));
+		c->count++;
+	} else {
+		lo = MIN(lo, r[i].first);
+		hi = MAX(hi, (UINT32)r[j - 1].last + 1);
+		memmove(r + i + 1, r + j, (c->count - j) * sizeof(*r));
+		c->count -= j - i - 1;
+	}
+
+	r[i].first = (UINT16)lo;
+	r[i].last = (UINT16)(hi - 1);
+	return 0;
+}
+
+static int runs_clear(struct sp_chunk **pc, UINT32 lo, UINT32 hi)
+{
+	struct sp_chunk *c = *pc;
+	struct sp_run *r = c->u.runs;
+	struct sp_run left, right;
+	UINT32 i = runs_lower(c, lo), j = i, k = 0;
+
+	while (j < c->count && r[j].first < hi)
+		++j;
+
+	if (i == j)
+		return 0;
+
+	left.first = r[i].first;
+	left.last = (UINT16)(lo - 1);
+	right.first = (UINT16)hi;
+	right.last = r[j - 1].last;
+
+	if (left.first < lo)
+		++k;
+	if (right.last >= hi)
+		++k;
+
+	if (k > j - i) {
+		if (runs_reserve(pc, c->count + 1) != 0)
+			return -ENOMEM;
+
+		c = *pc;
+		r = c->u.runs;
+	}
+
+	memmove(r + i + k, r + j, (c->count - j) * sizeof(*r));
+	c->count = c->count - (j - i) + k;
+
+	if (left.first < lo)
+		r[i++] = left;
+	if (right.last >= hi)
+		r[i] = right;
+	return 0;
+}
+
+static int runs_test(const struct sp_chunk *c, UINT32 lo, UINT32 hi, int value)
+{
+	UINT32 i = runs_lower(c, lo);
+
+	if (value)
+		return i < c->count && c->u.runs[i].first <= lo &&
+			c->u.runs[i].last >= hi - 1;
+
+	return i == c->count || c->u.runs[i].first >= hi;
+}
+
+static struct sp_chunk *page_alloc(int value)
+{
+	struct sp_chunk *c = malloc(SP_CHUNK_HDR + SP_CHUNK_BYTES);
+
+	if (c == NULL)
+		return NULL;
+
+	c->kind = SP_CHUNK_PAGE;
+	c->count = 0;
+	c->capacity = 0;
+	c->reserved = 0;
+	memset(c->u.bits, value ? 0xff : 0, SP_CHUNK_BYTES);
+	return c;
+}
+
+// Page with the same bits as c, c is left untouched
+static struct sp_chunk *page_from(const struct sp_chunk *c)
+{
+	struct sp_chunk *p;
+	UINT32 i;
+
+	if (!SP_MIXED(c))
+		return page_alloc(c == SP_CHUNK_SET);
+
+	if (c->kind == SP_CHUNK_PAGE) {
+		p = malloc(SP_CHUNK_HDR + SP_CHUNK_BYTES);
+		if (p != NULL)
+			memcpy(p, c, SP_CHUNK_HDR + SP_CHUNK_BYTES);
+		return p;
+	}
+
+	p = page_alloc(0);
+	if (p == NULL)
+		return NULL;
+
+	for (i = 0; i < c->count; ++i)
+		bits_fill(p->u.bits, c->u.runs[i].first, c->u.runs[i].last + 1u, 1);
+	return p;
+}
+
+static struct sp_chunk *runs_from_page(const struct sp_chunk *c, UINT32 bits, UINT32 runs)
+{
+	struct sp_chunk *r = runs_alloc(runs);
+	UINT32 pos = 0;
+
+	if (r == NULL)
+		return NULL;
+
+	while (pos < bits) {
+		LONG64 first = BitFindNextSet64(c->u.bits, bits, pos);
+		LONG64 last;
+
+		if (first < 0)
+			break;
+
+		last = BitFindNextClear64(c->u.bits, bits, (UINT32)first);
+		if (last < 0)
+			last = bits;
+
+		runs_push(r, (UINT32)first, (UINT32)last - 1);
+		pos = (UINT32)last;
+	}
+	return r;
+}
+
+static struct sp_chunk *runs_union(const struct sp_chunk *a, const struct sp_chunk *b)
+{
+	struct sp_chunk *c = runs_alloc(a->count + b->count);
+	UINT32 i = 0, j = 0;
+
+	if (c == NULL)
+		return NULL;
+
+	while (i < a->count || j < b->count) {
+		const struct sp_run *r;
+
+		if (j == b->count || (i < a->count && a->u.runs[i].first < b->u.runs[j].first))
+			r = &a->u.runs[i++];
+		else
+			r = &b->u.runs[j++];
+
+		if (c->count > 0 && r->first <= c->u.runs[c->count - 1].last + 1u) {
+			if (r->last > c->u.runs[c->count - 1].last)
+				c->u.runs[c->count - 1].last = r->last;
+		} else
+			c->u.runs[c->count++] = *r;
+	}
+	return c;
+}
+
+// Pick the smallest form of the chunk of bits length. Bits past the
+// length are not defined. The chunk is left as is if there is no
+// memory for the other form, it is still valid.
+static void chunk_normalize(struct sp_chunk **pc, UINT32 bits)
+{
+	struct sp_chunk *c = *pc, *n = NULL;
+	UINT32 runs;
+
+	if (c->kind == SP_CHUNK_RUNS) {
+		if (c->count == 0)
+			n = SP_CHUNK_CLEAR;
+		else if (c->count == 1 && c->u.runs[0].first == 0 &&
+				c->u.runs[0].last + 1u >= bits)
+			n = SP_CHUNK_SET;
+		else if (c->count > SP_RUNS_MAX)
+			n = page_from(c);
+		else
+			return;
+	} else {
+		runs = bits_runs(c->u.bits, bits, SP_RUNS_MIN);
+		if (runs == 0)
+			n = SP_CHUNK_CLEAR;
+		else if (runs == 1 && bits_test(c->u.bits, 0, bits, 1))
+			n = SP_CHUNK_SET;
+		else if (runs <= SP_RUNS_MIN)
+			n = runs_from_page(c, bits, runs);
+		else
+			return;
+	}
+
+	if (n == NULL)
+		return;
+
+	free(c);
+	*pc = n;
+}
+
+static int chunk_fill(struct sp_chunk **pc, UINT32 lo, UINT32 hi, UINT32 bits, int value)
+{
+	struct sp_chunk *c = *pc;
+	int ret = 0;
+
+	if (c == (value ? SP_CHUNK_SET : SP_CHUNK_CLEAR))
+		return 0;
+
+	if (lo == 0 && hi >= bits) {
+		chunk_free(c);
+		*pc = value ? SP_CHUNK_SET : SP_CHUNK_CLEAR;
+		return 0;
+	}
+
+	if (!SP_MIXED(c)) {
+		struct sp_chunk *n = runs_alloc(2);
+
+		if (n == NULL)
+			return -ENOMEM;
+
+		if (value)
+			runs_push(n, lo, hi - 1);
+		else {
+			if (lo > 0)
+				runs_push(n, 0, lo - 1);
+			if (hi < bits)
+				runs_push(n, hi, bits - 1);
+		}
+		*pc = n;
+		return 0;
+	}
+
+	if (c->kind == SP_CHUNK_PAGE)
+		bits_fill(c->u.bits, lo, hi, value);
+	else
+		ret = value ? runs_set(pc, lo, hi) : runs_clear(pc, lo, hi);
+
+	if (ret == 0)
+		chunk_normalize(pc, bits);
+	return ret;
+}
+
+static int chunk_test(const struct sp_chunk *c, UINT32 lo, UINT32 hi, int value)
+{
+	if (!SP_MIXED(c))
+		return (c == SP_CHUNK_SET) == !!value;
+
+	if (c->kind == SP_CHUNK_PAGE)
+		return bits_test(c->u.bits, lo, hi, value);
+
+	return runs_test(c, lo, hi, value);
+}
+
+// lo and hi are byte aligned
+static void chunk_read(const struct sp_chunk *c, UINT32 lo, UINT32 hi, UINT8 *buf)
+{
+	UINT64 tmp[SP_CHUNK_WORDS];
+	UINT32 i;
+
+	if (!SP_MIXED(c)) {
+		memset(buf, c == SP_CHUNK_SET ? 0xff : 0, (hi - lo) >> 3);
+		return;
+	}
+
+	if (c->kind == SP_CHUNK_PAGE) {
+		memcpy(buf, (const UINT8 *)c->u.bits + (lo >> 3), (hi - lo) >> 3);
+		return;
+	}
+
+	memset(tmp + (lo >> 6), 0, (((hi + BIT_MASK_UINT64) >> 6) - (lo >> 6)) * sizeof(UINT64));
+	for (i = runs_lower(c, lo); i < c->count && c->u.runs[i].first < hi; ++i) {
+		bits_fill(tmp, MAX(lo, (UINT32)c->u.runs[i].first),
+				MIN(hi, c->u.runs[i].last + 1u), 1);
+	}
+	memcpy(buf, (const UINT8 *)tmp + (lo >> 3), (hi - lo) >> 3);
+}
+
+// lo and hi are byte aligned
+static int chunk_write(struct sp_chunk **pc, UINT32 lo, UINT32 hi, UINT32 bits,
+		const UINT8 *buf)
+{
+	struct sp_chunk *c = *pc;
+	int value = bytes_uniform(buf, (hi - lo) >> 3);
+
+	if (value >= 0)
+		return chunk_fill(pc, lo, hi, bits, value);
+
+	if (!SP_MIXED(c) || c->kind != SP_CHUNK_PAGE) {
+		c = page_from(c);
+		if (c == NULL)
+			return -ENOMEM;
+
+		chunk_free(*pc);
+		*pc = c;
+	}
+
+	memcpy((UINT8 *)c->u.bits + (lo >> 3), buf, (hi - lo) >> 3);
+	chunk_normalize(pc, bits);
+	return 0;
+}
+
+static int chunk_merge(struct sp_chunk **pc, const struct sp_chunk *src, UINT32 bits)
+{
+	struct sp_chunk *c = *pc, *n;
+	UINT32 i;
+
+	if (src == SP_CHUNK_CLEAR || c == SP_CHUNK_SET)
+		return 0;
+
+	if (src == SP_CHUNK_SET) {
+		chunk_free(c);
+		*pc = SP_CHUNK_SET;
+		return 0;
+	}
+
+	if (c == SP_CHUNK_CLEAR) {
+		n = malloc(chunk_mem(src));
+		if (n == NULL)
+			return -ENOMEM;
+
+		memcpy(n, src, chunk_mem(src));
+		*pc = n;
+		return 0;
+	}
+
+	if (c->kind == SP_CHUNK_RUNS) {
+		n = src->kind == SP_CHUNK_RUNS ? runs_union(c, src) : page_from(src);
+		if (n == NULL)
+			return -ENOMEM;
+
+		if (n->kind == SP_CHUNK_PAGE) {
+			for (i = 0; i < c->count; ++i)
+				bits_fill(n->u.bits, c->u.runs[i].first, c->u.runs[i].last + 1u, 1);
+		}
+		free(c);
+		*pc = c = n;
+	} else if (src->kind == SP_CHUNK_PAGE) {
+		BitMergeWords64(c->u.bits, src->u.bits, SP_CHUNK_WORDS);
+	} else {
+		for (i = 0; i < src->count; ++i)
+			bits_fill(c->u.bits, src->u.runs[i].first, src->u.runs[i].last + 1u, 1);
+	}
+
+	chunk_normalize(pc, bits);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// leaves
+
+static UINT64 leaf_bits(const struct sp_bitmap64 *bmap, UINT64 li)
+{
+	return MIN(bmap->size - (li << SP_LEAF_BITS_SHIFT), SP_LEAF_BITS);
+}
+
+static UINT32 chunk_bits(UINT64 leafBits, UINT32 ci)
+{
+	return (UINT32)MIN(leafBits - ((UINT64)ci << SP_CHUNK_SHIFT), SP_CHUNK_BITS);
+}
+
+static UINT32 leaf_chunks(const struct sp_bitmap64 *bmap, UINT64 li)
+{
+	return (UINT32)((leaf_bits(bmap, li) + SP_CHUNK_BITS - 1) >> SP_CHUNK_SHIFT);
+}
+
+static void leaf_free(struct sp_leaf *l)
+{
+	UINT32 i;
+
+	if (!SP_MIXED(l))
+		return;
+
+	for (i = 0; i < l->chunks; i++)
+		chunk_free(l->slot[i]);
+	free(l);
+}
+
+// Turn all clear or all set leaf into slots for modification
+static struct sp_leaf *leaf_open(struct sp_bitmap64 *bmap, UINT64 li)
+{
+	struct sp_leaf *l = bmap->leaf[li], *n;
+	struct sp_chunk *fill = l == SP_LEAF_SET ? SP_CHUNK_SET : SP_CHUNK_CLEAR;
+	UINT32 i;
+
+	if (SP_MIXED(l))
+		return l;
+
+	n = malloc(sizeof(*n));
+	if (n == NULL)
+		return NULL;
+
+	n->chunks = leaf_chunks(bmap, li);
+	n->nclear = fill == SP_CHUNK_CLEAR ? n->chunks : 0;
+	n->nset = fill == SP_CHUNK_SET ? n->chunks : 0;
+	for (i = 0; i < SP_LEAF_CHUNKS; i++)
+		n->slot[i] = fill;
+
+	bmap->leaf[li] = n;
+	return n;
+}
+
+// Drop the slots if they became the same
+static void leaf_close(struct sp_bitmap64 *bmap, UINT64 li)
+{
+	struct sp_leaf *l = bmap->leaf[li];
+
+	if (l->nclear == l->chunks) {
+		free(l);
+		bmap->leaf[li] = SP_LEAF_CLEAR;
+	} else if (l->nset == l->chunks) {
+		free(l);
+		bmap->leaf[li] = SP_LEAF_SET;
+	}
+}
+
+static void leaf_store(struct sp_leaf *l, UINT32 ci, struct sp_chunk *c)
+{
+	struct sp_chunk *old = l->slot[ci];
+
+	if (old == SP_CHUNK_CLEAR)
+		l->nclear--;
+	else if (old == SP_CHUNK_SET)
+		l->nset--;
+
+	if (c == SP_CHUNK_CLEAR)
+		l->nclear++;
+	else if (c == SP_CHUNK_SET)
+		l->nset++;
+
+	l->slot[ci] = c;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// range walkers
+
+static int range_sanity_check(const struct sp_bitmap64 *bmap,
+							  UINT64 bmapSize,
+							  UINT64 startBit)
+{
+	if (NULL == bmap
+		|| startBit >= bmap->size
+		|| bmapSize > bmap->size)
+		return -1;
+
+	return 0;
+}
+
+// Fill [start, end) with value, or copy it from buf if not NULL
+static int modify_range(struct sp_bitmap64 *bmap, UINT64 start, UINT64 end,
+		int value, const UINT8 *buf)
+{
+	UINT64 li, from = start;
+
+	for (li = start >> SP_LEAF_BITS_SHIFT; start < end; li++) {
+		UINT64 base = li << SP_LEAF_BITS_SHIFT;
+		UINT64 bits = leaf_bits(bmap, li);
+		UINT64 lo = start - base, hi = MIN(end - base, bits);
+		struct sp_leaf *l, *want = value ? SP_LEAF_SET : SP_LEAF_CLEAR;
+		UINT32 ci;
+
+		start = base + hi;
+		if (buf == NULL) {
+			if (bmap->leaf[li] == want)
+				continue;
+
+			if (lo == 0 && hi == bits) {
+				leaf_free(bmap->leaf[li]);
+				bmap->leaf[li] = want;
+				continue;
+			}
+		}
+
+		l = leaf_open(bmap, li);
+		if (l == NULL)
+			return -ENOMEM;
+
+		for (ci = (UINT32)(lo >> SP_CHUNK_SHIFT); ((UINT64)ci << SP_CHUNK_SHIFT) < hi; ci++) {
+			UINT64 cbase = (UINT64)ci << SP_CHUNK_SHIFT;
+			UINT32 cbits = chunk_bits(bits, ci);
+			UINT32 clo = (UINT32)(MAX(lo, cbase) - cbase);
+			UINT32 chi = (UINT32)MIN(hi - cbase, cbits);
+			struct sp_chunk *c = l->slot[ci];
+			int ret;
+
+			if (buf == NULL)
+				ret = chunk_fill(&c, clo, chi, cbits, value);
+			else
+				ret = chunk_write(&c, clo, chi, cbits,
+						buf + ((base + cbase + clo - from) >> 3));
+
+			leaf_store(l, ci, c);
+			if (ret != 0) {
+				leaf_close(bmap, li);
+				return ret;
+			}
+		}
+		leaf_close(bmap, li);
+	}
+	return 0;
+}
+
+static int test_range(const struct sp_bitmap64 *bmap, UINT64 start, UINT64 end,
+		int value)
+{
+	UINT64 li;
+
+	for (li = start >> SP_LEAF_BITS_SHIFT; start < end; li++) {
+		UINT64 base = li << SP_LEAF_BITS_SHIFT;
+		UINT64 bits = leaf_bits(bmap, li);
+		UINT64 lo = start - base, hi = MIN(end - base, bits);
+		const struct sp_leaf *l = bmap->leaf[li];
+		UINT32 ci;
+
+		start = base + hi;
+		if (!SP_MIXED(l)) {
+			if ((l == SP_LEAF_SET) != !!value)
+				return 0;
+			continue;
+		}
+
+		for (ci = (UINT32)(lo >> SP_CHUNK_SHIFT); ((UINT64)ci << SP_CHUNK_SHIFT) < hi; ci++) {
+			UINT64 cbase = (UINT64)ci << SP_CHUNK_SHIFT;
+			UINT32 clo = (UINT32)(MAX(lo, cbase) - cbase);
+			UINT32 chi = (UINT32)MIN(hi - cbase, chunk_bits(bits, ci));
+
+			if (!chunk_test(l->slot[ci], clo, chi, value))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static void read_range(const struct sp_bitmap64 *bmap, UINT64 start, UINT64 end,
+		UINT8 *buf)
+{
+	UINT64 li;
+
+	for (li = start >> SP_LEAF_BITS_SHIFT; start < end; li++) {
+		UINT64 base = li << SP_LEAF_BITS_SHIFT;
+		UINT64 bits = leaf_bits(bmap, li);
+		UINT64 lo = start - base, hi = MIN(end - base, bits);
+		const struct sp_leaf *l = bmap->leaf[li];
+		UINT32 ci;
+
+		start = base + hi;
+		if (!SP_MIXED(l)) {
+			memset(buf, l == SP_LEAF_SET ? 0xff : 0, (hi - lo) >> 3);
+			buf += (hi - lo) >> 3;
+			continue;
+		}
+
+		for (ci = (UINT32)(lo >> SP_CHUNK_SHIFT); ((UINT64)ci << SP_CHUNK_SHIFT) < hi; ci++) {
+			UINT64 cbase = (UINT64)ci << SP_CHUNK_SHIFT;
+			UINT32 clo = (UINT32)(MAX(lo, cbase) - cbase);
+			UINT32 chi = (UINT32)MIN(hi - cbase, chunk_bits(bits, ci));
+
+			chunk_read(l->slot[ci], clo, chi, buf);
+			buf += (chi - clo) >> 3;
+		}
+	}
+}
+
+// OR leaves [first, last) of src into dest
+static int merge_leaves(struct sp_bitmap64 *dest, const struct sp_bitmap64 *src,
+		UINT64 first, UINT64 last)
+{
+	UINT64 li;
+
+	for (li = first; li < last; li++) {
+		const struct sp_leaf *s = src->leaf[li];
+		struct sp_leaf *d = dest->leaf[li];
+		UINT64 bits = leaf_bits(dest, li);
+		UINT32 ci;
+
+		if (s == SP_LEAF_CLEAR || d == SP_LEAF_SET)
+			continue;
+
+		if (s == SP_LEAF_SET) {
+			leaf_free(d);
+			dest->leaf[li] = SP_LEAF_SET;
+			continue;
+		}
+
+		d = leaf_open(dest, li);
+		if (d == NULL)
+			return -ENOMEM;
+
+		for (ci = 0; ci < d->chunks; ci++) {
+			struct sp_chunk *c = d->slot[ci];
+			int ret = chunk_merge(&c, s->slot[ci], chunk_bits(bits, ci));
+
+			leaf_store(d, ci, c);
+			if (ret != 0) {
+				leaf_close(dest, li);
+				return ret;
+			}
+		}
+		leaf_close(dest, li);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// interface
+
+struct sp_bitmap64 *sp_bitmap64_create(UINT64 size)
+{
+	struct sp_bitmap64 *bmap;
+	UINT64 leaves, i;
+
+	if (0 == size)
+		return NULL;
+
+	leaves = ((size - 1) >> SP_LEAF_BITS_SHIFT) + 1;
+	if (leaves > (SIZE_MAX - sizeof(*bmap)) / sizeof(struct sp_leaf *))
+		return NULL;
+
+	bmap = malloc(sizeof(*bmap) + (leaves - 1) * sizeof(struct sp_leaf *));
+	if (bmap == NULL)
+		return NULL;
+
+	bmap->size = size;
+	bmap->leaves = leaves;
+
+	for (i = 0; i < leaves; i++)
+		bmap->leaf[i] = SP_LEAF_CLEAR;
+
+	return bmap;
+}
+
+void sp_bitmap64_destroy(struct sp_bitmap64 *bmap)
+{
+	UINT64 i;
+
+	if (bmap == NULL)
+		return;
+
+	for (i = 0; i < bmap->leaves; i++)
+		leaf_free(bmap->leaf[i]);
+	free(bmap);
+}
+
+UINT64 sp_bitmap64_size(const struct sp_bitmap64 *bmap)
+{
+	return bmap == NULL ? 0 : bmap->size;
+}
+
+UINT64 sp_bitmap64_mem_usage(const struct sp_bitmap64 *bmap)
+{
+	UINT64 i, res;
+	UINT32 j;
+
+	if (bmap == NULL)
+		return 0;
+
+	res = sizeof(*bmap) + (bmap->leaves - 1) * sizeof(struct sp_leaf *);
+	for (i = 0; i < bmap->leaves; i++) {
+		const struct sp_leaf *l = bmap->leaf[i];
+
+		if (!SP_MIXED(l))
+			continue;
+
+		res += sizeof(*l);
+		for (j = 0; j < l->chunks; j++) {
+			if (SP_MIXED(l->slot[j]))
+				res += chunk_mem(l->slot[j]);
+		}
+	}
+	return res;
+}
+
+static int sp_bitmap64_fill_all(struct sp_bitmap64 *bmap, struct sp_leaf *fill)
+{
+	UINT64 i;
+
+	if (NULL == bmap)
+		return -EINVAL;
+
+	for (i = 0; i < bmap->leaves; i++) {
+		leaf_free(bmap->leaf[i]);
+		bmap->leaf[i] = fill;
+	}
+	return 0;
+}
+
+int sp_bitmap64_set_all(struct sp_bitmap64 *bmap)
+{
+	return sp_bitmap64_fill_all(bmap, SP_LEAF_SET);
+}
+
+int sp_bitmap64_clear_all(struct sp_bitmap64 *bmap)
+{
+	return sp_bitmap64_fill_all(bmap, SP_LEAF_CLEAR);
+}
+
+int sp_bitmap64_set(struct sp_bitmap64 *bmap, UINT64 idx)
+{
+	if ((bmap == NULL) || (idx >= bmap->size))
+		return -EINVAL;
+
+	return modify_range(bmap, idx, idx + 1, 1, NULL);
+}
+
+int sp_bitmap64_clear(struct sp_bitmap64 *bmap, UINT64 idx)
+{
+	if ((bmap == NULL) || (idx >= bmap->size))
+		return -EINVAL;
+
+	return modify_range(bmap, idx, idx + 1, 0, NULL);
+}
+
+int sp_bitmap64_is_set(const struct sp_bitmap64 *bmap, UINT64 idx)
+{
+	if ((bmap == NULL) || (idx >= bmap->size))
+		return -EINVAL;
+
+	return test_range(bmap, idx, idx + 1, 1);
+}
+
+int sp_bitmap64_merge(struct sp_bitmap64 *dest, const struct sp_bitmap64 *src)
+{
+	if (dest == NULL || src == NULL || dest->size != src->size)
+		return -EINVAL;
+
+	return merge_leaves(dest, src, 0, dest->leaves);
+}
+
+int sp_bitmap64_merge_range(struct sp_bitmap64 *dest, const struct sp_bitmap64 *src,
+		UINT64 bmapSize, UINT64 startBit)
+{
+	if (0 != range_sanity_check(dest, bmapSize, startBit)
+		|| src == NULL || dest->size != src->size)
+		return -EINVAL;
+
+	// whole parts only:
+	if ((startBit & (SP_LEAF_BITS - 1))
+		|| ((bmapSize & (SP_LEAF_BITS - 1)) && bmapSize != dest->size))
+		return -EINVAL;
+
+	if (startBit >= bmapSize)
+		return 0;
+
+	return merge_leaves(dest, src, startBit >> SP_LEAF_BITS_SHIFT,
+			((bmapSize - 1) >> SP_LEAF_BITS_SHIFT) + 1);
+}
+
+int sp_bitmap64_read_aligned_range(const struct sp_bitmap64 *bmap, UINT8 *buf,
+		UINT64 bmapSize, UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	// byte-aligned range:
+	if ((bmapSize | startBit) & 7)
+		return -EINVAL;
+
+	if (startBit < bmapSize)
+		read_range(bmap, startBit, bmapSize, buf);
+	return 0;
+}
+
+int sp_bitmap64_write_aligned_range(struct sp_bitmap64 *bmap, const UINT8 *buf,
+		UINT64 bmapSize, UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	// byte-aligned range:
+	if ((bmapSize | startBit) & 7)
+		return -EINVAL;
+
+	if (startBit >= bmapSize)
+		return 0;
+
+	return modify_range(bmap, startBit, bmapSize, 0, buf);
+}
+
+int sp_bitmap64_set_range(struct sp_bitmap64 *bmap,
+						  UINT64 bmapSize,
+						  UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	if (startBit >= bmapSize)
+		return 0;
+
+	return modify_range(bmap, startBit, bmapSize, 1, NULL);
+}
+
+int sp_bitmap64_clear_range(struct sp_bitmap64 *bmap,
+							UINT64 bmapSize,
+							UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	if (startBit >= bmapSize)
+		return 0;
+
+	return modify_range(bmap, startBit, bmapSize, 0, NULL);
+}
+
+int sp_bitmap64_is_set_range(const struct sp_bitmap64 *bmap,
+							 UINT64 bmapSize,
+							 UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	if (0 == bmapSize)
+		return 0;
+
+	return test_range(bmap, startBit, bmapSize, 1);
+}
+
+int sp_bitmap64_is_clear_range(const struct sp_bitmap64 *bmap,
+							   UINT64 bmapSize,
+							   UINT64 startBit)
+{
+	if (0 != range_sanity_check(bmap, bmapSize, startBit))
+		return -EINVAL;
+
+	if (0 == bmapSize)
+		return 0;
+
+	return test_range(bmap, startBit, bmapSize, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stream
+
+struct sp_writer
+{
+	sp_bitmap64_write_fn fn;
+	void *ctx;
+	// clear or set chunks not written yet
+	UINT32 fill;
+	UINT32 pending;
+	UINT32 len;
+	UINT8 buf[2 * SP_CHUNK_BYTES];
+};
+
+static void put_le16(UINT8 *p, UINT32 v)
+{
+	p[0] = (UINT8)v;
+	p[1] = (UINT8)(v >> 8);
+}
+
+static void put_le32(UINT8 *p, UINT32 v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static UINT32 get_le16(const UINT8 *p)
+{
+	return p[0] | ((UINT32)p[1] << 8);
+}
+
+static UINT32 get_le32(const UINT8 *p)
+{
+	return get_le16(p) | (get_le16(p + 2) << 16);
+}
+
+static int writer_flush(struct sp_writer *w)
+{
+	UINT32 len = w->len;
+
+	w->len = 0;
+	return len ? w->fn(w->ctx, w->buf, len) : 0;
+}
+
+// Room for size bytes in the buffer, NULL on error in *ret
+static UINT8 *writer_reserve(struct sp_writer *w, UINT32 size, int *ret)
+{
+	if (w->len + size > sizeof(w->buf)) {
+		*ret = writer_flush(w);
+		if (*ret != 0)
+			return NULL;
+	}
+	w->len += size;
+	return w->buf + w->len - size;
+}
+
+static int writer_pending(struct sp_writer *w)
+{
+	UINT8 *p;
+	int ret = 0;
+
+	if (w->pending == 0)
+		return 0;
+
+	p = writer_reserve(w, 5, &ret);
+	if (p == NULL)
+		return ret;
+
+	p[0] = (UINT8)w->fill;
+	put_le32(p + 1, w->pending);
+	w->pending = 0;
+	return 0;
+}
+
+static int writer_fill(struct sp_writer *w, int value, UINT32 count)
+{
+	UINT32 fill = value ? SP_REC_SET : SP_REC_CLEAR;
+
+	if (w->pending > 0 && (w->fill != fill || w->pending > UINT32_MAX - count)) {
+		int ret = writer_pending(w);
+
+		if (ret != 0)
+			return ret;
+	}
+	w->fill = fill;
+	w->pending += count;
+	return 0;
+}
+
+static int writer_chunk(struct sp_writer *w, const struct sp_chunk *c)
+{
+	UINT8 *p;
+	UINT32 i;
+	int ret = writer_pending(w);
+
+	if (ret != 0)
+		return ret;
+
+	if (c->kind == SP_CHUNK_PAGE) {
+		p = writer_reserve(w, 1 + SP_CHUNK_BYTES, &ret);
+		if (p == NULL)
+			return ret;
+
+		p[0] = SP_REC_PAGE;
+		memcpy(p + 1, c->u.bits, SP_CHUNK_BYTES);
+		return 0;
+	}
+
+	p = writer_reserve(w, 3, &ret);
+	if (p == NULL)
+		return ret;
+
+	p[0] = SP_REC_RUNS;
+	put_le16(p + 1, c->count);
+	for (i = 0; i < c->count; i++) {
+		p = writer_reserve(w, 4, &ret);
+		if (p == NULL)
+			return ret;
+
+		put_le16(p, c->u.runs[i].first);
+		put_le16(p + 2, c->u.runs[i].last);
+	}
+	return 0;
+}
+
+// Read RUNS or PAGE record body of the chunk of bits length
+static int reader_chunk(sp_bitmap64_read_fn fn, void *ctx, UINT32 tag, UINT32 bits,
+		struct sp_chunk **pc)
+{
+	struct sp_chunk *c;
+	UINT8 *p, hdr[2];
+	UINT32 i, count;
+	int ret;
+
+	if (tag == SP_REC_PAGE) {
+		c = page_alloc(0);
+		if (c == NULL)
+			return -ENOMEM;
+
+		ret = fn(ctx, c->u.bits, SP_CHUNK_BYTES);
+		if (ret != 0) {
+			free(c);
+			return ret;
+		}
+		*pc = c;
+		return 0;
+	}
+
+	ret = fn(ctx, hdr, 2);
+	if (ret != 0)
+		return ret;
+
+	count = get_le16(hdr);
+	c = runs_alloc(count);
+	if (c == NULL)
+		return -ENOMEM;
+
+	p = (UINT8 *)c->u.runs;
+	ret = fn(ctx, p, count * sizeof(struct sp_run));
+	for (i = 0; i < count && ret == 0; i++) {
+		UINT32 first = get_le16(p + 4 * i), last = get_le16(p + 4 * i + 2);
+
+		// sorted, not adjacent and inside the chunk
+		if (first > last || last >= bits ||
+				(i > 0 && first <= c->u.runs[i - 1].last + 1u))
+			ret = -EINVAL;
+		else
+			runs_push(c, first, last);
+	}
+
+	if (ret != 0) {
+		free(c);
+		return ret;
+	}
+	*pc = c;
+	return 0;
+}
+
+// OR the chunk into chunk slot ci of the bitmap, c is consumed
+static int load_chunk(struct sp_bitmap64 *bmap, UINT64 ci, struct sp_chunk *c)
+{
+	UINT64 li = ci >> SP_LEAF_SHIFT;
+	UINT32 k = (UINT32)(ci & (SP_LEAF_CHUNKS - 1));
+	UINT32 bits = chunk_bits(leaf_bits(bmap, li), k);
+	struct sp_chunk *d;
+	struct sp_leaf *l;
+	int ret = 0;
+
+	chunk_normalize(&c, bits);
+	if (c == SP_CHUNK_CLEAR || bmap->leaf[li] == SP_LEAF_SET)
+		goto out;
+
+	l = leaf_open(bmap, li);
+	if (l == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	d = l->slot[k];
+	if (d == SP_CHUNK_CLEAR) {
+		d = c;
+		c = SP_CHUNK_CLEAR;
+	} else
+		ret = chunk_merge(&d, c, bits);
+
+	leaf_store(l, k, d);
+	leaf_close(bmap, li);
+out:
+	chunk_free(c);
+	return ret;
+}
+
+int sp_bitmap64_save(const struct sp_bitmap64 *bmap, sp_bitmap64_write_fn fn, void *ctx)
+{
+	struct sp_writer *w;
+	UINT64 li;
+	int ret = 0;
+
+	if (bmap == NULL || fn == NULL)
+		return -EINVAL;
+
+	w = malloc(sizeof(*w));
+	if (w == NULL)
+		return -ENOMEM;
+
+	w->fn = fn;
+	w->ctx = ctx;
+	w->fill = SP_REC_CLEAR;
+	w->pending = 0;
+	w->len = 0;
+
+	for (li = 0; li < bmap->leaves && ret == 0; li++) {
+		const struct sp_leaf *l = bmap->leaf[li];
+		UINT32 ci;
+
+		if (!SP_MIXED(l)) {
+			ret = writer_fill(w, l == SP_LEAF_SET, leaf_chunks(bmap, li));
+			continue;
+		}
+
+		for (ci = 0; ci < l->chunks && ret == 0; ci++) {
+			const struct sp_chunk *c = l->slot[ci];
+
+			if (SP_MIXED(c))
+				ret = writer_chunk(w, c);
+			else
+				ret = writer_fill(w, c == SP_CHUNK_SET, 1);
+		}
+	}
+
+	if (ret == 0)
+		ret = writer_pending(w);
+	if (ret == 0)
+		ret = writer_flush(w);
+
+	free(w);
+	return ret;
+}
+
+int sp_bitmap64_load(struct sp_bitmap64 *bmap, sp_bitmap64_read_fn fn, void *ctx)
+{
+	UINT64 ci = 0, total;
+
+	if (bmap == NULL || fn == NULL)
+		return -EINVAL;
+
+	total = ((bmap->size - 1) >> SP_CHUNK_SHIFT) + 1;
+	while (ci < total) {
+		struct sp_chunk *c;
+		UINT8 hdr[4];
+		UINT32 tag, count;
+		int ret = fn(ctx, hdr, 1);
+
+		if (ret != 0)
+			return ret;
+
+		tag = hdr[0];
+		switch (tag) {
+		case SP_REC_CLEAR:
+		case SP_REC_SET:
+			ret = fn(ctx, hdr, 4);
+			if (ret != 0)
+				return ret;
+
+			count = get_le32(hdr);
+			if (count == 0 || count > total - ci)
+				return -EINVAL;
+
+			if (tag == SP_REC_SET) {
+				ret = modify_range(bmap, ci << SP_CHUNK_SHIFT,
+						MIN((ci + count) << SP_CHUNK_SHIFT, bmap->size), 1, NULL);
+				if (ret != 0)
+					return ret;
+			}
+			ci += count;
+			break;
+		case SP_REC_RUNS:
+		case SP_REC_PAGE:
+			ret = reader_chunk(fn, ctx, tag, chunk_bits(leaf_bits(bmap,
+					ci >> SP_LEAF_SHIFT), (UINT32)(ci & (SP_LEAF_CHUNKS - 1))), &c);
+			if (ret == 0)
+				ret = load_chunk(bmap, ci, c);
+			if (ret != 0)
+				return ret;
+			ci++;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+/* Copyright (c) 2026 Virtuozzo International GmbH.  All rights reserved.
+ *
+ * This file is part of OpenVZ. OpenVZ is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation;
+ * either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+#ifndef _SPARCE_BITMAP64_H_
+#define _SPARCE_BITMAP64_H_
+
+#include "Interfaces/VirtuozzoTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sparse bitmap with 64-bit indices.
+ *
+ * Bits are grouped in chunks of one page (32768 bits), chunks are grouped
+ * in leaves of 1024 chunks. Leaves are allocated only when they hold both
+ * set and clear bits, so the directory costs 8 bytes per 2^25 bits.
+ * A chunk is either all clear, all set, a sorted list of runs of set bits,
+ * or a plain page when there are too many runs to be smaller than the page.
+ * Chunks are converted between the forms after every modification.
+ *
+ * Range functions take the same arguments as their sp_bitmap counterparts:
+ * affected bits are from startBit to bmapSize-1 inclusive.
+ *
+ * Leaves do not share any state, so ranges from different parts of
+ * SP_BITMAP64_PART_BITS bits may be modified from different threads.
+ */
+struct sp_bitmap64;
+
+#define SP_BITMAP64_PART_BITS	((UINT64)1 << 25)
+
+/** Allocate and initialize sparce bitmap, data is zeroed */
+struct sp_bitmap64 *sp_bitmap64_create(UINT64 size);
+
+/** Destroy sparce bitmap and release all memory */
+void sp_bitmap64_destroy(struct sp_bitmap64 *bmap);
+
+/** Size of the bitmap in bits */
+UINT64 sp_bitmap64_size(const struct sp_bitmap64 *bmap);
+
+/** Memory held by the bitmap in bytes */
+UINT64 sp_bitmap64_mem_usage(const struct sp_bitmap64 *bmap);
+
+/** Set all bits */
+int sp_bitmap64_set_all(struct sp_bitmap64 *bmap);
+
+/** Clear all bits */
+int sp_bitmap64_clear_all(struct sp_bitmap64 *bmap);
+
+int sp_bitmap64_set(struct sp_bitmap64 *bmap, UINT64 idx);
+int sp_bitmap64_clear(struct sp_bitmap64 *bmap, UINT64 idx);
+int sp_bitmap64_is_set(const struct sp_bitmap64 *bmap, UINT64 idx);
+
+/** OR src into dest, both bitmaps must be of the same size */
+int sp_bitmap64_merge(struct sp_bitmap64 *dest, const struct sp_bitmap64 *src);
+
+/**
+ * OR the range of src into dest, startBit must be a multiple of
+ * SP_BITMAP64_PART_BITS, bmapSize too unless it is the bitmap size.
+ */
+int sp_bitmap64_merge_range(struct sp_bitmap64 *dest, const struct sp_bitmap64 *src,
+		UINT64 bmapSize, UINT64 startBit);
+
+/**
+ * Copy bits to/from the plain bitmap in buf, startBit and bmapSize
+ * must be multiples of 8.
+ */
+int sp_bitmap64_read_aligned_range(const struct sp_bitmap64 *bmap, UINT8 *buf,
+		UINT64 bmapSize, UINT64 startBit);
+int sp_bitmap64_write_aligned_range(struct sp_bitmap64 *bmap, const UINT8 *buf,
+		UINT64 bmapSize, UINT64 startBit);
+
+/**
+ * @return
+ *	\li	0	if success,
+ *	\li	-EINVAL	if bmap is NULL, startBit or bmapSize
+ *				are greate than whole bitmap size.
+ *	\li	-ENOMEM	if no memory for new chunk allocation.
+ */
+int sp_bitmap64_set_range(struct sp_bitmap64 *bmap,
+		UINT64 bmapSize,
+		UINT64 startBit);
+int sp_bitmap64_clear_range(struct sp_bitmap64 *bmap,
+		UINT64 bmapSize,
+		UINT64 startBit);
+
+/**
+ * @return
+ *	\li	1	if all bits in range are set (clear),
+ *	\li	0	if not or if bmapSize is zero,
+ *	\li	-EINVAL	if bmap is NULL, startBit or bmapSize
+ *				are greate than whole bitmap size.
+ */
+int sp_bitmap64_is_set_range(const struct sp_bitmap64 *bmap,
+		UINT64 bmapSize,
+		UINT64 startBit);
+int sp_bitmap64_is_clear_range(const struct sp_bitmap64 *bmap,
+		UINT64 bmapSize,
+		UINT64 startBit);
+
+/**
+ * Stream format, numbers are little-endian. Records describe chunks of
+ * 32768 bits one after another up to the end of the bitmap:
+ *	u8 0, u32 count			count chunks with all bits clear
+ *	u8 1, u32 count			count chunks with all bits set
+ *	u8 2, u16 n, n * (u16 first, u16 last)
+ *					one chunk with sorted inclusive runs of set bits
+ *	u8 3, 4096 bytes		one chunk as the plain bitmap
+ *
+ * Callbacks transfer exactly size bytes and return 0 or -errno.
+ */
+typedef int (*sp_bitmap64_write_fn)(void *ctx, const void *buf, UINT32 size);
+typedef int (*sp_bitmap64_read_fn)(void *ctx, void *buf, UINT32 size);
+
+/** Write the bitmap to the stream */
+int sp_bitmap64_save(const struct sp_bitmap64 *bmap, sp_bitmap64_write_fn fn, void *ctx);
+
+/**
+ * OR the stream of the bitmap of the same size into bmap
+ * @return
+ *	\li	0	if success,
+ *	\li	-EINVAL	if the stream is malformed,
+ *	\li	-ENOMEM	if no memory for new chunk allocation,
+ *	\li	the error of fn otherwise.
+ */
+int sp_bitmap64_load(struct sp_bitmap64 *bmap, sp_bitmap64_read_fn fn, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SPARCE_BITMAP64_H_ */
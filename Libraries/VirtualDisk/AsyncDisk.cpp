@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+#include <QThread>
+#include <QRunnable>
+#include <QFutureInterface>
+#include <prlsdk/PrlErrorsValues.h>
+#include "../Logging/Logging.h"
+
+#include "AsyncDisk.h"
+#include "VirtualDisk.h"
+
+namespace VirtualDisk
+{
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+
+typedef QFutureInterface<PRL_RESULT> result_type;
+
+// Skip transferred bytes of the buffers starting from the first one
+void advance(std::vector<struct iovec> &buffers, size_t &first, size_t bytes)
+{
+	while (first < buffers.size() && bytes >= buffers[first].iov_len)
+		bytes -= buffers[first++].iov_len;
+
+	if (bytes > 0)
+	{
+		buffers[first].iov_base = (char *)buffers[first].iov_base + bytes;
+		buffers[first].iov_len -= bytes;
+	}
+}
+
+void complete(const Async::callback_type &callback, result_type &result,
+		PRL_RESULT code)
+{
+	if (callback)
+		callback(code);
+	result.reportResult(code);
+	result.reportFinished();
+}
+
+PRL_RESULT convertError(Async::Request::Type type, int error)
+{
+	WRITE_TRACE(DBG_FATAL, "Asynchronous %s failed: %s",
+			type == Async::Request::Read ? "read" : "write", strerror(error));
+	return type == Async::Request::Read ?
+		PRL_ERR_FILE_READ_ERROR : PRL_ERR_FILE_WRITE_ERROR;
+}
+
+} // namespace
+
+namespace Async
+{
+///////////////////////////////////////////////////////////////////////////////
+// struct Request
+
+PRL_UINT64 Request::getSize() const
+{
+	PRL_UINT64 output = 0;
+	for (size_t i = 0; i < m_buffers.size(); ++i)
+		output += m_buffers[i].iov_len;
+
+	return output;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Queue
+
+Queue::Queue(PRL_UINT32 depth):
+	m_depth(std::max<PRL_UINT32>(depth, 1)), m_inFlight(0)
+{
+}
+
+void Queue::drain()
+{
+	QMutexLocker l(&m_mutex);
+	while (m_inFlight > 0)
+		m_room.wait(&m_mutex);
+}
+
+bool Queue::tryAcquire()
+{
+	QMutexLocker l(&m_mutex);
+	if (m_inFlight >= m_depth)
+		return false;
+
+	++m_inFlight;
+	return true;
+}
+
+void Queue::acquire()
+{
+	QMutexLocker l(&m_mutex);
+	while (m_inFlight >= m_depth)
+		m_room.wait(&m_mutex);
+
+	++m_inFlight;
+}
+
+void Queue::release()
+{
+	QMutexLocker l(&m_mutex);
+	--m_inFlight;
+	m_room.wakeAll();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Pool::Job
+
+struct Pool::Job : QRunnable
+{
+	Job(Pool &pool, const Request &request):
+		m_pool(pool), m_request(request)
+	{
+		m_result.reportStarted();
+	}
+
+	future_type getFuture()
+	{
+		return m_result.future();
+	}
+
+	void run()
+	{
+		complete(m_request.getCallback(), m_result,
+				m_pool.execute(m_request));
+		m_pool.release();
+	}
+
+private:
+	Pool &m_pool;
+	Request m_request;
+	result_type m_result;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Pool
+
+Pool::Pool(int fd, PRL_UINT32 depth):
+	Queue(depth), m_fd(fd), m_format(NULL)
+{
+	m_threads.setMaxThreadCount(getDepth());
+}
+
+Pool::Pool(Format &format, PRL_UINT32 depth):
+	Queue(depth), m_fd(-1), m_format(&format)
+{
+	m_threads.setMaxThreadCount(1);
+}
+
+Pool::~Pool()
+{
+	drain();
+	m_threads.waitForDone();
+}
+
+QList<future_type> Pool::submit(const QList<Request> &requests)
+{
+	QList<future_type> output;
+	foreach (const Request &r, requests)
+	{
+		acquire();
+		Job *j = new Job(*this, r);
+		output << j->getFuture();
+		m_threads.start(j);
+	}
+	return output;
+}
+
+PRL_RESULT Pool::execute(const Request &request)
+{
+	std::vector<struct iovec> buffers = request.getBuffers();
+	PRL_UINT64 offset = request.getOffset() * SECTOR_SIZE;
+
+	if (m_format != NULL)
+	{
+		QMutexLocker l(&m_formatMutex);
+		for (size_t i = 0; i < buffers.size(); ++i)
+		{
+			PRL_RESULT res = request.getType() == Request::Read ?
+				m_format->read(buffers[i].iov_base, buffers[i].iov_len,
+						offset / SECTOR_SIZE) :
+				m_format->write(buffers[i].iov_base, buffers[i].iov_len,
+						offset / SECTOR_SIZE);
+			if (PRL_FAILED(res))
+				return res;
+			offset += buffers[i].iov_len;
+		}
+		return PRL_ERR_SUCCESS;
+	}
+
+	size_t first = 0;
+	while (first < buffers.size())
+	{
+		int count = std::min<size_t>(buffers.size() - first, IOV_MAX);
+		ssize_t n = request.getType() == Request::Read ?
+			::preadv(m_fd, &buffers[first], count, offset) :
+			::pwritev(m_fd, &buffers[first], count, offset);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return convertError(request.getType(), errno);
+		}
+		if (n == 0 && request.getType() == Request::Read)
+			return PRL_ERR_DISK_READ_OUT_DISK;
+
+		offset += n;
+		advance(buffers, first, n);
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Uring::Slot
+
+struct Uring::Slot
+{
+	Request::Type type;
+	std::vector<struct iovec> buffers;
+	size_t first;
+	PRL_UINT64 offset;
+	callback_type callback;
+	result_type result;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Uring::Ring
+
+struct Uring::Ring
+{
+	Ring(): fd(-1), sqMap(MAP_FAILED), cqMap(MAP_FAILED), sqeMap(MAP_FAILED)
+	{
+	}
+
+	~Ring()
+	{
+		if (sqeMap != MAP_FAILED)
+			munmap(sqeMap, sqeSize);
+		if (cqMap != MAP_FAILED && cqMap != sqMap)
+			munmap(cqMap, cqSize);
+		if (sqMap != MAP_FAILED)
+			munmap(sqMap, sqSize);
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	PRL_RESULT setup(PRL_UINT32 entries);
+
+	template<class T>
+	T *at(void *map, PRL_UINT32 offset)
+	{
+		return (T *)((char *)map + offset);
+	}
+
+	int fd;
+	void *sqMap;
+	void *cqMap;
+	void *sqeMap;
+	size_t sqSize;
+	size_t cqSize;
+	size_t sqeSize;
+
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned sqMask;
+	unsigned *sqArray;
+	struct io_uring_sqe *sqes;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+PRL_RESULT Uring::Ring::setup(PRL_UINT32 entries)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0)
+	{
+		WRITE_TRACE(DBG_INFO, "io_uring is not available: %m");
+		return PRL_ERR_UNIMPLEMENTED;
+	}
+
+	sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	sqeSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		sqSize = cqSize = std::max(sqSize, cqSize);
+
+	sqMap = mmap(NULL, sqSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqMap == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cqMap = sqMap;
+	else
+	{
+		cqMap = mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqMap == MAP_FAILED)
+			goto fail;
+	}
+
+	sqeMap = mmap(NULL, sqeSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqeMap == MAP_FAILED)
+		goto fail;
+
+	sqHead = at<unsigned>(sqMap, p.sq_off.head);
+	sqTail = at<unsigned>(sqMap, p.sq_off.tail);
+	sqMask = *at<unsigned>(sqMap, p.sq_off.ring_mask);
+	sqArray = at<unsigned>(sqMap, p.sq_off.array);
+	sqes = (struct io_uring_sqe *)sqeMap;
+	cqHead = at<unsigned>(cqMap, p.cq_off.head);
+	cqTail = at<unsigned>(cqMap, p.cq_off.tail);
+	cqMask = *at<unsigned>(cqMap, p.cq_off.ring_mask);
+	cqes = at<struct io_uring_cqe>(cqMap, p.cq_off.cqes);
+
+	return PRL_ERR_SUCCESS;
+
+fail:
+	WRITE_TRACE(DBG_FATAL, "Cannot map io_uring: %m");
+	return PRL_ERR_FAILURE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Uring::Reaper
+
+struct Uring::Reaper : QThread
+{
+	explicit Reaper(Uring &uring): m_uring(uring)
+	{
+	}
+
+	void run()
+	{
+		m_uring.reap();
+	}
+
+private:
+	Uring &m_uring;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Uring
+
+Uring::Uring(int fd, PRL_UINT32 depth):
+	Queue(depth), m_fd(fd), m_ring(new Ring), m_reaper(new Reaper(*this)),
+	m_slots(getDepth())
+{
+	for (size_t i = 0; i < m_slots.size(); ++i)
+		m_free.push_back(&m_slots[i]);
+}
+
+Uring *Uring::create(int fd, PRL_UINT32 depth)
+{
+	QScopedPointer<Uring> output(new Uring(fd, depth));
+	// one more entry to stop the reaper
+	if (PRL_FAILED(output->m_ring->setup(output->getDepth() + 1)))
+		return NULL;
+
+	output->m_reaper->start();
+	return output.take();
+}
+
+Uring::~Uring()
+{
+	if (!m_reaper->isRunning())
+		return;
+
+	drain();
+	{
+		// NOP without the slot tells the reaper to stop
+		QMutexLocker l(&m_submit);
+		push(NULL);
+		if (PRL_FAILED(flush(l)))
+		{
+			WRITE_TRACE(DBG_FATAL, "Cannot stop io_uring reaper");
+			m_reaper->terminate();
+		}
+	}
+	m_reaper->wait();
+}
+
+QList<future_type> Uring::submit(const QList<Request> &requests)
+{
+	QList<future_type> output;
+	PRL_UINT32 pending = 0;
+
+	foreach (const Request &r, requests)
+	{
+		if (!tryAcquire())
+		{
+			// queue is full, let the kernel start what is collected
+			if (pending > 0)
+			{
+				QMutexLocker l(&m_submit);
+				flush(l);
+				pending = 0;
+			}
+			acquire();
+		}
+
+		QMutexLocker l(&m_submit);
+		Slot *s = m_free.back();
+		m_free.pop_back();
+		s->type = r.getType();
+		s->buffers = r.getBuffers();
+		s->first = 0;
+		s->offset = r.getOffset() * SECTOR_SIZE;
+		s->callback = r.getCallback();
+		s->result = result_type();
+		s->result.reportStarted();
+		output << s->result.future();
+
+		if (s->buffers.empty())
+		{
+			l.unlock();
+			complete(s->callback, s->result, PRL_ERR_SUCCESS);
+			l.relock();
+			m_free.push_back(s);
+			l.unlock();
+			release();
+			continue;
+		}
+
+		push(s);
+		++pending;
+	}
+
+	if (pending > 0)
+	{
+		QMutexLocker l(&m_submit);
+		flush(l);
+	}
+	return output;
+}
+
+// Called with m_submit locked
+void Uring::push(Slot *slot)
+{
+	Ring &r = *m_ring;
+	unsigned tail = *r.sqTail;
+	unsigned index = tail & r.sqMask;
+	struct io_uring_sqe *sqe = &r.sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	if (slot == NULL)
+		sqe->opcode = IORING_OP_NOP;
+	else
+	{
+		sqe->opcode = slot->type == Request::Read ?
+			IORING_OP_READV : IORING_OP_WRITEV;
+		sqe->fd = m_fd;
+		sqe->addr = (unsigned long)&slot->buffers[slot->first];
+		sqe->len = std::min<size_t>(slot->buffers.size() - slot->first, IOV_MAX);
+		sqe->off = slot->offset;
+	}
+	sqe->user_data = (unsigned long)slot;
+
+	r.sqArray[index] = index;
+	// the entry must be visible to the kernel before the tail
+	__atomic_store_n(r.sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int Uring::enter(PRL_UINT32 count, PRL_UINT32 wait)
+{
+	int output;
+	while ((output = syscall(__NR_io_uring_enter, m_ring->fd, count, wait,
+			wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0)) < 0)
+	{
+		if (errno != EINTR)
+			return -errno;
+	}
+	return output;
+}
+
+// Called with m_submit locked, passes all pushed entries to the kernel.
+// Entries the kernel does not take are removed from the ring and their
+// requests are failed.
+PRL_RESULT Uring::flush(QMutexLocker &lock)
+{
+	// retry while the kernel is short of memory or the completion
+	// queue overflows and waits for the reaper
+	enum { RETRY_COUNT = 1000, RETRY_DELAY = 1000 };
+
+	Ring &r = *m_ring;
+	int e = 0;
+	for (int retry = 0; retry < RETRY_COUNT;)
+	{
+		unsigned pending = *r.sqTail - __atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE);
+		if (pending == 0)
+			return PRL_ERR_SUCCESS;
+
+		int n = enter(pending, 0);
+		if (n > 0)
+			continue;
+
+		e = n < 0 ? -n : EAGAIN;
+		if (e != EAGAIN && e != EBUSY)
+			break;
+
+		lock.unlock();
+		usleep(RETRY_DELAY);
+		lock.relock();
+		++retry;
+	}
+
+	WRITE_TRACE(DBG_FATAL, "io_uring_enter() failed: %s", strerror(e));
+
+	// the kernel reads the ring in io_uring_enter() only, so the rest of
+	// the entries can be taken back
+	std::vector<Slot *> failed;
+	unsigned head = __atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE);
+	for (unsigned i = head; i != *r.sqTail; ++i)
+	{
+		struct io_uring_sqe *sqe = &r.sqes[r.sqArray[i & r.sqMask]];
+		failed.push_back((Slot *)(unsigned long)sqe->user_data);
+	}
+	__atomic_store_n(r.sqTail, head, __ATOMIC_RELEASE);
+
+	lock.unlock();
+	bool stop = false;
+	foreach (Slot *s, failed)
+	{
+		if (s == NULL)
+		{
+			stop = true;
+			continue;
+		}
+		complete(s->callback, s->result, convertError(s->type, e));
+		lock.relock();
+		m_free.push_back(s);
+		lock.unlock();
+		release();
+	}
+	lock.relock();
+	if (stop)
+		WRITE_TRACE(DBG_FATAL, "Cannot submit io_uring stop request");
+	return PRL_ERR_FAILURE;
+}
+
+void Uring::reap()
+{
+	Ring &r = *m_ring;
+	for (;;)
+	{
+		unsigned head = *r.cqHead;
+		if (head == __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE))
+		{
+			if (enter(0, 1) < 0)
+				usleep(1000);
+			continue;
+		}
+
+		struct io_uring_cqe cqe = r.cqes[head & r.cqMask];
+		__atomic_store_n(r.cqHead, head + 1, __ATOMIC_RELEASE);
+
+		Slot *s = (Slot *)(unsigned long)cqe.user_data;
+		if (s == NULL)
+			return;
+
+		PRL_RESULT code = PRL_ERR_SUCCESS;
+		if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+			cqe.res = 0;
+		else if (cqe.res < 0)
+			code = convertError(s->type, -cqe.res);
+		else if (cqe.res == 0)
+		{
+			code = s->type == Request::Read ?
+				PRL_ERR_DISK_READ_OUT_DISK : PRL_ERR_FILE_WRITE_ERROR;
+		}
+
+		if (PRL_SUCCEEDED(code))
+		{
+			s->offset += cqe.res;
+			advance(s->buffers, s->first, cqe.res);
+			if (s->first < s->buffers.size())
+			{
+				// short transfer, submit the rest
+				QMutexLocker l(&m_submit);
+				push(s);
+				flush(l);
+				continue;
+			}
+		}
+
+		complete(s->callback, s->result, code);
+		{
+			QMutexLocker l(&m_submit);
+			m_free.push_back(s);
+		}
+		release();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Queue *createQueue(int fd, PRL_UINT32 depth)
+{
+	Queue *output = Uring::create(fd, depth);
+	if (output == NULL)
+		output = new (std::nothrow) Pool(fd, depth);
+
+	return output;
+}
+
+} // namespace Async
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Format
+
+Async::Queue *Format::createQueue(PRL_UINT32 depth)
+{
+	return new (std::nothrow) Async::Pool(*this, depth);
+}
+
+} // namespace VirtualDisk
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+#ifndef __VIRTUAL_DISK_ASYNC__
+#define __VIRTUAL_DISK_ASYNC__
+
+#include <vector>
+#include <sys/uio.h>
+#include <QList>
+#include <QMutex>
+#include <QFuture>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QScopedPointer>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <prlsdk/PrlTypes.h>
+
+namespace VirtualDisk
+{
+struct Format;
+
+namespace Async
+{
+typedef QFuture<PRL_RESULT> future_type;
+// Called from the completion thread of the queue, must not block
+typedef boost::function<void (PRL_RESULT)> callback_type;
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Request
+
+struct Request
+{
+	enum Type
+	{
+		Read,
+		Write
+	};
+
+	Request(Type type, PRL_UINT64 offSec):
+		m_type(type), m_offSec(offSec)
+	{
+	}
+
+	Type getType() const
+	{
+		return m_type;
+	}
+
+	PRL_UINT64 getOffset() const
+	{
+		return m_offSec;
+	}
+
+	// Buffers are filled or written in order, they must be kept
+	// untouched till the completion of the request
+	const std::vector<struct iovec>& getBuffers() const
+	{
+		return m_buffers;
+	}
+
+	Request& addBuffer(void *data, PRL_UINT32 sizeBytes)
+	{
+		struct iovec v = {data, sizeBytes};
+		m_buffers.push_back(v);
+		return *this;
+	}
+
+	PRL_UINT64 getSize() const;
+
+	const callback_type& getCallback() const
+	{
+		return m_callback;
+	}
+
+	Request& setCallback(const callback_type& callback)
+	{
+		m_callback = callback;
+		return *this;
+	}
+
+private:
+	Type m_type;
+	PRL_UINT64 m_offSec;
+	std::vector<struct iovec> m_buffers;
+	callback_type m_callback;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Queue
+//
+// Not more than getDepth() requests are in flight, submit() waits for
+// the room. Result of every request is reported to its callback first,
+// then to its future.
+
+struct Queue : boost::noncopyable
+{
+	explicit Queue(PRL_UINT32 depth);
+	virtual ~Queue() {};
+
+	PRL_UINT32 getDepth() const
+	{
+		return m_depth;
+	}
+
+	virtual QList<future_type> submit(const QList<Request> &requests) = 0;
+	// Wait for the completion of all submitted requests
+	void drain();
+
+protected:
+	// Take the room for one more request
+	bool tryAcquire();
+	void acquire();
+	void release();
+
+private:
+	PRL_UINT32 m_depth;
+	PRL_UINT32 m_inFlight;
+	QMutex m_mutex;
+	QWaitCondition m_room;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Pool
+//
+// Fallback queue, runs requests on its threads.
+
+struct Pool : Queue
+{
+	// Requests are done with preadv()/pwritev(), up to depth at once
+	Pool(int fd, PRL_UINT32 depth);
+	// Requests are done with the blocking calls of the format,
+	// one at a time, as formats are not thread-safe
+	Pool(Format &format, PRL_UINT32 depth);
+	~Pool();
+
+	virtual QList<future_type> submit(const QList<Request> &requests);
+
+private:
+	struct Job;
+
+	PRL_RESULT execute(const Request &request);
+
+	int m_fd;
+	Format *m_format;
+	QMutex m_formatMutex;
+	QThreadPool m_threads;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Uring
+//
+// Requests are passed to the kernel with io_uring, a batch with one call.
+
+struct Uring : Queue
+{
+	// NULL if io_uring is not available
+	static Uring *create(int fd, PRL_UINT32 depth);
+	~Uring();
+
+	virtual QList<future_type> submit(const QList<Request> &requests);
+
+private:
+	struct Ring;
+	struct Reaper;
+	struct Slot;
+
+	Uring(int fd, PRL_UINT32 depth);
+
+	void push(Slot *slot);
+	// number of submitted entries or -errno
+	int enter(PRL_UINT32 count, PRL_UINT32 wait);
+	PRL_RESULT flush(QMutexLocker &lock);
+	void reap();
+
+	int m_fd;
+	QScopedPointer<Ring> m_ring;
+	QScopedPointer<Reaper> m_reaper;
+	// guards submission queue and free slots
+	QMutex m_submit;
+	std::vector<Slot> m_slots;
+	std::vector<Slot *> m_free;
+};
+
+// io_uring queue for the image file or device, thread pool if unavailable
+Queue *createQueue(int fd, PRL_UINT32 depth);
+
+} // namespace Async
+} // namespace VirtualDisk
+
+#endif // __VIRTUAL_DISK_ASYNC__
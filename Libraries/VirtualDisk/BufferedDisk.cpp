@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "../Logging/Logging.h"
+
+#include "BufferedDisk.h"
+
+namespace VirtualDisk
+{
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+// Cache buffers are passed to the formats opened with O_DIRECT
+enum {BUFFER_ALIGNMENT = 4096};
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Buffered
+
+Buffered::Buffered(Format *format, const Parameters::Cache &cache):
+	m_format(format), m_cache(cache), m_readOnly(true), m_size(0),
+	m_readNext(0), m_arena(NULL), m_staging(NULL)
+{
+	if (m_cache.getBlockSize() == 0)
+		m_cache.setBlockSize(Parameters::Cache().getBlockSize());
+	if (m_cache.getReadAhead() == 0)
+		m_cache.setReadAhead(1);
+	// all blocks of the read-ahead window are allocated at once
+	if (m_cache.getBlocks() < m_cache.getReadAhead())
+		m_cache.setBlocks(m_cache.getReadAhead());
+}
+
+Buffered::~Buffered()
+{
+	close();
+	free(m_arena);
+}
+
+PRL_RESULT Buffered::open(const QString &fileName,
+		const PRL_DISK_OPEN_FLAGS flags,
+		const policyList_type &policies)
+{
+	if (m_arena == NULL)
+	{
+		size_t blockBytes = (size_t)m_cache.getBlockSize() * SECTOR_SIZE;
+		size_t total = blockBytes *
+			(m_cache.getBlocks() + m_cache.getReadAhead());
+		if (posix_memalign((void **)&m_arena, BUFFER_ALIGNMENT, total))
+		{
+			m_arena = NULL;
+			WRITE_TRACE(DBG_FATAL, "Cannot allocate %zu bytes of disk cache",
+					total);
+			return PRL_ERR_OUT_OF_MEMORY;
+		}
+
+		m_staging = m_arena + blockBytes * m_cache.getBlocks();
+		m_blocks.resize(m_cache.getBlocks());
+		for (size_t i = 0; i < m_blocks.size(); ++i)
+			m_blocks[i].data = m_arena + blockBytes * i;
+	}
+	reset();
+
+	PRL_RESULT res = m_format->open(fileName, flags, policies);
+	if (PRL_FAILED(res))
+		return res;
+
+	m_readOnly = !(flags & PRL_DISK_WRITE);
+	Parameters::disk_type info = m_format->getInfo();
+	if (info.isFailed())
+		WRITE_TRACE(DBG_FATAL, "Size of '%s' is unknown, disk cache is off",
+				qPrintable(fileName));
+	else
+		m_size = info.value().getSizeInSectors();
+
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::read(void *data, PRL_UINT32 sizeBytes, PRL_UINT64 offSec)
+{
+	if (sizeBytes % SECTOR_SIZE)
+		return PRL_ERR_INVALID_ARG;
+
+	PRL_UINT64 sectors = sizeBytes / SECTOR_SIZE;
+	bool sequential = (offSec == m_readNext);
+	m_readNext = offSec + sectors;
+
+	if (m_size == 0 || offSec + sectors > m_size ||
+		sectors >= (PRL_UINT64)m_cache.getReadAhead() * m_cache.getBlockSize())
+	{
+		// Large request gains nothing from the cache, just get
+		// the dirty data it covers to the disk
+		PRL_RESULT res = writeBackRange(offSec, sectors, false);
+		if (PRL_FAILED(res))
+			return res;
+		return m_format->read(data, sizeBytes, offSec);
+	}
+
+	PRL_UINT32 blockSize = m_cache.getBlockSize();
+	char *out = (char *)data;
+	while (sectors > 0)
+	{
+		PRL_UINT32 begin = offSec % blockSize;
+		PRL_UINT32 end = std::min<PRL_UINT64>(blockSize, begin + sectors);
+		PRL_RESULT res = readBlock(out, offSec / blockSize, begin, end,
+				sequential);
+		if (PRL_FAILED(res))
+			return res;
+
+		out += (end - begin) * SECTOR_SIZE;
+		offSec += end - begin;
+		sectors -= end - begin;
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::write(const void *data, PRL_UINT32 sizeBytes,
+		PRL_UINT64 offSec)
+{
+	if (sizeBytes % SECTOR_SIZE)
+		return PRL_ERR_INVALID_ARG;
+
+	PRL_UINT64 sectors = sizeBytes / SECTOR_SIZE;
+	if (m_readOnly || m_size == 0 || offSec + sectors > m_size ||
+		sectors >= (PRL_UINT64)m_cache.getReadAhead() * m_cache.getBlockSize())
+	{
+		// Cached copies of the range become stale
+		PRL_RESULT res = writeBackRange(offSec, sectors, true);
+		if (PRL_FAILED(res))
+			return res;
+		return m_format->write(data, sizeBytes, offSec);
+	}
+
+	PRL_UINT32 blockSize = m_cache.getBlockSize();
+	const char *in = (const char *)data;
+	while (sectors > 0)
+	{
+		PRL_UINT32 begin = offSec % blockSize;
+		PRL_UINT32 end = std::min<PRL_UINT64>(blockSize, begin + sectors);
+		PRL_RESULT res = writeBlock(in, offSec / blockSize, begin, end);
+		if (PRL_FAILED(res))
+			return res;
+
+		in += (end - begin) * SECTOR_SIZE;
+		offSec += end - begin;
+		sectors -= end - begin;
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+Parameters::disk_type Buffered::getInfo()
+{
+	return m_format->getInfo();
+}
+
+PRL_RESULT Buffered::close()
+{
+	PRL_RESULT res = flush();
+	if (PRL_FAILED(res))
+		WRITE_TRACE(DBG_FATAL, "Cached data is lost on close");
+
+	PRL_RESULT output = m_format->close();
+	reset();
+
+	return PRL_FAILED(res) ? res : output;
+}
+
+PRL_RESULT Buffered::cloneState(const QString &uuid, const QString &target)
+{
+	PRL_RESULT res = flush();
+	if (PRL_FAILED(res))
+		return res;
+
+	return m_format->cloneState(uuid, target);
+}
+
+CSparseBitmap *Buffered::getUsedBlocksBitmap(UINT32 granularity,
+		PRL_RESULT &err)
+{
+	err = flush();
+	if (PRL_FAILED(err))
+		return NULL;
+
+	return m_format->getUsedBlocksBitmap(granularity, err);
+}
+
+CSparseBitmap *Buffered::getTrackingBitmap(const QString &uuid)
+{
+	if (PRL_FAILED(flush()))
+		return NULL;
+
+	return m_format->getTrackingBitmap(uuid);
+}
+
+PRL_RESULT Buffered::flush()
+{
+	for (map_type::iterator it = m_map.begin(); it != m_map.end(); ++it)
+	{
+		if (!it->second->isDirty())
+			continue;
+
+		PRL_RESULT res = writeBack(it);
+		if (PRL_FAILED(res))
+			return res;
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_UINT32 Buffered::getValidSectors(PRL_UINT64 index) const
+{
+	// the last block of the disk may be incomplete
+	PRL_UINT64 blockSize = m_cache.getBlockSize();
+	return std::min(blockSize, m_size - index * blockSize);
+}
+
+void Buffered::touch(Block *block)
+{
+	m_lru.splice(m_lru.begin(), m_lru, block->lru);
+}
+
+PRL_RESULT Buffered::allocate(Block *&block)
+{
+	if (m_free.empty())
+	{
+		map_type::iterator it = m_map.find(m_lru.back()->index);
+		if (it->second->isDirty())
+		{
+			PRL_RESULT res = writeBack(it);
+			if (PRL_FAILED(res))
+				return res;
+		}
+		release(it);
+	}
+
+	block = m_free.back();
+	m_free.pop_back();
+	return PRL_ERR_SUCCESS;
+}
+
+void Buffered::insert(Block *block)
+{
+	m_lru.push_front(block);
+	block->lru = m_lru.begin();
+	m_map[block->index] = block;
+}
+
+void Buffered::release(map_type::iterator it)
+{
+	m_lru.erase(it->second->lru);
+	m_free.push_back(it->second);
+	m_map.erase(it);
+}
+
+PRL_RESULT Buffered::writeBack(map_type::iterator it)
+{
+	PRL_UINT64 blockSize = m_cache.getBlockSize();
+	Block *first = it->second;
+	PRL_UINT64 start = first->index * blockSize + first->dirtyBegin;
+	PRL_UINT64 next = first->index * blockSize + first->dirtyEnd;
+
+	// Following blocks, which continue the dirty range, go with one write
+	PRL_UINT32 count = 1;
+	map_type::iterator last = it;
+	for (++last; last != m_map.end() && count < m_cache.getReadAhead();
+			++last, ++count)
+	{
+		Block *b = last->second;
+		if (!b->isDirty() || b->index * blockSize + b->dirtyBegin != next)
+			break;
+		next = b->index * blockSize + b->dirtyEnd;
+	}
+
+	char *data = first->data + first->dirtyBegin * SECTOR_SIZE;
+	if (count > 1)
+	{
+		data = m_staging;
+		char *p = m_staging;
+		for (map_type::iterator i = it; i != last; ++i)
+		{
+			Block *b = i->second;
+			size_t size = (b->dirtyEnd - b->dirtyBegin) * SECTOR_SIZE;
+			memcpy(p, b->data + b->dirtyBegin * SECTOR_SIZE, size);
+			p += size;
+		}
+	}
+
+	PRL_RESULT res = m_format->write(data, (next - start) * SECTOR_SIZE, start);
+	if (PRL_FAILED(res))
+	{
+		WRITE_TRACE(DBG_FATAL, "Cannot write back %llu sectors at %llu",
+				(unsigned long long)(next - start),
+				(unsigned long long)start);
+		return res;
+	}
+
+	for (; it != last; ++it)
+		it->second->dirtyBegin = it->second->dirtyEnd = 0;
+
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::load(PRL_UINT64 index, bool sequential)
+{
+	PRL_UINT64 blockSize = m_cache.getBlockSize();
+	PRL_UINT32 count = 1;
+	if (sequential)
+	{
+		// read ahead up to the next cached block or the end of the disk
+		PRL_UINT64 limit = (m_size + blockSize - 1) / blockSize;
+		map_type::const_iterator it = m_map.lower_bound(index);
+		if (it != m_map.end())
+			limit = std::min(limit, it->first);
+		count = std::min<PRL_UINT64>(m_cache.getReadAhead(), limit - index);
+	}
+
+	std::vector<Block *> blocks(count);
+	for (PRL_UINT32 i = 0; i < count; ++i)
+	{
+		PRL_RESULT res = allocate(blocks[i]);
+		if (PRL_FAILED(res))
+		{
+			m_free.insert(m_free.end(), blocks.begin(), blocks.begin() + i);
+			return res;
+		}
+	}
+
+	PRL_UINT64 sectors = (count - 1) * blockSize +
+		getValidSectors(index + count - 1);
+	char *data = count > 1 ? m_staging : blocks[0]->data;
+	PRL_RESULT res = m_format->read(data, sectors * SECTOR_SIZE,
+			index * blockSize);
+	if (PRL_FAILED(res))
+	{
+		m_free.insert(m_free.end(), blocks.begin(), blocks.end());
+		return res;
+	}
+
+	for (PRL_UINT32 i = 0; i < count; ++i)
+	{
+		Block *b = blocks[i];
+		b->index = index + i;
+		b->loaded = true;
+		b->dirtyBegin = b->dirtyEnd = 0;
+		if (count > 1)
+		{
+			memcpy(b->data, m_staging + i * blockSize * SECTOR_SIZE,
+					getValidSectors(b->index) * SECTOR_SIZE);
+		}
+		insert(b);
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::readBlock(char *data, PRL_UINT64 index,
+		PRL_UINT32 begin, PRL_UINT32 end, bool sequential)
+{
+	map_type::iterator it = m_map.find(index);
+	if (it != m_map.end() && !it->second->loaded &&
+		(begin < it->second->dirtyBegin || end > it->second->dirtyEnd))
+	{
+		// Only written part of the block is here, get the rest from disk
+		if (it->second->isDirty())
+		{
+			PRL_RESULT res = writeBack(it);
+			if (PRL_FAILED(res))
+				return res;
+		}
+		release(it);
+		it = m_map.end();
+	}
+
+	if (it == m_map.end())
+	{
+		PRL_RESULT res = load(index, sequential);
+		if (PRL_FAILED(res))
+			return res;
+		it = m_map.find(index);
+	}
+
+	Block *b = it->second;
+	touch(b);
+	memcpy(data, b->data + begin * SECTOR_SIZE, (end - begin) * SECTOR_SIZE);
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::writeBlock(const char *data, PRL_UINT64 index,
+		PRL_UINT32 begin, PRL_UINT32 end)
+{
+	Block *b;
+	map_type::iterator it = m_map.find(index);
+	if (it == m_map.end())
+	{
+		PRL_RESULT res = allocate(b);
+		if (PRL_FAILED(res))
+			return res;
+
+		b->index = index;
+		b->loaded = false;
+		b->dirtyBegin = b->dirtyEnd = 0;
+		insert(b);
+	}
+	else
+	{
+		b = it->second;
+		// Dirty range of the block not read from disk can't have holes
+		if (!b->loaded && b->isDirty() &&
+			(end < b->dirtyBegin || begin > b->dirtyEnd))
+		{
+			PRL_RESULT res = writeBack(it);
+			if (PRL_FAILED(res))
+				return res;
+		}
+		touch(b);
+	}
+
+	if (b->isDirty())
+	{
+		b->dirtyBegin = std::min(b->dirtyBegin, begin);
+		b->dirtyEnd = std::max(b->dirtyEnd, end);
+	}
+	else
+	{
+		b->dirtyBegin = begin;
+		b->dirtyEnd = end;
+	}
+	memcpy(b->data + begin * SECTOR_SIZE, data, (end - begin) * SECTOR_SIZE);
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Buffered::writeBackRange(PRL_UINT64 offSec, PRL_UINT64 sectors,
+		bool drop)
+{
+	if (sectors == 0)
+		return PRL_ERR_SUCCESS;
+
+	PRL_UINT64 blockSize = m_cache.getBlockSize();
+	PRL_UINT64 last = (offSec + sectors - 1) / blockSize;
+	map_type::iterator it = m_map.lower_bound(offSec / blockSize);
+	while (it != m_map.end() && it->first <= last)
+	{
+		if (it->second->isDirty())
+		{
+			PRL_RESULT res = writeBack(it);
+			if (PRL_FAILED(res))
+				return res;
+		}
+
+		map_type::iterator cur = it++;
+		if (drop)
+			release(cur);
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+void Buffered::reset()
+{
+	m_map.clear();
+	m_lru.clear();
+	m_free.clear();
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+		m_free.push_back(&m_blocks[i]);
+
+	m_size = 0;
+	m_readNext = 0;
+}
+
+} // namespace VirtualDisk
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+#ifndef __VIRTUAL_DISK_BUFFERED__
+#define __VIRTUAL_DISK_BUFFERED__
+
+#include <map>
+#include <list>
+#include <vector>
+#include <QScopedPointer>
+
+#include "VirtualDisk.h"
+
+namespace VirtualDisk
+{
+namespace Parameters
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache
+
+struct Cache
+{
+	Cache():
+		m_blockSize(128), m_blocks(256), m_readAhead(16)
+	{
+	}
+
+	// in sectors
+	PRL_UINT32 getBlockSize() const
+	{
+		return m_blockSize;
+	}
+
+	void setBlockSize(PRL_UINT32 blockSize)
+	{
+		m_blockSize = blockSize;
+	}
+
+	// number of cached blocks
+	PRL_UINT32 getBlocks() const
+	{
+		return m_blocks;
+	}
+
+	void setBlocks(PRL_UINT32 blocks)
+	{
+		m_blocks = blocks;
+	}
+
+	// blocks read at once on the miss of the sequential stream,
+	// also the max number of blocks merged into one write
+	PRL_UINT32 getReadAhead() const
+	{
+		return m_readAhead;
+	}
+
+	void setReadAhead(PRL_UINT32 readAhead)
+	{
+		m_readAhead = readAhead;
+	}
+
+private:
+	PRL_UINT32 m_blockSize;
+	PRL_UINT32 m_blocks;
+	PRL_UINT32 m_readAhead;
+};
+
+} // namespace Parameters
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Buffered
+//
+// Decorator caching blocks of the wrapped format. Small writes are collected
+// in the blocks and written back on eviction or flush(), neighbour dirty
+// blocks with one request. Sequential reads are served from the read-ahead.
+// Requests not smaller than the read-ahead window go to the wrapped format.
+// Not thread-safe, as other formats are.
+
+struct Buffered : Format
+{
+	explicit Buffered(Format *format,
+			const Parameters::Cache &cache = Parameters::Cache());
+	~Buffered();
+
+	virtual PRL_RESULT open(const QString &fileName,
+			const PRL_DISK_OPEN_FLAGS flags,
+			const policyList_type &policies = policyList_type());
+	virtual PRL_RESULT read(void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec);
+	virtual PRL_RESULT write(const void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec);
+	virtual Parameters::disk_type getInfo(void);
+	virtual PRL_RESULT close(void);
+	virtual PRL_RESULT cloneState(const QString &uuid,
+			const QString &target);
+	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32 granularity,
+			PRL_RESULT &err);
+	virtual CSparseBitmap *getTrackingBitmap(const QString &uuid);
+
+	// Write all dirty blocks to the wrapped format
+	PRL_RESULT flush();
+
+private:
+	struct Block
+	{
+		PRL_UINT64 index;
+		char *data;
+		// whole block is read from the disk
+		bool loaded;
+		// sectors inside the block to be written back
+		PRL_UINT32 dirtyBegin;
+		PRL_UINT32 dirtyEnd;
+		std::list<Block *>::iterator lru;
+
+		bool isDirty() const
+		{
+			return dirtyBegin < dirtyEnd;
+		}
+	};
+	typedef std::map<PRL_UINT64, Block *> map_type;
+
+	PRL_UINT32 getValidSectors(PRL_UINT64 index) const;
+	void touch(Block *block);
+	PRL_RESULT allocate(Block *&block);
+	void insert(Block *block);
+	void release(map_type::iterator it);
+	PRL_RESULT writeBack(map_type::iterator it);
+	PRL_RESULT load(PRL_UINT64 index, bool sequential);
+	PRL_RESULT readBlock(char *data, PRL_UINT64 index,
+			PRL_UINT32 begin, PRL_UINT32 end, bool sequential);
+	PRL_RESULT writeBlock(const char *data, PRL_UINT64 index,
+			PRL_UINT32 begin, PRL_UINT32 end);
+	PRL_RESULT writeBackRange(PRL_UINT64 offSec, PRL_UINT64 sectors,
+			bool drop);
+	void reset();
+
+	QScopedPointer<Format> m_format;
+	Parameters::Cache m_cache;
+	bool m_readOnly;
+	// disk size in sectors, 0 if unknown and nothing is cached
+	PRL_UINT64 m_size;
+	// sector following the last read, to detect sequential stream
+	PRL_UINT64 m_readNext;
+	char *m_arena;
+	char *m_staging;
+	std::vector<Block> m_blocks;
+	std::vector<Block *> m_free;
+	std::list<Block *> m_lru;
+	map_type m_map;
+};
+
+} // namespace VirtualDisk
+
+#endif // __VIRTUAL_DISK_BUFFERED__
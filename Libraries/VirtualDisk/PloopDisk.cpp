@@ -37,6 +37,7 @@
 #include <QByteArray>
 
 #include "PloopDisk.h"
+#include "AsyncDisk.h"
 #include "Libraries/Logging/Logging.h"
 #include "Libraries/VirtualDisk/SparseBitmap.h"
 #include "Libraries/Std/BitOps.h"
@@ -275,6 +276,17 @@ PRL_RESULT Ploop::write(const void *data, PRL_UINT32 sizeBytes,
 	return m_file.pwrite(data, sizeBytes, offSec * 512);
 }
 
+Async::Queue *Ploop::createQueue(PRL_UINT32 depth)
+{
+	if (m_di == NULL)
+		return NULL;
+
+	if (mount())
+		return NULL;
+
+	return Async::createQueue(m_file.getDescriptor(), depth);
+}
+
 Parameters::disk_type Ploop::getInfo(void)
 {
 	if (m_di == NULL)
@@ -63,6 +63,7 @@ struct Ploop : Format
 	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32 granularity,
 			PRL_RESULT &err);
 	virtual CSparseBitmap *getTrackingBitmap(const QString &uuid);
+	virtual Async::Queue *createQueue(PRL_UINT32 depth);
 	static const char *getComponentName();
 	static QString getComponentName(const QString &uuid);
 
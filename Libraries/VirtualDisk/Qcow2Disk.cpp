@@ -31,6 +31,8 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include "Qcow2Disk.h"
 #include "Qcow2Disk_p.h"
+#include "AsyncDisk.h"
+#include "Qcow2Metadata.h"
 #include "Util.h"
 
 #include <sys/ioctl.h>
@@ -38,8 +40,6 @@
 #include <linux/fs.h>
 #include <fcntl.h>
 #include <cstdlib>
-#include <json.h>
-#include <json-c/json.h>
 #include <QStringList>
 #include <QDir>
 #include <errno.h>
@@ -50,7 +50,6 @@
 #include "../Logging/Logging.h"
 #include "../HostUtils/HostUtils.h"
 #include "Util.h"
-#include <boost/algorithm/string.hpp>
 #include <QtConcurrent/QtConcurrent>
 
 namespace VirtualDisk
@@ -63,6 +62,11 @@ enum {
 	CMD_WORK_TIMEOUT = 60 * 60 * 1000,
 	CMD_FAIL_TIMEOUT = 500,
 	CMD_WAIT_TIMEOUT = 60000,
+	// first delay between the probes of the device, doubled up to
+	// CMD_FAIL_TIMEOUT
+	PROBE_DELAY = 10,
+	// age of the last scan for the orphan exports to scan again
+	ORPHAN_SCAN_TIMEOUT = 60000,
 };
 
 const char MODPROBE[] = "/usr/sbin/modprobe";
@@ -86,6 +90,36 @@ bool isAligned(const void *value)
 	return !((uintptr_t)value % SECTOR_SIZE);
 }
 
+// exists while the device is connected
+QString getPidFile(const QString& device_)
+{
+	return QString("/sys/block/%1/pid").arg(QFileInfo(device_).fileName());
+}
+
+// command line of qemu-nbd connected to the device, empty if none
+QByteArray getExportCommand(const QString& device_)
+{
+	QString pid;
+	QFile f(getPidFile(device_));
+	if (f.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		QTextStream s(&f);
+		pid = s.readLine();
+	}
+	if (pid.isEmpty())
+		return QByteArray();
+
+	QFile c(QString("/proc/%1/cmdline").arg(pid));
+	if (!c.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	QByteArray output = c.readAll();
+	if (!output.startsWith(QEMU_NBD))
+		return QByteArray();
+
+	return output;
+}
+
 } // namespace
 
 namespace Nbd
@@ -219,13 +253,13 @@ Retired Stopping::retire()
 ///////////////////////////////////////////////////////////////////////////////
 // struct Wakeup
 
-void Wakeup::bind(QObject& target_)
+void Wakeup::bind(QObject& target_, int msecs_)
 {
 	QTimer* t = new QTimer();
 	t->setSingleShot(true);
 	target_.connect(t, SIGNAL(timeout()), SLOT(reactTimeout()));
 	t->connect(t, SIGNAL(timeout()), SLOT(deleteLater()));
-	t->start(CMD_FAIL_TIMEOUT);
+	t->start(msecs_);
 
 	m_timer = t;
 }
@@ -369,7 +403,7 @@ PRL_RESULT Running::disconnect(const QString& device_)
 // struct Steady
 
 Steady::Steady(const machineCarrier_type& machine_, const token_type& token_):
-	m_token(token_), m_machine(machine_)
+	m_delay(PROBE_DELAY), m_token(token_), m_machine(machine_)
 {
 	m_timer.start();
 }
@@ -415,7 +449,8 @@ Prl::Expected<size_t, PRL_RESULT> Steady::probe()
 Steady Steady::retry() const
 {
 	Steady output = *this;
-	output.m_retry.bind(*m_machine);
+	output.m_delay = qMin(m_delay * 2, (int)CMD_FAIL_TIMEOUT);
+	output.m_retry.bind(*m_machine, m_delay);
 
 	return output;
 }
@@ -506,7 +541,7 @@ namespace State
 Linger::Linger(const machineCarrier_type& machine_, const token_type& token_):
 	m_token(token_), m_machine(machine_)
 {
-	m_delay.bind(*machine_);
+	m_delay.bind(*machine_, CMD_FAIL_TIMEOUT);
 }
 
 Running Linger::expire()
@@ -575,6 +610,280 @@ Flavor<Export::state_type>::start(const Script& script_, const token_type& token
 
 } // namespace Backend
 
+namespace
+{
+///////////////////////////////////////////////////////////////////////////////
+// struct Refill
+
+struct Refill: QRunnable
+{
+	explicit Refill(Registry& registry_): m_registry(&registry_)
+	{
+	}
+
+	void run()
+	{
+		m_registry->refill();
+	}
+
+private:
+	Registry* m_registry;
+};
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Registry
+
+Registry::Registry(const QStringList& devices_):
+	m_reserveSize(0), m_refilling(false), m_devices(devices_), m_rescan(true)
+{
+	m_threads.setMaxThreadCount(1);
+}
+
+Registry::~Registry()
+{
+	m_threads.waitForDone();
+	qDeleteAll(m_reserve);
+}
+
+void Registry::setReserve(PRL_UINT32 value_)
+{
+	QMutexLocker l(&m_mutex);
+	m_reserveSize = value_;
+	while ((PRL_UINT32)m_reserve.size() > m_reserveSize)
+		delete m_reserve.takeLast();
+
+	scheduleRefill();
+}
+
+Pool::Metrics Registry::getMetrics() const
+{
+	QMutexLocker l(&m_mutex);
+	Pool::Metrics output = m_metrics;
+	output.reserved = m_reserve.size();
+	return output;
+}
+
+void Registry::account(qint64 msecs_, bool shared_)
+{
+	QMutexLocker l(&m_mutex);
+	++m_metrics.opens;
+	if (shared_)
+		++m_metrics.shared;
+	m_metrics.totalMsecs += msecs_;
+	m_metrics.maxMsecs = qMax<PRL_UINT64>(m_metrics.maxMsecs, msecs_);
+}
+
+PRL_RESULT Registry::claim(Frontend& target_)
+{
+	QMutexLocker l(&m_mutex);
+	while (!m_reserve.isEmpty())
+	{
+		QFile* f = m_reserve.takeFirst();
+		// someone may ignore the lock
+		if (QFileInfo(getPidFile(f->fileName())).exists())
+		{
+			delete f;
+			continue;
+		}
+		scheduleRefill();
+		return target_.adopt(f);
+	}
+	if (0 < m_reserveSize)
+		++m_metrics.misses;
+	// devices may be held by the exports started by someone else
+	m_rescan = true;
+	scheduleRefill();
+	l.unlock();
+
+	// most of the devices are busy, don't complain about each one
+	foreach(const QString &device, getDevices())
+	{
+		QFile* f = Frontend::tryLock(device);
+		if (NULL != f)
+			return target_.adopt(f);
+	}
+
+	WRITE_TRACE(DBG_FATAL, "Cannot find free NBD device");
+	return PRL_ERR_DISK_GENERIC_ERROR;
+}
+
+Registry::frontend_type Registry::share(const QString& key_)
+{
+	QMutexLocker l(&m_mutex);
+	QHash<QString, Share>::iterator i = m_shares.find(key_);
+	if (m_shares.end() == i)
+		return frontend_type();
+
+	frontend_type output = i->frontend.toStrongRef();
+	if (!output.isNull())
+		++i->users;
+
+	return output;
+}
+
+void Registry::publish(const QString& key_, const frontend_type& frontend_)
+{
+	QMutexLocker l(&m_mutex);
+	if (m_shares.contains(key_))
+		return;
+
+	Share x;
+	x.frontend = frontend_.toWeakRef();
+	x.users = 1;
+	m_shares.insert(key_, x);
+}
+
+bool Registry::release(const frontend_type& frontend_)
+{
+	QMutexLocker l(&m_mutex);
+	QHash<QString, Share>::iterator i = m_shares.begin();
+	for (; i != m_shares.end(); ++i)
+	{
+		if (i->frontend.data() != frontend_.data())
+			continue;
+
+		if (0 < --i->users)
+			return false;
+
+		m_shares.erase(i);
+		break;
+	}
+	return true;
+}
+
+QString Registry::takeOrphan(const QString& image_)
+{
+	QMutexLocker l(&m_mutex);
+	// Exports started later are known, the others are looked for again
+	// when the devices run out or the last scan is old
+	if (m_rescan || !m_scanned.isValid() ||
+		ORPHAN_SCAN_TIMEOUT < m_scanned.elapsed())
+	{
+		m_rescan = false;
+		m_scanned.start();
+		l.unlock();
+		QHash<QString, QByteArray> x;
+		foreach(const QString &dev, getDevices())
+		{
+			QByteArray cmd = getExportCommand(dev);
+			if (!cmd.isEmpty())
+				x.insert(dev, cmd);
+		}
+		l.relock();
+		m_orphans = x;
+	}
+
+	QHash<QString, QByteArray>::iterator i = m_orphans.begin();
+	while (i != m_orphans.end())
+	{
+		if (!i.value().contains(qPrintable(image_)))
+		{
+			++i;
+			continue;
+		}
+		QString output = i.key();
+		m_orphans.erase(i);
+		// the orphan may have gone and the device may be reused since
+		// the scan
+		l.unlock();
+		if (getExportCommand(output).contains(qPrintable(image_)))
+			return output;
+		l.relock();
+		i = m_orphans.begin();
+	}
+
+	return QString();
+}
+
+void Registry::rescan()
+{
+	QMutexLocker l(&m_mutex);
+	m_rescan = true;
+}
+
+void Registry::refill()
+{
+	QStringList taken;
+	PRL_UINT32 need = 0;
+	{
+		QMutexLocker l(&m_mutex);
+		if (m_reserveSize > (PRL_UINT32)m_reserve.size())
+			need = m_reserveSize - m_reserve.size();
+		foreach(QFile* f, m_reserve)
+			taken << f->fileName();
+	}
+
+	QList<QFile* > x;
+	foreach(const QString &device, getDevices())
+	{
+		if ((PRL_UINT32)x.size() >= need)
+			break;
+		if (taken.contains(device))
+			continue;
+
+		QFile* f = Frontend::tryLock(device);
+		if (NULL != f)
+			x << f;
+	}
+
+	QMutexLocker l(&m_mutex);
+	m_reserve << x;
+	m_refilling = false;
+	if ((PRL_UINT32)x.size() < need)
+		WRITE_TRACE(DBG_FATAL, "Only %d of %u NBD devices are reserved",
+			x.size(), need);
+}
+
+QStringList Registry::getDevices()
+{
+	{
+		QMutexLocker l(&m_mutex);
+		if (!m_devices.isEmpty())
+			return m_devices;
+	}
+
+	QStringList output = Driver::getDeviceList();
+	QMutexLocker l(&m_mutex);
+	m_devices = output;
+
+	return output;
+}
+
+void Registry::scheduleRefill()
+{
+	if (m_refilling || m_reserveSize <= (PRL_UINT32)m_reserve.size())
+		return;
+
+	m_refilling = true;
+	m_threads.start(new Refill(*this));
+}
+
+namespace
+{
+Q_GLOBAL_STATIC(Registry, getRegistry)
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Pool
+
+void Pool::setReserve(PRL_UINT32 reserve_)
+{
+	getRegistry()->setReserve(reserve_);
+}
+
+void Pool::rescan()
+{
+	getRegistry()->rescan();
+}
+
+Pool::Metrics Pool::getMetrics()
+{
+	return getRegistry()->getMetrics();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // struct Script
 
@@ -604,7 +913,7 @@ public:
 
 void Script::operator()(Process& target_) const
 {
-	QString dev = findConnectedDevice(m_image);
+	QString dev = getRegistry()->takeOrphan(m_image);
 	if (!dev.isEmpty())
 	{
 		Export::State::Running::disconnect(dev);
@@ -624,33 +933,6 @@ void Script::operator()(Process& target_) const
 }
 
 
-/* Search running qemu-nbd with assigned image and return NBD device */
-QString Script::findConnectedDevice(const QString& image_) const
-{
-	foreach(const QString &dev, Nbd::Driver::getDeviceList())
-	{
-		QString pid;
-		QFile f(QString("/sys/block/%1/pid").arg(QFileInfo(dev).fileName()));
-		if (f.open(QIODevice::ReadOnly | QIODevice::Text))
-		{
-			QTextStream s(&f);
-			pid = s.readLine();
-		}
-		if (pid.isEmpty())
-			continue;
-
-		QFile c(QString("/proc/%1/cmdline").arg(pid));
-		if (c.open(QIODevice::ReadOnly))
-		{
-			QByteArray cmd = c.readAll();
-			if (cmd.startsWith(QEMU_NBD) && cmd.contains(qPrintable(image_)))
-				return dev;
-		}
-	}
-
-	return QString();;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 // struct Frontend
 
@@ -686,28 +968,63 @@ PRL_RESULT Frontend::bind(const QString& device_)
 	if (NULL != m_nbd)
 		return PRL_ERR_OPERATION_PENDING;
 
+	QFile* f = lock(device_);
+	if (NULL == f)
+		return PRL_ERR_INVALID_ARG;
+
+	m_guard.reset(f);
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Frontend::adopt(QFile* guard_)
+{
+	QScopedPointer<QFile> f(guard_);
+	if (NULL != m_nbd)
+		return PRL_ERR_OPERATION_PENDING;
+
+	m_guard.reset(f.take());
+	return PRL_ERR_SUCCESS;
+}
+
+QFile* Frontend::lock(const QString& device_)
+{
+	QString e;
+	QFile* output = tryLock(device_, &e);
+	if (NULL == output)
+		WRITE_TRACE(DBG_FATAL, "%s", qPrintable(e));
+
+	return output;
+}
+
+QFile* Frontend::tryLock(const QString& device_, QString* error_)
+{
 	QScopedPointer<QFile> f(new QFile(device_));
 	if (!f->open(QIODevice::ReadOnly))
 	{
-		WRITE_TRACE(DBG_FATAL, "Cannot open file '%s': %m",
-			qPrintable(device_));
-		return PRL_ERR_DISK_FILE_OPEN_ERROR;
+		if (NULL != error_)
+		{
+			*error_ = QString("Cannot open file '%1': %2")
+				.arg(device_).arg(f->errorString());
+		}
+		return NULL;
 	}
 	if (-1 == TEMP_FAILURE_RETRY(::flock(f->handle(), LOCK_EX | LOCK_NB)))
 	{
-		WRITE_TRACE(DBG_FATAL, "Device '%s' has already been locked",
-			qPrintable(device_));
-		return PRL_ERR_INVALID_ARG;
+		if (NULL != error_)
+			*error_ = QString("Device '%1' has already been locked").arg(device_);
+		return NULL;
 	}
-	if (QFileInfo(QString("/sys/block/%1/pid").arg(QFileInfo(device_).fileName())).exists())
+	if (QFileInfo(getPidFile(device_)).exists())
 	{
-		WRITE_TRACE(DBG_FATAL, "Device '%s' is being used by someone else",
-			qPrintable(device_));
-		return PRL_ERR_INVALID_ARG;
+		if (NULL != error_)
+		{
+			*error_ = QString("Device '%1' is being used by someone else")
+				.arg(device_);
+		}
+		return NULL;
 	}
 
-	m_guard.reset(f.take());
-	return PRL_ERR_SUCCESS;
+	return f.take();
 }
 
 PRL_RESULT Frontend::start(const Script& script_)
@@ -768,7 +1085,7 @@ struct SetImage
 	typedef QSharedPointer<Nbd::Frontend> qemuCarrier_type;
 
 	SetImage():
-		m_offset(0), m_compressed(false), m_cached(false),
+		m_offset(0), m_compressed(false), m_cached(false), m_autoDevice(false),
 		m_device(qemuCarrier_type(new Nbd::Frontend()))
 	{
 	}
@@ -778,11 +1095,41 @@ struct SetImage
 		if (m_device.isFailed())
 			return m_device.error();
 
+		QElapsedTimer t;
+		t.start();
+		Nbd::Registry& r = *Nbd::getRegistry();
+		// Only exports to the device are shared, not to a socket
+		QString key;
+		if (readOnly && m_autoDevice && m_args.isEmpty() && m_portList.isEmpty())
+		{
+			key = (QStringList() << image << buildArgs(image)).join(" ");
+			qemuCarrier_type x = r.share(key);
+			if (!x.isNull())
+			{
+				m_device = x;
+				r.account(t.elapsed(), true);
+				return PRL_ERR_SUCCESS;
+			}
+		}
+
+		PRL_RESULT output;
+		if (m_autoDevice && PRL_FAILED(output = r.claim(*m_device.value())))
+			return output;
+
 		Nbd::Script x(image, m_portList);
 		if (readOnly)
 			x.addArgument("-r");
 
-		return m_device.value()->start(x.addArguments(buildArgs(image)));
+		output = m_device.value()->start(x.addArguments(buildArgs(image)));
+		if (PRL_FAILED(output))
+			return output;
+
+		if (!key.isEmpty())
+			r.publish(key, m_device.value());
+		r.account(t.elapsed(), false);
+		WRITE_TRACE(DBG_DEBUG, "Export of '%s' is ready in %lld ms",
+			qPrintable(image), t.elapsed());
+		return output;
 	}
 
 	const qemuCarrier_type& getDevice() const
@@ -814,20 +1161,11 @@ struct SetImage
 		}
 	}
 
+	// The device is claimed from the pool on start
 	void setAutoDevice(bool autoDevice)
 	{
-		qemuCarrier_type qemu(new Nbd::Frontend());
-		if (!autoDevice)
-			return (void)(m_device = qemu);
-
-		foreach(const QString &device, Nbd::Driver::getDeviceList())
-		{
-			if (PRL_SUCCEEDED(qemu->bind(device)))
-				return (void)(m_device = qemu);
-		}
-
-		WRITE_TRACE(DBG_FATAL, "Cannot find free NBD device");
-		m_device = PRL_ERR_DISK_GENERIC_ERROR;
+		m_autoDevice = autoDevice;
+		m_device = qemuCarrier_type(new Nbd::Frontend());
 	}
 
 	void setCompressed(bool compressed)
@@ -886,6 +1224,7 @@ private:
 	PRL_UINT64 m_offset;
 	bool m_compressed;
 	bool m_cached;
+	bool m_autoDevice;
 	QString m_exportName;
 	Nbd::Script::portList_type m_portList;
 
@@ -1105,7 +1444,8 @@ PRL_RESULT Qcow2::close()
 void Qcow2::closeForce()
 {
 	m_file.close();
-	m_device->stop();
+	if (Nbd::getRegistry()->release(m_device))
+		m_device->stop();
 	m_device.clear();
 	m_fileName.clear();
 }
@@ -1138,6 +1478,18 @@ PRL_RESULT Qcow2::write(const void *data, PRL_UINT32 sizeBytes, PRL_UINT64 offSe
 	return m_file.pwrite(data, sizeBytes, offSec * SECTOR_SIZE);
 }
 
+Async::Queue *Qcow2::createQueue(PRL_UINT32 depth)
+{
+	if (m_file.getDescriptor() < 0)
+	{
+		WRITE_TRACE(DBG_FATAL, "Image is not opened");
+		return NULL;
+	}
+
+	// requests go to the NBD device directly
+	return Async::createQueue(m_file.getDescriptor(), depth);
+}
+
 Parameters::disk_type Qcow2::getInfo()
 {
 	Parameters::Disk disk;
@@ -1167,49 +1519,28 @@ Parameters::disk_type Qcow2::getInfo()
 
 bool Qcow2::isValid(const QString &fileName)
 {
-	QStringList cmdLine = QStringList()
-		<< QEMU_IMG_BIN << "info" << "--force-share" << "--output=json"
-		<< fileName;
-	QString out;
-	if (!HostUtils::RunCmdLineUtility(
-			cmdLine.join(" "), out, CMD_WORK_TIMEOUT))
-	{
-		WRITE_TRACE(DBG_FATAL, "Cannot get image info");
-		return false;
-	}
-	QByteArray bytes(out.toUtf8());
-	struct json_object* j = json_tokener_parse(bytes.constData());
-	if (NULL == j)
-	{
-		WRITE_TRACE(DBG_FATAL, "Cannot parse qemu-img info output");
-		return false;
-	}
-	json_object_object_foreach(j, k, v)
-	{
-		if (boost::equals(k, "format"))
-		{
-			const char* V = json_object_get_string(v);
-			if (NULL == V)
-				break;
-
-			bool output = boost::equals(V, "qcow2");
-			json_object_put(j);
-			return output;
-		}
-	}
-	json_object_put(j);
-
-	WRITE_TRACE(DBG_FATAL, "Cannot get image format");
-	return false;
+	return Qcow2Metadata::isValid(fileName);
 }
 
 CSparseBitmap *Qcow2::getUsedBlocksBitmap(UINT32 granularity,
                 PRL_RESULT &err)
 {
-	Q_UNUSED(granularity)
-	Q_UNUSED(err)
+	if (m_fileName.isEmpty())
+	{
+		err = PRL_ERR_DISK_DISK_NOT_OPENED;
+		return NULL;
+	}
 
-	return NULL;
+	// Metadata is read from the file, while qemu-nbd may still cache
+	// updated L1/L2 tables of writes done through the device
+	if (!m_readOnly && PRL_FAILED(err = m_file.flush()))
+	{
+		WRITE_TRACE(DBG_FATAL, "Cannot flush '%s' before reading its metadata",
+				m_fileName.toUtf8().constData());
+		return NULL;
+	}
+
+	return Qcow2Metadata::getUsedBlocksBitmap(m_fileName, granularity, err);
 }
 
 CSparseBitmap *Qcow2::getTrackingBitmap(const QString &uuid)
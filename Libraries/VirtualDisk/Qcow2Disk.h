@@ -71,6 +71,41 @@ private:
 	QList<int> m_channels;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// struct Pool
+//
+// Free NBD devices locked in advance for the exports of qcow2 images.
+// Read-only opens of the same image with the same options share one export.
+
+struct Pool
+{
+	struct Metrics
+	{
+		Metrics(): opens(0), shared(0), misses(0), totalMsecs(0), maxMsecs(0),
+			reserved(0)
+		{
+		}
+
+		// exports opened, shared ones included
+		PRL_UINT64 opens;
+		// opens served by a running read-only export
+		PRL_UINT64 shared;
+		// devices found by a scan as the reserve was empty
+		PRL_UINT64 misses;
+		// time from the start of the open till the device is ready
+		PRL_UINT64 totalMsecs;
+		PRL_UINT64 maxMsecs;
+		// free devices locked now
+		PRL_UINT32 reserved;
+	};
+
+	// Number of free devices to keep locked, none by default
+	static void setReserve(PRL_UINT32 reserve_);
+	static Metrics getMetrics();
+	// Look for the exports left by someone else on the next open
+	static void rescan();
+};
+
 } // namespace Nbd
 
 namespace Policy
@@ -164,6 +199,7 @@ struct Qcow2: Format
 	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32 granularity,
 			PRL_RESULT &err);
 	virtual CSparseBitmap *getTrackingBitmap(const QString &uuid);
+	virtual Async::Queue *createQueue(PRL_UINT32 depth);
 private:
 	void closeForce();
 
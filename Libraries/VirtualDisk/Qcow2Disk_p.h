@@ -33,9 +33,13 @@
 
 #include <memory>
 #include "Util.h"
+#include "Qcow2Disk.h"
 #include <QFuture>
 #include <QProcess>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
 #include <QElapsedTimer>
 #include <QSharedPointer>
 #include <QScopedPointer>
@@ -77,7 +81,6 @@ struct Script
 	Script& addArgument(const QString& one_);
 	Script& addArguments(const QStringList& bunch_);
 	void operator()(Process& target_) const;
-	QString findConnectedDevice(const QString& image_) const;
 
 private:
 	QString m_image;
@@ -174,7 +177,7 @@ struct Wakeup
 	{
 	}
 
-	void bind(QObject& target_);
+	void bind(QObject& target_, int msecs_);
 	void cancel();
 
 private:
@@ -374,6 +377,8 @@ struct Steady
 	Steady retry() const;
 
 private:
+	// till the next probe, grows with every retry
+	int m_delay;
 	token_type m_token;
 	QElapsedTimer m_timer;
 	Nbd::State::Wakeup m_retry;
@@ -858,8 +863,15 @@ struct Frontend: QObject
 
 	PRL_RESULT stop();
 	PRL_RESULT bind(const QString& device_);
+	// Take the device locked by lock()
+	PRL_RESULT adopt(QFile* guard_);
 	PRL_RESULT start(const Script& script_);
 
+	// Open and lock the free device, NULL if it is busy
+	static QFile* lock(const QString& device_);
+	// Same as lock(), but the reason is returned instead of being logged
+	static QFile* tryLock(const QString& device_, QString* error_ = NULL);
+
 	const QString& getDevice() const
 	{
 		return m_device;
@@ -871,6 +883,64 @@ private:
 	QScopedPointer<QFile> m_guard;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// struct Registry
+//
+// Implementation of the Pool. Devices of the running exports stay locked
+// by their frontends and are skipped by the refill.
+
+struct Registry
+{
+	typedef QSharedPointer<Frontend> frontend_type;
+
+	// The devices are read from the driver unless given
+	explicit Registry(const QStringList& devices_ = QStringList());
+	~Registry();
+
+	void setReserve(PRL_UINT32 value_);
+	Pool::Metrics getMetrics() const;
+	void account(qint64 msecs_, bool shared_);
+
+	// Lock a free device for the frontend, from the reserve if possible
+	PRL_RESULT claim(Frontend& target_);
+	// Running read-only export with the same key, if any
+	frontend_type share(const QString& key_);
+	void publish(const QString& key_, const frontend_type& frontend_);
+	// Whether the caller was the last user and should stop the export
+	bool release(const frontend_type& frontend_);
+	// Device of qemu-nbd exporting the image that was not started by us,
+	// empty if none. The devices are scanned on the first use, when they
+	// run out, on demand, or when the last scan is old.
+	QString takeOrphan(const QString& image_);
+	void rescan();
+
+	void refill();
+
+private:
+	struct Share
+	{
+		QWeakPointer<Frontend> frontend;
+		PRL_UINT32 users;
+	};
+
+	QStringList getDevices();
+	void scheduleRefill();
+
+	mutable QMutex m_mutex;
+	PRL_UINT32 m_reserveSize;
+	bool m_refilling;
+	QList<QFile* > m_reserve;
+	QStringList m_devices;
+	QHash<QString, Share> m_shares;
+	// when the orphans were looked for, and whether to look again
+	QElapsedTimer m_scanned;
+	bool m_rescan;
+	// device -> qemu-nbd command line
+	QHash<QString, QByteArray> m_orphans;
+	Pool::Metrics m_metrics;
+	QThreadPool m_threads;
+};
+
 } // namespace Nbd
 } // namespace VirtualDisk
 
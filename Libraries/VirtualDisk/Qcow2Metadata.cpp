@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <prlsdk/PrlErrorsValues.h>
+#include "../Logging/Logging.h"
+
+#include "Qcow2Metadata.h"
+#include "SparseBitmap.h"
+
+namespace VirtualDisk
+{
+namespace Qcow2Metadata
+{
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+
+enum
+{
+	MAGIC = 0x514649fb, // "QFI\xfb"
+	HEADER_V2_LENGTH = 72,
+	HEADER_V3_LENGTH = 104,
+	MIN_CLUSTER_BITS = 9,
+	MAX_CLUSTER_BITS = 21,
+	MAX_BACKING_FILE_SIZE = 1023,
+	// images with longer backing chains are treated as broken
+	MAX_CHAIN_LENGTH = 256,
+	// L2 tables adjacent in the file are read at once up to this size
+	READ_BATCH = 16 * 1024 * 1024,
+};
+
+enum
+{
+	EXT_END = 0,
+	EXT_BACKING_FORMAT = 0xe2792aca,
+};
+
+// incompatible feature bits
+const PRL_UINT64 INCOMPAT_CORRUPT = 1ULL << 1;
+const PRL_UINT64 INCOMPAT_EXTENDED_L2 = 1ULL << 4;
+const PRL_UINT64 INCOMPAT_KNOWN = (1ULL << 5) - 1;
+
+const PRL_UINT64 OFFSET_MASK = 0x00fffffffffffe00ULL;
+const PRL_UINT64 L2_COMPRESSED = 1ULL << 62;
+const PRL_UINT64 L2_ZERO = 1ULL;
+
+enum {SUBCLUSTERS = 32};
+
+PRL_UINT32 be32(const char *data)
+{
+	return qFromBigEndian<quint32>((const uchar *)data);
+}
+
+PRL_UINT64 be64(const char *data)
+{
+	return qFromBigEndian<quint64>((const uchar *)data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Painter
+//
+// Collects neighbour clusters of the same kind into one bitmap update.
+
+struct Painter
+{
+	enum Kind
+	{
+		Unallocated,
+		Data,
+		Zero
+	};
+
+	Painter(CSparseBitmap &bitmap, PRL_UINT64 size):
+		m_bitmap(bitmap), m_size(size), m_kind(Unallocated),
+		m_begin(0), m_end(0)
+	{
+	}
+
+	// offsets are in bytes
+	PRL_RESULT operator()(Kind kind, PRL_UINT64 begin, PRL_UINT64 end)
+	{
+		if (kind == m_kind && begin == m_end)
+		{
+			m_end = end;
+			return PRL_ERR_SUCCESS;
+		}
+
+		PRL_RESULT res = flush();
+		m_kind = kind;
+		m_begin = begin;
+		m_end = end;
+		return res;
+	}
+
+	PRL_RESULT flush()
+	{
+		PRL_UINT64 begin = m_begin / SECTOR_SIZE;
+		PRL_UINT64 end = qMin(m_end, m_size) / SECTOR_SIZE;
+		Kind kind = m_kind;
+		m_kind = Unallocated;
+		if (begin >= end || kind == Unallocated)
+			return PRL_ERR_SUCCESS;
+
+		if (kind == Data)
+			return m_bitmap.SetRange(begin, end);
+
+		// Only blocks zeroed entirely are cleared, the rest may hold data,
+		// the last block is shorter
+		PRL_UINT64 g = m_bitmap.GetGranularity();
+		begin = (begin + g - 1) / g * g;
+		if (end < m_bitmap.GetSize())
+			end = end / g * g;
+		if (begin >= end)
+			return PRL_ERR_SUCCESS;
+		return m_bitmap.ClearRange(begin, end);
+	}
+
+private:
+	CSparseBitmap &m_bitmap;
+	PRL_UINT64 m_size;
+	Kind m_kind;
+	PRL_UINT64 m_begin;
+	PRL_UINT64 m_end;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Table - L2 table to read
+
+struct Table
+{
+	Table(PRL_UINT64 offset_, PRL_UINT64 index_):
+		offset(offset_), index(index_)
+	{
+	}
+
+	bool operator<(const Table &other) const
+	{
+		return offset < other.offset;
+	}
+
+	PRL_UINT64 offset;
+	// index in the L1 table
+	PRL_UINT64 index;
+};
+
+PRL_RESULT paintTable(Painter &painter, const Header &header,
+		const char *table, PRL_UINT64 index)
+{
+	const PRL_UINT64 cluster = header.getClusterSize();
+	const PRL_UINT64 entries = header.getL2Entries();
+	const PRL_UINT64 subcluster = cluster / SUBCLUSTERS;
+	const PRL_UINT64 first = index * entries * cluster;
+
+	for (PRL_UINT64 i = 0; i < entries; ++i)
+	{
+		PRL_UINT64 begin = first + i * cluster;
+		if (begin >= header.size)
+			break;
+
+		PRL_RESULT res;
+		PRL_UINT64 entry;
+		if (!header.isExtendedL2())
+		{
+			entry = be64(table + i * 8);
+			// bit 0 is a part of the compressed cluster descriptor,
+			// and it is reserved in version 2
+			Painter::Kind kind = Painter::Unallocated;
+			if (entry & L2_COMPRESSED)
+				kind = Painter::Data;
+			else if (header.version >= 3 && (entry & L2_ZERO))
+				kind = Painter::Zero;
+			else if (entry & OFFSET_MASK)
+				kind = Painter::Data;
+			if (PRL_FAILED(res = painter(kind, begin, begin + cluster)))
+				return res;
+			continue;
+		}
+
+		entry = be64(table + i * 16);
+		if (entry & L2_COMPRESSED)
+		{
+			// the subcluster bitmap is not used for compressed clusters
+			if (PRL_FAILED(res = painter(Painter::Data, begin, begin + cluster)))
+				return res;
+			continue;
+		}
+
+		PRL_UINT64 bitmap = be64(table + i * 16 + 8);
+		for (PRL_UINT32 j = 0; j < SUBCLUSTERS; ++j)
+		{
+			Painter::Kind kind = Painter::Unallocated;
+			if (bitmap & (1ULL << j))
+				kind = Painter::Data;
+			else if (bitmap & (1ULL << (j + SUBCLUSTERS)))
+				kind = Painter::Zero;
+			PRL_UINT64 b = begin + j * subcluster;
+			if (PRL_FAILED(res = painter(kind, b, b + subcluster)))
+				return res;
+		}
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Header
+
+Header::Header():
+	version(0), clusterBits(0), size(0), l1Size(0), l1Offset(0),
+	refcountOffset(0), refcountClusters(0), refcountOrder(0),
+	incompatible(0), headerLength(0)
+{
+}
+
+bool Header::isExtendedL2() const
+{
+	return incompatible & INCOMPAT_EXTENDED_L2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Image
+
+PRL_RESULT Image::open(const QString &fileName)
+{
+	PRL_RESULT res = m_file.open(fileName, O_RDONLY | O_CLOEXEC);
+	if (PRL_FAILED(res))
+		return res;
+
+	m_fileName = fileName;
+	// works for block devices too
+	off_t size = ::lseek(m_file.getDescriptor(), 0, SEEK_END);
+	if (size < 0)
+	{
+		WRITE_TRACE(DBG_FATAL, "lseek() failed: %m");
+		return PRL_ERR_FILE_READ_ERROR;
+	}
+	m_fileSize = size;
+
+	if (PRL_FAILED(res = readHeader()))
+		return res;
+	return readExtensions();
+}
+
+PRL_RESULT Image::readHeader()
+{
+	char h[HEADER_V3_LENGTH] = {};
+	PRL_RESULT res = m_file.pread(h, HEADER_V2_LENGTH, 0);
+	if (PRL_FAILED(res))
+		return res;
+
+	if (be32(h) != MAGIC)
+	{
+		WRITE_TRACE(DBG_DEBUG, "Not a qcow2 image: '%s'", m_fileName.toUtf8().constData());
+		return PRL_ERR_DISK_FILE_OPEN_ERROR;
+	}
+
+	Header &x = m_header;
+	x.version = be32(h + 4);
+	x.clusterBits = be32(h + 20);
+	x.size = be64(h + 24);
+	x.l1Size = be32(h + 36);
+	x.l1Offset = be64(h + 40);
+	x.refcountOffset = be64(h + 48);
+	x.refcountClusters = be32(h + 56);
+	x.refcountOrder = 4;
+	x.headerLength = HEADER_V2_LENGTH;
+	if (x.version >= 3)
+	{
+		res = m_file.pread(h + HEADER_V2_LENGTH,
+				HEADER_V3_LENGTH - HEADER_V2_LENGTH, HEADER_V2_LENGTH);
+		if (PRL_FAILED(res))
+			return res;
+		x.incompatible = be64(h + 72);
+		x.refcountOrder = be32(h + 96);
+		x.headerLength = be32(h + 100);
+	}
+	if (PRL_FAILED(res = check()))
+		return res;
+
+	PRL_UINT64 backingOffset = be64(h + 8);
+	PRL_UINT32 backingSize = be32(h + 16);
+	if (backingOffset == 0)
+		return PRL_ERR_SUCCESS;
+
+	if (backingSize > MAX_BACKING_FILE_SIZE ||
+		backingOffset + backingSize > x.getClusterSize())
+	{
+		WRITE_TRACE(DBG_FATAL, "Invalid backing file name in '%s'",
+				m_fileName.toUtf8().constData());
+		return PRL_ERR_DISK_FILE_OPEN_ERROR;
+	}
+
+	QByteArray name(backingSize, 0);
+	if (PRL_FAILED(res = m_file.pread(name.data(), backingSize, backingOffset)))
+		return res;
+	x.backingFile = QString::fromUtf8(name);
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Image::readExtensions()
+{
+	// Extensions follow the header up to the end of the first cluster
+	PRL_UINT64 end = qMin(m_header.getClusterSize(), m_fileSize);
+	for (PRL_UINT64 offset = m_header.headerLength; offset + 8 <= end;)
+	{
+		char e[8];
+		PRL_RESULT res = m_file.pread(e, sizeof(e), offset);
+		if (PRL_FAILED(res))
+			return res;
+
+		PRL_UINT32 type = be32(e);
+		PRL_UINT32 length = be32(e + 4);
+		offset += sizeof(e);
+		if (type == EXT_END)
+			break;
+		if (offset + length > end)
+		{
+			WRITE_TRACE(DBG_FATAL, "Invalid header extension in '%s'",
+					m_fileName.toUtf8().constData());
+			return PRL_ERR_DISK_FILE_OPEN_ERROR;
+		}
+
+		if (type == EXT_BACKING_FORMAT)
+		{
+			QByteArray format(length, 0);
+			if (PRL_FAILED(res = m_file.pread(format.data(), length, offset)))
+				return res;
+			m_header.backingFormat = QString::fromUtf8(format);
+		}
+		offset += (length + 7) & ~7ULL;
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT Image::check() const
+{
+	const Header &x = m_header;
+	const char *reason = NULL;
+	if (x.version != 2 && x.version != 3)
+		reason = "unsupported version";
+	else if (x.clusterBits < MIN_CLUSTER_BITS || x.clusterBits > MAX_CLUSTER_BITS)
+		reason = "invalid cluster size";
+	else if (x.headerLength < (x.version == 2 ? HEADER_V2_LENGTH : HEADER_V3_LENGTH) ||
+		x.headerLength > x.getClusterSize())
+		reason = "invalid header length";
+	else if (x.incompatible & ~INCOMPAT_KNOWN)
+		reason = "unknown incompatible features";
+	else if (x.refcountOrder > 6)
+		reason = "invalid refcount width";
+	else if (x.refcountClusters == 0 ||
+		x.refcountOffset % x.getClusterSize() ||
+		x.refcountOffset >= m_fileSize)
+		reason = "invalid refcount table";
+	else if (x.l1Offset % x.getClusterSize() ||
+		(PRL_UINT64)x.l1Size * x.getL2Entries() * x.getClusterSize() < x.size)
+		reason = "invalid L1 table";
+
+	if (reason != NULL)
+	{
+		WRITE_TRACE(DBG_FATAL, "Broken qcow2 image '%s': %s",
+				m_fileName.toUtf8().constData(), reason);
+		return PRL_ERR_DISK_FILE_OPEN_ERROR;
+	}
+
+	if (x.incompatible & INCOMPAT_CORRUPT)
+		WRITE_TRACE(DBG_FATAL, "qcow2 image '%s' is marked corrupt",
+				m_fileName.toUtf8().constData());
+	return PRL_ERR_SUCCESS;
+}
+
+QString Image::getBackingPath() const
+{
+	if (m_header.backingFile.isEmpty())
+		return QString();
+
+	return QFileInfo(m_fileName).dir().absoluteFilePath(m_header.backingFile);
+}
+
+PRL_RESULT Image::apply(CSparseBitmap &bitmap) const
+{
+	const PRL_UINT64 cluster = m_header.getClusterSize();
+	const PRL_UINT64 l1Entries = (m_header.size +
+		m_header.getL2Entries() * cluster - 1) / (m_header.getL2Entries() * cluster);
+
+	std::vector<char> l1(l1Entries * 8);
+	PRL_RESULT res;
+	if (!l1.empty() &&
+		PRL_FAILED(res = m_file.pread(&l1[0], l1.size(), m_header.l1Offset)))
+	{
+		return res;
+	}
+
+	std::vector<Table> tables;
+	for (PRL_UINT64 i = 0; i < l1Entries; ++i)
+	{
+		PRL_UINT64 offset = be64(&l1[i * 8]) & OFFSET_MASK;
+		if (offset != 0)
+			tables.push_back(Table(offset, i));
+	}
+	std::sort(tables.begin(), tables.end());
+
+	Painter painter(bitmap, bitmap.GetSize() * SECTOR_SIZE);
+	std::vector<char> batch;
+	for (size_t first = 0; first < tables.size();)
+	{
+		// Take the tables following each other in the file
+		size_t last = first + 1;
+		while (last < tables.size() &&
+			tables[last].offset == tables[last - 1].offset + cluster &&
+			(last - first + 1) * cluster <= READ_BATCH)
+		{
+			++last;
+		}
+
+		batch.resize((last - first) * cluster);
+		res = m_file.pread(&batch[0], batch.size(), tables[first].offset);
+		if (PRL_FAILED(res))
+		{
+			WRITE_TRACE(DBG_FATAL, "Cannot read L2 tables of '%s'",
+					m_fileName.toUtf8().constData());
+			return res;
+		}
+
+		for (size_t i = first; i < last; ++i)
+		{
+			res = paintTable(painter, m_header,
+					&batch[(i - first) * cluster], tables[i].index);
+			if (PRL_FAILED(res))
+				return res;
+		}
+		first = last;
+	}
+	return painter.flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// free functions
+
+bool isValid(const QString &fileName)
+{
+	return PRL_SUCCEEDED(Image().open(fileName));
+}
+
+CSparseBitmap *getUsedBlocksBitmap(const QString &fileName,
+		UINT32 granularity, PRL_RESULT &err)
+{
+	// Walk the chain down to the base image or to the first non-qcow2 file
+	QList<QSharedPointer<Image> > chain;
+	bool foreign = false;
+	for (QString name = fileName; !name.isEmpty();)
+	{
+		if (chain.size() == MAX_CHAIN_LENGTH)
+		{
+			WRITE_TRACE(DBG_FATAL, "Backing chain of '%s' is too long",
+					fileName.toUtf8().constData());
+			err = PRL_ERR_DISK_FILE_OPEN_ERROR;
+			return NULL;
+		}
+
+		QSharedPointer<Image> image(new Image());
+		if (chain.isEmpty())
+		{
+			if (PRL_FAILED(err = image->open(name)))
+				return NULL;
+		}
+		else
+		{
+			// Unknown data of a missing backing file must not be
+			// reported as used or as unused
+			if (!QFileInfo(name).isReadable())
+			{
+				WRITE_TRACE(DBG_FATAL, "Backing file '%s' of '%s' is not readable",
+						name.toUtf8().constData(),
+						fileName.toUtf8().constData());
+				err = PRL_ERR_DISK_FILE_OPEN_ERROR;
+				return NULL;
+			}
+
+			const QString &format = chain.last()->getHeader().backingFormat;
+			foreign = !format.isEmpty() && format != "qcow2";
+			if (foreign)
+				break;
+			if (PRL_FAILED(err = image->open(name)))
+			{
+				// Format is not recorded, so the backing file can be raw
+				foreign = format.isEmpty();
+				if (!foreign)
+					return NULL;
+				break;
+			}
+		}
+
+		chain << image;
+		name = image->getBackingPath();
+	}
+
+	PRL_UINT64 size = chain.first()->getHeader().size / SECTOR_SIZE;
+	QScopedPointer<CSparseBitmap> bitmap(
+			CSparseBitmap::Create(size, granularity, err));
+	if (bitmap.isNull())
+		return NULL;
+
+	if (foreign && PRL_FAILED(err = bitmap->SetAll()))
+		return NULL;
+
+	// Upper layers override the lower ones
+	for (int i = chain.size() - 1; i >= 0; --i)
+	{
+		if (PRL_FAILED(err = chain.at(i)->apply(*bitmap)))
+			return NULL;
+	}
+
+	err = PRL_ERR_SUCCESS;
+	return bitmap.take();
+}
+
+} // namespace Qcow2Metadata
+} // namespace VirtualDisk
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+#ifndef __VIRTUAL_DISK_QCOW2_METADATA__
+#define __VIRTUAL_DISK_QCOW2_METADATA__
+
+#include <QString>
+#include <boost/noncopyable.hpp>
+#include <prlsdk/PrlTypes.h>
+#include "Util.h"
+
+class CSparseBitmap;
+
+namespace VirtualDisk
+{
+namespace Qcow2Metadata
+{
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Header
+
+struct Header
+{
+	Header();
+
+	PRL_UINT64 getClusterSize() const
+	{
+		return 1ULL << clusterBits;
+	}
+
+	// number of entries in one L2 table
+	PRL_UINT64 getL2Entries() const
+	{
+		return getClusterSize() / (isExtendedL2() ? 16 : 8);
+	}
+
+	bool isExtendedL2() const;
+
+	PRL_UINT32 version;
+	PRL_UINT32 clusterBits;
+	// virtual size in bytes
+	PRL_UINT64 size;
+	PRL_UINT32 l1Size;
+	PRL_UINT64 l1Offset;
+	PRL_UINT64 refcountOffset;
+	PRL_UINT32 refcountClusters;
+	PRL_UINT32 refcountOrder;
+	PRL_UINT64 incompatible;
+	PRL_UINT32 headerLength;
+	QString backingFile;
+	QString backingFormat;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Image
+//
+// Read-only view of the qcow2 metadata, does not require qemu. The image may
+// be in use by qemu-nbd, then the state is as of its last flush.
+
+struct Image : boost::noncopyable
+{
+	// Fails unless the header describes a supported qcow2 image
+	PRL_RESULT open(const QString &fileName);
+
+	const Header &getHeader() const
+	{
+		return m_header;
+	}
+
+	// Backing file name resolved against the directory of the image,
+	// empty if there is no backing file
+	QString getBackingPath() const;
+
+	// Mark the sectors of the bitmap covered by this layer: data is set,
+	// zero clusters are cleared, unallocated ones are left as is.
+	// L2 tables are read in the order of their host offsets.
+	PRL_RESULT apply(CSparseBitmap &bitmap) const;
+
+private:
+	PRL_RESULT readHeader();
+	PRL_RESULT readExtensions();
+	PRL_RESULT check() const;
+
+	QString m_fileName;
+	PRL_UINT64 m_fileSize;
+	IO::File m_file;
+	Header m_header;
+};
+
+bool isValid(const QString &fileName);
+
+// Sectors holding data in the image or its backing chain, granularity is
+// in sectors. Data of backing files other than qcow2 is counted as used,
+// a missing backing file is an error.
+CSparseBitmap *getUsedBlocksBitmap(const QString &fileName,
+		UINT32 granularity, PRL_RESULT &err);
+
+} // namespace Qcow2Metadata
+} // namespace VirtualDisk
+
+#endif // __VIRTUAL_DISK_QCOW2_METADATA__
@@ -20,14 +20,235 @@
  * Schaffhausen, Switzerland.
  */
 
+#include <algorithm>
+#include <QIODevice>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QtEndian>
+#include <QVector>
 #include <prlsdk/PrlErrorsValues.h>
 #include <prlsdk/PrlErrors.h>
 #include "Libraries/Std/BitOps.h"
 #include "Libraries/PrlUuid/Uuid.h"
-#include "Libraries/Std/sparse_bitmap.h"
+#include "Libraries/Std/sparse_bitmap64.h"
 #include "SparseBitmap.h"
 #include <errno.h>
 
+namespace
+{
+
+enum
+{
+	// fewer parts are handled by the calling thread
+	PARALLEL_PARTS_MIN = 4,
+	// bitmap bytes per step of the unaligned GetRange
+	READ_BLOCK = 4096,
+	STREAM_TIMEOUT = 30 * 1000,
+	STREAM_MAGIC = 0x4d425053, // "SPBM"
+	STREAM_VERSION = 1,
+	STREAM_HEADER = 36
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Part - piece of a range inside one part of sp_bitmap64, the pieces
+// are processed independently by the worker threads
+
+struct Part
+{
+	UINT64 begin;
+	UINT64 end;
+	int result;
+};
+
+QVector<Part> split(UINT64 begin, UINT64 end)
+{
+	QVector<Part> res;
+
+	while (begin < end) {
+		Part p;
+		p.begin = begin;
+		p.end = qMin(end, (begin & ~(SP_BITMAP64_PART_BITS - 1)) + SP_BITMAP64_PART_BITS);
+		p.result = 0;
+		res.append(p);
+		begin = p.end;
+	}
+	return res;
+}
+
+template<class T>
+int process(QVector<Part> &parts, const T &job)
+{
+	if (parts.size() < PARALLEL_PARTS_MIN || QThreadPool::globalInstance()->maxThreadCount() < 2)
+		std::for_each(parts.begin(), parts.end(), job);
+	else
+		QtConcurrent::blockingMap(parts, job);
+
+	foreach (const Part &p, parts) {
+		if (p.result != 0)
+			return p.result;
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Merge
+
+struct Merge
+{
+	typedef void result_type;
+
+	Merge(sp_bitmap64 *dest, const sp_bitmap64 *src): m_dest(dest), m_src(src)
+	{
+	}
+
+	void operator()(Part &part) const
+	{
+		part.result = sp_bitmap64_merge_range(m_dest, m_src, part.end, part.begin);
+	}
+
+private:
+	sp_bitmap64 *m_dest;
+	const sp_bitmap64 *m_src;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Write - buf holds bits from base on
+
+struct Write
+{
+	typedef void result_type;
+
+	Write(sp_bitmap64 *bitmap, const UINT8 *buf, UINT64 base):
+		m_bitmap(bitmap), m_buf(buf), m_base(base)
+	{
+	}
+
+	void operator()(Part &part) const
+	{
+		part.result = sp_bitmap64_write_aligned_range(m_bitmap,
+				m_buf + ((part.begin - m_base) >> 3), part.end, part.begin);
+	}
+
+private:
+	sp_bitmap64 *m_bitmap;
+	const UINT8 *m_buf;
+	UINT64 m_base;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Read - buf receives bits from base on
+
+struct Read
+{
+	typedef void result_type;
+
+	Read(const sp_bitmap64 *bitmap, UINT8 *buf, UINT64 base):
+		m_bitmap(bitmap), m_buf(buf), m_base(base)
+	{
+	}
+
+	void operator()(Part &part) const
+	{
+		part.result = sp_bitmap64_read_aligned_range(m_bitmap,
+				m_buf + ((part.begin - m_base) >> 3), part.end, part.begin);
+	}
+
+private:
+	const sp_bitmap64 *m_bitmap;
+	UINT8 *m_buf;
+	UINT64 m_base;
+};
+
+// Next bit of the value at from or later in the plain bitmap of size bits,
+// size if there is none
+UINT64 findNext(const UINT8 *buf, UINT64 size, UINT64 from, bool value)
+{
+	UINT64 bytes = (size + 7) >> 3;
+
+	while (from < size) {
+		UINT64 i = from >> 3, w = 0;
+		size_t n = (size_t)qMin<UINT64>(sizeof(w), bytes - i);
+
+		memcpy(&w, buf + i, n);
+		if (!value)
+			w = ~w;
+
+		w &= BIT_ALL_SET64 << (from & 7);
+		if (w != 0)
+			return qMin(size, (i << 3) + BitFindLowestSet64(w));
+
+		from = (i + n) << 3;
+	}
+	return size;
+}
+
+// OR count bits of the bitmap from first on into buf from bit 0 on
+int readBits(const sp_bitmap64 *bitmap, UINT8 *buf, UINT64 first, UINT64 count)
+{
+	UINT8 tmp[READ_BLOCK + 1];
+	UINT64 size = sp_bitmap64_size(bitmap);
+	UINT32 shift = first & 7;
+
+	for (UINT64 done = 0; done < count; done += READ_BLOCK * 8) {
+		UINT64 n = qMin<UINT64>(count - done, READ_BLOCK * 8);
+		UINT64 lo = (first + done) & ~7ull;
+		UINT64 hi = lo + ((shift + n + 7) & ~7ull);
+		UINT64 aligned = qMin(hi, size & ~7ull);
+		UINT8 *out = buf + (done >> 3);
+
+		memset(tmp, 0, sizeof(tmp));
+		if (lo < aligned) {
+			int ret = sp_bitmap64_read_aligned_range(bitmap, tmp, aligned, lo);
+			if (ret != 0)
+				return ret;
+		}
+		for (UINT64 bit = qMax(lo, aligned); bit < qMin(hi, size); ++bit) {
+			if (sp_bitmap64_is_set(bitmap, bit) > 0)
+				tmp[(bit - lo) >> 3] |= 1 << ((bit - lo) & 7);
+		}
+
+		UINT64 bytes = (n + 7) >> 3;
+		for (UINT64 i = 0; i < bytes; ++i) {
+			UINT8 v = tmp[i] >> shift;
+
+			if (shift)
+				v |= tmp[i + 1] << (8 - shift);
+			if (i == bytes - 1 && (n & 7))
+				v &= (1 << (n & 7)) - 1;
+			out[i] |= v;
+		}
+	}
+	return 0;
+}
+
+int writeStream(void *ctx, const void *buf, UINT32 size)
+{
+	QIODevice *dev = static_cast<QIODevice *>(ctx);
+
+	if (dev->write(static_cast<const char *>(buf), size) != (qint64)size)
+		return -EIO;
+	return 0;
+}
+
+int readStream(void *ctx, void *buf, UINT32 size)
+{
+	QIODevice *dev = static_cast<QIODevice *>(ctx);
+	char *p = static_cast<char *>(buf);
+
+	while (size > 0) {
+		qint64 n = dev->read(p, size);
+
+		if (n < 0 || (n == 0 && !dev->waitForReadyRead(STREAM_TIMEOUT)))
+			return -EIO;
+
+		p += n;
+		size -= (UINT32)n;
+	}
+	return 0;
+}
+
+} // namespace
+
 
 CSparseBitmap::CSparseBitmap() :  m_Uid(new Uuid)
 {
@@ -36,7 +257,7 @@ CSparseBitmap::CSparseBitmap() :  m_Uid(new Uuid)
 /* Constructors and assignment are private, use static Create instead */
 CSparseBitmap::~CSparseBitmap()
 {
-	sp_bitmap_destroy(m_Bitmap);
+	sp_bitmap64_destroy(m_Bitmap);
 }
 
 CSparseBitmap *CSparseBitmap::Create(UINT64 size, UINT32 granularity,
@@ -103,47 +324,53 @@ UINT64 CSparseBitmap::GetSize() const
 
 PRL_RESULT CSparseBitmap::SetAll()
 {
-	return ToPrlResult(sp_bitmap_set_all(m_Bitmap));
+	return ToPrlResult(sp_bitmap64_set_all(m_Bitmap));
 }
 
 PRL_RESULT CSparseBitmap::SetRange(UINT64 begin, UINT64 end)
 {
-	return ToPrlResult(sp_bitmap_set_range(m_Bitmap, End(end), Begin(begin)));
+	return ToPrlResult(sp_bitmap64_set_range(m_Bitmap, End(end), Begin(begin)));
 }
 
 PRL_RESULT CSparseBitmap::ClearRange(UINT64 begin, UINT64 end)
 {
-	return ToPrlResult(sp_bitmap_clear_range(m_Bitmap, End(end), Begin(begin)));
+	return ToPrlResult(sp_bitmap64_clear_range(m_Bitmap, End(end), Begin(begin)));
 }
 
 PRL_RESULT CSparseBitmap::ClearAll()
 {
-	return ToPrlResult(sp_bitmap_clear_all(m_Bitmap));
+	return ToPrlResult(sp_bitmap64_clear_all(m_Bitmap));
 }
 
 PRL_RESULT CSparseBitmap::SetBit(UINT64 pos)
 {
-	return ToPrlResult(sp_bitmap_set(m_Bitmap, Begin(pos)));
+	return ToPrlResult(sp_bitmap64_set(m_Bitmap, Begin(pos)));
 }
 
 bool CSparseBitmap::IsSet(UINT64 pos) const
 {
-	return sp_bitmap_is_set(m_Bitmap, Begin(pos)) > 0;
+	return sp_bitmap64_is_set(m_Bitmap, Begin(pos)) > 0;
 }
 
 bool CSparseBitmap::IsSetRange(UINT64 begin, UINT64 end) const
 {
-	return sp_bitmap_is_set_range(m_Bitmap, End(end), Begin(begin)) > 0;
+	return sp_bitmap64_is_set_range(m_Bitmap, End(end), Begin(begin)) > 0;
 }
 
 bool CSparseBitmap::IsClearRange(UINT64 begin, UINT64 end) const
 {
-	return sp_bitmap_is_clear_range(m_Bitmap, End(end), Begin(begin)) > 0;
+	return sp_bitmap64_is_clear_range(m_Bitmap, End(end), Begin(begin)) > 0;
 }
 
 PRL_RESULT CSparseBitmap::Merge(const CSparseBitmap &bitmap, bool use_new_uid)
 {
-	PRL_RESULT res = ToPrlResult(sp_bitmap_merge(m_Bitmap, bitmap.m_Bitmap));
+	UINT64 size = sp_bitmap64_size(m_Bitmap);
+
+	if (size != sp_bitmap64_size(bitmap.m_Bitmap))
+		return PRL_ERR_INVALID_ARG;
+
+	QVector<Part> parts = split(0, size);
+	PRL_RESULT res = ToPrlResult(process(parts, ::Merge(m_Bitmap, bitmap.m_Bitmap)));
 	if (PRL_FAILED(res))
 		return res;
 
@@ -157,8 +384,7 @@ PRL_RESULT CSparseBitmap::Merge(const CSparseBitmap &bitmap, bool use_new_uid)
  * storages to global cdisk bitmap.
  * In normal case, when granularity == this.GetGranularity() and block_size
  * mod (granularity * 8) == 0, the fast way would be used with memcpy'ing
- * internal bitmap data. Else, there would be slow MERGING of each set bit
- * from source */
+ * internal bitmap data. Else, runs of set bits from source are MERGED */
 PRL_RESULT CSparseBitmap::AssignRange(UINT8 *buf, UINT32 granularity,
 		UINT64 begin, UINT64 end)
 {
@@ -167,12 +393,28 @@ PRL_RESULT CSparseBitmap::AssignRange(UINT8 *buf, UINT32 granularity,
 
 	if (((begin | end) & (GetGranularity() * 8 - 1)) == 0) {
 		// Normal way
-		return ToPrlResult(sp_bitmap_write_aligned_range(m_Bitmap, buf, End(end), Begin(begin)));
+		UINT64 first = Begin(begin), last = End(end);
+
+		if (first >= sp_bitmap64_size(m_Bitmap) || last > sp_bitmap64_size(m_Bitmap))
+			return PRL_ERR_INVALID_ARG;
+
+		QVector<Part> parts = split(first, last);
+		return ToPrlResult(process(parts, Write(m_Bitmap, buf, first)));
 	}
 
-	for (UINT64 bit = begin; bit < end; bit += granularity) {
-		if (BMAP_GET(buf, (bit - begin) / granularity))
-			SetRange(bit, bit + granularity);
+	if (begin >= end || begin >= m_Size)
+		return PRL_ERR_SUCCESS;
+
+	UINT64 count = (qMin(end, m_Size) - begin + granularity - 1) >> m_GranularityBits;
+	for (UINT64 i = findNext(buf, count, 0, true); i < count;) {
+		UINT64 j = findNext(buf, count, i, false);
+		PRL_RESULT res = SetRange(begin + (i << m_GranularityBits),
+				qMin(begin + (j << m_GranularityBits), m_Size));
+
+		if (PRL_FAILED(res))
+			return res;
+
+		i = findNext(buf, count, j, true);
 	}
 
 	return PRL_ERR_SUCCESS;
@@ -186,17 +428,21 @@ PRL_RESULT CSparseBitmap::GetRange(UINT8 *buf, UINT32 granularity,
 
 	if (((begin | end) & (GetGranularity() * 8 - 1)) == 0) {
 		// Normal way
-		return ToPrlResult(sp_bitmap_read_aligned_range(m_Bitmap, buf, End(end), Begin(begin)));
-	}
+		UINT64 first = Begin(begin), last = End(end);
 
-	for (UINT64 bit = begin; bit < end; bit += granularity) {
-		if (IsSet(bit)) {
-			BMAP_SET(buf, (bit - begin) / granularity);
-			BMAP_SET(buf, (bit + granularity - 1 - begin) / granularity);
-		}
+		if (first >= sp_bitmap64_size(m_Bitmap) || last > sp_bitmap64_size(m_Bitmap))
+			return PRL_ERR_INVALID_ARG;
+
+		QVector<Part> parts = split(first, last);
+		return ToPrlResult(process(parts, Read(m_Bitmap, buf, first)));
 	}
 
-	return PRL_ERR_SUCCESS;
+	UINT64 first = Begin(begin), size = sp_bitmap64_size(m_Bitmap);
+	if (begin >= end || first >= size)
+		return PRL_ERR_SUCCESS;
+
+	UINT64 count = (end - begin + granularity - 1) >> m_GranularityBits;
+	return ToPrlResult(readBits(m_Bitmap, buf, first, qMin(count, size - first)));
 }
 
 bool CSparseBitmap::IsValid() const
@@ -215,6 +461,96 @@ void CSparseBitmap::PartComplete()
 		m_WaitParts--;
 }
 
+PRL_RESULT CSparseBitmap::Save(QIODevice &dev) const
+{
+	UINT8 hdr[STREAM_HEADER];
+	Uuid_t uid;
+
+	m_Uid->dump(uid);
+	qToLittleEndian<quint32>(STREAM_MAGIC, hdr);
+	qToLittleEndian<quint32>(STREAM_VERSION, hdr + 4);
+	qToLittleEndian<quint64>(m_Size, hdr + 8);
+	qToLittleEndian<quint32>(GetGranularity(), hdr + 16);
+	memcpy(hdr + 20, uid, sizeof(uid));
+
+	int ret = writeStream(&dev, hdr, sizeof(hdr));
+	if (ret == 0)
+		ret = sp_bitmap64_save(m_Bitmap, &writeStream, &dev);
+
+	return ret == -EIO ? PRL_ERR_FILE_WRITE_ERROR : ToPrlResult(ret);
+}
+
+CSparseBitmap *CSparseBitmap::Load(QIODevice &dev, PRL_RESULT &err)
+{
+	UINT64 size;
+	UINT32 granularity;
+	Uuid uid;
+
+	err = ReadHeader(dev, size, granularity, uid);
+	if (PRL_FAILED(err))
+		return NULL;
+
+	QScopedPointer<CSparseBitmap> res(Create(size, granularity, uid, err));
+	if (res.isNull())
+		return NULL;
+
+	err = res->MergeBody(dev);
+	if (PRL_FAILED(err))
+		return NULL;
+
+	return res.take();
+}
+
+PRL_RESULT CSparseBitmap::MergeFrom(QIODevice &dev, bool use_new_uid)
+{
+	UINT64 size;
+	UINT32 granularity;
+	Uuid uid;
+
+	PRL_RESULT res = ReadHeader(dev, size, granularity, uid);
+	if (PRL_FAILED(res))
+		return res;
+
+	if (size != m_Size || granularity != GetGranularity())
+		return PRL_ERR_INVALID_ARG;
+
+	res = MergeBody(dev);
+	if (PRL_FAILED(res))
+		return res;
+
+	if (use_new_uid)
+		SetUid(uid);
+
+	return PRL_ERR_SUCCESS;
+}
+
+PRL_RESULT CSparseBitmap::MergeBody(QIODevice &dev)
+{
+	int ret = sp_bitmap64_load(m_Bitmap, &readStream, &dev);
+
+	return ret == -EIO ? PRL_ERR_FILE_READ_ERROR : ToPrlResult(ret);
+}
+
+PRL_RESULT CSparseBitmap::ReadHeader(QIODevice &dev, UINT64 &size,
+		UINT32 &granularity, Uuid &uid)
+{
+	UINT8 hdr[STREAM_HEADER];
+	Uuid_t u;
+
+	if (readStream(&dev, hdr, sizeof(hdr)) != 0)
+		return PRL_ERR_FILE_READ_ERROR;
+
+	if (qFromLittleEndian<quint32>(hdr) != STREAM_MAGIC ||
+			qFromLittleEndian<quint32>(hdr + 4) != STREAM_VERSION)
+		return PRL_ERR_INVALID_ARG;
+
+	size = qFromLittleEndian<quint64>(hdr + 8);
+	granularity = qFromLittleEndian<quint32>(hdr + 16);
+	memcpy(u, hdr + 20, sizeof(u));
+	uid = Uuid::toUuid(u);
+	return PRL_ERR_SUCCESS;
+}
+
 PRL_RESULT CSparseBitmap::Init(UINT64 size, UINT32 granularity,
 		const Uuid &uid, UINT32 waitParts)
 {
@@ -225,7 +561,7 @@ PRL_RESULT CSparseBitmap::Init(UINT64 size, UINT32 granularity,
 	m_Size = size;
 	m_Uid.reset(new Uuid(uid));
 	m_WaitParts = waitParts;
-	m_Bitmap = sp_bitmap_create((m_Size + granularity - 1) >> m_GranularityBits);
+	m_Bitmap = sp_bitmap64_create((m_Size + granularity - 1) >> m_GranularityBits);
 
 	if (m_Bitmap == NULL)
 		return PRL_ERR_OUT_OF_MEMORY;
@@ -25,8 +25,9 @@
 #include <QScopedPointer>
 #include <prlsdk/PrlTypes.h>
 
+class QIODevice;
 class Uuid;
-struct sp_bitmap;
+struct sp_bitmap64;
 class CSparseBitmap {
 public:
 	/* Constructors and assignment are private, use static Create instead */
@@ -59,25 +60,34 @@ public:
 	 * storages to global cdisk bitmap.
 	 * In normal case, when granularity == this.GetGranularity() and block_size
 	 * mod (granularity * 8) == 0, the fast way would be used with memcpy'ing
-	 * internal bitmap data. Else, there would be slow MERGING of each set bit
-	 * from source */
+	 * internal bitmap data. Else, runs of set bits from source are MERGED.
+	 * Large ranges and merges are split between the global thread pool */
 	PRL_RESULT AssignRange(UINT8 *buf, UINT32 granularity, UINT64 begin, UINT64 end);
 	PRL_RESULT GetRange(UINT8 *buf, UINT32 granularity, UINT64 begin, UINT64 end) const;
 	bool IsValid() const;
 	bool IsLoading() const;
 	void PartComplete();
 
+	/* Stream the bitmap with its size, granularity and uid. Empty and full
+	 * ranges take a few bytes, so it is cheap to ship between nodes.
+	 * MergeFrom ORs the stream of the bitmap of the same geometry */
+	PRL_RESULT Save(QIODevice &dev) const;
+	static CSparseBitmap *Load(QIODevice &dev, PRL_RESULT &err);
+	PRL_RESULT MergeFrom(QIODevice &dev, bool use_new_uid);
+
 private:
 	CSparseBitmap();
 	CSparseBitmap(const CSparseBitmap &);
 	CSparseBitmap & operator=(const CSparseBitmap &);
 
 	PRL_RESULT Init(UINT64 size, UINT32 granularity, const Uuid &uid, UINT32 waitParts);
+	static PRL_RESULT ReadHeader(QIODevice &dev, UINT64 &size, UINT32 &granularity, Uuid &uid);
+	PRL_RESULT MergeBody(QIODevice &dev);
 	static PRL_RESULT ToPrlResult(int ret);
 	UINT64 End(UINT64 end) const;
 	UINT64 Begin(UINT64 begin) const;
 private:
-	sp_bitmap *m_Bitmap;
+	sp_bitmap64 *m_Bitmap;
 	UINT32 m_GranularityBits;
 	UINT64 m_Size;
 	QScopedPointer<Uuid> m_Uid;
@@ -124,6 +124,20 @@ PRL_RESULT File::pwrite(const void *data, PRL_UINT64 size, PRL_UINT64 offset) co
 	return PRL_ERR_SUCCESS;
 }
 
+PRL_RESULT File::flush() const
+{
+	if (m_fd < 0)
+		return PRL_ERR_DISK_DISK_NOT_OPENED;
+
+	if (::fsync(m_fd))
+	{
+		WRITE_TRACE(DBG_FATAL, "fsync() failed: %m");
+		return PRL_ERR_FILE_WRITE_ERROR;
+	}
+
+	return PRL_ERR_SUCCESS;
+}
+
 PRL_RESULT File::ioctl(int request, void *data) const
 {
 	if (::ioctl(m_fd, request, data))
@@ -59,9 +59,15 @@ struct File
 	// size and offset are in BYTES
 	PRL_RESULT pread(void *data, PRL_UINT64 size, PRL_UINT64 offset) const;
 	PRL_RESULT pwrite(const void *data, PRL_UINT64 size, PRL_UINT64 offset) const;
+	PRL_RESULT flush() const;
 	PRL_RESULT ioctl(int request, void *data) const;
 	PRL_RESULT close();
 
+	int getDescriptor() const
+	{
+		return m_fd;
+	}
+
 private:
 	File(const File &other);
 
@@ -36,6 +36,11 @@
 class CSparseBitmap;
 namespace VirtualDisk
 {
+namespace Async
+{
+struct Queue;
+} // namespace Async
+
 namespace Parameters
 {
 
@@ -263,6 +268,10 @@ struct Format : boost::noncopyable
 	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32 granularity,
 			PRL_RESULT &err) = 0;
 	virtual CSparseBitmap *getTrackingBitmap(const QString &uuid) = 0;
+	// Queue of asynchronous requests to the opened image, owned by
+	// the caller and to be destroyed before close(). NULL on failure.
+	// By default requests are served by read()/write() on a thread.
+	virtual Async::Queue *createQueue(PRL_UINT32 depth);
 
 protected:
 	static flags_type convertFlags(PRL_DISK_OPEN_FLAGS flags);
@@ -23,6 +23,6 @@
 
 LIBTARGET = VirtualDisk
 PROJ_FILE = $$PWD/VirtualDisk.pro
-QTCONFIG = core xml
+QTCONFIG = core xml concurrent
 
 include(../../Build/qmake/staticlib.pri)
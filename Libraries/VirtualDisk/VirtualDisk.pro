@@ -33,15 +33,21 @@ HEADERS = PloopDisk.h \
           Util.h \
           Qcow2Disk.h \
           Qcow2Disk_p.h \
+          Qcow2Metadata.h \
           SparseBitmap.h \
-          NbdDisk.h
+          NbdDisk.h \
+          BufferedDisk.h \
+          AsyncDisk.h
 
 SOURCES = PloopDisk.cpp \
           VirtualDisk.cpp \
           Util.cpp \
           Qcow2Disk.cpp \
+          Qcow2Metadata.cpp \
 	  SparseBitmap.cpp \
-          NbdDisk.cpp
+          NbdDisk.cpp \
+          BufferedDisk.cpp \
+          AsyncDisk.cpp
 
 headers.files = $${HEADERS}
 headers.path = $${PREFIX}/include/prlcommon/VirtualDisk
@@ -28,10 +28,11 @@ TEMPLATE = subdirs
 include(Build/Options.pri)
 include(common.pri)
 
-SUBDIRS = main test-utils
+SUBDIRS = main test-utils log-decoder
 
 main.subdir = Libraries
 test-utils.subdir = TestsUtils
+log-decoder.subdir = Utils/LogDecoder
 
 test-utils.depends = main
 
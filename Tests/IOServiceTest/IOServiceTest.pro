@@ -13,3 +13,5 @@ include(protocoltest/protocoltest.deps)
 include(routingtabletest/routingtabletest.deps)
 #include(tcpcontrolblockstattest/tcpcontrolblockstattest.deps)
 include(ssltest/ssltest.deps)
+unix:include(reactortest/reactortest.deps)
+unix:include(ktlstest/ktlstest.deps)
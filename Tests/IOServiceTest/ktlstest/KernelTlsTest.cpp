@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo Core. Virtuozzo Core is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation;
+ * either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <QCoreApplication>
+#include <QtTest>
+
+#include "IOClient.h"
+#include "IORoutingTableHelper.h"
+#include "IOServer.h"
+#include "IOSSLInterface.h"
+#include "Socket/KernelTls_p.h"
+#include "Libraries/Logging/Logging.h"
+#include "Libraries/Std/AtomicOps.h"
+
+#include <unistd.h>
+#define sleepMsecs(msecs) usleep(msecs * 1000)
+
+using namespace IOService;
+
+/*****************************************************************************/
+
+static const quint32 RemotePortNumber = 5557;
+static const quint32 MinSleep = 10;
+static const quint32 WaitIterations = 60000 / MinSleep; //1 min
+static const quint32 TestPackage = 100;
+
+// Sizes of the benchmark, can be overridden from environment
+static quint32 envValue ( const char* name, quint32 defValue )
+{
+    bool ok = false;
+    quint32 val = qgetenv(name).toUInt(&ok);
+    return ok ? val : defValue;
+}
+
+/*****************************************************************************/
+
+class KernelTlsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    KernelTlsTest () : m_received(0), m_corrupted(0) {}
+
+private slots:
+    void sendPackagesToServer ();
+    void sendPackagesWithCredentials ();
+    void benchmarkThroughput ();
+
+public slots:
+    void onPackageToServer ( IOServerInterface*, IOSender::Handle,
+                             const SmartPtr<IOPackage> );
+
+private:
+    // Sends packages over SSL route, returns throughput in MB/sec
+    // and whether connection was offloaded to the kernel.
+    // Connection is anonymous if credentials are not valid.
+    bool runTransfer ( bool kernelTls, quint32 packageSize,
+                       quint32 packages, quint64& mbPerSec,
+                       bool& offloaded,
+                       const IOCredentials& credentials = IOCredentials() );
+
+private:
+    int m_received;
+    int m_corrupted;
+    QByteArray m_data;
+};
+
+/*****************************************************************************/
+
+void KernelTlsTest::onPackageToServer ( IOServerInterface*, IOSender::Handle,
+                                        const SmartPtr<IOPackage> p )
+{
+    if ( p->header.type != TestPackage )
+        return;
+    if ( IODATAMEMBERCONST(p)[0].bufferSize != (quint32)m_data.size() ||
+         ::memcmp(p->buffers[0].getImpl(), m_data.constData(),
+                  m_data.size()) != 0 )
+        AtomicInc( &m_corrupted );
+    AtomicInc( &m_received );
+}
+
+bool KernelTlsTest::runTransfer ( bool kernelTls, quint32 packageSize,
+                                  quint32 packages, quint64& mbPerSec,
+                                  bool& offloaded,
+                                  const IOCredentials& credentials )
+{
+    bool res = false;
+    IOClient* client = 0;
+    SmartPtr<IOPackage> p;
+    IOService::TimeMark startMark = 0, endMark = 0;
+
+    offloaded = false;
+    AtomicWrite( &m_received, 0 );
+    AtomicWrite( &m_corrupted, 0 );
+    m_data.resize( packageSize );
+    for ( quint32 i = 0; i < packageSize; ++i )
+        m_data[i] = (char)(i * 7);
+
+    // SSL route for every package type
+    IOServer* server = new IOServer(
+                 IORoutingTableHelper::GetServerRoutingTable(PSL_HIGH_SECURITY),
+                 IOSender::Dispatcher, IOService::LoopbackAddr,
+                 RemotePortNumber, false, credentials );
+    server->setKernelTls( kernelTls );
+    QObject::connect( server,
+                     SIGNAL(onPackageReceived(IOServerInterface*,
+                                              IOSender::Handle,
+                                              const SmartPtr<IOPackage>)),
+                     SLOT(onPackageToServer(IOServerInterface*,
+                                            IOSender::Handle,
+                                            const SmartPtr<IOPackage>)),
+                     Qt::DirectConnection );
+    if ( server->listen() != IOSender::Connected )
+        goto cleanup;
+
+    client = new IOClient(
+                IORoutingTableHelper::GetClientRoutingTable(PSL_HIGH_SECURITY),
+                IOSender::Vm, IOService::LoopbackAddr, RemotePortNumber,
+                false, credentials );
+    client->setKernelTls( kernelTls );
+    client->connectClient();
+    if ( client->waitForConnection() != IOSender::Connected )
+        goto cleanup;
+    offloaded = client->kernelTlsActive();
+
+    p = IOPackage::createInstance( TestPackage, 1 );
+    p->fillBuffer( 0, IOPackage::RawEncoding, m_data.data(), m_data.size() );
+
+    IOService::timeMark(startMark);
+    for ( quint32 n = 0; n < packages; ++n ) {
+        IOSendJob::Handle job = client->sendPackage( p );
+        while ( client->getSendResult(job) == IOSendJob::SendQueueIsFull ) {
+            sleepMsecs(1);
+            job = client->sendPackage( p );
+        }
+    }
+    for ( quint32 i = 0; i < WaitIterations &&
+              AtomicRead(&m_received) < (int)packages; ++i )
+        sleepMsecs(MinSleep);
+    if ( AtomicRead(&m_received) < (int)packages )
+        goto cleanup;
+    IOService::timeMark(endMark);
+
+    mbPerSec = (quint64)packageSize * packages * 1000 / (1024 * 1024) /
+        qMax(IOService::msecsDiffTimeMark(startMark, endMark), 1u);
+    res = (AtomicRead(&m_corrupted) == 0);
+
+cleanup:
+    delete client;
+    delete server;
+    return res;
+}
+
+/*****************************************************************************/
+
+void KernelTlsTest::sendPackagesToServer ()
+{
+    // Packages must be delivered whether kernel offloads TLS or not.
+    // Anonymous DH suites exist in TLS 1.2 only.
+    const bool supported =
+        ( KernelTls::supportedCiphers(TLS1_2_VERSION) != KernelTls::NoCipher );
+    quint64 mbPerSec = 0;
+    bool offloaded = false;
+
+    QVERIFY( runTransfer(false, 1 << 16, 100, mbPerSec, offloaded) );
+    QVERIFY( ! offloaded );
+
+    QVERIFY( runTransfer(true, 1 << 16, 100, mbPerSec, offloaded) );
+    QCOMPARE( offloaded, supported );
+    if ( ! supported )
+        QSKIP("Kernel TLS is not supported, only fallback is checked", SkipAll);
+}
+
+void KernelTlsTest::sendPackagesWithCredentials ()
+{
+    // Sides with certificates negotiate the newest protocol
+#ifdef TLS1_3_VERSION
+    const int version = TLS1_3_VERSION;
+#else
+    const int version = TLS1_2_VERSION;
+#endif
+    const bool supported =
+        ( KernelTls::supportedCiphers(version) != KernelTls::NoCipher );
+    quint64 mbPerSec = 0;
+    bool offloaded = false;
+
+    // Post connection check wants the same subject on both sides
+    IOCredentials credentials;
+    QVERIFY( generateCredentials("ktlstest", "Server", credentials, 2048) );
+
+    QVERIFY( runTransfer(false, 1 << 16, 100, mbPerSec, offloaded,
+                         credentials) );
+    QVERIFY( ! offloaded );
+
+    QVERIFY( runTransfer(true, 1 << 16, 100, mbPerSec, offloaded,
+                         credentials) );
+    QCOMPARE( offloaded, supported );
+    if ( ! supported )
+        QSKIP("Kernel TLS is not supported, only fallback is checked", SkipAll);
+}
+
+void KernelTlsTest::benchmarkThroughput ()
+{
+    if ( KernelTls::supportedCiphers() == KernelTls::NoCipher )
+        QSKIP("Kernel TLS is not supported", SkipAll);
+
+    quint32 size = envValue( "KTLS_TEST_PACKAGE_SIZE", 1 << 20 );
+    quint32 packages = envValue( "KTLS_TEST_PACKAGES", 1000 );
+
+    quint64 withSsl = 0, withKernel = 0;
+    bool offloaded = false;
+    QVERIFY( runTransfer(false, size, packages, withSsl, offloaded) );
+    QVERIFY( ! offloaded );
+    QVERIFY( runTransfer(true, size, packages, withKernel, offloaded) );
+    QVERIFY( offloaded );
+
+    qWarning("%u packages of %u bytes over SSL route:", packages, size);
+    qWarning("  user space SSL: %llu MB/sec", withSsl);
+    qWarning("  kernel TLS:     %llu MB/sec", withKernel);
+}
+
+/*****************************************************************************/
+
+int main ( int argc, char *argv[] )
+{
+    QCoreApplication a(argc, argv);
+    KernelTlsTest test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+/*****************************************************************************/
+#include "KernelTlsTest.moc"
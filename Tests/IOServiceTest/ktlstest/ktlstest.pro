@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += qtestlib console warn_on testcase
+QT = core network
+
+include(ktlstest.deps)
+
+SOURCES += KernelTlsTest.cpp
+
+TARGET = test_ktls
+PROJ_PATH = $$PWD
+include(../../../Build/qmake/build_target.pri)
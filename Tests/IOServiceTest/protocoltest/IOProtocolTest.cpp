@@ -24,8 +24,11 @@
 
 
 #include <QtTest>
+#include <QThread>
 
+#include "IOCompression.h"
 #include "IOProtocol.h"
+#include "IOSendJob.h"
 
 using namespace IOService;
 
@@ -40,10 +43,121 @@ private slots:
     void readWriteToStream ();
     void readWriteToBuffer ();
     void checksumCheck ();
+    void poolStatistics ();
+    void poolCrossThreadFree ();
+    void poolBoundedOnThreadExit ();
+    void benchmarkCreateDestroy ();
+    void responseDispatch ();
+    void benchmarkResponseDispatch_data ();
+    void benchmarkResponseDispatch ();
+    void activeJobsLimit ();
+    void activeJobsConcurrentPush ();
+    void activeJobsBounded ();
+    void compressionRoundTrip ();
+    void limiterBudget ();
 };
 
 /*****************************************************************************/
 
+namespace {
+
+// Releases packages, which were created in other thread
+class PackageReleaser : public QThread
+{
+public:
+    QList< SmartPtr<IOPackage> > packages;
+
+protected:
+    void run ()
+    {
+        packages.clear();
+    }
+};
+
+// Creates packages with big buffers, releases them and exits
+class PackageChurner : public QThread
+{
+public:
+    PackageChurner ( quint32 pkgsNum, quint32 buffSize ) :
+        m_pkgsNum(pkgsNum),
+        m_buff(buffSize, 'x')
+    {}
+
+protected:
+    void run ()
+    {
+        QList< SmartPtr<IOPackage> > packages;
+        for ( quint32 i = 0; i < m_pkgsNum; ++i ) {
+            SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 1 );
+            p->fillBuffer( 0, IOPackage::RawEncoding,
+                           m_buff.constData(), m_buff.size() );
+            packages.append( p );
+        }
+    }
+
+private:
+    quint32 m_pkgsNum;
+    QByteArray m_buff;
+};
+
+// Pushes active jobs as sending thread does, retries while queue is full
+class JobPusher : public QThread
+{
+public:
+    JobPusher ( IOJobManager& jobManager,
+                SmartPtr<IOJobManager::JobPool>& jobPool,
+                IOPackage::Type pusherId, quint32 jobsNum ) :
+        m_jobManager(jobManager),
+        m_jobPool(jobPool),
+        m_pusherId(pusherId),
+        m_jobsNum(jobsNum),
+        m_foreignJobs(0)
+    {}
+
+    // Returned send jobs, which belong to packages of other pushers
+    quint32 foreignJobs () const
+    {
+        return m_foreignJobs;
+    }
+
+protected:
+    void run ()
+    {
+        for ( quint32 i = 0; i < m_jobsNum; ++i ) {
+            SmartPtr<IOPackage> p = IOPackage::createInstance( m_pusherId, 0 );
+            p->header.numericId = i;
+            Uuid::createUuid( p->header.uuid );
+            QSharedPointer<IOJobManager::Job> job;
+            SmartPtr<IOSendJob> sendJob;
+            while ( ! m_jobManager.initActiveJob(m_jobPool, p->header,
+                                                 p, job, sendJob, false) )
+                QThread::yieldCurrentThread();
+            // Job can be already written and reused by another pusher
+            job.clear();
+            QThread::yieldCurrentThread();
+            if ( ! sendJob.isValid() ||
+                 sendJob->getPackageUuid() != Uuid::toUuid(p->header.uuid) )
+                ++m_foreignJobs;
+        }
+    }
+
+private:
+    IOJobManager& m_jobManager;
+    SmartPtr<IOJobManager::JobPool>& m_jobPool;
+    IOPackage::Type m_pusherId;
+    quint32 m_jobsNum;
+    quint32 m_foreignJobs;
+};
+
+void countResume ( void* context )
+{
+    ++*reinterpret_cast<int*>(context);
+}
+
+} // anonymous namespace
+
+/*****************************************************************************/
+
 void IOProtocolTest::createInstances ()
 {
     for ( uint i = 0; i <= 1000; ++i ) {
@@ -357,6 +471,495 @@ void IOProtocolTest::checksumCheck ()
     QVERIFY( crc16_1 == crc16_2 );
 }
 
+void IOProtocolTest::poolStatistics ()
+{
+    const char data[] = "pooled buffer";
+
+    // Warm up pool
+    {
+        SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 1 );
+        QVERIFY( p.isValid() );
+        QVERIFY( p->fillBuffer(0, IOPackage::RawEncoding, data, sizeof(data)) );
+    }
+
+    IOPackage::AllocStatistics before, after;
+    IOPackage::allocStatistics( before );
+
+    for ( uint i = 0; i < 100; ++i ) {
+        SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 1 );
+        QVERIFY( p.isValid() );
+        QVERIFY( p->fillBuffer(0, IOPackage::RawEncoding, data, sizeof(data)) );
+
+        SmartPtr<char> buff;
+        quint32 size;
+        IOPackage::EncodingType enc;
+        QVERIFY( p->getBuffer(0, enc, buff, size) );
+        QVERIFY( size == sizeof(data) );
+        QVERIFY( ::memcmp(buff.getImpl(), data, size) == 0 );
+    }
+
+    IOPackage::allocStatistics( after );
+
+    // Package and its buffer are allocated on each iteration
+    // and must be reused from pool
+    QVERIFY( after.allocations - before.allocations >= 200 );
+    QVERIFY( after.deallocations - before.deallocations >= 200 );
+    QVERIFY( after.poolHits - before.poolHits >= 200 );
+    QVERIFY( after.heapAllocations == before.heapAllocations );
+    QVERIFY( after.cachedBytes > 0 );
+
+    // Huge buffer does not fit any size class
+    {
+        QByteArray big( 1 << 20, 'x' );
+        SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 1 );
+        QVERIFY( p.isValid() );
+        QVERIFY( p->fillBuffer(0, IOPackage::RawEncoding,
+                               big.constData(), big.size()) );
+    }
+    IOPackage::allocStatistics( before );
+    QVERIFY( before.heapAllocations == after.heapAllocations + 1 );
+}
+
+void IOProtocolTest::poolCrossThreadFree ()
+{
+    const uint PkgsNum = 1000;
+    const char data[] = "cross thread";
+
+    for ( uint round = 0; round < 3; ++round ) {
+        PackageReleaser releaser;
+        for ( uint i = 0; i < PkgsNum; ++i ) {
+            SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 1 );
+            QVERIFY( p.isValid() );
+            QVERIFY( p->fillBuffer(0, IOPackage::RawEncoding,
+                                   data, sizeof(data)) );
+            releaser.packages.append( p );
+        }
+
+        IOPackage::AllocStatistics before, after;
+        IOPackage::allocStatistics( before );
+
+        // Free in other thread, blocks go back through depot
+        releaser.start();
+        QVERIFY( releaser.wait(30000) );
+        QVERIFY( releaser.packages.isEmpty() );
+
+        IOPackage::allocStatistics( after );
+        QVERIFY( after.deallocations - before.deallocations >= 2 * PkgsNum );
+        QVERIFY( after.depotTransfers > before.depotTransfers );
+    }
+}
+
+void IOProtocolTest::poolBoundedOnThreadExit ()
+{
+    // 30M of buffers of the largest size class
+    const quint32 PkgsNum = 1000;
+    const quint32 BuffSize = 30000;
+
+    IOPackage::AllocStatistics before, after;
+    IOPackage::allocStatistics( before );
+
+    for ( uint round = 0; round < 3; ++round ) {
+        PackageChurner churner( PkgsNum, BuffSize );
+        churner.start();
+        QVERIFY( churner.wait(30000) );
+    }
+
+    IOPackage::allocStatistics( after );
+    QVERIFY( after.deallocations - before.deallocations >= 3 * 2 * PkgsNum );
+
+    // Depot keeps no more than 4M per class, package headers
+    // and buffers are of two classes
+    QVERIFY( after.cachedBytes <= before.cachedBytes + 2 * 4 * 1024 * 1024 );
+}
+
+void IOProtocolTest::benchmarkCreateDestroy ()
+{
+    const char data[256] = { 0 };
+
+    QBENCHMARK {
+        for ( uint i = 0; i < 1000; ++i ) {
+            SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 2 );
+            p->fillBuffer( 0, IOPackage::RawEncoding, data, 32 );
+            p->fillBuffer( 1, IOPackage::RawEncoding, data, sizeof(data) );
+        }
+    }
+}
+
+namespace {
+
+// Inits in-flight jobs, as write thread does, and returns their
+// send jobs, which are held by callers waiting for responses
+QList< SmartPtr<IOSendJob> > initInFlightJobs (
+    IOJobManager& jobManager,
+    SmartPtr<IOJobManager::JobPool>& jobPool,
+    quint32 jobsNum,
+    QList< SmartPtr<IOPackage> >& responses )
+{
+    QList< SmartPtr<IOSendJob> > sendJobs;
+    for ( quint32 i = 0; i < jobsNum; ++i ) {
+        SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 0 );
+        Uuid::createUuid( p->header.uuid );
+
+        QSharedPointer<IOJobManager::Job> job;
+        SmartPtr<IOSendJob> sendJob;
+        if ( ! jobManager.initActiveJob(jobPool, p->header, p,
+                                        job, sendJob, true) )
+            break;
+        sendJobs.append( sendJob );
+
+        // Package has been sent
+        jobManager.putActiveJob( jobPool, job );
+
+        responses.append( IOPackage::createInstance(0, 0, p) );
+    }
+    return sendJobs;
+}
+
+} // anonymous namespace
+
+void IOProtocolTest::responseDispatch ()
+{
+    IOJobManager jobManager;
+    SmartPtr<IOJobManager::JobPool> jobPool = jobManager.initJobPool();
+    QVERIFY( jobPool.isValid() );
+
+    QList< SmartPtr<IOPackage> > responses;
+    QList< SmartPtr<IOSendJob> > sendJobs =
+        initInFlightJobs( jobManager, jobPool, 200, responses );
+    QCOMPARE( sendJobs.size(), 200 );
+
+    for ( int i = 0; i < sendJobs.size(); ++i )
+        QVERIFY( jobManager.findJobByResponsePackage(jobPool, responses[i]) ==
+                 sendJobs[i] );
+
+    // Released jobs do not match responses any more
+    SmartPtr<IOPackage> response = responses.first();
+    sendJobs.removeFirst();
+    QVERIFY( ! jobManager.findJobByResponsePackage(jobPool,
+                                                   response).isValid() );
+
+    QList< SmartPtr<IOPackage> > newResponses;
+    QList< SmartPtr<IOSendJob> > newSendJobs =
+        initInFlightJobs( jobManager, jobPool, 1, newResponses );
+    QCOMPARE( newSendJobs.size(), 1 );
+    QVERIFY( jobManager.findJobByResponsePackage(jobPool, newResponses[0]) ==
+             newSendJobs[0] );
+    QVERIFY( ! jobManager.findJobByResponsePackage(jobPool,
+                                                   response).isValid() );
+    for ( int i = 0; i < sendJobs.size(); ++i )
+        QVERIFY( jobManager.findJobByResponsePackage(jobPool,
+                                                     responses[i + 1]) ==
+                 sendJobs[i] );
+}
+
+void IOProtocolTest::benchmarkResponseDispatch_data ()
+{
+    QTest::addColumn<quint32>("jobsNum");
+    QTest::newRow("10 jobs") << 10u;
+    QTest::newRow("100 jobs") << 100u;
+    QTest::newRow("1000 jobs") << 1000u;
+}
+
+void IOProtocolTest::benchmarkResponseDispatch ()
+{
+    QFETCH(quint32, jobsNum);
+
+    IOJobManager jobManager;
+    SmartPtr<IOJobManager::JobPool> jobPool = jobManager.initJobPool();
+    QVERIFY( jobPool.isValid() );
+
+    QList< SmartPtr<IOPackage> > responses;
+    QList< SmartPtr<IOSendJob> > sendJobs =
+        initInFlightJobs( jobManager, jobPool, jobsNum, responses );
+    QCOMPARE( (quint32)sendJobs.size(), jobsNum );
+
+    QBENCHMARK {
+        foreach ( const SmartPtr<IOPackage>& p, responses )
+            jobManager.findJobByResponsePackage( jobPool, p );
+    }
+}
+
+void IOProtocolTest::activeJobsLimit ()
+{
+    IOJobManager jobManager;
+    jobManager.setActiveJobsLimit( 4 );
+    SmartPtr<IOJobManager::JobPool> jobPool = jobManager.initJobPool();
+    QVERIFY( jobPool.isValid() );
+
+    QVERIFY( jobManager.getNextActiveJob(jobPool).isNull() );
+
+    QList<IOJobManager::JobRefType> jobs;
+    for ( uint i = 0; i < 4; ++i ) {
+        SmartPtr<IOPackage> p = IOPackage::createInstance( i, 0 );
+        QSharedPointer<IOJobManager::Job> job;
+        SmartPtr<IOSendJob> sendJob;
+        QVERIFY( jobManager.initActiveJob(jobPool, p->header, p,
+                                          job, sendJob, false) );
+        jobs.append( job );
+    }
+
+    // Queue is full for non urgent jobs, rejected job is still returned
+    SmartPtr<IOPackage> p = IOPackage::createInstance( 4, 0 );
+    QSharedPointer<IOJobManager::Job> job;
+    SmartPtr<IOSendJob> sendJob;
+    QVERIFY( ! jobManager.initActiveJob(jobPool, p->header, p,
+                                        job, sendJob, false) );
+    QVERIFY( ! job.isNull() );
+
+    // Urgent jobs ignore the limit
+    QVERIFY( jobManager.initActiveJob(jobPool, p->header, p,
+                                      job, sendJob, true) );
+    jobs.append( job );
+
+    // Jobs are taken in push order
+    IOJobManager::JobRefType next = jobManager.getNextActiveJob( jobPool );
+    for ( int i = 0; i < jobs.size(); ++i ) {
+        QVERIFY( next == jobs[i] );
+        next = jobManager.getFollowingActiveJob( jobPool, next );
+    }
+    QVERIFY( next.isNull() );
+
+    for ( int i = 0; i < jobs.size(); ++i ) {
+        QVERIFY( jobManager.getNextActiveJob(jobPool) == jobs[i] );
+        jobManager.putActiveJob( jobPool, jobs[i] );
+    }
+    QVERIFY( jobManager.getNextActiveJob(jobPool).isNull() );
+
+    // Limit is released
+    QVERIFY( jobManager.initActiveJob(jobPool, p->header, p,
+                                      job, sendJob, false) );
+    QVERIFY( jobManager.getNextActiveJob(jobPool).toStrongRef() == job );
+    jobManager.putActiveJob( jobPool, job );
+}
+
+void IOProtocolTest::activeJobsConcurrentPush ()
+{
+    const quint32 PushersNum = 4;
+    const quint32 JobsNum = 20000;
+
+    IOJobManager jobManager;
+    SmartPtr<IOJobManager::JobPool> jobPool = jobManager.initJobPool();
+    QVERIFY( jobPool.isValid() );
+
+    QList< QSharedPointer<JobPusher> > pushers;
+    for ( quint32 i = 0; i < PushersNum; ++i )
+        pushers.append( QSharedPointer<JobPusher>(
+                            new JobPusher(jobManager, jobPool, i, JobsNum)) );
+    foreach ( const QSharedPointer<JobPusher>& pusher, pushers )
+        pusher->start();
+
+    // Take jobs as writing thread does, checking order of each pusher
+    QVector<quint64> nextIds( PushersNum, 0 );
+    quint32 taken = 0, misordered = 0;
+    QTime timer;
+    timer.start();
+    while ( taken < PushersNum * JobsNum && timer.elapsed() < 60000 ) {
+        IOJobManager::JobRefType job = jobManager.getNextActiveJob( jobPool );
+        if ( job.isNull() ) {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        QSharedPointer<IOJobManager::Job> h = job.toStrongRef();
+        if ( h->pkgHeader.type >= PushersNum ||
+             h->pkgHeader.numericId != nextIds[h->pkgHeader.type]++ )
+            ++misordered;
+        jobManager.putActiveJob( jobPool, job );
+        ++taken;
+    }
+
+    foreach ( const QSharedPointer<JobPusher>& pusher, pushers )
+        QVERIFY( pusher->wait(30000) );
+    QCOMPARE( taken, PushersNum * JobsNum );
+    QCOMPARE( misordered, 0u );
+    // Each pusher got send jobs of its own packages
+    foreach ( const QSharedPointer<JobPusher>& pusher, pushers )
+        QCOMPARE( pusher->foreignJobs(), 0u );
+    QVERIFY( jobManager.getNextActiveJob(jobPool).isNull() );
+}
+
+void IOProtocolTest::activeJobsBounded ()
+{
+    IOJobManager jobManager;
+    jobManager.setActiveJobsLimit( 4 );
+    SmartPtr<IOJobManager::JobPool> jobPool = jobManager.initJobPool();
+    QVERIFY( jobPool.isValid() );
+
+    // Urgent jobs exceed the limit, but not the queue capacity
+    QList<IOJobManager::JobRefType> jobs;
+    SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 0 );
+    QSharedPointer<IOJobManager::Job> job;
+    SmartPtr<IOSendJob> sendJob;
+    while ( jobManager.initActiveJob(jobPool, p->header, p,
+                                     job, sendJob, true) ) {
+        jobs.append( job );
+        QVERIFY( jobs.size() <= (int)IOJobManager::OptimalPoolSize );
+    }
+    QVERIFY( ! job.isNull() );
+    QCOMPARE( jobs.size(), (int)IOJobManager::OptimalPoolSize );
+    IOJobManager::JobRefType rejected = job;
+    job.clear();
+    sendJob = SmartPtr<IOSendJob>();
+
+    foreach ( const IOJobManager::JobRefType& j, jobs ) {
+        QVERIFY( jobManager.getNextActiveJob(jobPool) == j );
+        jobManager.putActiveJob( jobPool, j );
+    }
+    QVERIFY( jobManager.getNextActiveJob(jobPool).isNull() );
+
+    // Free jobs are bounded, the rest are deleted
+    int alive = (rejected.toStrongRef().isNull() ? 0 : 1);
+    foreach ( const IOJobManager::JobRefType& j, jobs )
+        alive += (j.toStrongRef().isNull() ? 0 : 1);
+    QCOMPARE( alive, (int)IOJobManager::OptimalPoolSize );
+
+    // Free jobs are reused
+    QVERIFY( jobManager.initActiveJob(jobPool, p->header, p,
+                                      job, sendJob, false) );
+    QVERIFY( jobs.contains(job) || rejected.toStrongRef() == job );
+}
+
+void IOProtocolTest::compressionRoundTrip ()
+{
+    // Compressible buffer, small buffer and buffer which does not shrink
+    QByteArray text;
+    while ( text.size() < (1 << 16) )
+        text.append( "compressible package buffer " );
+    QByteArray small( 64, 'x' );
+    QByteArray noise( 1 << 12, 0 );
+    quint32 seed = 1;
+    for ( int i = 0; i < noise.size(); ++i ) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = char(seed >> 16);
+    }
+
+    SmartPtr<IOPackage> p = IOPackage::createInstance( 0, 3 );
+    QVERIFY( p.isValid() );
+    QVERIFY( p->fillBuffer(0, IOPackage::RawEncodingAlligned,
+                           text.constData(), text.size()) );
+    QVERIFY( p->fillBuffer(1, IOPackage::RawEncoding,
+                           small.constData(), small.size()) );
+    QVERIFY( p->fillBuffer(2, IOPackage::RawEncoding,
+                           noise.constData(), noise.size()) );
+
+    // Nothing is done without codec
+    IOSender::Statistics stat;
+    QVERIFY( IOCompression::compressPackage(p, IOCompression::NoCodec,
+                                            stat) == p );
+    QVERIFY( stat.compressionRawBytes == 0 );
+
+    const IOCompression::Codec codecs[] = { IOCompression::LZ4Codec,
+                                            IOCompression::ZstdCodec };
+    for ( uint c = 0; c < sizeof(codecs)/sizeof(codecs[0]); ++c ) {
+        if ( ! (IOCompression::supportedCodecs() & codecs[c]) )
+            continue;
+
+        IOSender::Statistics stat;
+        SmartPtr<IOPackage> cp =
+            IOCompression::compressPackage( p, codecs[c], stat );
+        QVERIFY( cp.isValid() && cp != p );
+        QVERIFY( stat.compressionRawBytes == text.size() );
+        QVERIFY( stat.compressionWireBytes < text.size() );
+
+        // Original package is untouched, small and noise buffers
+        // are shared as is
+        const IOPackage::PODData* data = IODATAMEMBERCONST(p);
+        const IOPackage::PODData* cdata = IODATAMEMBERCONST(cp);
+        QVERIFY( data[0].bufferEncoding == IOPackage::RawEncodingAlligned );
+        QVERIFY( data[0].bufferSize == quint32(text.size()) );
+        QVERIFY( cdata[0].bufferEncoding & IOPackage::CompressionEncodingMask );
+        QVERIFY( cp->buffers[1] == p->buffers[1] );
+        QVERIFY( cp->buffers[2] == p->buffers[2] );
+        QVERIFY( cdata[2].bufferEncoding == IOPackage::RawEncoding );
+
+        QVERIFY( IOCompression::decompressPackage(cp, stat) );
+        QVERIFY( stat.decompressionRawBytes == text.size() );
+        QVERIFY( stat.decompressionWireBytes == stat.compressionWireBytes );
+
+        SmartPtr<char> buff;
+        quint32 size;
+        IOPackage::EncodingType enc;
+        QVERIFY( cp->getBuffer(0, enc, buff, size) );
+        QVERIFY( enc == IOPackage::RawEncodingAlligned );
+        QVERIFY( size == quint32(text.size()) );
+        QVERIFY( ::memcmp(buff.getImpl(), text.constData(), size) == 0 );
+
+        // Corrupted raw size closes the connection
+        cp = IOCompression::compressPackage( p, codecs[c], stat );
+        QVERIFY( cp.isValid() && cp != p );
+        quint32 wrongSize = IOPackage::SIZE_LIMIT + 1;
+        ::memcpy( cp->buffers[0].getImpl(), &wrongSize, sizeof(wrongSize) );
+        QVERIFY( ! IOCompression::decompressPackage(cp, stat) );
+    }
+}
+
+void IOProtocolTest::limiterBudget ()
+{
+    const quint64 MB = 1 << 20;
+    int resumed = 0;
+    IOPackage::BudgetStatistics s;
+
+    // Own budget of connection keeps old 64MB/8MB marks
+    {
+        IOPackage::Limiter own;
+        own.put( 64 * MB );
+        QVERIFY( ! own.waitAsync(countResume, &resumed) );
+        own.put( 1 );
+        QVERIFY( own.waitAsync(countResume, &resumed) );
+        own.get( 56 * MB );
+        QCOMPARE( resumed, 0 );
+        own.get( 1 );
+        QCOMPARE( resumed, 1 );
+    }
+
+    resumed = 0;
+    QSharedPointer<IOPackage::Budget> budget(
+        new IOPackage::Budget(16 * MB, 2 * MB) );
+    QSharedPointer<IOPackage::Limiter> fat(
+        new IOPackage::Limiter(budget) );
+    QSharedPointer<IOPackage::Limiter> thin(
+        new IOPackage::Limiter(budget) );
+
+    // Free budget may be taken by one connection over its share
+    fat->put( 12 * MB );
+    QVERIFY( ! fat->waitAsync(countResume, &resumed) );
+
+    // Budget is exhausted: connection above its fair share of 8MB
+    // is paused, connection below it goes on
+    thin->put( 6 * MB );
+    QVERIFY( ! thin->waitAsync(countResume, &resumed) );
+    QVERIFY( fat->waitAsync(countResume, &resumed) );
+
+    budget->getStatistics( s );
+    QCOMPARE( s.usedBytes, 18 * MB );
+    QCOMPARE( s.totalBytes, 16 * MB );
+    QCOMPARE( s.connections, 2u );
+    QCOMPARE( s.pausedConnections, 1u );
+    QCOMPARE( s.pauses, (quint64)1 );
+
+    // Is resumed when 1/8 of the share is left
+    fat->get( 10 * MB );
+    QCOMPARE( resumed, 0 );
+    fat->get( 1 * MB );
+    QCOMPARE( resumed, 1 );
+    budget->getStatistics( s );
+    QCOMPARE( s.pausedConnections, 0u );
+
+    // Limits are changed at runtime
+    budget->setLimits( 4 * MB, 1 * MB );
+    QVERIFY( thin->waitAsync(countResume, &resumed) );
+    QVERIFY( ! fat->waitAsync(countResume, &resumed) );
+
+    // Destroyed limiter returns bytes of packages, which outlive it
+    thin.clear();
+    budget->getStatistics( s );
+    QCOMPARE( s.usedBytes, 1 * MB );
+    QCOMPARE( s.minShareBytes, 1 * MB );
+    QCOMPARE( s.connections, 1u );
+    QCOMPARE( s.pausedConnections, 0u );
+    QCOMPARE( s.pauses, (quint64)2 );
+    QCOMPARE( resumed, 1 );
+}
+
 /*****************************************************************************/
 
 int main ( int argc, char *argv[] )
@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo Core. Virtuozzo Core is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation;
+ * either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QtTest>
+
+#include "IOClient.h"
+#include "IORoutingTableHelper.h"
+#include "IOServer.h"
+#include "Socket/SocketReactor_p.h"
+#include "Libraries/Logging/Logging.h"
+#include "Libraries/Std/AtomicOps.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define sleepMsecs(msecs) usleep(msecs * 1000)
+
+using namespace IOService;
+
+/*****************************************************************************/
+
+static const quint32 RemotePortNumber = 5556;
+static const quint32 MinSleep = 10;
+static const quint32 WaitIterations = 60000 / MinSleep; //1 min
+static const quint32 ReactorThreads = 2;
+static const quint32 TestPackage = 100;
+
+// Sizes of the connection benchmark, can be overridden from environment
+static quint32 envValue ( const char* name, quint32 defValue )
+{
+    bool ok = false;
+    quint32 val = qgetenv(name).toUInt(&ok);
+    return ok ? val : defValue;
+}
+
+// Returns value of field from /proc/self/status
+static qint64 procStatus ( const QByteArray& field )
+{
+    QFile f("/proc/self/status");
+    if ( ! f.open(QIODevice::ReadOnly) )
+        return -1;
+    foreach ( const QByteArray& line, f.readAll().split('\n') ) {
+        if ( ! line.startsWith(field + ":") )
+            continue;
+        return line.mid(field.size() + 1).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+// Raises limit of open descriptors up to hard limit
+static bool raiseFilesLimit ( rlim_t required )
+{
+    struct rlimit lim;
+    if ( ::getrlimit(RLIMIT_NOFILE, &lim) != 0 )
+        return false;
+    if ( lim.rlim_cur >= required )
+        return true;
+    if ( lim.rlim_max != RLIM_INFINITY && lim.rlim_max < required )
+        return false;
+    lim.rlim_cur = required;
+    return ::setrlimit(RLIMIT_NOFILE, &lim) == 0;
+}
+
+static bool waitForValue ( int* value, int expected )
+{
+    for ( quint32 i = 0; i < WaitIterations; ++i ) {
+        if ( AtomicRead(value) >= expected )
+            return true;
+        sleepMsecs(MinSleep);
+    }
+    return false;
+}
+
+/*****************************************************************************/
+
+class TestHandler : public SocketReactorHandler
+{
+public:
+    TestHandler () :
+        reactor(0), thr(-1), detachOnEvent(false),
+        events(0), bytes(0), lastFd(-1), timers(0)
+    {}
+
+    virtual void onReactorEvent ( int fd )
+    {
+        char buf[256];
+        ssize_t n;
+        while ( (n = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0 )
+            AtomicAdd( &bytes, (int)n );
+        AtomicWrite( &lastFd, fd );
+        if ( detachOnEvent && SocketReactor::currentHandler() == this )
+            reactor->detach( thr, this );
+        AtomicInc( &events );
+    }
+
+    virtual void onReactorTimer ()
+    {
+        if ( SocketReactor::currentHandler() == this )
+            AtomicInc( &timers );
+    }
+
+    SocketReactor* reactor;
+    int thr;
+    bool detachOnEvent;
+    int events;
+    int bytes;
+    int lastFd;
+    int timers;
+};
+
+/*****************************************************************************/
+
+class ReactorTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    ReactorTest () : m_received(0) {}
+
+private slots:
+    void dispatchEvents ();
+    void detachFromHandler ();
+    void enableDisable ();
+    void kick ();
+    void balanceThreads ();
+    void attachFailure ();
+    void timers ();
+    void sendPackagesToServer ();
+    void benchmarkConnections ();
+
+public slots:
+    void onPackageToServer ( IOServerInterface*, IOSender::Handle,
+                             const SmartPtr<IOPackage> );
+
+private:
+    struct RunResult
+    {
+        qint64 threads;
+        qint64 rssKb;
+        quint64 pkgsPerSec;
+    };
+
+    bool runConnections ( quint32 reactorThreads, quint32 idle, quint32 busy,
+                          quint32 packages, RunResult& result );
+
+private:
+    int m_received;
+};
+
+/*****************************************************************************/
+
+void ReactorTest::onPackageToServer ( IOServerInterface*, IOSender::Handle,
+                                      const SmartPtr<IOPackage> p )
+{
+    if ( p->header.type == TestPackage )
+        AtomicInc( &m_received );
+}
+
+bool ReactorTest::runConnections ( quint32 reactorThreads, quint32 idle,
+                                   quint32 busy, quint32 packages,
+                                   RunResult& result )
+{
+    bool res = false;
+    qint64 threadsBefore = procStatus("Threads");
+    QList<IOClient*> clients;
+    SmartPtr<IOPackage> p;
+    QByteArray data( 1024, 'x' );
+    IOService::TimeMark startMark = 0, endMark = 0;
+
+    AtomicWrite( &m_received, 0 );
+
+    IOServer* server = new IOServer(
+                 IORoutingTableHelper::GetServerRoutingTable(PSL_LOW_SECURITY),
+                 IOSender::Dispatcher, IOService::LoopbackAddr,
+                 RemotePortNumber );
+    server->setReactorThreadsCount( reactorThreads );
+    QObject::connect( server,
+                     SIGNAL(onPackageReceived(IOServerInterface*,
+                                              IOSender::Handle,
+                                              const SmartPtr<IOPackage>)),
+                     SLOT(onPackageToServer(IOServerInterface*,
+                                            IOSender::Handle,
+                                            const SmartPtr<IOPackage>)),
+                     Qt::DirectConnection );
+    if ( server->listen() != IOSender::Connected )
+        goto cleanup;
+
+    for ( quint32 i = 0; i < idle + busy; ++i ) {
+        IOClient* client = new IOClient(
+                IORoutingTableHelper::GetClientRoutingTable(PSL_LOW_SECURITY),
+                IOSender::Vm, IOService::LoopbackAddr, RemotePortNumber );
+        clients.append( client );
+        client->connectClient();
+        if ( client->waitForConnection() != IOSender::Connected )
+            goto cleanup;
+    }
+    for ( quint32 i = 0; i < WaitIterations &&
+              server->countClients() != idle + busy; ++i )
+        sleepMsecs(MinSleep);
+    if ( server->countClients() != idle + busy )
+        goto cleanup;
+
+    result.threads = procStatus("Threads") - threadsBefore;
+    result.rssKb = procStatus("VmRSS");
+
+    // Busy clients are the last ones
+    p = IOPackage::createInstance( TestPackage, 1 );
+    p->fillBuffer( 0, IOPackage::RawEncoding, data.data(), data.size() );
+
+    IOService::timeMark(startMark);
+    for ( quint32 n = 0; n < packages; ++n ) {
+        for ( quint32 i = idle; i < idle + busy; ++i ) {
+            IOClient* client = clients[i];
+            IOSendJob::Handle job = client->sendPackage( p );
+            while ( client->getSendResult(job) == IOSendJob::SendQueueIsFull ) {
+                sleepMsecs(1);
+                job = client->sendPackage( p );
+            }
+        }
+    }
+    if ( ! waitForValue(&m_received, busy * packages) )
+        goto cleanup;
+    IOService::timeMark(endMark);
+
+    result.pkgsPerSec = (quint64)busy * packages * 1000 /
+        qMax(IOService::msecsDiffTimeMark(startMark, endMark), 1u);
+    res = true;
+
+cleanup:
+    foreach ( IOClient* client, clients )
+        delete client;
+    delete server;
+    return res;
+}
+
+/*****************************************************************************/
+
+void ReactorTest::dispatchEvents ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(ReactorThreads) );
+    QVERIFY( reactor.isStarted() );
+    QCOMPARE( reactor.threadsCount(), ReactorThreads );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    TestHandler handler;
+    int thr = reactor.selectThread();
+    QVERIFY( thr >= 0 );
+    QVERIFY( reactor.attach(thr, &handler, &sv[0], 1) );
+    QCOMPARE( reactor.countDescriptors(), 1u );
+
+    QVERIFY( ::write(sv[1], "ping", 4) == 4 );
+    QVERIFY( waitForValue(&handler.bytes, 4) );
+    QCOMPARE( AtomicRead(&handler.lastFd), sv[0] );
+    QVERIFY( reactor.countEvents() > 0 );
+
+    reactor.stop();
+    QVERIFY( ! reactor.isStarted() );
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::detachFromHandler ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(1) );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    TestHandler handler;
+    handler.reactor = &reactor;
+    handler.thr = reactor.selectThread();
+    handler.detachOnEvent = true;
+    QVERIFY( reactor.attach(handler.thr, &handler, &sv[0], 1) );
+
+    QVERIFY( ::write(sv[1], "a", 1) == 1 );
+    QVERIFY( waitForValue(&handler.events, 1) );
+    QCOMPARE( reactor.countDescriptors(), 0u );
+
+    // Nothing is dispatched after detach
+    QVERIFY( ::write(sv[1], "b", 1) == 1 );
+    sleepMsecs(200);
+    QCOMPARE( AtomicRead(&handler.events), 1 );
+
+    reactor.stop();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::enableDisable ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(1) );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    TestHandler handler;
+    int thr = reactor.selectThread();
+    QVERIFY( reactor.attach(thr, &handler, &sv[0], 1) );
+    QVERIFY( reactor.enable(thr, sv[0], false) );
+
+    QVERIFY( ::write(sv[1], "ping", 4) == 4 );
+    sleepMsecs(200);
+    QCOMPARE( AtomicRead(&handler.events), 0 );
+
+    QVERIFY( reactor.enable(thr, sv[0], true) );
+    QVERIFY( waitForValue(&handler.bytes, 4) );
+
+    // Unknown descriptor
+    QVERIFY( ! reactor.enable(thr, sv[1], false) );
+
+    reactor.stop();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::kick ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(1) );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    TestHandler handler;
+    int thr = reactor.selectThread();
+    QVERIFY( reactor.attach(thr, &handler, &sv[0], 1) );
+
+    // Event without data
+    reactor.kick( thr, sv[0] );
+    QVERIFY( waitForValue(&handler.events, 1) );
+    QCOMPARE( AtomicRead(&handler.bytes), 0 );
+    QCOMPARE( AtomicRead(&handler.lastFd), sv[0] );
+
+    // Kick is dispatched for disabled descriptor too
+    QVERIFY( reactor.enable(thr, sv[0], false) );
+    reactor.kick( thr, sv[0] );
+    QVERIFY( waitForValue(&handler.events, 2) );
+
+    reactor.stop();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::balanceThreads ()
+{
+    enum { HandlersNumber = 8 };
+
+    SocketReactor reactor;
+    QVERIFY( reactor.start(ReactorThreads) );
+
+    int sv[HandlersNumber][2];
+    TestHandler handlers[HandlersNumber];
+    QVector<int> load( ReactorThreads, 0 );
+
+    for ( int i = 0; i < HandlersNumber; ++i ) {
+        QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) == 0 );
+        int thr = reactor.selectThread();
+        QVERIFY( thr >= 0 && thr < (int)ReactorThreads );
+        QVERIFY( reactor.attach(thr, &handlers[i], &sv[i][0], 1) );
+        ++load[thr];
+    }
+    for ( quint32 i = 0; i < ReactorThreads; ++i )
+        QCOMPARE( load[i], (int)(HandlersNumber / ReactorThreads) );
+
+    reactor.stop();
+    for ( int i = 0; i < HandlersNumber; ++i ) {
+        ::close(sv[i][0]);
+        ::close(sv[i][1]);
+    }
+}
+
+void ReactorTest::attachFailure ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(1) );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+    QVERIFY( ::write(sv[1], "ping", 4) == 4 );
+
+    // Readable descriptor is added first and must be rolled back
+    // without dispatching
+    TestHandler handler;
+    int thr = reactor.selectThread();
+    const int fds[] = { sv[0], -1 };
+    QVERIFY( ! reactor.attach(thr, &handler, fds, 2) );
+    QCOMPARE( reactor.countDescriptors(), 0u );
+    sleepMsecs(200);
+    QCOMPARE( AtomicRead(&handler.events), 0 );
+
+    // Descriptor can be attached again
+    QVERIFY( reactor.attach(thr, &handler, &sv[0], 1) );
+    QVERIFY( waitForValue(&handler.bytes, 4) );
+
+    reactor.stop();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::timers ()
+{
+    SocketReactor reactor;
+    QVERIFY( reactor.start(1) );
+
+    int sv[2];
+    QVERIFY( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    // Idle handler gets timer calls without events
+    TestHandler handler;
+    int thr = reactor.selectThread();
+    QVERIFY( reactor.attach(thr, &handler, sv, 2) );
+    QVERIFY( waitForValue(&handler.timers, 2) );
+    QCOMPARE( AtomicRead(&handler.events), 0 );
+
+    reactor.stop();
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+void ReactorTest::sendPackagesToServer ()
+{
+    // All packages must be delivered through the reactor
+    RunResult result;
+    QVERIFY( runConnections(ReactorThreads, 4, 4, 100, result) );
+}
+
+void ReactorTest::benchmarkConnections ()
+{
+    // Every connection takes both client and server side descriptors
+    // and event pipes in this process
+    enum { FilesPerConnection = 8, FilesReserve = 256 };
+
+    quint32 idle = envValue( "REACTOR_TEST_IDLE_CLIENTS", 10000 );
+    quint32 busy = envValue( "REACTOR_TEST_BUSY_CLIENTS", 1000 );
+    quint32 packages = envValue( "REACTOR_TEST_PACKAGES", 100 );
+    quint32 threads = envValue( "REACTOR_TEST_THREADS", ReactorThreads );
+
+    if ( ! raiseFilesLimit((rlim_t)(idle + busy) * FilesPerConnection +
+                           FilesReserve) )
+        QSKIP("Limit of open files is too low for the benchmark, "
+              "set REACTOR_TEST_IDLE_CLIENTS and REACTOR_TEST_BUSY_CLIENTS",
+              SkipAll);
+
+    RunResult withThreads, withReactor;
+    QVERIFY( runConnections(threads, idle, busy, packages, withReactor) );
+    qWarning("%u idle + %u busy connections:", idle, busy);
+    qWarning("  reactor (%u): threads +%lld, VmRSS %lld kB, %llu pkgs/sec",
+             threads, withReactor.threads, withReactor.rssKb,
+             withReactor.pkgsPerSec);
+
+    // Thread per connection can hit system limits at this scale,
+    // which is the point of the reactor, so it is not a failure
+    if ( ! runConnections(0, idle, busy, packages, withThreads) ) {
+        qWarning("  read threads: can't serve all connections");
+        return;
+    }
+    qWarning("  read threads: threads +%lld, VmRSS %lld kB, %llu pkgs/sec",
+             withThreads.threads, withThreads.rssKb, withThreads.pkgsPerSec);
+
+    QVERIFY( withReactor.threads < withThreads.threads );
+}
+
+/*****************************************************************************/
+
+int main ( int argc, char *argv[] )
+{
+    QCoreApplication a(argc, argv);
+    ReactorTest test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+/*****************************************************************************/
+#include "ReactorTest.moc"
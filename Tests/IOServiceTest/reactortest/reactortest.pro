@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += qtestlib console warn_on testcase
+QT = core network
+
+include(reactortest.deps)
+
+SOURCES += ReactorTest.cpp
+
+TARGET = test_reactor
+PROJ_PATH = $$PWD
+include(../../../Build/qmake/build_target.pri)
@@ -43,6 +43,8 @@ class RoutingTableTest : public QObject
 
 private slots:
     void doAccepting ();
+    void findInRanges ();
+    void benchmarkFindRoute ();
 };
 
 namespace PackageType {
@@ -330,6 +332,57 @@ void RoutingTableTest::doAccepting ()
 
 }
 
+void RoutingTableTest::findInRanges ()
+{
+    // Direct routes in the gaps of ranges and on their bounds
+    IORoutingTable table( First_RouteName, IORoutingTable::OptionalRoute );
+    for ( quint32 i = 0; i < IORoutingTable::MaxRoutesNumber / 2; ++i ) {
+        QVERIFY( table.addRoute(i * 100 + 10, i * 100 + 50,
+                                Second_RouteName,
+                                IORoutingTable::OptionalRoute) );
+        QVERIFY( table.addRoute(i * 100 + 51, Third_RouteName,
+                                IORoutingTable::OptionalRoute) );
+    }
+    QVERIFY( ! table.addRoute(1000, Third_RouteName,
+                              IORoutingTable::OptionalRoute) );
+
+    for ( quint32 type = 0; type < 1100; ++type ) {
+        const quint32 offs = type % 100;
+        IORoutingTable::RouteName routeName = First_RouteName;
+        if ( type < 1000 && offs >= 10 && offs <= 50 )
+            routeName = Second_RouteName;
+        else if ( type < 1000 && offs == 51 )
+            routeName = Third_RouteName;
+        QCOMPARE( table.findRoute(type), routeName );
+    }
+    QCOMPARE( table.findRoute(0xffffffff), First_RouteName );
+
+    // Copy has the same routes
+    IORoutingTable copy;
+    QCOMPARE( copy.findRoute(PackageType::SomeType),
+              IORoutingTable::UnknownRoute );
+    copy = table;
+    QCOMPARE( copy.findRoute(10), Second_RouteName );
+    QCOMPARE( copy.findRoute(151), Third_RouteName );
+    QCOMPARE( copy.findRoute(152), First_RouteName );
+}
+
+void RoutingTableTest::benchmarkFindRoute ()
+{
+    IORoutingTable table( First_RouteName, IORoutingTable::OptionalRoute );
+    for ( quint32 i = 0; i < IORoutingTable::MaxRoutesNumber; ++i )
+        QVERIFY( table.addRoute(i * 100, i * 100 + 10,
+                                (i % 2 ? Second_RouteName : Third_RouteName),
+                                IORoutingTable::OptionalRoute) );
+
+    quint32 routed = 0;
+    QBENCHMARK {
+        for ( quint32 type = 0; type < 100000; ++type )
+            routed += table.findRoute(type % 2500) != First_RouteName;
+    }
+    QVERIFY( routed > 0 );
+}
+
 /*****************************************************************************/
 
 int main ( int argc, char *argv[] )
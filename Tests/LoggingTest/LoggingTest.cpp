@@ -0,0 +1,218 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		LoggingTest.cpp
+///
+/// @brief
+///		Binary logging mode and prllogdecode test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QFile>
+
+#include "Libraries/Logging/Logging.h"
+#include "Utils/LogDecoder/LogDecoder.h"
+
+#include "LoggingTest.h"
+
+namespace {
+
+std::string decodeArgs(const char* format, const unsigned char* kinds,
+					   size_t nkinds, const UINT64* args, size_t nargs)
+{
+	return LogDecoder::formatMessage(format,
+			std::vector<unsigned char>(kinds, kinds + nkinds),
+			(const char*)args, nargs * sizeof(UINT64));
+}
+
+} // anonymous namespace
+
+void LoggingTest::initTestCase()
+{
+	m_path = QDir::tempPath();
+	m_name = QString("prl-logging-test-%1.log").arg(getpid());
+	SetLogFileName(QFile::encodeName(m_path).constData(),
+				   QFile::encodeName(m_name).constData());
+	// Binary mode is not used while console logging is on
+	SetConsoleLogging(0);
+	SetBinaryLogging(1);
+}
+
+void LoggingTest::cleanupTestCase()
+{
+	SetAsyncLogging(0);
+	SetBinaryLogging(0);
+	QFile::remove(QDir(m_path).absoluteFilePath(m_name));
+	QFile::remove(QDir(m_path).absoluteFilePath(m_name + LOG_BIN_SUFFIX));
+}
+
+QByteArray LoggingTest::decodeAll()
+{
+	LogFlush();
+
+	QByteArray name = QFile::encodeName(
+			QDir(m_path).absoluteFilePath(m_name + LOG_BIN_SUFFIX));
+	FILE* in = fopen(name.constData(), "rb");
+	FILE* out = tmpfile();
+	if (in == NULL || out == NULL) {
+		if (in != NULL)
+			fclose(in);
+		if (out != NULL)
+			fclose(out);
+		return QByteArray();
+	}
+
+	LogDecoder decoder(out);
+	decoder.decode(in, name.constData());
+	fclose(in);
+
+	QByteArray text;
+	char buf[4096];
+	size_t n;
+	rewind(out);
+	while ((n = fread(buf, 1, sizeof(buf), out)) != 0)
+		text.append(buf, n);
+	fclose(out);
+	return text;
+}
+
+QList<QByteArray> LoggingTest::siteFormats(int line)
+{
+	LogFlush();
+
+	QList<QByteArray> formats;
+	QFile f(QDir(m_path).absoluteFilePath(m_name + LOG_BIN_SUFFIX));
+	if (!f.open(QIODevice::ReadOnly))
+		return formats;
+
+	QByteArray data = f.readAll();
+	int pos = 0;
+	while (pos + (int)sizeof(LogBinHeader) <= data.size()) {
+		const LogBinHeader* h = (const LogBinHeader*)(data.constData() + pos);
+		if (h->size < sizeof(*h) || pos + (int)h->size > data.size())
+			break;
+		if (h->type == LOG_BIN_SITE && h->size >= sizeof(LogBinSite)) {
+			const LogBinSite* s = (const LogBinSite*)h;
+			if (s->line == line)
+				formats.append(QByteArray((const char*)(s + 1),
+										  s->format_len));
+		}
+		pos += h->size;
+	}
+	return formats;
+}
+
+void LoggingTest::binaryRoundTrip_data()
+{
+	QTest::addColumn<bool>("async");
+	QTest::newRow("sync") << false;
+	QTest::newRow("async") << true;
+}
+
+void LoggingTest::binaryRoundTrip()
+{
+	QFETCH(bool, async);
+
+	SetAsyncLogging(async);
+
+	const char* str = "abc";
+	const char* null = NULL;
+	long long big = 1LL << 40;
+	char expected[512];
+	for (int i = 0; i < 100; ++i) {
+		WRITE_TRACE(DBG_FATAL, "round %d %s: %hhd %ld %lld %zu %.3f %p "
+					"%s %s %*d %.*s %%", i, async ? "async" : "sync",
+					(char)-5, 7L, big + i, (size_t)42, 3.25, (void*)0x1234,
+					str, null, 6, 9, 2, "xyz");
+	}
+	SetAsyncLogging(0);
+
+	QByteArray text = decodeAll();
+	for (int i = 0; i < 100; ++i) {
+		snprintf(expected, sizeof(expected), "round %d %s: %hhd %ld %lld %zu "
+				 "%.3f %p %s %s %*d %.*s %%\n", i, async ? "async" : "sync",
+				 (char)-5, 7L, big + i, (size_t)42, 3.25, (void*)0x1234,
+				 str, "(null)", 6, 9, 2, "xyz");
+		QVERIFY2(text.contains(expected), expected);
+	}
+	QCOMPARE(GetLogDroppedMessages(), 0ull);
+}
+
+void LoggingTest::textOnlyFormats()
+{
+	char expected[512];
+
+	// MSVC size of the argument is glibc I flag with width, argument
+	// type is decided by vsnprintf(), so message is formatted at once
+	const int msvcLine = __LINE__ + 1;
+	WRITE_TRACE(DBG_FATAL, "msvc size %I64d", 7);
+	QCOMPARE(siteFormats(msvcLine), QList<QByteArray>() << "%s");
+
+	errno = ENOENT;
+	const int errnoLine = __LINE__ + 1;
+	WRITE_TRACE(DBG_FATAL, "errno %m");
+	QCOMPARE(siteFormats(errnoLine), QList<QByteArray>() << "%s");
+
+	QByteArray text = decodeAll();
+	snprintf(expected, sizeof(expected), "errno %s\n", strerror(ENOENT));
+	QVERIFY(text.contains(expected));
+	QVERIFY(text.contains("msvc size "));
+}
+
+void LoggingTest::decoderChecksKinds()
+{
+	const unsigned char ints[] = { LOG_ARG_INT, LOG_ARG_INT };
+	const unsigned char starDouble[] = { LOG_ARG_INT, LOG_ARG_DOUBLE };
+	double d = 2.5;
+	UINT64 v[2] = { 5, 0 };
+
+	QCOMPARE(decodeArgs("%d and %d", ints, 2, v, 2), std::string("5 and 0"));
+
+	// Kind of the argument does not match the conversion
+	QCOMPARE(decodeArgs("%d and %s", ints, 2, v, 2), std::string("5 and %s"));
+	QCOMPARE(decodeArgs("%ld", ints, 1, v, 1), std::string("%ld"));
+
+	// Conversions which are never deferred
+	QCOMPARE(decodeArgs("%n%d", ints, 2, v, 2), std::string("%n%d"));
+	QCOMPARE(decodeArgs("%1$d", ints, 1, v, 1), std::string("%1$d"));
+	QCOMPARE(decodeArgs("%I64d", ints, 1, v, 1), std::string("%I64d"));
+	QCOMPARE(decodeArgs("%Lf", starDouble + 1, 1, v, 1), std::string("%Lf"));
+
+	// Not enough recorded arguments
+	QCOMPARE(decodeArgs("%d %d %d", ints, 2, v, 2), std::string("5 0 %d"));
+
+	// Star takes int argument
+	::memcpy(&v[1], &d, sizeof(d));
+	v[0] = 3;
+	QCOMPARE(decodeArgs("%.*f", starDouble, 2, v, 2), std::string("2.500"));
+	QCOMPARE(decodeArgs("%.*f", ints, 2, v, 2), std::string("%.*f"));
+}
+
+QTEST_MAIN(LoggingTest)
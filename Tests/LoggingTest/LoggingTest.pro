@@ -0,0 +1,13 @@
+CONFIG += qtestlib testcase
+QT = core
+
+include(LoggingTest.deps)
+
+HEADERS += LoggingTest.h \
+	$$SRC_LEVEL/Utils/LogDecoder/LogDecoder.h
+SOURCES += LoggingTest.cpp \
+	$$SRC_LEVEL/Utils/LogDecoder/LogDecoder.cpp
+
+# It is important to have "File Info" embedded in the
+# windows binaries - which means we need windows resource file
+win32:RC_FILE = $$SRC_LEVEL/Tests/UnitTests.rc
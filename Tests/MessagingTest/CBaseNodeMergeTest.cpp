@@ -0,0 +1,185 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		CBaseNodeMergeTest.cpp
+///
+/// @brief
+///		CBaseNode three-way merge and diff test cases and benchmarks.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <Libraries/Messaging/CVmEventBase.h>
+#include <Libraries/Messaging/CVmEventParameterList.h>
+
+#include "CBaseNodeMergeTest.h"
+
+namespace
+{
+
+void addParameter(CVmEventBase& evt, const QString& qsName, const QString& qsValue)
+{
+	evt.getEventParameters()->m_lstEventParameter +=
+		new CVmEventParameter(PVE::String, qsValue, qsName);
+}
+
+// Large document like VM configuration with parameters without ids yet
+void fill(CVmEventBase& evt, int nCount)
+{
+	evt.setEventType(PET_DSP_EVT_VM_CONFIG_CHANGED);
+	for (int i = 0; i < nCount; ++i)
+		addParameter(evt, QString("param_%1").arg(i), QString("value_%1").arg(i));
+	evt.getEventParameters()->m_lstEventParameter += new CVmEventParameterList(
+		PVE::String, QStringList() << "one" << "two", "list");
+}
+
+} // namespace
+
+void CBaseNodeMergeTest::copy()
+{
+	CVmEventBase evt;
+	fill(evt, 10);
+
+	CVmEventBase res;
+	CBaseNode::copyDocument(res, evt);
+
+	// Same result as serializing and parsing back
+	CVmEventBase parsed;
+	QCOMPARE(parsed.fromString(evt.toString()), 0);
+	QCOMPARE(res.toString(), parsed.toString());
+
+	const QList<CVmEventParameter* >& lstRes = res.getEventParameters()->m_lstEventParameter;
+	const QList<CVmEventParameter* >& lstParsed = parsed.getEventParameters()->m_lstEventParameter;
+	QCOMPARE(lstRes.size(), lstParsed.size());
+	for (int i = 0; i < lstRes.size(); ++i)
+	{
+		QCOMPARE(lstRes[i]->getItemId(), lstParsed[i]->getItemId());
+		QCOMPARE(lstRes[i]->getFullItemId(), lstParsed[i]->getFullItemId());
+		QVERIFY(lstRes[i] != evt.getEventParameters()->m_lstEventParameter[i]);
+	}
+
+	// Source is not touched
+	QCOMPARE(evt.getEventParameters()->m_lstEventParameter.first()->getItemId(), -1);
+}
+
+void CBaseNodeMergeTest::merge()
+{
+	CVmEventBase prev;
+	fill(prev, 3);
+
+	CVmEventBase cur(prev);
+	cur.setEventCode(PRL_ERR_FAILURE);
+	addParameter(cur, "added", "value");
+
+	CVmEventBase evt(prev);
+	evt.setEventSource("source");
+
+	QCOMPARE(evt.mergeDocuments(&cur, &prev), int(PRL_ERR_SUCCESS));
+	QCOMPARE(evt.getEventCode(), PRL_ERR_FAILURE);
+	QCOMPARE(evt.getEventSource(), QString("source"));
+
+	const QList<CVmEventParameter* >& lst = evt.getEventParameters()->m_lstEventParameter;
+	QCOMPARE(lst.size(), 5);
+	QCOMPARE(lst.last()->getParamName(), QString("added"));
+	QCOMPARE(lst.last()->getItemId(), 4);
+
+	// Inputs are not touched
+	QCOMPARE(cur.getEventSource(), QString());
+	QCOMPARE(prev.getEventParameters()->m_lstEventParameter.size(), 4);
+}
+
+void CBaseNodeMergeTest::mergeConflict()
+{
+	CVmEventBase prev;
+	fill(prev, 3);
+
+	CVmEventBase cur(prev);
+	cur.setEventCode(PRL_ERR_FAILURE);
+
+	CVmEventBase evt(prev);
+	evt.setEventCode(PRL_ERR_UNEXPECTED);
+
+	QCOMPARE(evt.mergeDocuments(&cur, &prev), int(PRL_ERR_MERGE_XML_DOCUMENT_CONFLICT));
+	QVERIFY(evt.GetErrorMessage().endsWith(".EventCode"));
+}
+
+void CBaseNodeMergeTest::diff()
+{
+	CVmEventBase prev;
+	fill(prev, 3);
+
+	CVmEventBase evt(prev);
+	evt.setEventCode(PRL_ERR_FAILURE);
+	addParameter(evt, "added", "value");
+
+	QStringList lst;
+	QCOMPARE(evt.diffDocuments(&prev, lst), int(PRL_ERR_SUCCESS));
+	QCOMPARE(lst, QStringList() << "EventCode" << "EventParameters.EventParameter[4]");
+}
+
+void CBaseNodeMergeTest::benchmarkCopy_data()
+{
+	QTest::addColumn<bool>("roundTrip");
+
+	QTest::newRow("xml round trip") << true;
+	QTest::newRow("object copy") << false;
+}
+
+void CBaseNodeMergeTest::benchmarkCopy()
+{
+	QFETCH(bool, roundTrip);
+
+	CVmEventBase evt;
+	fill(evt, 5000);
+
+	if (roundTrip)
+	{
+		QBENCHMARK {
+			CVmEventBase res;
+			res.fromString(evt.toString());
+		}
+	}
+	else
+	{
+		QBENCHMARK {
+			CVmEventBase res;
+			CBaseNode::copyDocument(res, evt);
+		}
+	}
+}
+
+void CBaseNodeMergeTest::benchmarkMerge()
+{
+	CVmEventBase prev;
+	fill(prev, 5000);
+
+	CVmEventBase cur(prev);
+	cur.setEventCode(PRL_ERR_FAILURE);
+	addParameter(cur, "added", "value");
+
+	QBENCHMARK {
+		CVmEventBase evt(prev);
+		evt.setEventSource("source");
+		evt.mergeDocuments(&cur, &prev);
+	}
+}
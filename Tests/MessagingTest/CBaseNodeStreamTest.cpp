@@ -0,0 +1,336 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		CBaseNodeStreamTest.cpp
+///
+/// @brief
+///		CBaseNode XML stream serialization test cases and benchmarks.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <Libraries/Messaging/CVmEvent.h>
+#include <Libraries/Messaging/CVmEventParameterList.h>
+
+#include "CBaseNodeStreamTest.h"
+
+namespace
+{
+
+enum Document
+{
+	VmCatalogue,
+	HostHwInfo
+};
+
+// Large documents: catalogue of registered VMs and host hardware list
+void fill(CVmEvent& evt, int nDocument)
+{
+	evt.setEventType(PET_DSP_EVT_VM_CONFIG_CHANGED);
+	evt.setEventIssuerId(Uuid::createUuid().toString());
+	if (nDocument == VmCatalogue)
+	{
+		for (int i = 0; i < 2000; ++i)
+		{
+			evt.addEventParameter(new CVmEventParameterList(PVE::String,
+				QStringList() << Uuid::createUuid().toString()
+					<< QString("vm-%1 \u0432\u043c").arg(i)
+					<< QString("/vz/vmprivate/%1/config.pvs").arg(i)
+					<< "root" << "vz-host.local",
+				"vm_directory_item"));
+		}
+		return;
+	}
+
+	for (int i = 0; i < 5000; ++i)
+	{
+		evt.addEventParameter(new CVmEventParameter(PVE::String,
+			QString("/sys/devices/pci0000:00/0000:00:%1.0 & <usb>").arg(i),
+			QString("device_%1").arg(i)));
+	}
+	evt.addEventParameter(new CVmEventParameter(PVE::CData,
+		QString(64 * 1024, QChar('x')), "cpu_features"));
+}
+
+QString legacyToString(const CBaseNode& node)
+{
+	QDomDocument document = node.getXml(false);
+	QString str;
+	QTextStream out(&str);
+	document.save(out, 1);
+	out.flush();
+	return str;
+}
+
+int legacyFromString(CBaseNode& node, const QString& str)
+{
+	QDomDocument document;
+	if (!document.setContent(str))
+		return PRL_ERR_PARSE_VM_CONFIG;
+	QDomElement element = document.firstChildElement();
+	return node.readXml(&element);
+}
+
+void addDocumentRows()
+{
+	QTest::addColumn<int>("doc");
+	QTest::addColumn<bool>("stream");
+
+	QTest::newRow("vm catalogue dom") << int(VmCatalogue) << false;
+	QTest::newRow("vm catalogue stream") << int(VmCatalogue) << true;
+	QTest::newRow("host hw info dom") << int(HostHwInfo) << false;
+	QTest::newRow("host hw info stream") << int(HostHwInfo) << true;
+}
+
+} // namespace
+
+void CBaseNodeStreamTest::roundTrip()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString(),
+		PIE_DISPATCHER, PRL_ERR_FAILURE, PVE::EventRespRequired,
+		"source & <\u0438\u0441\u0442\u043e\u0447\u043d\u0438\u043a>");
+	evt.setEventId(Q_UINT64_C(0x123456789abcdef));
+	evt.addEventParameter(new CVmEventParameter(PVE::String, " value ", "str"));
+	evt.addEventParameter(new CVmEventParameter(PVE::String, QString(), "empty"));
+	evt.addEventParameter(new CVmEventParameter(PVE::CData, "<a>&</a>", "cdata"));
+	evt.addEventParameter(new CVmEventParameterList(PVE::String,
+		QStringList() << "one" << QString() << "three", "list"));
+
+	QString x = evt.toString();
+
+	CVmEvent res;
+	QCOMPARE(res.fromString(x), 0);
+	QCOMPARE(res.toString(), x);
+	QCOMPARE(res.getEventType(), PET_DSP_EVT_VM_STARTED);
+	QCOMPARE(res.getEventCode(), PRL_ERR_FAILURE);
+	QCOMPARE(res.getEventSource(), evt.getEventSource());
+	QCOMPARE(res.getEventIssuerId(), evt.getEventIssuerId());
+	QCOMPARE(res.getEventId(), evt.getEventId());
+	QCOMPARE(res.getEventParameter("str")->getParamValue(), QString(" value "));
+	QCOMPARE(res.getEventParameter("empty")->getParamValue(), QString());
+	QCOMPARE(res.getEventParameter("cdata")->getCdata(), QString("<a>&</a>"));
+	QCOMPARE(res.getEventParameter("list")->getValuesList(),
+		QStringList() << "one" << QString() << "three");
+
+	// DOM parser reads the same object
+	CVmEvent dom;
+	QCOMPARE(legacyFromString(dom, x), 0);
+	QCOMPARE(dom.toString(), x);
+}
+
+void CBaseNodeStreamTest::legacyDocument()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STOPPED, Uuid::createUuid().toString());
+	fill(evt, VmCatalogue);
+
+	CVmEvent res;
+	QCOMPARE(res.fromString(legacyToString(evt)), 0);
+	QCOMPARE(res.toString(), evt.toString());
+
+	CVmEvent dom;
+	QCOMPARE(legacyFromString(dom, evt.toString()), 0);
+	QCOMPARE(dom.toString(), evt.toString());
+}
+
+void CBaseNodeStreamTest::extElements()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString());
+	evt.addEventParameter(new CVmEventParameter(PVE::String, "value", "str"));
+
+	QString x = evt.toString();
+	x.replace("<EventParameters", "<Unknown a=\"1\"><Sub>text</Sub><![CDATA[<&>]]></Unknown>"
+		"<EventParameters");
+	x.replace("<Name>", "<Custom/><Name>");
+
+	CVmEvent res;
+	QCOMPARE(res.fromString(x), 0);
+	QCOMPARE(res.getEventParameter("str")->getParamValue(), QString("value"));
+
+	// Unknown elements are kept in place as DOM parser does
+	CVmEvent dom;
+	QCOMPARE(legacyFromString(dom, x), 0);
+	QCOMPARE(res.toString(), dom.toString());
+	QVERIFY(res.toString().contains("<Sub>text</Sub>"));
+	QVERIFY(res.toString().contains("<Custom/>"));
+	QVERIFY(res.toString().contains("<![CDATA[<&>]]>"));
+}
+
+void CBaseNodeStreamTest::fieldAttributes()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString(),
+		PIE_DISPATCHER, PRL_ERR_FAILURE, PVE::EventRespRequired, "source");
+	evt.addEventParameter(new CVmEventParameter(PVE::String, "value", "str"));
+
+	// Fields may be given as attributes of the root or of any child
+	QString x = evt.toString();
+	QVERIFY(x.contains("<EventParameter "));
+	QVERIFY(x.contains("<Name>str</Name>"));
+	QVERIFY(x.contains("<EventSource>source</EventSource>"));
+	x.replace("<EventParameter ", "<EventParameter Name=\"attr\" ");
+	x.replace("<Name>str</Name>", "");
+	x.replace("<EventSource>source</EventSource>", "<Custom EventSource=\"other\"/>");
+
+	CVmEvent res;
+	QCOMPARE(res.fromString(x), 0);
+	QVERIFY(res.getEventParameter("attr") != NULL);
+	QCOMPARE(res.getEventParameter("attr")->getParamValue(), QString("value"));
+	QCOMPARE(res.getEventSource(), QString("other"));
+	QVERIFY(!res.toString().contains("<Custom"));
+
+	CVmEvent dom;
+	QCOMPARE(legacyFromString(dom, x), 0);
+	QCOMPARE(res.toString(), dom.toString());
+}
+
+void CBaseNodeStreamTest::itemIds()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString());
+	for (int i = 0; i < 3; ++i)
+		evt.addEventParameter(new CVmEventParameter(PVE::String, "v", "p"));
+
+	QString x = evt.toString();
+	x.replace("<EventParameter id=\"0\"", "<EventParameter id=\"5\"");
+	x.replace("<EventParameter id=\"1\"", "<EventParameter");
+
+	CVmEvent res;
+	QCOMPARE(res.fromString(x), 0);
+	CVmEvent dom;
+	QCOMPARE(legacyFromString(dom, x), 0);
+
+	QCOMPARE(res.m_lstEventParameters.size(), 3);
+	for (int i = 0; i < 3; ++i)
+	{
+		QCOMPARE(res.m_lstEventParameters[i]->getItemId(),
+			dom.m_lstEventParameters[i]->getItemId());
+		QCOMPARE(res.m_lstEventParameters[i]->getFullItemId(),
+			dom.m_lstEventParameters[i]->getFullItemId());
+	}
+	QCOMPARE(res.m_lstEventParameters[1]->getItemId(), 6);
+}
+
+void CBaseNodeStreamTest::malformed()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString());
+	evt.addEventParameter(new CVmEventParameterList(PVE::String,
+		QStringList() << "one" << "two", "list"));
+	QString x = evt.toString();
+
+	CVmEvent res;
+	QString qsError;
+	int nLine = 0;
+	QCOMPARE(res.fromString(x.left(x.size() / 2), false, &qsError, &nLine),
+		int(PRL_ERR_PARSE_VM_CONFIG));
+	QVERIFY(!qsError.isEmpty());
+	QVERIFY(nLine > 0);
+	QCOMPARE(int(res.m_uiRcInit), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	// Garbage after the root element
+	QCOMPARE(res.fromString(x + "<a>"), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	// Wrong root element
+	QCOMPARE(res.fromString("<Event/>"), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	// Absent mandatory field
+	QString y = x;
+	int nStart = y.indexOf("<EventType>");
+	y.remove(nStart, y.indexOf("</EventType>") + sizeof("</EventType>") - 1 - nStart);
+	QCOMPARE(res.fromString(y), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	QCOMPARE(res.fromString(x), 0);
+	QCOMPARE(int(res.m_uiRcInit), 0);
+}
+
+void CBaseNodeStreamTest::file()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString());
+	fill(evt, HostHwInfo);
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QString qsFile = dir.path() + "/event.xml";
+	QCOMPARE(evt.saveToFile(qsFile), 0);
+
+	CVmEvent res;
+	QCOMPARE(res.loadFromFile(qsFile), 0);
+	QCOMPARE(res.toString(), evt.toString());
+
+	QFile f(qsFile);
+	QVERIFY(f.open(QIODevice::ReadOnly));
+	QVERIFY(f.readLine().startsWith("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"));
+}
+
+void CBaseNodeStreamTest::benchmarkParse_data()
+{
+	addDocumentRows();
+}
+
+void CBaseNodeStreamTest::benchmarkParse()
+{
+	QFETCH(int, doc);
+	QFETCH(bool, stream);
+
+	CVmEvent evt;
+	fill(evt, doc);
+	QString x = evt.toString();
+
+	CVmEvent res;
+	if (stream)
+	{
+		QBENCHMARK {
+			res.fromString(x);
+		}
+	}
+	else
+	{
+		QBENCHMARK {
+			legacyFromString(res, x);
+		}
+	}
+}
+
+void CBaseNodeStreamTest::benchmarkSerialize_data()
+{
+	addDocumentRows();
+}
+
+void CBaseNodeStreamTest::benchmarkSerialize()
+{
+	QFETCH(int, doc);
+	QFETCH(bool, stream);
+
+	CVmEvent evt;
+	fill(evt, doc);
+
+	if (stream)
+	{
+		QBENCHMARK {
+			evt.toString();
+		}
+	}
+	else
+	{
+		QBENCHMARK {
+			legacyToString(evt);
+		}
+	}
+}
@@ -0,0 +1,262 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		CVmEventBinaryTest.cpp
+///
+/// @brief
+///		CVmEvent binary encoding test cases and benchmarks.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <Libraries/Messaging/CVmEvent.h>
+#include <Libraries/Messaging/CVmEventParameterList.h>
+#include <Libraries/Messaging/CVmBinaryEventParameter.h>
+#include <Libraries/ProtoSerializer/CProtoSerializer.h>
+
+#include "CVmEventBinaryTest.h"
+
+namespace
+{
+
+enum Command
+{
+	Login,
+	VmStart,
+	EditCommit
+};
+
+// VM config like payload of edit commit
+QString config()
+{
+	QString res("<ParallelsVirtualMachine><Hardware>");
+	for (int i = 0; i < 200; ++i)
+	{
+		res += QString("<Hdd id=\"%1\"><Index>%1</Index>"
+			"<SystemName>/vz/vmprivate/disk-%1.hdd</SystemName>"
+			"<Description>disk &amp; \u043e\u0431\u0440\u0430\u0437</Description>"
+			"</Hdd>").arg(i);
+	}
+	return res + "</Hardware></ParallelsVirtualMachine>";
+}
+
+CProtoCommandPtr command(int nCommand)
+{
+	switch (nCommand)
+	{
+	case Login:
+		return CProtoSerializer::CreateDspCmdUserLoginCommand(
+			"root", "secret", Uuid::createUuid().toString(), 0);
+	case VmStart:
+		return CProtoSerializer::CreateProtoBasicVmCommand(
+			PVE::DspCmdVmStart, Uuid::createUuid().toString());
+	default:
+		return CProtoSerializer::CreateProtoCommandWithOneStrParam(
+			PVE::DspCmdDirVmEditCommit, config());
+	}
+}
+
+PVE::IDispatcherCommands type(int nCommand)
+{
+	switch (nCommand)
+	{
+	case Login:
+		return PVE::DspCmdUserLogin;
+	case VmStart:
+		return PVE::DspCmdVmStart;
+	default:
+		return PVE::DspCmdDirVmEditCommit;
+	}
+}
+
+SmartPtr<IOService::IOPackage> package(int nCommand, bool bBinary)
+{
+	CProtoCommandPtr pCmd = command(nCommand);
+	if (bBinary)
+		return DispatcherPackage::createBinaryInstance(type(nCommand), pCmd);
+	return DispatcherPackage::createInstance(type(nCommand), pCmd);
+}
+
+void addCommandRows()
+{
+	QTest::addColumn<int>("cmd");
+	QTest::addColumn<bool>("binary");
+
+	QTest::newRow("login xml") << int(Login) << false;
+	QTest::newRow("login binary") << int(Login) << true;
+	QTest::newRow("vm start xml") << int(VmStart) << false;
+	QTest::newRow("vm start binary") << int(VmStart) << true;
+	QTest::newRow("edit commit xml") << int(EditCommit) << false;
+	QTest::newRow("edit commit binary") << int(EditCommit) << true;
+}
+
+} // namespace
+
+void CVmEventBinaryTest::roundTrip()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString(),
+		PIE_DISPATCHER, PRL_ERR_FAILURE, PVE::EventRespRequired,
+		"\u0438\u0441\u0442\u043e\u0447\u043d\u0438\u043a", PVE::EventLevel2);
+	evt.setInitRequestId(Uuid::createUuid().toString());
+	evt.setEventId(Q_UINT64_C(0x123456789abcdef));
+	evt.addEventParameter(new CVmEventParameter(PVE::String, "value", "str"));
+	evt.addEventParameter(new CVmEventParameter(PVE::String, QString(), "empty"));
+	evt.addEventParameter(new CVmEventParameter(PVE::CData, "<a>&</a>", "cdata"));
+	evt.addEventParameter(new CVmEventParameterList(PVE::String,
+		QStringList() << "one" << QString() << "three", "list"));
+	CVmBinaryEventParameter* pBinary = new CVmBinaryEventParameter("binary");
+	*pBinary->getBinaryDataStream() << quint32(42) << QString("payload");
+	evt.addEventParameter(pBinary);
+
+	QByteArray b = evt.toBinary();
+	QVERIFY(CVmEvent::isBinary(b.constData(), b.size()));
+
+	CVmEvent res;
+	QCOMPARE(res.fromBinary(b.constData(), b.size()), 0);
+	QCOMPARE(res.toBinary(), b);
+	QCOMPARE(res.getEventType(), PET_DSP_EVT_VM_STARTED);
+	QCOMPARE(res.getEventCode(), PRL_ERR_FAILURE);
+	QCOMPARE(res.getEventLevel(), PVE::EventLevel2);
+	QCOMPARE(res.getEventSource(), evt.getEventSource());
+	QCOMPARE(res.getEventIssuerId(), evt.getEventIssuerId());
+	QCOMPARE(res.getInitRequestId(), evt.getInitRequestId());
+	QCOMPARE(res.getEventId(), evt.getEventId());
+	QCOMPARE(res.m_lstEventParameters.size(), 5);
+	QCOMPARE(res.getEventParameter("str")->getParamValue(), QString("value"));
+	QCOMPARE(res.getEventParameter("cdata")->getCdata(), QString("<a>&</a>"));
+	QCOMPARE(res.getEventParameter("list")->getValuesList(),
+		QStringList() << "one" << QString() << "three");
+
+	CVmEventParameter* p = res.getEventParameter("binary");
+	QVERIFY(p);
+	QCOMPARE(p->getEventParameterClassType(), CVmEventParameter::Binary);
+	quint32 n = 0;
+	QString s;
+	*static_cast<CVmBinaryEventParameter* >(p)->getBinaryDataStream() >> n >> s;
+	QCOMPARE(n, quint32(42));
+	QCOMPARE(s, QString("payload"));
+
+	// XML view of both events is the same
+	QCOMPARE(res.toString(), evt.toString());
+}
+
+void CVmEventBinaryTest::malformed()
+{
+	CVmEvent evt(PET_DSP_EVT_VM_STARTED, Uuid::createUuid().toString());
+	evt.addEventParameter(new CVmEventParameterList(PVE::String,
+		QStringList() << "one" << "two", "list"));
+	QByteArray b = evt.toBinary();
+
+	QByteArray x = evt.toString().toUtf8();
+	QVERIFY(!CVmEvent::isBinary(x.constData(), x.size()));
+
+	CVmEvent res;
+	for (int i = 0; i < b.size(); ++i)
+		QCOMPARE(res.fromBinary(b.constData(), i), int(PRL_ERR_PARSE_VM_CONFIG));
+	QCOMPARE(res.fromBinary(b.constData(), b.size()), 0);
+
+	// Trailing data
+	QByteArray t = b + 'x';
+	QCOMPARE(res.fromBinary(t.constData(), t.size()), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	// Unknown version
+	QByteArray v = b;
+	v[4] = CVmEvent::BinaryVersion + 1;
+	QCOMPARE(res.fromBinary(v.constData(), v.size()), int(PRL_ERR_PARSE_VM_CONFIG));
+
+	// Huge list is not allocated, count precedes two last strings
+	QByteArray l = b;
+	int nOffset = l.size() - 2 * (4 + 3) - 4;
+	l[nOffset + 3] = char(0xff);
+	QCOMPARE(res.fromBinary(l.constData(), l.size()), int(PRL_ERR_PARSE_VM_CONFIG));
+}
+
+void CVmEventBinaryTest::parseCommand_data()
+{
+	addCommandRows();
+}
+
+void CVmEventBinaryTest::parseCommand()
+{
+	QFETCH(int, cmd);
+	QFETCH(bool, binary);
+
+	SmartPtr<IOService::IOPackage> p = package(cmd, binary);
+	QVERIFY(p.isValid());
+
+	CProtoCommandPtr pCmd = CProtoSerializer::ParseCommand(p);
+	QVERIFY(pCmd->IsValid());
+	QCOMPARE(pCmd->GetCommandId(), type(cmd));
+
+	// Both encodings give the same command
+	SmartPtr<IOService::IOPackage> x = DispatcherPackage::createInstance(
+		type(cmd), pCmd);
+	CProtoCommandPtr pXml = CProtoSerializer::ParseCommand(x);
+	QCOMPARE(pXml->GetCommand()->toString(), pCmd->GetCommand()->toString());
+
+	CVmEvent evt;
+	QCOMPARE(CProtoSerializer::ParseEvent(p, evt), 0);
+	QCOMPARE(evt.toBinary(), pCmd->GetCommand()->toBinary());
+}
+
+void CVmEventBinaryTest::benchmarkSerialize_data()
+{
+	addCommandRows();
+}
+
+void CVmEventBinaryTest::benchmarkSerialize()
+{
+	QFETCH(int, cmd);
+	QFETCH(bool, binary);
+
+	CProtoCommandPtr pCmd = command(cmd);
+	PVE::IDispatcherCommands t = type(cmd);
+	if (binary)
+	{
+		QBENCHMARK {
+			DispatcherPackage::createBinaryInstance(t, pCmd);
+		}
+	}
+	else
+	{
+		QBENCHMARK {
+			DispatcherPackage::createInstance(t, pCmd);
+		}
+	}
+}
+
+void CVmEventBinaryTest::benchmarkParse_data()
+{
+	addCommandRows();
+}
+
+void CVmEventBinaryTest::benchmarkParse()
+{
+	QFETCH(int, cmd);
+	QFETCH(bool, binary);
+
+	SmartPtr<IOService::IOPackage> p = package(cmd, binary);
+	QBENCHMARK {
+		CProtoSerializer::ParseCommand(p);
+	}
+}
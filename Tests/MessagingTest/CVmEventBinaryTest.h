@@ -0,0 +1,51 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		CVmEventBinaryTest.h
+///
+/// @brief
+///		CVmEvent binary encoding test cases and benchmarks.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef CVM_EVENT_BINARY_TEST_H
+#define CVM_EVENT_BINARY_TEST_H
+
+#include <QtTest/QtTest>
+
+class CVmEventBinaryTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void roundTrip();
+	void malformed();
+	void parseCommand_data();
+	void parseCommand();
+	void benchmarkSerialize_data();
+	void benchmarkSerialize();
+	void benchmarkParse_data();
+	void benchmarkParse();
+};
+
+#endif // CVM_EVENT_BINARY_TEST_H
@@ -0,0 +1,205 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+/// @file
+///		CVmEventParamIndexTest.cpp
+///
+/// @brief
+///		CVmEvent parameters lookup test cases and benchmarks.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <Libraries/Messaging/CVmEvent.h>
+#include <Libraries/Messaging/CVmEventParameterList.h>
+
+#include "CVmEventParamIndexTest.h"
+
+namespace
+{
+
+CVmEventParameter* parameter(const QString& qsName, const QString& qsValue)
+{
+	return new CVmEventParameter(PVE::UnsignedInt, qsValue, qsName);
+}
+
+// Event with nCount parameters, every third one is named "dup"
+void fill(CVmEvent& evt, int nCount)
+{
+	for (int i = 0; i < nCount; ++i)
+	{
+		if (i % 3 == 2)
+			evt.addEventParameter(parameter("dup", QString::number(i)));
+		else
+			evt.addEventParameter(parameter(QString("param_%1").arg(i), QString::number(i)));
+	}
+}
+
+} // namespace
+
+void CVmEventParamIndexTest::lookup_data()
+{
+	QTest::addColumn<int>("count");
+
+	// Small events are searched linearly
+	QTest::newRow("small") << 5;
+	QTest::newRow("large") << 100;
+}
+
+void CVmEventParamIndexTest::lookup()
+{
+	QFETCH(int, count);
+
+	CVmEvent evt;
+	fill(evt, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (i % 3 == 2)
+			continue;
+		CVmEventParameter* pParam = evt.getEventParameter(QString("param_%1").arg(i));
+		QVERIFY(pParam == evt.m_lstEventParameters[i]);
+		QCOMPARE(evt.GetParamsCount(QString("param_%1").arg(i)), 1);
+	}
+	QVERIFY(NULL == evt.getEventParameter("missing"));
+	QCOMPARE(evt.GetParamsCount("missing"), 0);
+
+	// Parameters with the same name are found in order of the list
+	int nDup = count / 3;
+	QCOMPARE(evt.GetParamsCount("dup"), nDup);
+	QVERIFY(evt.getEventParameter("dup") == evt.getEventParameter("dup", 0));
+	for (int i = 0; i < nDup; ++i)
+	{
+		CVmEventParameter* pParam = evt.getEventParameter("dup", i);
+		QVERIFY(pParam != NULL);
+		QCOMPARE(pParam->getParamValue(), QString::number(i * 3 + 2));
+	}
+	QVERIFY(NULL == evt.getEventParameter("dup", nDup));
+	QVERIFY(NULL == evt.getEventParameter("dup", -1));
+
+	// Parameters added after lookup are found as well
+	evt.addEventParameter(parameter("dup", "last"));
+	evt.addEventParameter(parameter("added", "1"));
+	QCOMPARE(evt.GetParamsCount("dup"), nDup + 1);
+	QCOMPARE(evt.getEventParameter("dup", nDup)->getParamValue(), QString("last"));
+	QVERIFY(evt.getEventParameter("added") == evt.m_lstEventParameters.last());
+}
+
+void CVmEventParamIndexTest::listChanges()
+{
+	CVmEvent evt;
+	fill(evt, 100);
+	QVERIFY(evt.getEventParameter("param_0") != NULL);
+
+	// Remove parameter directly from the list as proto commands do
+	QMutableListIterator<CVmEventParameter* > it(evt.m_lstEventParameters);
+	while (it.hasNext())
+	{
+		CVmEventParameter* pParam = it.next();
+		if (pParam->getParamName() == "param_0")
+		{
+			it.remove();
+			delete pParam;
+		}
+	}
+	QVERIFY(NULL == evt.getEventParameter("param_0"));
+	QVERIFY(evt.getEventParameter("param_1") == evt.m_lstEventParameters.first());
+
+	// Replace parameter in place keeping size of the list
+	delete evt.m_lstEventParameters[0];
+	evt.m_lstEventParameters[0] = parameter("replaced", "1");
+	QVERIFY(NULL == evt.getEventParameter("param_1"));
+	QVERIFY(evt.getEventParameter("replaced") == evt.m_lstEventParameters.first());
+
+	evt.m_lstEventParameters.append(parameter("appended", "1"));
+	QVERIFY(evt.getEventParameter("appended") == evt.m_lstEventParameters.last());
+
+	// Event is parsed again
+	CVmEvent other;
+	fill(other, 10);
+	other.addEventParameter(parameter("other", "1"));
+	QCOMPARE(evt.fromString(other.toString()), 0);
+	QVERIFY(NULL == evt.getEventParameter("appended"));
+	QCOMPARE(evt.getEventParameter("other")->getParamValue(), QString("1"));
+
+	evt.m_lstEventParameters.clear();
+	QVERIFY(NULL == evt.getEventParameter("other"));
+	QCOMPARE(evt.GetParamsCount("dup"), 0);
+}
+
+void CVmEventParamIndexTest::numbers()
+{
+	CVmEvent evt;
+	fill(evt, 100);
+	evt.addEventParameter(parameter("big", "4294967296"));
+	evt.addEventParameter(parameter("text", "text"));
+
+	bool bOk = false;
+	QCOMPARE(evt.getEventParameterUInt("param_1", &bOk), 1u);
+	QVERIFY(bOk);
+	QCOMPARE(evt.getEventParameterUInt64("param_1", &bOk), Q_UINT64_C(1));
+	QVERIFY(bOk);
+
+	// Same results as QString conversions give
+	QCOMPARE(evt.getEventParameterUInt("big", &bOk), QString("4294967296").toUInt());
+	QVERIFY(!bOk);
+	QCOMPARE(evt.getEventParameterUInt64("big", &bOk), Q_UINT64_C(4294967296));
+	QVERIFY(bOk);
+	QCOMPARE(evt.getEventParameterUInt("text", &bOk), 0u);
+	QVERIFY(!bOk);
+	QCOMPARE(evt.getEventParameterUInt("missing", &bOk), 0u);
+	QVERIFY(!bOk);
+
+	// Cached number follows parameter value
+	evt.getEventParameter("param_1")->setParamValue("42");
+	QCOMPARE(evt.getEventParameterUInt("param_1"), 42u);
+	evt.getEventParameter("param_1")->setParamValue(QString("42"));
+	QCOMPARE(evt.getEventParameterUInt("param_1"), 42u);
+	evt.getEventParameter("param_1")->setParamValue("43");
+	QCOMPARE(evt.getEventParameterUInt64("param_1"), Q_UINT64_C(43));
+}
+
+void CVmEventParamIndexTest::benchmarkLookup_data()
+{
+	QTest::addColumn<int>("count");
+
+	QTest::newRow("8 params") << 8;
+	QTest::newRow("64 params") << 64;
+	QTest::newRow("1024 params") << 1024;
+}
+
+void CVmEventParamIndexTest::benchmarkLookup()
+{
+	QFETCH(int, count);
+
+	CVmEvent evt;
+	fill(evt, count);
+	QStringList lstNames;
+	for (int i = 0; i < count; i += 3)
+		lstNames << QString("param_%1").arg(i);
+
+	quint64 nSum = 0;
+	QBENCHMARK {
+		foreach(const QString& qsName, lstNames)
+			nSum += evt.getEventParameterUInt64(qsName);
+	}
+	QVERIFY(nSum > 0 || count < 4);
+}
@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		Main.cpp
+///
+/// @brief
+///		main().
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include "CVmEventBinaryTest.h"
+#include "CBaseNodeStreamTest.h"
+#include "CBaseNodeMergeTest.h"
+#include "CVmEventParamIndexTest.h"
+
+#define EXECUTE_TESTS_SUITE(TESTS_SUITE_CLASS_NAME)\
+{\
+	TESTS_SUITE_CLASS_NAME _tests_suite;\
+	nRet += QTest::qExec(&_tests_suite, argc, argv);\
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+
+	int nRet = 0;
+	EXECUTE_TESTS_SUITE(CVmEventBinaryTest)
+	EXECUTE_TESTS_SUITE(CBaseNodeStreamTest)
+	EXECUTE_TESTS_SUITE(CBaseNodeMergeTest)
+	EXECUTE_TESTS_SUITE(CVmEventParamIndexTest)
+
+	return nRet;
+}
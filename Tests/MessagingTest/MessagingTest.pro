@@ -0,0 +1,17 @@
+CONFIG += qtestlib testcase
+QT = xml core network
+
+INCLUDEPATH += /usr/include/prlsdk
+
+include(MessagingTest.deps)
+
+HEADERS += CVmEventBinaryTest.h \
+	CBaseNodeStreamTest.h \
+	CBaseNodeMergeTest.h \
+	CVmEventParamIndexTest.h
+
+SOURCES += Main.cpp \
+	CVmEventBinaryTest.cpp \
+	CBaseNodeStreamTest.cpp \
+	CBaseNodeMergeTest.cpp \
+	CVmEventParamIndexTest.cpp
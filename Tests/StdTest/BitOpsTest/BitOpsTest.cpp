@@ -33,6 +33,7 @@
 ///
 /////////////////////////////////////////////////////////////////////////////
 #include	<limits.h>
+#include	<QVector>
 
 #include <Libraries/Std/BitOps.h>
 
@@ -46,6 +47,55 @@
 
 #define		UINT64_BITS		64
 
+// 1 MiB, bitmap of a 4 TB disk with 512 KB granularity
+#define		BENCH_WORDS		(1 << 17)
+
+namespace
+{
+
+UINT64	random64()
+{
+	return ((UINT64)qrand() << 40) ^ ((UINT64)qrand() << 20) ^ qrand();
+}
+
+// Random words with long runs of all-clear and all-set ones
+void	fillWords(UINT64 *buff, int words)
+{
+	for (int i = 0; i < words; ++i)
+	{
+		switch (qrand() % 4)
+		{
+		case 0:
+			buff[i] = 0;
+			break;
+		case 1:
+			buff[i] = ~0llu;
+			break;
+		case 2:
+			buff[i] = random64();
+			break;
+		default:
+			buff[i] = i ? buff[i - 1] : 0;
+		}
+	}
+}
+
+bool	useLevel(int level)
+{
+	return BitOpsSetLevel(level) == level;
+}
+
+void	addLevels()
+{
+	QTest::addColumn<int>("level");
+
+	QTest::newRow("scalar") << (int)BITOPS_LEVEL_SCALAR;
+	QTest::newRow("sse4.2") << (int)BITOPS_LEVEL_SSE42;
+	QTest::newRow("avx2") << (int)BITOPS_LEVEL_AVX2;
+}
+
+} // namespace
+
 void	BitOpsTest::findLowers64()
 {
 	//
@@ -194,4 +244,138 @@ void BitOpsTest::findNextClear64()
 	QVERIFY2(8 == rv, qPrintable(msg));
 }
 
+void BitOpsTest::kernels_data()
+{
+	addLevels();
+}
+
+void BitOpsTest::kernels()
+{
+	QFETCH(int, level);
+	if (!useLevel(level))
+		QSKIP("Not supported by the CPU", SkipSingle);
+
+	qsrand(level + 1);
+	QVector<UINT64> a(300), b(300), c;
+	for (int k = 0; k < 2000; ++k)
+	{
+		int off = qrand() % 8, words = qrand() % (a.size() - off);
+		fillWords(a.data(), a.size());
+		fillWords(b.data(), b.size());
+
+		c = a;
+		BitMergeWords64(c.data() + off, b.constData() + off, words);
+		SIZE_T count = 0;
+		for (int i = 0; i < a.size(); ++i)
+		{
+			bool inside = i >= off && i < off + words;
+			QCOMPARE(c[i], inside ? a[i] | b[i] : a[i]);
+			for (UINT64 v = inside ? a[i] : 0; v; v &= v - 1)
+				++count;
+		}
+		QCOMPARE(BitCountWords64(a.constData() + off, words), count);
+
+		// unaligned head and tail of bytes
+		int byteOff = qrand() % 8, bytes = qrand() % (words * 8 + 1);
+		const unsigned char *p = (const unsigned char *)(a.constData() + off) + byteOff;
+		SIZE_T bytesCount = 0;
+		for (int i = 0; i < bytes; ++i)
+			for (unsigned v = p[i]; v; v &= v - 1)
+				++bytesCount;
+		QCOMPARE(BMAP_COUNT_IN_BYTES(p, bytes), bytesCount);
+
+		UINT64 pattern = qrand() % 2 ? 0 : ~0llu;
+		int first = off;
+		while (first < off + words && a[first] == pattern)
+			++first;
+		QCOMPARE(BitFindWordNot64(a.constData() + off, words, pattern),
+			(SIZE_T)(first - off));
+
+		// same through the bit search
+		if (words == 0)
+			continue;
+		int from = qrand() % (words * 64);
+		LONG64 set = -1, clear = -1;
+		for (int bit = from; bit < words * 64; ++bit)
+		{
+			bool value = (a[off + bit / 64] >> (bit % 64)) & 1;
+			if (value && set < 0)
+				set = bit;
+			if (!value && clear < 0)
+				clear = bit;
+		}
+		QCOMPARE(BitFindNextSet64(a.constData() + off, words * 64, from), set);
+		QCOMPARE(BitFindNextClear64(a.constData() + off, words * 64, from), clear);
+	}
+
+	BitOpsSetLevel(-1);
+}
+
+void BitOpsTest::benchmarkMerge_data()
+{
+	addLevels();
+}
+
+void BitOpsTest::benchmarkMerge()
+{
+	QFETCH(int, level);
+	if (!useLevel(level))
+		QSKIP("Not supported by the CPU", SkipSingle);
+
+	QVector<UINT64> dest(BENCH_WORDS), src(BENCH_WORDS);
+	fillWords(src.data(), src.size());
+	QBENCHMARK
+	{
+		BMAP_MERGE(dest.data(), src.data(), BENCH_WORDS * 64);
+	}
+
+	BitOpsSetLevel(-1);
+}
+
+void BitOpsTest::benchmarkCount_data()
+{
+	addLevels();
+}
+
+void BitOpsTest::benchmarkCount()
+{
+	QFETCH(int, level);
+	if (!useLevel(level))
+		QSKIP("Not supported by the CPU", SkipSingle);
+
+	QVector<UINT64> buff(BENCH_WORDS);
+	fillWords(buff.data(), buff.size());
+	SIZE_T count = 0;
+	QBENCHMARK
+	{
+		count += BMAP_COUNT(buff.constData(), BENCH_WORDS * 64);
+	}
+	QVERIFY(count > 0);
+
+	BitOpsSetLevel(-1);
+}
+
+void BitOpsTest::benchmarkFindAllSet_data()
+{
+	addLevels();
+}
+
+// Check of merged page being full, as sp_bitmap_merge() does
+void BitOpsTest::benchmarkFindAllSet()
+{
+	QFETCH(int, level);
+	if (!useLevel(level))
+		QSKIP("Not supported by the CPU", SkipSingle);
+
+	QVector<UINT64> buff(BENCH_WORDS, ~0llu);
+	buff[BENCH_WORDS - 1] = 0;
+	QBENCHMARK
+	{
+		QCOMPARE(BitFindNextClear64(buff.constData(), BENCH_WORDS * 64, 0),
+			(LONG64)(BENCH_WORDS - 1) * 64);
+	}
+
+	BitOpsSetLevel(-1);
+}
+
 QTEST_MAIN(BitOpsTest)
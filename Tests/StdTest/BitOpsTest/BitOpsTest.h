@@ -47,6 +47,14 @@ private slots:
 	void	findNextClearSingle64();
 	void	findNextSet64();
 	void	findNextClear64();
+	void	kernels_data();
+	void	kernels();
+	void	benchmarkMerge_data();
+	void	benchmarkMerge();
+	void	benchmarkCount_data();
+	void	benchmarkCount();
+	void	benchmarkFindAllSet_data();
+	void	benchmarkFindAllSet();
 };
 
 #endif //SPARCE_BITMAP_TEST_H
@@ -0,0 +1,635 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		SparseBitmapTest.cpp
+///
+/// @brief
+///		sp_bitmap64 test cases and benchmarks against sp_bitmap.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <QBitArray>
+#include <QByteArray>
+
+#include <Libraries/Std/sparse_bitmap.h>
+#include <Libraries/Std/sparse_bitmap64.h>
+
+#include "SparseBitmapTest.h"
+
+#define		CHUNK_BITS		32768llu
+#define		LEAF_BITS		(CHUNK_BITS << 10)
+
+namespace
+{
+
+UINT64 random64()
+{
+	return ((UINT64)qrand() << 33) ^ ((UINT64)qrand() << 16) ^ qrand();
+}
+
+bool getBit(const QByteArray &buf, UINT64 bit)
+{
+	return (buf.at(bit / 8) >> (bit % 8)) & 1;
+}
+
+bool isClear(const QBitArray &ref, UINT64 begin, UINT64 end)
+{
+	for (UINT64 i = begin; i < end; ++i)
+	{
+		if (ref.testBit(i))
+			return false;
+	}
+	return true;
+}
+
+bool isSet(const QBitArray &ref, UINT64 begin, UINT64 end)
+{
+	for (UINT64 i = begin; i < end; ++i)
+	{
+		if (!ref.testBit(i))
+			return false;
+	}
+	return true;
+}
+
+// Random runs, uniform stretches and noise of the size
+void fill(sp_bitmap64 *bmap, UINT64 size, int ranges)
+{
+	for (int i = 0; i < ranges; ++i)
+	{
+		UINT64 begin = random64() % size;
+		UINT64 len = qrand() % 8 ? qrand() % 4096 : random64() % (LEAF_BITS * 2);
+		UINT64 end = qMin<UINT64>(size, begin + len + 1);
+
+		if (qrand() % 4)
+		{
+			sp_bitmap64_set_range(bmap, end, begin);
+			continue;
+		}
+
+		begin &= ~7llu;
+		end = qMin<UINT64>(begin + CHUNK_BITS, end & ~7llu);
+		if (begin >= end)
+			continue;
+		QByteArray buf((end - begin) / 8, 0);
+		for (int j = 0; j < buf.size(); ++j)
+			buf[j] = (char)qrand();
+		sp_bitmap64_write_aligned_range(bmap, (const UINT8 *)buf.constData(), end, begin);
+	}
+}
+
+bool isEqual(const sp_bitmap64 *a, const sp_bitmap64 *b)
+{
+	UINT64 size = sp_bitmap64_size(a);
+	if (size != sp_bitmap64_size(b))
+		return false;
+
+	QByteArray x(LEAF_BITS / 8, 0), y(LEAF_BITS / 8, 0);
+	for (UINT64 pos = 0; pos < (size & ~7llu); pos += LEAF_BITS)
+	{
+		UINT64 end = qMin<UINT64>(size & ~7llu, pos + LEAF_BITS);
+		sp_bitmap64_read_aligned_range(a, (UINT8 *)x.data(), end, pos);
+		sp_bitmap64_read_aligned_range(b, (UINT8 *)y.data(), end, pos);
+		if (memcmp(x.constData(), y.constData(), (end - pos) / 8))
+			return false;
+	}
+	for (UINT64 bit = size & ~7llu; bit < size; ++bit)
+	{
+		if (sp_bitmap64_is_set(a, bit) != sp_bitmap64_is_set(b, bit))
+			return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Stream
+
+struct Stream
+{
+	Stream(): m_pos(0)
+	{
+	}
+
+	static int write(void *ctx, const void *buf, UINT32 size)
+	{
+		static_cast<Stream *>(ctx)->m_data.append((const char *)buf, size);
+		return 0;
+	}
+
+	static int read(void *ctx, void *buf, UINT32 size)
+	{
+		Stream *s = static_cast<Stream *>(ctx);
+		if (s->m_pos + size > (UINT64)s->m_data.size())
+			return -EIO;
+
+		memcpy(buf, s->m_data.constData() + s->m_pos, size);
+		s->m_pos += size;
+		return 0;
+	}
+
+	QByteArray m_data;
+	UINT64 m_pos;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Legacy
+
+struct Legacy
+{
+	explicit Legacy(UINT64 size): m_bmap(sp_bitmap_create(size))
+	{
+	}
+
+	~Legacy()
+	{
+		sp_bitmap_destroy(m_bmap);
+	}
+
+	int setRange(UINT64 begin, UINT64 end)
+	{
+		return sp_bitmap_set_range(m_bmap, end, begin);
+	}
+
+	int merge(const Legacy &src)
+	{
+		return sp_bitmap_merge(m_bmap, src.m_bmap);
+	}
+
+	int read(UINT8 *buf, UINT64 begin, UINT64 end) const
+	{
+		return sp_bitmap_read_aligned_range(m_bmap, buf, end, begin);
+	}
+
+	UINT64 getMemUsage() const
+	{
+		UINT64 res = sizeof(*m_bmap) + m_bmap->size_pages * sizeof(UINT64 *);
+		for (UINT32 i = 0; i < m_bmap->size_pages; ++i)
+		{
+			if ((quintptr)m_bmap->data[i] > 1)
+				res += CHUNK_BITS / 8;
+		}
+		return res;
+	}
+
+private:
+	sp_bitmap *m_bmap;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Radix
+
+struct Radix
+{
+	explicit Radix(UINT64 size): m_bmap(sp_bitmap64_create(size))
+	{
+	}
+
+	~Radix()
+	{
+		sp_bitmap64_destroy(m_bmap);
+	}
+
+	int setRange(UINT64 begin, UINT64 end)
+	{
+		return sp_bitmap64_set_range(m_bmap, end, begin);
+	}
+
+	int merge(const Radix &src)
+	{
+		return sp_bitmap64_merge(m_bmap, src.m_bmap);
+	}
+
+	int read(UINT8 *buf, UINT64 begin, UINT64 end) const
+	{
+		return sp_bitmap64_read_aligned_range(m_bmap, buf, end, begin);
+	}
+
+	UINT64 getMemUsage() const
+	{
+		return sp_bitmap64_mem_usage(m_bmap);
+	}
+
+private:
+	sp_bitmap64 *m_bmap;
+};
+
+// 1 TB disk with 512 byte granularity, the most the legacy can hold
+const UINT64 BENCH_BITS = 1llu << 31;
+// the dense bitmap, with the chunk headers and the index on top
+const UINT64 BENCH_MEM_LIMIT = BENCH_BITS / CHUNK_BITS * (CHUNK_BITS / 8 + 64);
+
+// Writes of a guest as seen by the change tracking: short sequential
+// streams at random places with a hot area at the start of the disk
+template<class T>
+void track(T &bitmap, int writes, uint seed)
+{
+	qsrand(seed);
+	UINT64 pos = 0;
+	for (int i = 0; i < writes; ++i)
+	{
+		if (i % 16 == 0)
+			pos = random64() % (i % 64 ? BENCH_BITS : BENCH_BITS / 256);
+
+		UINT64 len = 1 + qrand() % 256;
+		if (pos + len > BENCH_BITS)
+			pos = 0;
+
+		QCOMPARE(bitmap.setRange(pos, pos + len), 0);
+		pos += len + qrand() % 8;
+	}
+}
+
+template<class T>
+void benchmarkTracking()
+{
+	QScopedPointer<T> bitmap;
+	QBENCHMARK
+	{
+		bitmap.reset(new T(BENCH_BITS));
+		track(*bitmap, 200000, 1);
+	}
+	QVERIFY(bitmap->getMemUsage() <= BENCH_MEM_LIMIT);
+}
+
+template<class T>
+void benchmarkMerge()
+{
+	QList<QSharedPointer<T> > sources;
+	for (uint i = 0; i < 16; ++i)
+	{
+		sources << QSharedPointer<T>(new T(BENCH_BITS));
+		track(*sources.last(), 20000, i);
+	}
+
+	QScopedPointer<T> bitmap;
+	QBENCHMARK
+	{
+		bitmap.reset(new T(BENCH_BITS));
+		foreach (const QSharedPointer<T> &s, sources)
+			QCOMPARE(bitmap->merge(*s), 0);
+	}
+	QVERIFY(bitmap->getMemUsage() <= BENCH_MEM_LIMIT);
+}
+
+template<class T>
+void benchmarkReadRange()
+{
+	T bitmap(BENCH_BITS);
+	track(bitmap, 200000, 1);
+
+	// window of the backup reading the bitmap
+	QByteArray buf(1 << 20, 0);
+	const UINT64 step = (UINT64)buf.size() * 8;
+	QBENCHMARK
+	{
+		for (UINT64 pos = 0; pos < BENCH_BITS; pos += step)
+			QCOMPARE(bitmap.read((UINT8 *)buf.data(), pos, pos + step), 0);
+	}
+}
+
+} // namespace
+
+void SparseBitmapTest::randomOperations_data()
+{
+	QTest::addColumn<qulonglong>("size");
+
+	QTest::newRow("short") << 1000llu;
+	QTest::newRow("partial chunk") << CHUNK_BITS * 5 + 77;
+	QTest::newRow("leaves") << LEAF_BITS * 2 + CHUNK_BITS * 3 + 8;
+}
+
+void SparseBitmapTest::randomOperations()
+{
+	QFETCH(qulonglong, size);
+
+	qsrand(size);
+	sp_bitmap64 *bmap = sp_bitmap64_create(size);
+	QVERIFY(bmap != NULL);
+	QBitArray ref(size);
+
+	for (int i = 0; i < 3000; ++i)
+	{
+		UINT64 begin = random64() % size;
+		UINT64 len = qrand() % 4 ? qrand() % (CHUNK_BITS * 3) : random64() % size;
+		if (qrand() % 3 == 0)
+			len = qrand() % 40;
+		UINT64 end = qMin<UINT64>(size, begin + len + 1);
+
+		switch (qrand() % 5)
+		{
+		case 0:
+			QCOMPARE(sp_bitmap64_set_range(bmap, end, begin), 0);
+			ref.fill(true, begin, end);
+			break;
+		case 1:
+			QCOMPARE(sp_bitmap64_clear_range(bmap, end, begin), 0);
+			ref.fill(false, begin, end);
+			break;
+		case 2:
+			QCOMPARE(sp_bitmap64_is_set_range(bmap, end, begin),
+				(int)isSet(ref, begin, end));
+			QCOMPARE(sp_bitmap64_is_clear_range(bmap, end, begin),
+				(int)isClear(ref, begin, end));
+			break;
+		case 3:
+		{
+			begin &= ~7llu;
+			end &= ~7llu;
+			if (begin >= end)
+				break;
+			// mostly uniform bytes as bitmaps of formats are
+			QByteArray buf((end - begin) / 8, 0);
+			for (int j = 0; j < buf.size(); ++j)
+				buf[j] = qrand() % 8 ? buf[qMax(j - 1, 0)] : (char)qrand();
+			QCOMPARE(sp_bitmap64_write_aligned_range(bmap,
+				(const UINT8 *)buf.constData(), end, begin), 0);
+			for (UINT64 bit = begin; bit < end; ++bit)
+				ref.setBit(bit, getBit(buf, bit - begin));
+			break;
+		}
+		default:
+		{
+			UINT64 bit = random64() % size;
+			QCOMPARE(sp_bitmap64_is_set(bmap, bit), (int)ref.testBit(bit));
+		}
+		}
+	}
+
+	QByteArray out(size / 8, 0);
+	QCOMPARE(sp_bitmap64_read_aligned_range(bmap, (UINT8 *)out.data(),
+		size & ~7llu, 0), 0);
+	for (UINT64 bit = 0; bit < (size & ~7llu); ++bit)
+		QCOMPARE(getBit(out, bit), ref.testBit(bit));
+
+	sp_bitmap64 *copy = sp_bitmap64_create(size);
+	QCOMPARE(sp_bitmap64_merge(copy, bmap), 0);
+	QCOMPARE(sp_bitmap64_set_range(bmap, size, size / 2), 0);
+	QCOMPARE(sp_bitmap64_merge(bmap, copy), 0);
+	QCOMPARE(sp_bitmap64_is_set_range(bmap, size, size / 2), 1);
+	QCOMPARE(sp_bitmap64_is_set_range(copy, size, size / 2),
+		(int)isSet(ref, size / 2, size));
+
+	sp_bitmap64_destroy(copy);
+	sp_bitmap64_destroy(bmap);
+}
+
+void SparseBitmapTest::largeIndices()
+{
+	// 32 PB disk with 512 byte granularity
+	const UINT64 size = 1llu << 46;
+	sp_bitmap64 *bmap = sp_bitmap64_create(size);
+	QVERIFY(bmap != NULL);
+	QCOMPARE(sp_bitmap64_size(bmap), size);
+	// directory of 2^21 leaves
+	QVERIFY(sp_bitmap64_mem_usage(bmap) <= 17llu << 20);
+
+	const UINT64 wrap = 1llu << 32;
+	QCOMPARE(sp_bitmap64_set_range(bmap, wrap + 100, wrap - 100), 0);
+	QCOMPARE(sp_bitmap64_is_set_range(bmap, wrap + 100, wrap - 100), 1);
+	QCOMPARE(sp_bitmap64_is_set(bmap, wrap - 101), 0);
+	QCOMPARE(sp_bitmap64_is_set(bmap, 100), 0);
+	QCOMPARE(sp_bitmap64_is_clear_range(bmap, wrap - 100, 0), 1);
+
+	QCOMPARE(sp_bitmap64_set(bmap, size - 1), 0);
+	QCOMPARE(sp_bitmap64_is_set(bmap, size - 1), 1);
+	QCOMPARE(sp_bitmap64_is_set(bmap, size), -EINVAL);
+	QCOMPARE(sp_bitmap64_set_range(bmap, size + 1, size - 1), -EINVAL);
+
+	QCOMPARE(sp_bitmap64_set_all(bmap), 0);
+	QCOMPARE(sp_bitmap64_clear_range(bmap, size - 8, wrap), 0);
+	QCOMPARE(sp_bitmap64_is_set_range(bmap, wrap, 0), 1);
+	QCOMPARE(sp_bitmap64_is_clear_range(bmap, size - 8, wrap), 1);
+	QCOMPARE(sp_bitmap64_is_set_range(bmap, size, size - 8), 1);
+
+	UINT8 buf[2];
+	QCOMPARE(sp_bitmap64_read_aligned_range(bmap, buf, size, size - 16), 0);
+	QCOMPARE(buf[0], (UINT8)0);
+	QCOMPARE(buf[1], (UINT8)0xff);
+
+	sp_bitmap64_destroy(bmap);
+}
+
+void SparseBitmapTest::compactForms()
+{
+	const UINT64 size = LEAF_BITS * 4;
+	sp_bitmap64 *bmap = sp_bitmap64_create(size);
+	const UINT64 empty = sp_bitmap64_mem_usage(bmap);
+
+	// Uniform data takes no chunks, only slots of the leaf
+	QByteArray buf(CHUNK_BITS * 4 / 8, (char)0xff);
+	QCOMPARE(sp_bitmap64_write_aligned_range(bmap,
+		(const UINT8 *)buf.constData(), CHUNK_BITS * 5, CHUNK_BITS), 0);
+	QVERIFY(sp_bitmap64_mem_usage(bmap) - empty < 8300);
+
+	// Few runs are kept as runs
+	for (UINT64 bit = 0; bit < size; bit += CHUNK_BITS / 4)
+		QCOMPARE(sp_bitmap64_set(bmap, bit), 0);
+	QVERIFY(sp_bitmap64_mem_usage(bmap) - empty < (size / CHUNK_BITS) * 64 + 4 * 8200);
+
+	// Fragmented chunk is a page, dropped once it is filled
+	for (UINT64 bit = 0; bit < CHUNK_BITS; bit += 2)
+		QCOMPARE(sp_bitmap64_set(bmap, bit), 0);
+	QCOMPARE(sp_bitmap64_set_range(bmap, CHUNK_BITS, 0), 0);
+	QCOMPARE(sp_bitmap64_is_set_range(bmap, CHUNK_BITS * 5, 0), 1);
+
+	QCOMPARE(sp_bitmap64_set_all(bmap), 0);
+	QCOMPARE(sp_bitmap64_mem_usage(bmap), empty);
+	QCOMPARE(sp_bitmap64_clear(bmap, 12345), 0);
+	QVERIFY(sp_bitmap64_mem_usage(bmap) - empty < 8300);
+	QCOMPARE(sp_bitmap64_set(bmap, 12345), 0);
+	QCOMPARE(sp_bitmap64_mem_usage(bmap), empty);
+
+	sp_bitmap64_destroy(bmap);
+}
+
+void SparseBitmapTest::legacyClearRange()
+{
+	const UINT32 size = CHUNK_BITS * 3;
+	sp_bitmap *bmap = sp_bitmap_create(size);
+
+	QCOMPARE(sp_bitmap_set(bmap, CHUNK_BITS + 5), 0);
+	QCOMPARE(sp_bitmap_clear_range(bmap, size, 0), 0);
+	QCOMPARE(sp_bitmap_is_clear_range(bmap, size, 0), 1);
+
+	sp_bitmap_destroy(bmap);
+}
+
+void SparseBitmapTest::mergeRange()
+{
+	const UINT64 size = LEAF_BITS * 3 + 100;
+	sp_bitmap64 *src = sp_bitmap64_create(size);
+	sp_bitmap64 *whole = sp_bitmap64_create(size);
+	sp_bitmap64 *parts = sp_bitmap64_create(size);
+
+	qsrand(1);
+	fill(src, size, 300);
+	fill(whole, size, 300);
+	QCOMPARE(sp_bitmap64_merge(parts, whole), 0);
+
+	QCOMPARE(sp_bitmap64_merge(whole, src), 0);
+	// in any order, as the threads would do
+	QCOMPARE(sp_bitmap64_merge_range(parts, src, size, SP_BITMAP64_PART_BITS * 3), 0);
+	QCOMPARE(sp_bitmap64_merge_range(parts, src, SP_BITMAP64_PART_BITS, 0), 0);
+	QCOMPARE(sp_bitmap64_merge_range(parts, src, SP_BITMAP64_PART_BITS * 3,
+		SP_BITMAP64_PART_BITS), 0);
+	QVERIFY(isEqual(whole, parts));
+
+	QCOMPARE(sp_bitmap64_merge_range(parts, src, size, 8), -EINVAL);
+	QCOMPARE(sp_bitmap64_merge_range(parts, src, size - 1, 0), -EINVAL);
+
+	sp_bitmap64_destroy(parts);
+	sp_bitmap64_destroy(whole);
+	sp_bitmap64_destroy(src);
+}
+
+void SparseBitmapTest::stream_data()
+{
+	QTest::addColumn<qulonglong>("size");
+	QTest::addColumn<int>("ranges");
+
+	QTest::newRow("short") << 1000llu << 20;
+	QTest::newRow("partial chunk") << CHUNK_BITS * 5 + 77 << 200;
+	QTest::newRow("leaves") << LEAF_BITS * 3 + CHUNK_BITS * 3 + 9 << 2000;
+}
+
+void SparseBitmapTest::stream()
+{
+	QFETCH(qulonglong, size);
+	QFETCH(int, ranges);
+
+	qsrand(ranges);
+	sp_bitmap64 *bmap = sp_bitmap64_create(size);
+	fill(bmap, size, ranges);
+
+	Stream s;
+	QCOMPARE(sp_bitmap64_save(bmap, &Stream::write, &s), 0);
+
+	sp_bitmap64 *copy = sp_bitmap64_create(size);
+	QCOMPARE(sp_bitmap64_load(copy, &Stream::read, &s), 0);
+	QCOMPARE(s.m_pos, (UINT64)s.m_data.size());
+	QVERIFY(isEqual(bmap, copy));
+
+	// loading ORs the stream into the bitmap
+	sp_bitmap64 *other = sp_bitmap64_create(size);
+	fill(other, size, ranges);
+	QCOMPARE(sp_bitmap64_merge(copy, other), 0);
+	s.m_pos = 0;
+	QCOMPARE(sp_bitmap64_load(other, &Stream::read, &s), 0);
+	QVERIFY(isEqual(other, copy));
+
+	sp_bitmap64_destroy(other);
+	sp_bitmap64_destroy(copy);
+	sp_bitmap64_destroy(bmap);
+}
+
+void SparseBitmapTest::streamErrors()
+{
+	const UINT64 size = 1llu << 40;
+	sp_bitmap64 *bmap = sp_bitmap64_create(size);
+
+	// Uniform bitmaps are a single record
+	Stream empty;
+	QCOMPARE(sp_bitmap64_save(bmap, &Stream::write, &empty), 0);
+	QCOMPARE(empty.m_data.size(), 5);
+
+	QCOMPARE(sp_bitmap64_set_range(bmap, size, CHUNK_BITS * 3 + 1), 0);
+	Stream s;
+	QCOMPARE(sp_bitmap64_save(bmap, &Stream::write, &s), 0);
+	QVERIFY(s.m_data.size() < 32);
+
+	sp_bitmap64 *copy = sp_bitmap64_create(size);
+	Stream cut;
+	cut.m_data = s.m_data;
+	cut.m_data.chop(1);
+	QCOMPARE(sp_bitmap64_load(copy, &Stream::read, &cut), -EIO);
+
+	// Records past the end of the bitmap
+	Stream longer;
+	longer.m_data = s.m_data;
+	longer.m_data[1] = 4;
+	QCOMPARE(sp_bitmap64_load(copy, &Stream::read, &longer), -EINVAL);
+
+	Stream tag;
+	tag.m_data = QByteArray(5, 4);
+	QCOMPARE(sp_bitmap64_load(copy, &Stream::read, &tag), -EINVAL);
+
+	// Runs must be sorted
+	const char runs[] = {2, 2, 0, 10, 0, 20, 0, 5, 0, 6, 0};
+	Stream unsorted;
+	unsorted.m_data = QByteArray(runs, sizeof(runs));
+	QCOMPARE(sp_bitmap64_load(copy, &Stream::read, &unsorted), -EINVAL);
+
+	sp_bitmap64_destroy(copy);
+	sp_bitmap64_destroy(bmap);
+}
+
+void SparseBitmapTest::benchmarkTracking_data()
+{
+	QTest::addColumn<bool>("legacy");
+
+	QTest::newRow("sp_bitmap") << true;
+	QTest::newRow("sp_bitmap64") << false;
+}
+
+void SparseBitmapTest::benchmarkTracking()
+{
+	QFETCH(bool, legacy);
+
+	if (legacy)
+		::benchmarkTracking<Legacy>();
+	else
+		::benchmarkTracking<Radix>();
+}
+
+void SparseBitmapTest::benchmarkMerge_data()
+{
+	benchmarkTracking_data();
+}
+
+void SparseBitmapTest::benchmarkMerge()
+{
+	QFETCH(bool, legacy);
+
+	if (legacy)
+		::benchmarkMerge<Legacy>();
+	else
+		::benchmarkMerge<Radix>();
+}
+
+void SparseBitmapTest::benchmarkReadRange_data()
+{
+	benchmarkTracking_data();
+}
+
+void SparseBitmapTest::benchmarkReadRange()
+{
+	QFETCH(bool, legacy);
+
+	if (legacy)
+		::benchmarkReadRange<Legacy>();
+	else
+		::benchmarkReadRange<Radix>();
+}
+
+QTEST_MAIN(SparseBitmapTest)
@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		SparseBitmapTest.h
+///
+/// @brief
+///		sp_bitmap64 test cases and benchmarks against sp_bitmap.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef SPARSE_BITMAP64_TEST_H
+#define SPARSE_BITMAP64_TEST_H
+
+#include <QtTest/QtTest>
+
+class SparseBitmapTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void randomOperations_data();
+	void randomOperations();
+	void largeIndices();
+	void compactForms();
+	void legacyClearRange();
+	void mergeRange();
+	void stream_data();
+	void stream();
+	void streamErrors();
+	void benchmarkTracking_data();
+	void benchmarkTracking();
+	void benchmarkMerge_data();
+	void benchmarkMerge();
+	void benchmarkReadRange_data();
+	void benchmarkReadRange();
+};
+
+#endif // SPARSE_BITMAP64_TEST_H
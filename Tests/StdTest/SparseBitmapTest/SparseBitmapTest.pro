@@ -0,0 +1,7 @@
+CONFIG += qtestlib testcase
+QT = core
+
+include(SparseBitmapTest.deps)
+
+HEADERS += SparseBitmapTest.h
+SOURCES += SparseBitmapTest.cpp
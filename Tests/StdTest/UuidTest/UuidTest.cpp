@@ -296,6 +296,68 @@ void UuidTest::useUuidFormatWithoutDashes()
 	QCOMPARE(Uuid("863cd36b106c4bbc831fc3c33d3f8c7c").toString(), Uuid("863cd36b-106c-4bbc-831f-c3c33d3f8c7c").toString());
 }
 
+void UuidTest::randomUuidVersion()
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+		Uuid_t uuid;
+		Uuid::createUuid(uuid);
+		// RFC 4122 version 4, variant 10xx
+		QCOMPARE(uuid[6] & 0xF0, 0x40);
+		QCOMPARE(uuid[8] & 0xC0, 0x80);
+		QCOMPARE(QUuid(Uuid::toString(uuid)).version(), QUuid::Random);
+	}
+}
+
+void UuidTest::bulkUuids()
+{
+	QVERIFY(Uuid::createUuids(0).isEmpty());
+
+	// More than one block of random generator
+	QList<Uuid> uuids = Uuid::createUuids(1000);
+	QCOMPARE(uuids.size(), 1000);
+
+	QSet<QString> set;
+	foreach(const Uuid& uuid, uuids)
+	{
+		QVERIFY(!uuid.isNull());
+		QCOMPARE(QUuid(uuid.toString()).version(), QUuid::Random);
+		set.insert(uuid.toString());
+	}
+	set.insert(Uuid::createUuid().toString());
+	QCOMPARE(set.size(), 1001);
+}
+
+void UuidTest::benchmarkCreateUuid_data()
+{
+	QTest::addColumn<bool>("bulk");
+
+	QTest::newRow("single") << false;
+	QTest::newRow("bulk") << true;
+}
+
+void UuidTest::benchmarkCreateUuid()
+{
+	QFETCH(bool, bulk);
+
+	const int UuidsNum = 1000;
+	Uuid_t uuids[UuidsNum];
+	if (bulk)
+	{
+		QBENCHMARK {
+			PrlUuid::generate(uuids, UuidsNum);
+		}
+	}
+	else
+	{
+		QBENCHMARK {
+			for (int i = 0; i < UuidsNum; ++i)
+				PrlUuid::generate(uuids[i]);
+		}
+	}
+	QVERIFY(!Uuid::toUuid(uuids[UuidsNum - 1]).isNull());
+}
+
 /****************************************************************************/
 
 QTEST_MAIN(UuidTest)
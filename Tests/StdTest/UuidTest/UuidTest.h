@@ -52,6 +52,10 @@ private slots:
     void obfuscateUuid();
     void obfuscateUuidForWrongUuid();
     void useUuidFormatWithoutDashes();
+    void randomUuidVersion();
+    void bulkUuids();
+    void benchmarkCreateUuid_data();
+    void benchmarkCreateUuid();
 };
 
 #endif //UUIDTEST_H
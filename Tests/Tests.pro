@@ -20,4 +20,7 @@ addSubdirsDir(IOServiceTest, $$PWD/IOServiceTest)
 
 include($$PWD/VirtuozzoDirTest/VirtuozzoDirTest.deps)
 include($$PWD/StdTest/StdTest.pro)
+include($$PWD/LoggingTest/LoggingTest.deps)
 include($$PWD/QtLibraryTest/QtLibraryTest.deps)
+include($$PWD/VirtualDiskTest/VirtualDiskTest.deps)
+include($$PWD/MessagingTest/MessagingTest.deps)
@@ -0,0 +1,316 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		AsyncDiskTest.cpp
+///
+/// @brief
+///		VirtualDisk::Async request queues test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <boost/bind.hpp>
+#include <prlsdk/PrlErrorsValues.h>
+#include <QAtomicInt>
+#include <QTemporaryFile>
+
+#include <Libraries/VirtualDisk/AsyncDisk.h>
+#include <Libraries/VirtualDisk/VirtualDisk.h>
+
+#include "AsyncDiskTest.h"
+
+using namespace VirtualDisk;
+
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Memory - image in memory, served with the default queue
+
+struct Memory : Format
+{
+	explicit Memory(const QByteArray &data): m_data(data)
+	{
+	}
+
+	virtual PRL_RESULT open(const QString &, const PRL_DISK_OPEN_FLAGS,
+			const policyList_type &)
+	{
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT read(void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		if (offSec * SECTOR_SIZE + sizeBytes > (PRL_UINT64)m_data.size())
+			return PRL_ERR_DISK_READ_OUT_DISK;
+		memcpy(data, m_data.constData() + offSec * SECTOR_SIZE, sizeBytes);
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT write(const void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		if (offSec * SECTOR_SIZE + sizeBytes > (PRL_UINT64)m_data.size())
+			return PRL_ERR_INVALID_ARG;
+		memcpy(m_data.data() + offSec * SECTOR_SIZE, data, sizeBytes);
+		return PRL_ERR_SUCCESS;
+	}
+	virtual Parameters::disk_type getInfo()
+	{
+		Parameters::Disk disk;
+		disk.setSizeInSectors(m_data.size() / SECTOR_SIZE);
+		return disk;
+	}
+	virtual PRL_RESULT close()
+	{
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT cloneState(const QString &, const QString &)
+	{
+		return PRL_ERR_UNIMPLEMENTED;
+	}
+	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32, PRL_RESULT &err)
+	{
+		err = PRL_ERR_UNIMPLEMENTED;
+		return NULL;
+	}
+	virtual CSparseBitmap *getTrackingBitmap(const QString &)
+	{
+		return NULL;
+	}
+
+	QByteArray m_data;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Image - the same data in a file and in memory
+
+struct Image
+{
+	explicit Image(PRL_UINT64 sectors):
+		m_memory(QByteArray(sectors * SECTOR_SIZE, 0))
+	{
+		for (int i = 0; i < m_memory.m_data.size(); ++i)
+			m_memory.m_data[i] = (char)qrand();
+	}
+
+	bool open()
+	{
+		if (!m_file.open())
+			return false;
+		return m_file.write(m_memory.m_data) == m_memory.m_data.size()
+			&& m_file.flush();
+	}
+
+	QByteArray read()
+	{
+		m_file.seek(0);
+		return m_file.readAll();
+	}
+
+	// NULL if the backend is not available
+	Async::Queue *createQueue(const QString &backend, PRL_UINT32 depth)
+	{
+		if (backend == "uring")
+			return Async::Uring::create(m_file.handle(), depth);
+		if (backend == "pool")
+			return new Async::Pool(m_file.handle(), depth);
+		return m_memory.createQueue(depth);
+	}
+
+	QByteArray getData() const
+	{
+		return m_memory.m_data;
+	}
+
+	QTemporaryFile m_file;
+	Memory m_memory;
+};
+
+void count(QAtomicInt *counter, PRL_RESULT *result, PRL_RESULT code)
+{
+	*result = code;
+	counter->ref();
+}
+
+void addBackends()
+{
+	QTest::addColumn<QString>("backend");
+	QTest::addColumn<uint>("depth");
+
+	QTest::newRow("uring/1") << QString("uring") << 1u;
+	QTest::newRow("uring/32") << QString("uring") << 32u;
+	QTest::newRow("pool/1") << QString("pool") << 1u;
+	QTest::newRow("pool/32") << QString("pool") << 32u;
+	QTest::newRow("format/32") << QString("format") << 32u;
+}
+
+} // namespace
+
+void AsyncDiskTest::readWrite_data()
+{
+	addBackends();
+}
+
+void AsyncDiskTest::readWrite()
+{
+	QFETCH(QString, backend);
+	QFETCH(uint, depth);
+
+	enum {SECTORS = 2048, CHUNK = 16, COUNT = SECTORS / CHUNK};
+	Image image(SECTORS);
+	QVERIFY(image.open());
+	QScopedPointer<Async::Queue> queue(image.createQueue(backend, depth));
+	if (queue.isNull())
+		QSKIP("Backend is not available", SkipSingle);
+	QCOMPARE(queue->getDepth(), (PRL_UINT32)depth);
+
+	// Overwrite every chunk with two buffers, in reverse order
+	QByteArray pattern(SECTORS * SECTOR_SIZE, 0);
+	for (int i = 0; i < pattern.size(); ++i)
+		pattern[i] = (char)qrand();
+	const PRL_UINT32 half = CHUNK * SECTOR_SIZE / 2;
+	QAtomicInt done(0);
+	std::vector<PRL_RESULT> results(COUNT, PRL_ERR_UNINITIALIZED);
+	QList<Async::Request> requests;
+	for (int i = COUNT - 1; i >= 0; --i)
+	{
+		char *d = pattern.data() + i * CHUNK * SECTOR_SIZE;
+		requests << Async::Request(Async::Request::Write, i * CHUNK)
+			.addBuffer(d, half).addBuffer(d + half, half)
+			.setCallback(boost::bind(&count, &done, &results[i], _1));
+	}
+	QList<Async::future_type> futures = queue->submit(requests);
+	QCOMPARE(futures.size(), (int)COUNT);
+	foreach (Async::future_type f, futures)
+		QCOMPARE(f.result(), PRL_ERR_SUCCESS);
+	// callbacks are called before the futures are finished
+	QCOMPARE(done.fetchAndAddOrdered(0), (int)COUNT);
+	foreach (PRL_RESULT r, results)
+		QCOMPARE(r, PRL_ERR_SUCCESS);
+
+	// Read it back with one buffer per request
+	QByteArray data(SECTORS * SECTOR_SIZE, 0);
+	requests.clear();
+	for (int i = 0; i < COUNT; ++i)
+	{
+		requests << Async::Request(Async::Request::Read, i * CHUNK)
+			.addBuffer(data.data() + i * CHUNK * SECTOR_SIZE,
+				CHUNK * SECTOR_SIZE);
+	}
+	futures = queue->submit(requests);
+	foreach (Async::future_type f, futures)
+		QCOMPARE(f.result(), PRL_ERR_SUCCESS);
+	QVERIFY(data == pattern);
+
+	if (backend == "format")
+		QVERIFY(image.getData() == pattern);
+	else
+		QVERIFY(image.read() == pattern);
+}
+
+void AsyncDiskTest::readBeyondEnd_data()
+{
+	addBackends();
+}
+
+void AsyncDiskTest::readBeyondEnd()
+{
+	QFETCH(QString, backend);
+	QFETCH(uint, depth);
+
+	Image image(64);
+	QVERIFY(image.open());
+	QScopedPointer<Async::Queue> queue(image.createQueue(backend, depth));
+	if (queue.isNull())
+		QSKIP("Backend is not available", SkipSingle);
+
+	// The first request is valid, the other one starts at the end
+	QByteArray data(8 * SECTOR_SIZE, 0);
+	QList<Async::Request> requests;
+	requests << Async::Request(Async::Request::Read, 56)
+		.addBuffer(data.data(), data.size());
+	requests << Async::Request(Async::Request::Read, 64)
+		.addBuffer(data.data(), data.size());
+	QList<Async::future_type> futures = queue->submit(requests);
+	QCOMPARE(futures.at(0).result(), PRL_ERR_SUCCESS);
+	QCOMPARE(futures.at(1).result(), PRL_ERR_DISK_READ_OUT_DISK);
+}
+
+void AsyncDiskTest::drain()
+{
+	Image image(1024);
+	QVERIFY(image.open());
+	QScopedPointer<Async::Queue> queue(Async::createQueue(image.m_file.handle(), 4));
+	QVERIFY(!queue.isNull());
+
+	QByteArray data(1024 * SECTOR_SIZE, 0);
+	QList<Async::Request> requests;
+	for (int i = 0; i < 1024; i += 8)
+	{
+		requests << Async::Request(Async::Request::Read, i)
+			.addBuffer(data.data() + i * SECTOR_SIZE, 8 * SECTOR_SIZE);
+	}
+	QList<Async::future_type> futures = queue->submit(requests);
+	queue->drain();
+	foreach (Async::future_type f, futures)
+		QVERIFY(f.isFinished());
+	QVERIFY(data == image.getData());
+}
+
+void AsyncDiskTest::benchmarkRead_data()
+{
+	QTest::addColumn<uint>("depth");
+
+	QTest::newRow("depth 1") << 1u;
+	QTest::newRow("depth 32") << 32u;
+}
+
+void AsyncDiskTest::benchmarkRead()
+{
+	QFETCH(uint, depth);
+
+	// 4K random reads over 16M
+	enum {SECTORS = 32768, CHUNK = 8, COUNT = 1024};
+	Image image(SECTORS);
+	QVERIFY(image.open());
+	QScopedPointer<Async::Queue> queue(Async::createQueue(image.m_file.handle(), depth));
+	QVERIFY(!queue.isNull());
+
+	QByteArray data(COUNT * CHUNK * SECTOR_SIZE, 0);
+	QList<Async::Request> requests;
+	for (int i = 0; i < COUNT; ++i)
+	{
+		requests << Async::Request(Async::Request::Read,
+				qrand() % (SECTORS / CHUNK) * CHUNK)
+			.addBuffer(data.data() + i * CHUNK * SECTOR_SIZE,
+				CHUNK * SECTOR_SIZE);
+	}
+	QBENCHMARK
+	{
+		queue->submit(requests);
+		queue->drain();
+	}
+}
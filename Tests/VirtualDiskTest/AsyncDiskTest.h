@@ -0,0 +1,50 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		AsyncDiskTest.h
+///
+/// @brief
+///		VirtualDisk::Async request queues test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ASYNC_DISK_TEST_H
+#define ASYNC_DISK_TEST_H
+
+#include <QtTest/QtTest>
+
+class AsyncDiskTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void readWrite_data();
+	void readWrite();
+	void readBeyondEnd_data();
+	void readBeyondEnd();
+	void drain();
+	void benchmarkRead_data();
+	void benchmarkRead();
+};
+
+#endif // ASYNC_DISK_TEST_H
@@ -0,0 +1,374 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		BufferedDiskTest.cpp
+///
+/// @brief
+///		VirtualDisk::Buffered cache test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <prlsdk/PrlErrorsValues.h>
+#include <QTemporaryFile>
+
+#include <Libraries/VirtualDisk/BufferedDisk.h>
+#include <Libraries/VirtualDisk/Util.h>
+
+#include "BufferedDiskTest.h"
+
+using namespace VirtualDisk;
+
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Memory - image in memory, counts requests
+
+struct Memory : Format
+{
+	explicit Memory(PRL_UINT64 sectors):
+		m_data(sectors * SECTOR_SIZE, 0), m_reads(0), m_writes(0)
+	{
+	}
+
+	virtual PRL_RESULT open(const QString &, const PRL_DISK_OPEN_FLAGS,
+			const policyList_type &)
+	{
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT read(void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		++m_reads;
+		if (offSec * SECTOR_SIZE + sizeBytes > (PRL_UINT64)m_data.size())
+			return PRL_ERR_DISK_READ_OUT_DISK;
+		memcpy(data, m_data.constData() + offSec * SECTOR_SIZE, sizeBytes);
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT write(const void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		++m_writes;
+		if (offSec * SECTOR_SIZE + sizeBytes > (PRL_UINT64)m_data.size())
+			return PRL_ERR_INVALID_ARG;
+		memcpy(m_data.data() + offSec * SECTOR_SIZE, data, sizeBytes);
+		return PRL_ERR_SUCCESS;
+	}
+	virtual Parameters::disk_type getInfo()
+	{
+		Parameters::Disk disk;
+		disk.setSizeInSectors(m_data.size() / SECTOR_SIZE);
+		return disk;
+	}
+	virtual PRL_RESULT close()
+	{
+		return PRL_ERR_SUCCESS;
+	}
+	virtual PRL_RESULT cloneState(const QString &, const QString &)
+	{
+		return PRL_ERR_UNIMPLEMENTED;
+	}
+	virtual CSparseBitmap *getUsedBlocksBitmap(UINT32, PRL_RESULT &err)
+	{
+		err = PRL_ERR_UNIMPLEMENTED;
+		return NULL;
+	}
+	virtual CSparseBitmap *getTrackingBitmap(const QString &)
+	{
+		return NULL;
+	}
+
+	QByteArray m_data;
+	int m_reads;
+	int m_writes;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Raw - plain image file, one syscall per request
+
+struct Raw : Memory
+{
+	Raw(): Memory(0), m_size(0)
+	{
+	}
+
+	virtual PRL_RESULT open(const QString &fileName,
+			const PRL_DISK_OPEN_FLAGS flags, const policyList_type &)
+	{
+		m_size = QFileInfo(fileName).size() / SECTOR_SIZE;
+		return m_file.open(fileName, flags & PRL_DISK_WRITE ? O_RDWR : O_RDONLY);
+	}
+	virtual PRL_RESULT read(void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		++m_reads;
+		return m_file.pread(data, sizeBytes, offSec * SECTOR_SIZE);
+	}
+	virtual PRL_RESULT write(const void *data, PRL_UINT32 sizeBytes,
+			PRL_UINT64 offSec)
+	{
+		++m_writes;
+		return m_file.pwrite(data, sizeBytes, offSec * SECTOR_SIZE);
+	}
+	virtual Parameters::disk_type getInfo()
+	{
+		Parameters::Disk disk;
+		disk.setSizeInSectors(m_size);
+		return disk;
+	}
+	virtual PRL_RESULT close()
+	{
+		return m_file.close();
+	}
+
+	PRL_UINT64 m_size;
+	IO::File m_file;
+};
+
+void fillRandom(char *data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		data[i] = (char)qrand();
+}
+
+PRL_RESULT copy(Format &src, Format &dst, PRL_UINT64 sectors,
+		PRL_UINT32 chunk)
+{
+	QByteArray buf(chunk * SECTOR_SIZE, 0);
+	for (PRL_UINT64 off = 0; off < sectors; off += chunk)
+	{
+		PRL_UINT32 n = qMin<PRL_UINT64>(chunk, sectors - off) * SECTOR_SIZE;
+		PRL_RESULT res = src.read(buf.data(), n, off);
+		if (PRL_FAILED(res))
+			return res;
+		res = dst.write(buf.constData(), n, off);
+		if (PRL_FAILED(res))
+			return res;
+	}
+	return PRL_ERR_SUCCESS;
+}
+
+} // namespace
+
+void BufferedDiskTest::randomReadWrite_data()
+{
+	QTest::addColumn<uint>("blockSize");
+	QTest::addColumn<uint>("blocks");
+	QTest::addColumn<uint>("readAhead");
+
+	QTest::newRow("tiny cache") << 8u << 2u << 1u;
+	QTest::newRow("read-ahead") << 16u << 8u << 4u;
+	QTest::newRow("default") << 128u << 256u << 16u;
+}
+
+void BufferedDiskTest::randomReadWrite()
+{
+	QFETCH(uint, blockSize);
+	QFETCH(uint, blocks);
+	QFETCH(uint, readAhead);
+
+	// The last block of the disk is incomplete
+	const PRL_UINT64 sectors = 20000 + 37;
+	qsrand(blockSize);
+
+	Memory *memory = new Memory(sectors);
+	fillRandom(memory->m_data.data(), memory->m_data.size());
+	QByteArray expected = memory->m_data;
+
+	Parameters::Cache cache;
+	cache.setBlockSize(blockSize);
+	cache.setBlocks(blocks);
+	cache.setReadAhead(readAhead);
+	Buffered disk(memory, cache);
+	QCOMPARE(disk.open("memory", PRL_DISK_READ | PRL_DISK_WRITE),
+			PRL_ERR_SUCCESS);
+
+	QByteArray buf(64 * SECTOR_SIZE, 0);
+	for (int i = 0; i < 20000; ++i)
+	{
+		PRL_UINT32 n = 1 + qrand() % 64;
+		PRL_UINT64 off = qrand() % (sectors - n + 1);
+		// mix in sequential streams to trigger read-ahead
+		if (i % 3 == 0)
+			off = (i * 7) % (sectors - n);
+
+		if (qrand() % 2)
+		{
+			fillRandom(buf.data(), n * SECTOR_SIZE);
+			QCOMPARE(disk.write(buf.constData(), n * SECTOR_SIZE, off),
+					PRL_ERR_SUCCESS);
+			memcpy(expected.data() + off * SECTOR_SIZE, buf.constData(),
+					n * SECTOR_SIZE);
+		}
+		else
+		{
+			QCOMPARE(disk.read(buf.data(), n * SECTOR_SIZE, off),
+					PRL_ERR_SUCCESS);
+			QVERIFY(!memcmp(buf.constData(),
+					expected.constData() + off * SECTOR_SIZE, n * SECTOR_SIZE));
+		}
+	}
+
+	QCOMPARE(disk.flush(), PRL_ERR_SUCCESS);
+	QVERIFY(memory->m_data == expected);
+}
+
+void BufferedDiskTest::readPartiallyWritten()
+{
+	Memory *memory = new Memory(1024);
+	fillRandom(memory->m_data.data(), memory->m_data.size());
+	QByteArray expected = memory->m_data;
+	Buffered disk(memory);
+	QCOMPARE(disk.open("memory", PRL_DISK_READ | PRL_DISK_WRITE),
+			PRL_ERR_SUCCESS);
+
+	// Block is not read from disk for write
+	QByteArray buf(4 * SECTOR_SIZE, 'x');
+	QCOMPARE(disk.write(buf.constData(), buf.size(), 10), PRL_ERR_SUCCESS);
+	memcpy(expected.data() + 10 * SECTOR_SIZE, buf.constData(), buf.size());
+	QCOMPARE(memory->m_reads, 0);
+
+	// Written part is read from the cache
+	QByteArray out(2 * SECTOR_SIZE, 0);
+	QCOMPARE(disk.read(out.data(), out.size(), 11), PRL_ERR_SUCCESS);
+	QVERIFY(out == buf.left(out.size()));
+	QCOMPARE(memory->m_reads, 0);
+
+	// The rest of the block is merged with written data
+	out.resize(32 * SECTOR_SIZE);
+	QCOMPARE(disk.read(out.data(), out.size(), 0), PRL_ERR_SUCCESS);
+	QVERIFY(out == expected.left(out.size()));
+	QCOMPARE(memory->m_writes, 1);
+
+	QCOMPARE(disk.close(), PRL_ERR_SUCCESS);
+	QVERIFY(memory->m_data == expected);
+}
+
+void BufferedDiskTest::coalesceSequentialCopy()
+{
+	const PRL_UINT64 sectors = 1 << 16;
+	Memory *src = new Memory(sectors);
+	Memory *dst = new Memory(sectors);
+	fillRandom(src->m_data.data(), src->m_data.size());
+
+	Parameters::Cache cache;
+	Buffered in(src, cache), out(dst, cache);
+	QCOMPARE(in.open("src", PRL_DISK_READ), PRL_ERR_SUCCESS);
+	QCOMPARE(out.open("dst", PRL_DISK_READ | PRL_DISK_WRITE), PRL_ERR_SUCCESS);
+
+	// 4K requests become whole read-ahead windows
+	QCOMPARE(copy(in, out, sectors, 8), PRL_ERR_SUCCESS);
+	QCOMPARE(out.flush(), PRL_ERR_SUCCESS);
+
+	int window = cache.getBlockSize() * cache.getReadAhead();
+	QCOMPARE(src->m_reads, (int)(sectors / window));
+	QCOMPARE(dst->m_writes, (int)(sectors / window));
+	QCOMPARE(dst->m_reads, 0);
+	QVERIFY(src->m_data == dst->m_data);
+}
+
+void BufferedDiskTest::largeRequestsBypass()
+{
+	Memory *memory = new Memory(8192);
+	Buffered disk(memory);
+	QCOMPARE(disk.open("memory", PRL_DISK_READ | PRL_DISK_WRITE),
+			PRL_ERR_SUCCESS);
+
+	QByteArray small(SECTOR_SIZE, 's');
+	QCOMPARE(disk.write(small.constData(), small.size(), 5), PRL_ERR_SUCCESS);
+	QCOMPARE(memory->m_writes, 0);
+
+	// Overlapped dirty data goes first, then the request itself
+	QByteArray large(4096 * SECTOR_SIZE, 'l');
+	QCOMPARE(disk.write(large.constData(), large.size(), 0), PRL_ERR_SUCCESS);
+	QCOMPARE(memory->m_writes, 2);
+
+	QCOMPARE(disk.read(small.data(), small.size(), 5), PRL_ERR_SUCCESS);
+	QVERIFY(small == large.left(SECTOR_SIZE));
+
+	// Beyond the end of the disk error comes from the image
+	QCOMPARE(disk.read(small.data(), small.size(), 8192),
+			PRL_ERR_DISK_READ_OUT_DISK);
+}
+
+void BufferedDiskTest::benchmarkCopy_data()
+{
+	QTest::addColumn<bool>("buffered");
+
+	QTest::newRow("direct") << false;
+	QTest::newRow("buffered") << true;
+}
+
+void BufferedDiskTest::benchmarkCopy()
+{
+	QFETCH(bool, buffered);
+
+	const PRL_UINT64 sectors = 64 * 1024 * 1024 / SECTOR_SIZE;
+	QTemporaryFile srcFile, dstFile;
+	QVERIFY(srcFile.open());
+	QVERIFY(dstFile.open());
+	QByteArray data(sectors * SECTOR_SIZE, 0);
+	fillRandom(data.data(), data.size());
+	QCOMPARE(srcFile.write(data), (qint64)data.size());
+	QVERIFY(dstFile.resize(data.size()));
+	srcFile.close();
+	dstFile.close();
+
+	Raw *src = new Raw, *dst = new Raw;
+	QScopedPointer<Format> in(src), out(dst);
+	if (buffered)
+	{
+		in.reset(new Buffered(in.take()));
+		out.reset(new Buffered(out.take()));
+	}
+	QCOMPARE(in->open(srcFile.fileName(), PRL_DISK_READ), PRL_ERR_SUCCESS);
+	QCOMPARE(out->open(dstFile.fileName(), PRL_DISK_READ | PRL_DISK_WRITE),
+			PRL_ERR_SUCCESS);
+
+	// Image copy by backup tools, 4K at once
+	QBENCHMARK
+	{
+		src->m_reads = dst->m_writes = 0;
+		QCOMPARE(copy(*in, *out, sectors, 8), PRL_ERR_SUCCESS);
+		QCOMPARE(in->close(), PRL_ERR_SUCCESS);
+		QCOMPARE(in->open(srcFile.fileName(), PRL_DISK_READ), PRL_ERR_SUCCESS);
+		QCOMPARE(out->close(), PRL_ERR_SUCCESS);
+		QCOMPARE(out->open(dstFile.fileName(), PRL_DISK_READ | PRL_DISK_WRITE),
+				PRL_ERR_SUCCESS);
+	}
+
+	// Buffered copy goes to the images by whole read-ahead windows
+	Parameters::Cache cache;
+	int requests = (int)(sectors / (buffered ?
+		cache.getBlockSize() * cache.getReadAhead() : 8));
+	QCOMPARE(src->m_reads, requests);
+	QCOMPARE(dst->m_writes, requests);
+
+	QCOMPARE(out->close(), PRL_ERR_SUCCESS);
+	QVERIFY(dstFile.open());
+	QVERIFY(dstFile.readAll() == data);
+}
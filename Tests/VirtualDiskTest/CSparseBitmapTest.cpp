@@ -0,0 +1,290 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		CSparseBitmapTest.cpp
+///
+/// @brief
+///		CSparseBitmap range, merge and stream test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <QBuffer>
+#include <QThreadPool>
+#include <prlsdk/PrlErrorsValues.h>
+
+#include <Libraries/PrlUuid/Uuid.h>
+#include <Libraries/Std/BitOps.h>
+#include <Libraries/VirtualDisk/SparseBitmap.h>
+
+#include "CSparseBitmapTest.h"
+
+namespace
+{
+
+// 128 GB disk in sectors, 8 parts of the bitmap with 512 byte granularity
+const UINT64 DISK_SIZE = 1llu << 28;
+const UINT64 PART_SIZE = 1llu << 25;
+
+UINT64 random64()
+{
+	return ((UINT64)qrand() << 33) ^ ((UINT64)qrand() << 16) ^ qrand();
+}
+
+void fill(CSparseBitmap &bitmap, int ranges)
+{
+	for (int i = 0; i < ranges; ++i)
+	{
+		UINT64 begin = random64() % bitmap.GetSize();
+		UINT64 end = qMin(bitmap.GetSize(), begin + 1 + qrand() % (1 << 20));
+		QCOMPARE(bitmap.SetRange(begin, end), PRL_ERR_SUCCESS);
+	}
+}
+
+// Mostly uniform bytes as the bitmaps of the formats are
+QByteArray random(UINT64 bits)
+{
+	QByteArray res((bits + 31) / 32 * 4, 0);
+	for (int i = 0; i < res.size(); ++i)
+		res[i] = qrand() % 8 ? res[qMax(i - 1, 0)] : (char)qrand();
+	return res;
+}
+
+QByteArray dump(const CSparseBitmap &bitmap)
+{
+	UINT64 granularity = bitmap.GetGranularity();
+	UINT64 end = bitmap.GetSize() & ~(granularity * 8 - 1);
+	QByteArray res(end / granularity / 8, 0);
+
+	if (bitmap.GetRange((UINT8 *)res.data(), granularity, 0, end) != PRL_ERR_SUCCESS)
+		return QByteArray();
+	return res;
+}
+
+} // namespace
+
+void CSparseBitmapTest::merge()
+{
+	PRL_RESULT err;
+	QScopedPointer<CSparseBitmap> a(CSparseBitmap::Create(DISK_SIZE, 1, err));
+	QScopedPointer<CSparseBitmap> b(CSparseBitmap::Create(DISK_SIZE, 1, err));
+	QVERIFY(!a.isNull() && !b.isNull());
+
+	qsrand(1);
+	fill(*a, 1000);
+	fill(*b, 1000);
+	QByteArray expected = dump(*a), other = dump(*b);
+	for (int i = 0; i < expected.size(); ++i)
+		expected[i] = expected.at(i) | other.at(i);
+
+	b->SetUid(Uuid::createUuid());
+	QCOMPARE(a->Merge(*b, true), PRL_ERR_SUCCESS);
+	QVERIFY(a->CheckUid(b->GetUid()));
+	QVERIFY(dump(*a) == expected);
+
+	QScopedPointer<CSparseBitmap> c(CSparseBitmap::Create(DISK_SIZE / 2, 1, err));
+	QCOMPARE(a->Merge(*c, false), PRL_ERR_INVALID_ARG);
+}
+
+void CSparseBitmapTest::assignRange_data()
+{
+	QTest::addColumn<uint>("granularity");
+	QTest::addColumn<qulonglong>("begin");
+	QTest::addColumn<qulonglong>("end");
+
+	QTest::newRow("whole") << 1u << 0llu << DISK_SIZE;
+	QTest::newRow("parts") << 1u << PART_SIZE - 64 << PART_SIZE * 5 + 128;
+	QTest::newRow("unaligned") << 1u << 5llu << 100005llu;
+	QTest::newRow("unaligned granularity") << 8u << PART_SIZE - 8003 << PART_SIZE + 77773;
+	QTest::newRow("disk end") << 8u << DISK_SIZE - 803 << DISK_SIZE + 5;
+}
+
+void CSparseBitmapTest::assignRange()
+{
+	QFETCH(uint, granularity);
+	QFETCH(qulonglong, begin);
+	QFETCH(qulonglong, end);
+
+	PRL_RESULT err;
+	QScopedPointer<CSparseBitmap> a(CSparseBitmap::Create(DISK_SIZE, granularity, err));
+	QScopedPointer<CSparseBitmap> ref(CSparseBitmap::Create(DISK_SIZE, granularity, err));
+	QVERIFY(!a.isNull() && !ref.isNull());
+
+	qsrand(begin);
+	fill(*a, 300);
+	QCOMPARE(ref->Merge(*a, false), PRL_ERR_SUCCESS);
+
+	QByteArray buf = random((end - begin + granularity - 1) / granularity);
+	QCOMPARE(a->AssignRange((UINT8 *)buf.data(), granularity, begin, end), PRL_ERR_SUCCESS);
+
+	QByteArray expected = dump(*ref);
+	if (((begin | end) & (granularity * 8 - 1)) == 0)
+	{
+		// replaced by the buffer
+		memcpy(expected.data() + begin / granularity / 8, buf.constData(),
+			(end - begin) / granularity / 8);
+	}
+	else
+	{
+		// set bits are merged one by one
+		for (UINT64 bit = begin; bit < end; bit += granularity)
+		{
+			if (BMAP_GET(buf.constData(), (bit - begin) / granularity))
+				ref->SetRange(bit, qMin(bit + granularity, DISK_SIZE));
+		}
+		expected = dump(*ref);
+	}
+	QVERIFY(dump(*a) == expected);
+}
+
+void CSparseBitmapTest::getRange_data()
+{
+	QTest::addColumn<uint>("granularity");
+	QTest::addColumn<qulonglong>("begin");
+	QTest::addColumn<qulonglong>("end");
+
+	QTest::newRow("aligned") << 1u << PART_SIZE - 64 << PART_SIZE + 100000;
+	QTest::newRow("unaligned") << 1u << 5llu << 100005llu;
+	QTest::newRow("long unaligned") << 1u << PART_SIZE - 100001 << PART_SIZE + 1000000;
+	QTest::newRow("unaligned granularity") << 8u << PART_SIZE - 8003 << PART_SIZE + 77773;
+	QTest::newRow("disk end") << 8u << DISK_SIZE - 803 << DISK_SIZE + 2000;
+}
+
+void CSparseBitmapTest::getRange()
+{
+	QFETCH(uint, granularity);
+	QFETCH(qulonglong, begin);
+	QFETCH(qulonglong, end);
+
+	PRL_RESULT err;
+	QScopedPointer<CSparseBitmap> a(CSparseBitmap::Create(DISK_SIZE, granularity, err));
+	QVERIFY(!a.isNull());
+
+	qsrand(begin);
+	fill(*a, 3000);
+	for (int i = 0; i < 3000; ++i)
+	{
+		UINT64 pos = begin + random64() % (qMin(end, DISK_SIZE) - begin);
+		QCOMPARE(a->ClearRange(pos, qMin(pos + 1 + qrand() % 256, DISK_SIZE)),
+			PRL_ERR_SUCCESS);
+	}
+
+	UINT64 bits = (end - begin + granularity - 1) / granularity;
+	QByteArray buf((bits + 31) / 32 * 4, 0), expected(buf.size(), 0);
+	QCOMPARE(a->GetRange((UINT8 *)buf.data(), granularity, begin, end), PRL_ERR_SUCCESS);
+
+	for (UINT64 bit = begin; bit < end; bit += granularity)
+	{
+		if (a->IsSet(bit))
+			BMAP_SET(expected.data(), (bit - begin) / granularity);
+	}
+	QVERIFY(buf == expected);
+}
+
+void CSparseBitmapTest::saveLoad()
+{
+	PRL_RESULT err;
+	QScopedPointer<CSparseBitmap> a(CSparseBitmap::Create(DISK_SIZE + 5, 8,
+		Uuid::createUuid(), err));
+	QVERIFY(!a.isNull());
+
+	qsrand(1);
+	fill(*a, 1000);
+
+	QBuffer dev;
+	QVERIFY(dev.open(QIODevice::ReadWrite));
+	QCOMPARE(a->Save(dev), PRL_ERR_SUCCESS);
+
+	QVERIFY(dev.seek(0));
+	QScopedPointer<CSparseBitmap> b(CSparseBitmap::Load(dev, err));
+	QCOMPARE(err, PRL_ERR_SUCCESS);
+	QVERIFY(!b.isNull());
+	QCOMPARE(b->GetSize(), a->GetSize());
+	QCOMPARE(b->GetGranularity(), 8u);
+	QVERIFY(b->CheckUid(a->GetUid()));
+	QVERIFY(dump(*b) == dump(*a));
+	QCOMPARE(b->IsSet(DISK_SIZE + 4), a->IsSet(DISK_SIZE + 4));
+
+	// Loading more streams merges them
+	QScopedPointer<CSparseBitmap> c(CSparseBitmap::Create(DISK_SIZE + 5, 8, err));
+	QCOMPARE(c->SetRange(DISK_SIZE - 1000, DISK_SIZE + 5), PRL_ERR_SUCCESS);
+	QVERIFY(dev.seek(0));
+	QCOMPARE(c->MergeFrom(dev, true), PRL_ERR_SUCCESS);
+	QVERIFY(c->CheckUid(a->GetUid()));
+	QCOMPARE(a->SetRange(DISK_SIZE - 1000, DISK_SIZE + 5), PRL_ERR_SUCCESS);
+	QVERIFY(dump(*c) == dump(*a));
+
+	QScopedPointer<CSparseBitmap> d(CSparseBitmap::Create(DISK_SIZE + 5, 16, err));
+	QVERIFY(dev.seek(0));
+	QCOMPARE(d->MergeFrom(dev, false), PRL_ERR_INVALID_ARG);
+
+	QBuffer cut;
+	cut.setData(dev.data().left(dev.size() - 1));
+	QVERIFY(cut.open(QIODevice::ReadOnly));
+	QVERIFY(CSparseBitmap::Load(cut, err) == NULL);
+	QCOMPARE(err, PRL_ERR_FILE_READ_ERROR);
+
+	// Empty bitmap is the header and a single record
+	QScopedPointer<CSparseBitmap> e(CSparseBitmap::Create(DISK_SIZE, 1, err));
+	QBuffer empty;
+	QVERIFY(empty.open(QIODevice::WriteOnly));
+	QCOMPARE(e->Save(empty), PRL_ERR_SUCCESS);
+	QCOMPARE(empty.size(), (qint64)41);
+}
+
+void CSparseBitmapTest::benchmarkMerge_data()
+{
+	QTest::addColumn<int>("threads");
+
+	QTest::newRow("serial") << 1;
+	QTest::newRow("pool") << QThread::idealThreadCount();
+}
+
+void CSparseBitmapTest::benchmarkMerge()
+{
+	QFETCH(int, threads);
+
+	// global bitmap of a 1 TB disk gathered from the storages
+	PRL_RESULT err;
+	QList<QSharedPointer<CSparseBitmap> > sources;
+	for (int i = 0; i < 8; ++i)
+	{
+		sources << QSharedPointer<CSparseBitmap>(
+			CSparseBitmap::Create(DISK_SIZE * 8, 1, err));
+		qsrand(i);
+		fill(*sources.last(), 2000);
+	}
+
+	int saved = QThreadPool::globalInstance()->maxThreadCount();
+	QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+	QScopedPointer<CSparseBitmap> bitmap;
+	QBENCHMARK
+	{
+		bitmap.reset(CSparseBitmap::Create(DISK_SIZE * 8, 1, err));
+		foreach (const QSharedPointer<CSparseBitmap> &s, sources)
+			QCOMPARE(bitmap->Merge(*s, false), PRL_ERR_SUCCESS);
+	}
+
+	QThreadPool::globalInstance()->setMaxThreadCount(saved);
+}
@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		NbdPoolTest.cpp
+///
+/// @brief
+///		VirtualDisk::Nbd device pool test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <QDir>
+#include <QFile>
+#include <prlsdk/PrlErrorsValues.h>
+
+#include <Libraries/VirtualDisk/Qcow2Disk_p.h>
+
+#include "NbdPoolTest.h"
+
+using namespace VirtualDisk::Nbd;
+
+// Plain files stand for the devices: they are locked the same way and
+// are never connected, so no NBD driver is needed
+
+void NbdPoolTest::init()
+{
+	m_dir.reset(new QTemporaryDir());
+	QVERIFY(m_dir->isValid());
+
+	m_devices.clear();
+	for (int i = 0; i < 3; ++i)
+	{
+		QFile f(QDir(m_dir->path()).filePath(QString("fake-nbd%1").arg(i)));
+		QVERIFY(f.open(QIODevice::WriteOnly));
+		m_devices << f.fileName();
+	}
+}
+
+void NbdPoolTest::cleanup()
+{
+	m_devices.clear();
+	m_dir.reset();
+}
+
+void NbdPoolTest::tryLock()
+{
+	QScopedPointer<QFile> f(Frontend::tryLock(m_devices[0]));
+	QVERIFY(f.data() != NULL);
+
+	// the lock is held per open file, so it conflicts in one process too
+	QString e;
+	QVERIFY(Frontend::tryLock(m_devices[0], &e) == NULL);
+	QVERIFY(e.contains(m_devices[0]));
+
+	f.reset();
+	f.reset(Frontend::tryLock(m_devices[0]));
+	QVERIFY(f.data() != NULL);
+
+	e.clear();
+	QVERIFY(Frontend::tryLock(m_dir->path() + "/missing", &e) == NULL);
+	QVERIFY(!e.isEmpty());
+}
+
+void NbdPoolTest::reserve()
+{
+	Registry r(m_devices);
+	QCOMPARE(r.getMetrics().reserved, (PRL_UINT32)0);
+
+	r.setReserve(2);
+	QTRY_COMPARE(r.getMetrics().reserved, (PRL_UINT32)2);
+
+	// the reserved devices are locked
+	int busy = 0;
+	foreach(const QString& d, m_devices)
+	{
+		QScopedPointer<QFile> f(Frontend::tryLock(d));
+		if (f.isNull())
+			++busy;
+	}
+	QCOMPARE(busy, 2);
+
+	Frontend a;
+	QVERIFY(PRL_SUCCEEDED(r.claim(a)));
+	QCOMPARE(r.getMetrics().misses, (PRL_UINT64)0);
+	// refilled by the last free device
+	QTRY_COMPARE(r.getMetrics().reserved, (PRL_UINT32)2);
+
+	r.setReserve(1);
+	QCOMPARE(r.getMetrics().reserved, (PRL_UINT32)1);
+	r.setReserve(0);
+	QCOMPARE(r.getMetrics().reserved, (PRL_UINT32)0);
+}
+
+void NbdPoolTest::claimWhenDry()
+{
+	Registry r(m_devices);
+	r.setReserve(1);
+	QTRY_COMPARE(r.getMetrics().reserved, (PRL_UINT32)1);
+
+	Frontend a, b, c, d;
+	QVERIFY(PRL_SUCCEEDED(r.claim(a)));
+	QTRY_COMPARE(r.getMetrics().reserved, (PRL_UINT32)1);
+	QVERIFY(PRL_SUCCEEDED(r.claim(b)));
+	QTRY_COMPARE(r.getMetrics().reserved, (PRL_UINT32)1);
+	QVERIFY(PRL_SUCCEEDED(r.claim(c)));
+	QCOMPARE(r.getMetrics().misses, (PRL_UINT64)0);
+
+	// all the devices are taken by the frontends
+	QCOMPARE(r.claim(d), (PRL_RESULT)PRL_ERR_DISK_GENERIC_ERROR);
+	QCOMPARE(r.getMetrics().misses, (PRL_UINT64)1);
+	QCOMPARE(r.getMetrics().reserved, (PRL_UINT32)0);
+}
+
+void NbdPoolTest::noOrphans()
+{
+	Registry r(m_devices);
+	QVERIFY(r.takeOrphan("image.qcow2").isEmpty());
+	r.rescan();
+	QVERIFY(r.takeOrphan("image.qcow2").isEmpty());
+}
@@ -0,0 +1,386 @@
+/////////////////////////////////////////////////////////////////////////////
+///
+/// Copyright (c) 2026 Virtuozzo International GmbH, All rights reserved.
+///
+/// This file is part of Virtuozzo Core. Virtuozzo Core is free
+/// software; you can redistribute it and/or modify it under the terms
+/// of the GNU General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any
+/// later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+/// 02110-1301, USA.
+///
+/// Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+/// Schaffhausen, Switzerland.
+///
+/// @file
+///		Qcow2MetadataTest.cpp
+///
+/// @brief
+///		VirtualDisk::Qcow2Metadata reader test cases.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+#include <map>
+#include <QtEndian>
+#include <QTemporaryFile>
+#include <prlsdk/PrlErrorsValues.h>
+
+#include <Libraries/VirtualDisk/Qcow2Metadata.h>
+#include <Libraries/VirtualDisk/SparseBitmap.h>
+
+#include "Qcow2MetadataTest.h"
+
+using namespace VirtualDisk;
+
+namespace
+{
+
+enum {SECTOR_SIZE = 512};
+
+///////////////////////////////////////////////////////////////////////////////
+// struct Builder - qcow2 image metadata, data clusters are not stored
+//
+// Layout: header, refcount table, L1 table, L2 tables in the order of their
+// first use.
+
+struct Builder
+{
+	Builder(PRL_UINT64 clusters, PRL_UINT32 clusterBits, bool extended = false):
+		m_version(3), m_clusterBits(clusterBits), m_extended(extended),
+		m_size(clusters << clusterBits), m_host(1ULL << 40),
+		m_image(3 << clusterBits, 0)
+	{
+	}
+
+	PRL_UINT64 getClusterSize() const
+	{
+		return 1ULL << m_clusterBits;
+	}
+
+	Builder& setVersion(PRL_UINT32 version)
+	{
+		m_version = version;
+		return *this;
+	}
+
+	Builder& setBacking(const QString &file, const QString &format)
+	{
+		m_backingFile = file;
+		m_backingFormat = format;
+		return *this;
+	}
+
+	Builder& data(PRL_UINT64 cluster)
+	{
+		return set(cluster, allocate() | (1ULL << 63), 0xffffffffULL);
+	}
+
+	Builder& zero(PRL_UINT64 cluster, bool preallocated = false)
+	{
+		if (m_extended)
+			return set(cluster, 0, 0xffffffffULL << 32);
+		return set(cluster, (preallocated ? allocate() : 0) | 1, 0);
+	}
+
+	// compressed data is byte aligned in the host file
+	Builder& compressed(PRL_UINT64 cluster, PRL_UINT64 shift = 0)
+	{
+		return set(cluster, (allocate() + shift) | (1ULL << 62), 0);
+	}
+
+	// extended L2 only
+	Builder& subclusters(PRL_UINT64 cluster, quint32 allocated, quint32 zeroed)
+	{
+		return set(cluster, allocated ? allocate() : 0,
+				allocated | ((PRL_UINT64)zeroed << 32));
+	}
+
+	bool save(QFile &file)
+	{
+		writeHeader();
+		return file.write(m_image) == m_image.size() && file.flush();
+	}
+
+private:
+	PRL_UINT64 getL2Entries() const
+	{
+		return getClusterSize() / (m_extended ? 16 : 8);
+	}
+
+	PRL_UINT64 allocate()
+	{
+		m_host += getClusterSize();
+		return m_host;
+	}
+
+	void put32(PRL_UINT64 offset, quint32 value)
+	{
+		qToBigEndian<quint32>(value, (uchar *)m_image.data() + offset);
+	}
+
+	void put64(PRL_UINT64 offset, PRL_UINT64 value)
+	{
+		qToBigEndian<quint64>(value, (uchar *)m_image.data() + offset);
+	}
+
+	Builder& set(PRL_UINT64 cluster, PRL_UINT64 entry, PRL_UINT64 bitmap)
+	{
+		PRL_UINT64 index = cluster / getL2Entries();
+		if (!m_tables.count(index))
+		{
+			m_tables[index] = m_image.size();
+			put64(2 * getClusterSize() + index * 8,
+					m_image.size() | (1ULL << 63));
+			m_image.append(QByteArray(getClusterSize(), 0));
+		}
+
+		PRL_UINT64 offset = m_tables[index] +
+			cluster % getL2Entries() * (m_extended ? 16 : 8);
+		put64(offset, entry);
+		if (m_extended)
+			put64(offset + 8, bitmap);
+		return *this;
+	}
+
+	void writeHeader()
+	{
+		const PRL_UINT64 l1 = (m_size + getL2Entries() * getClusterSize() - 1) /
+			(getL2Entries() * getClusterSize());
+		const PRL_UINT32 length = m_version == 2 ? 72 : 104;
+
+		put32(0, 0x514649fb);
+		put32(4, m_version);
+		put32(20, m_clusterBits);
+		put64(24, m_size);
+		put32(36, l1);
+		put64(40, 2 * getClusterSize());
+		put64(48, getClusterSize());
+		put32(56, 1);
+		if (m_version == 3)
+		{
+			put64(72, m_extended ? 1ULL << 4 : 0);
+			put32(96, 4);
+			put32(100, length);
+		}
+
+		// backing format extension, end of extensions, backing file name
+		PRL_UINT64 offset = length;
+		if (!m_backingFormat.isEmpty())
+		{
+			QByteArray f = m_backingFormat.toUtf8();
+			put32(offset, 0xe2792aca);
+			put32(offset + 4, f.size());
+			m_image.replace(offset + 8, f.size(), f);
+			offset += 8 + ((f.size() + 7) & ~7);
+		}
+		offset += 8;
+		if (!m_backingFile.isEmpty())
+		{
+			QByteArray b = m_backingFile.toUtf8();
+			put64(8, offset);
+			put32(16, b.size());
+			m_image.replace(offset, b.size(), b);
+		}
+	}
+
+	PRL_UINT32 m_version;
+	PRL_UINT32 m_clusterBits;
+	bool m_extended;
+	PRL_UINT64 m_size;
+	PRL_UINT64 m_host;
+	QString m_backingFile;
+	QString m_backingFormat;
+	QByteArray m_image;
+	std::map<PRL_UINT64, PRL_UINT64> m_tables;
+};
+
+CSparseBitmap *getUsed(const QFile &file, UINT32 granularity)
+{
+	PRL_RESULT err = PRL_ERR_UNINITIALIZED;
+	CSparseBitmap *b = Qcow2Metadata::getUsedBlocksBitmap(file.fileName(),
+			granularity, err);
+	if (b == NULL || PRL_FAILED(err))
+		qWarning("getUsedBlocksBitmap failed: %x", err);
+	return b;
+}
+
+} // namespace
+
+void Qcow2MetadataTest::isValid()
+{
+	QTemporaryFile image, v2, junk, future;
+	QVERIFY(image.open() && v2.open() && junk.open() && future.open());
+
+	QVERIFY(Builder(16, 16).data(1).save(image));
+	QVERIFY(Qcow2Metadata::isValid(image.fileName()));
+
+	QVERIFY(Builder(16, 16).setVersion(2).data(1).save(v2));
+	QVERIFY(Qcow2Metadata::isValid(v2.fileName()));
+
+	QVERIFY(junk.write(QByteArray(4096, 'x')) == 4096 && junk.flush());
+	QVERIFY(!Qcow2Metadata::isValid(junk.fileName()));
+
+	QVERIFY(Builder(16, 16).setVersion(4).save(future));
+	QVERIFY(!Qcow2Metadata::isValid(future.fileName()));
+
+	QVERIFY(!Qcow2Metadata::isValid(image.fileName() + ".missing"));
+}
+
+void Qcow2MetadataTest::usedBlocks_data()
+{
+	QTest::addColumn<uint>("clusterBits");
+
+	// 64 L2 entries per table, image spans several tables
+	QTest::newRow("512b clusters") << 9u;
+	QTest::newRow("64k clusters") << 16u;
+}
+
+void Qcow2MetadataTest::usedBlocks()
+{
+	QFETCH(uint, clusterBits);
+
+	const PRL_UINT64 clusters = 1000;
+	Builder b(clusters, clusterBits);
+	// L2 tables go to the file in the reverse order
+	for (PRL_UINT64 c = clusters; c-- > 0;)
+	{
+		if (c % 5 == 0)
+			b.data(c);
+		else if (c % 5 == 1)
+			b.zero(c);
+		else if (c % 5 == 2)
+			b.compressed(c, c % 2 ? 0x1a3 : 0);
+	}
+	QTemporaryFile image;
+	QVERIFY(image.open());
+	QVERIFY(b.save(image));
+
+	const PRL_UINT64 sectors = b.getClusterSize() / SECTOR_SIZE;
+	QScopedPointer<CSparseBitmap> used(getUsed(image, sectors));
+	QVERIFY(!used.isNull());
+	QCOMPARE(used->GetSize(), clusters * sectors);
+	for (PRL_UINT64 c = 0; c < clusters; ++c)
+		QCOMPARE(used->IsSet(c * sectors), c % 5 == 0 || c % 5 == 2);
+}
+
+void Qcow2MetadataTest::zeroFlag()
+{
+	QTemporaryFile v3, v2;
+	QVERIFY(v3.open() && v2.open());
+
+	QVERIFY(Builder(8, 12).zero(1, true).compressed(2, 1).save(v3));
+	QScopedPointer<CSparseBitmap> used(getUsed(v3, 8));
+	QVERIFY(!used.isNull());
+	QVERIFY(used->IsClearRange(0, 16));
+	QVERIFY(used->IsSetRange(16, 24));
+	QVERIFY(used->IsClearRange(24, 64));
+
+	// the flag is reserved in version 2
+	QVERIFY(Builder(8, 12).setVersion(2).zero(1, true).save(v2));
+	used.reset(getUsed(v2, 8));
+	QVERIFY(!used.isNull());
+	QVERIFY(used->IsClearRange(0, 8));
+	QVERIFY(used->IsSetRange(8, 16));
+	QVERIFY(used->IsClearRange(16, 64));
+}
+
+void Qcow2MetadataTest::backingChain()
+{
+	const PRL_UINT64 clusters = 256;
+	QTemporaryFile base, top;
+	QVERIFY(base.open() && top.open());
+
+	Builder b(clusters, 12);
+	for (PRL_UINT64 c = 0; c < clusters / 2; ++c)
+		b.data(c);
+	QVERIFY(b.save(base));
+
+	Builder t(clusters, 12);
+	t.setBacking(base.fileName(), "qcow2");
+	for (PRL_UINT64 c = 0; c < clusters; ++c)
+	{
+		if (c % 4 == 0)
+			t.zero(c);
+		else if (c % 4 == 1)
+			t.data(c);
+	}
+	QVERIFY(t.save(top));
+
+	// zero clusters of the top hide the data of the base
+	QScopedPointer<CSparseBitmap> used(getUsed(top, 8));
+	QVERIFY(!used.isNull());
+	for (PRL_UINT64 c = 0; c < clusters; ++c)
+	{
+		bool expected = c % 4 == 1 || (c % 4 != 0 && c < clusters / 2);
+		QCOMPARE(used->IsSet(c * 8), expected);
+	}
+
+	// coarse blocks are cleared only when zeroed entirely
+	used.reset(getUsed(top, 32));
+	QVERIFY(!used.isNull());
+	QVERIFY(used->IsSetRange(0, clusters * 8));
+}
+
+void Qcow2MetadataTest::foreignBacking()
+{
+	QTemporaryFile raw, top;
+	QVERIFY(raw.open() && top.open());
+	QVERIFY(raw.write(QByteArray(64 * 4096, 0)) == 64 * 4096 && raw.flush());
+
+	Builder t(64, 12);
+	t.setBacking(raw.fileName(), "raw").zero(3).data(5);
+	QVERIFY(t.save(top));
+
+	// raw data is not tracked, it is all used
+	QScopedPointer<CSparseBitmap> used(getUsed(top, 8));
+	QVERIFY(!used.isNull());
+	for (PRL_UINT64 c = 0; c < 64; ++c)
+		QCOMPARE(used->IsSet(c * 8), c != 3);
+}
+
+void Qcow2MetadataTest::missingBacking()
+{
+	QTemporaryFile top;
+	QVERIFY(top.open());
+
+	Builder t(64, 12);
+	t.setBacking(top.fileName() + ".missing", "qcow2").data(5);
+	QVERIFY(t.save(top));
+
+	// data of the missing file is unknown, it is not all used
+	PRL_RESULT err = PRL_ERR_SUCCESS;
+	QScopedPointer<CSparseBitmap> used(
+			Qcow2Metadata::getUsedBlocksBitmap(top.fileName(), 8, err));
+	QVERIFY(used.isNull());
+	QVERIFY(PRL_FAILED(err));
+}
+
+void Qcow2MetadataTest::extendedL2()
+{
+	QTemporaryFile image;
+	QVERIFY(image.open());
+
+	// 2K subclusters, 4 sectors each
+	Builder b(8, 16, true);
+	b.subclusters(0, 0x0000ffff, 0).subclusters(1, 0x1, 0xfffffffe)
+		.compressed(2).data(3).zero(4);
+	QVERIFY(b.save(image));
+
+	QScopedPointer<CSparseBitmap> used(getUsed(image, 4));
+	QVERIFY(!used.isNull());
+	QVERIFY(used->IsSetRange(0, 64));
+	QVERIFY(used->IsClearRange(64, 128));
+	QVERIFY(used->IsSetRange(128, 132));
+	QVERIFY(used->IsClearRange(132, 256));
+	QVERIFY(used->IsSetRange(256, 512));
+	QVERIFY(used->IsClearRange(512, 1024));
+}
@@ -0,0 +1,19 @@
+CONFIG += qtestlib testcase
+QT = core
+
+INCLUDEPATH += /usr/include/prlsdk
+
+include(VirtualDiskTest.deps)
+
+HEADERS += BufferedDiskTest.h \
+	AsyncDiskTest.h \
+	Qcow2MetadataTest.h \
+	NbdPoolTest.h \
+	CSparseBitmapTest.h
+
+SOURCES += Main.cpp \
+	BufferedDiskTest.cpp \
+	AsyncDiskTest.cpp \
+	Qcow2MetadataTest.cpp \
+	NbdPoolTest.cpp \
+	CSparseBitmapTest.cpp
@@ -0,0 +1,439 @@
+/*
+ * LogDecoder.cpp: Renders binary log stream to the text log format.
+ *
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "LogDecoder.h"
+
+namespace {
+
+enum {
+	// Same as the line buffer of Logger::DefaultParseMessage()
+	LineSize = 4096
+};
+
+// Cursor over raw arguments of the message record
+struct Args
+{
+	const char* p;
+	const char* end;
+
+	UINT64 next()
+	{
+		UINT64 v = 0;
+		if (end - p >= (long)sizeof(v)) {
+			::memcpy(&v, p, sizeof(v));
+			p += sizeof(v);
+		}
+		return v;
+	}
+
+	// Returns false for NULL string
+	bool nextString(std::string& s)
+	{
+		UINT32 len = 0;
+		s.clear();
+		if (end - p < (long)sizeof(len))
+			return true;
+		::memcpy(&len, p, sizeof(len));
+		p += sizeof(len);
+		if (len == LOG_BIN_NULL_STR)
+			return false;
+		if (len > (UINT32)(end - p))
+			len = end - p;
+		s.assign(p, len);
+		p += len;
+		return true;
+	}
+};
+
+template <typename T>
+void put(std::string& out, const std::string& spec,
+		 const int* stars, int nstars, T v)
+{
+	char buf[LineSize];
+	int n;
+
+	switch (nstars) {
+	case 0:
+		n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+		break;
+	case 1:
+		n = snprintf(buf, sizeof(buf), spec.c_str(), stars[0], v);
+		break;
+	default:
+		n = snprintf(buf, sizeof(buf), spec.c_str(), stars[0], stars[1], v);
+		break;
+	}
+	if (n < 0)
+		return;
+	out.append(buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// Kind of the argument taken by the conversion spec, as the logging
+// library records it, or 0 for the spec it never defers
+unsigned char specKind(const std::string& spec, int& nstars)
+{
+	const char* p = spec.c_str() + 1;
+	unsigned char len = 0;
+
+	nstars = 0;
+	for (; *p && ::strchr("-+ #0'I", *p); ++p)
+		if (*p == 'I' && p[1] >= '0' && p[1] <= '9')
+			return 0;
+	if (*p == '*') {
+		++nstars;
+		++p;
+	} else
+		while (*p >= '0' && *p <= '9')
+			++p;
+	if (*p == '.') {
+		if (*++p == '*') {
+			++nstars;
+			++p;
+		} else
+			while (*p >= '0' && *p <= '9')
+				++p;
+	}
+
+	switch (*p) {
+	case 'h':
+		if (*++p == 'h')
+			++p;
+		break;
+	case 'l':
+		len = LOG_ARG_LONG;
+		if (*++p == 'l') {
+			len = LOG_ARG_LLONG;
+			++p;
+		}
+		break;
+	case 'q':
+		len = LOG_ARG_LLONG;
+		++p;
+		break;
+	case 'j':
+	case 'z':
+	case 't':
+		len = LOG_ARG_SIZE;
+		++p;
+		break;
+	}
+
+	// Conversion must end the spec
+	if (*p == 0 || p[1] != 0)
+		return 0;
+
+	switch (*p) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		return len ? len : (unsigned char)LOG_ARG_INT;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		return LOG_ARG_DOUBLE;
+	case 'c':
+		return len ? 0 : LOG_ARG_INT;
+	case 's':
+		return len ? 0 : LOG_ARG_STRING;
+	case 'p':
+		return LOG_ARG_PTR;
+	}
+	return 0;
+}
+
+} // anonymous namespace
+
+LogDecoder::LogDecoder(FILE* out) : m_out(out)
+{
+}
+
+std::string LogDecoder::formatMessage(const std::string& format,
+									  const std::vector<unsigned char>& kinds,
+									  const char* data, size_t size)
+{
+	Args args = { data, data + size };
+	std::string out;
+	size_t k = 0;
+	const char* f = format.c_str();
+
+	while (*f) {
+		if (*f != '%') {
+			out += *f++;
+			continue;
+		}
+		if (f[1] == '%') {
+			out += '%';
+			f += 2;
+			continue;
+		}
+
+		const char* start = f++;
+		while (*f && !::strchr("diouxXeEfFgGaAcsp", *f))
+			++f;
+		if (*f == 0) {
+			out += start;
+			break;
+		}
+		std::string spec(start, ++f - start);
+
+		// Corrupted or foreign site must not make snprintf() take
+		// the argument of the other type
+		int nstars = 0;
+		unsigned char kind = specKind(spec, nstars);
+		bool valid = kind != 0 && k + nstars < kinds.size() &&
+			kinds[k + nstars] == kind;
+		for (int i = 0; valid && i < nstars; ++i)
+			valid = kinds[k + i] == LOG_ARG_INT;
+		if (!valid) {
+			out += start;
+			break;
+		}
+
+		int stars[2] = {0, 0};
+		for (int i = 0; i < nstars; ++i)
+			stars[i] = (int)args.next();
+		k += nstars + 1;
+
+		switch (kind) {
+		case LOG_ARG_INT:
+			put(out, spec, stars, nstars, (int)args.next());
+			break;
+		case LOG_ARG_LONG:
+			put(out, spec, stars, nstars, (long)args.next());
+			break;
+		case LOG_ARG_LLONG:
+			put(out, spec, stars, nstars, (long long)args.next());
+			break;
+		case LOG_ARG_SIZE:
+			put(out, spec, stars, nstars, (size_t)args.next());
+			break;
+		case LOG_ARG_DOUBLE: {
+			UINT64 v = args.next();
+			double d;
+			::memcpy(&d, &v, sizeof(d));
+			put(out, spec, stars, nstars, d);
+			break;
+		}
+		case LOG_ARG_PTR:
+			put(out, spec, stars, nstars, (void*)(ULONG_PTR)args.next());
+			break;
+		case LOG_ARG_STRING: {
+			std::string s;
+			if (args.nextString(s))
+				put(out, spec, stars, nstars, s.c_str());
+			else
+				put(out, spec, stars, nstars, (const char*)0);
+			break;
+		}
+		}
+	}
+	return out;
+}
+
+// Same format as GetDateTimeString() of the logging library
+std::string LogDecoder::formatTime(const Process& proc, UINT64 ticks)
+{
+	char buf[64];
+	const struct LogBinClock& c = proc.clock;
+
+	if (!proc.clockValid || c.frequency == 0)
+		return "00-00 00:00:00.000 ";
+
+	LONG64 delta = (LONG64)(ticks - c.ticks);
+	LONG64 usecs = (LONG64)c.usecs + delta / (LONG64)c.frequency * 1000000 +
+		delta % (LONG64)c.frequency * 1000000 / (LONG64)c.frequency;
+
+	time_t secs = usecs / 1000000 + c.utc_offset;
+	struct tm t;
+	int pos = strftime(buf, sizeof(buf), "%m-%d %H:%M:%S", gmtime_r(&secs, &t));
+	snprintf(buf + pos, sizeof(buf) - pos, ".%03d ",
+			 (int)(usecs % 1000000 / 1000));
+	return buf;
+}
+
+void LogDecoder::printMessage(const struct LogBinMessage& m, const char* data,
+							  size_t size)
+{
+	Process& proc = m_processes[m.h.pid];
+	std::string line = formatTime(proc, m.ticks);
+	char buf[256];
+
+	std::map<UINT32, Site>::const_iterator it = proc.sites.find(m.id);
+	if (it == proc.sites.end()) {
+		snprintf(buf, sizeof(buf), "? /:%u:%u/ <message of unknown site #%u>\n",
+				 m.h.pid, m.h.tid, m.id);
+		fputs((line + buf).c_str(), m_out);
+		return;
+	}
+	const Site& site = it->second;
+
+	int group = m.level / DBG_GROUP_SIZE;
+	int level = m.level % DBG_GROUP_SIZE;
+
+	if (group == DBG_GROUP_QT)
+		line += "QT: ";
+
+	switch (level) {
+	case DBG_FATAL:
+		line += "F ";
+		break;
+	case DBG_WARNING:
+		line += "W ";
+		break;
+	case DBG_INFO:
+		line += "I ";
+		break;
+	case DBG_DEBUG:
+		line += "D ";
+		break;
+	case DBG_TRACE:
+		line += "T ";
+		break;
+	default:
+		snprintf(buf, sizeof(buf), "O(%u) ", level);
+		line += buf;
+		break;
+	}
+
+	if (!site.prefix.empty())
+		line += site.prefix + " ";
+	snprintf(buf, sizeof(buf), "/%s:%u:%u/ ", site.target.c_str(),
+			 m.h.pid, m.h.tid);
+	line += buf;
+
+	if (group != DBG_GROUP_QT && !site.file.empty()) {
+		line += "{" + site.function + " @ " + site.file + ":";
+		snprintf(buf, sizeof(buf), "%i} ", site.line);
+		line += buf;
+	}
+
+	line += formatMessage(site.format, site.kinds, data, size);
+
+	// Truncate the string to fit buffer even with the trailing "\n"
+	if (line.size() > LineSize - 2)
+		line.resize(LineSize - 2);
+	line += "\n";
+	fputs(line.c_str(), m_out);
+}
+
+bool LogDecoder::readSite(const struct LogBinSite& s, const char* data,
+						  size_t size)
+{
+	const UINT16* lens[] = { &s.format_len, &s.file_len, &s.function_len,
+							 &s.prefix_len, &s.target_len };
+	size_t total = 0;
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+		total += *lens[i];
+	if (total > size || s.nargs > LOG_BIN_MAX_ARGS)
+		return false;
+
+	Site site;
+	std::string* strs[] = { &site.format, &site.file, &site.function,
+							&site.prefix, &site.target };
+	for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i) {
+		strs[i]->assign(data, *lens[i]);
+		data += *lens[i];
+	}
+	site.line = s.line;
+	site.kinds.assign(s.kinds, s.kinds + s.nargs);
+
+	// Site ids of restarted process with the same pid start again
+	m_processes[s.h.pid].sites[s.id] = site;
+	return true;
+}
+
+int LogDecoder::decode(FILE* f, const char* name)
+{
+	UINT64 buf[LOG_BIN_MAX_RECORD / sizeof(UINT64)];
+	char* rec = (char*)buf;
+	struct LogBinHeader* h = (struct LogBinHeader*)rec;
+	unsigned long long offset = 0;
+	bool synced = true;
+
+	if (fread(h, sizeof(*h), 1, f) != 1)
+		return 0;
+
+	for (;;) {
+		if (h->magic != LOG_BIN_MAGIC || h->size < sizeof(*h) ||
+			h->size > LOG_BIN_MAX_RECORD) {
+			// Slide by one byte until the next record header
+			if (synced)
+				fprintf(stderr, "%s: garbage at offset %llu\n", name, offset);
+			synced = false;
+			::memmove(rec, rec + 1, sizeof(*h) - 1);
+			if (fread(rec + sizeof(*h) - 1, 1, 1, f) != 1)
+				break;
+			++offset;
+			continue;
+		}
+		synced = true;
+
+		size_t rest = h->size - sizeof(*h);
+		if (rest && fread(rec + sizeof(*h), rest, 1, f) != 1) {
+			fprintf(stderr, "%s: truncated record at offset %llu\n",
+					name, offset);
+			break;
+		}
+
+		switch (h->type) {
+		case LOG_BIN_CLOCK:
+			if (h->size >= sizeof(struct LogBinClock)) {
+				Process& proc = m_processes[h->pid];
+				::memcpy(&proc.clock, rec, sizeof(proc.clock));
+				proc.clockValid = true;
+			}
+			break;
+		case LOG_BIN_SITE:
+			if (h->size < sizeof(struct LogBinSite) ||
+				!readSite(*(struct LogBinSite*)rec,
+						  rec + sizeof(struct LogBinSite),
+						  h->size - sizeof(struct LogBinSite)))
+				fprintf(stderr, "%s: bad site record at offset %llu\n",
+						name, offset);
+			break;
+		case LOG_BIN_MESSAGE:
+			if (h->size >= sizeof(struct LogBinMessage))
+				printMessage(*(struct LogBinMessage*)rec,
+							 rec + sizeof(struct LogBinMessage),
+							 h->size - sizeof(struct LogBinMessage));
+			break;
+		default:
+			// Unknown records of newer writers are skipped
+			break;
+		}
+
+		offset += h->size;
+		if (fread(h, sizeof(*h), 1, f) != 1)
+			break;
+	}
+
+	if (ferror(f)) {
+		fprintf(stderr, "%s: %s\n", name, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * LogDecoder.h: Renders binary log stream to the text log format.
+ *
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+#ifndef __LOG_DECODER_H__
+#define __LOG_DECODER_H__
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Libraries/Logging/LoggingBinary.h"
+
+/*
+ * Records are printed as the text lines, exactly as
+ * Logger::DefaultParseMessage() would format them.
+ */
+class LogDecoder
+{
+public:
+	explicit LogDecoder(FILE* out);
+
+	// Returns non zero if the stream can't be read
+	int decode(FILE* in, const char* name);
+
+	// Conversions of the format are checked against recorded kinds of
+	// arguments, format is printed as is from the first mismatch on
+	static std::string formatMessage(const std::string& format,
+									 const std::vector<unsigned char>& kinds,
+									 const char* data, size_t size);
+
+private:
+	struct Site
+	{
+		std::string format;
+		std::string file;
+		std::string function;
+		std::string prefix;
+		std::string target;
+		int line;
+		std::vector<unsigned char> kinds;
+	};
+
+	struct Process
+	{
+		Process() : clockValid(false) { ::memset(&clock, 0, sizeof(clock)); }
+
+		bool clockValid;
+		struct LogBinClock clock;
+		std::map<UINT32, Site> sites;
+	};
+
+	static std::string formatTime(const Process& proc, UINT64 ticks);
+	void printMessage(const struct LogBinMessage& m, const char* data,
+					  size_t size);
+	bool readSite(const struct LogBinSite& s, const char* data, size_t size);
+
+	FILE* m_out;
+	std::map<UINT32, Process> m_processes;
+};
+
+#endif // __LOG_DECODER_H__
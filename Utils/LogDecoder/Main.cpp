@@ -0,0 +1,64 @@
+/*
+ * Main.cpp: prllogdecode utility.
+ *
+ *
+ * Copyright (c) 2026 Virtuozzo International GmbH. All rights reserved.
+ *
+ * This file is part of Virtuozzo SDK. Virtuozzo SDK is free
+ * software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/> or write to Free Software Foundation,
+ * 51 Franklin Street, Fifth Floor Boston, MA 02110, USA.
+ *
+ * Our contact details: Virtuozzo International GmbH, Vordergasse 59, 8200
+ * Schaffhausen, Switzerland.
+ */
+
+/*
+ * Usage: prllogdecode [file.bin ...]
+ *
+ * Records are read from the given files or from the standard input and
+ * printed as the text lines.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "LogDecoder.h"
+
+int main(int argc, char** argv)
+{
+	LogDecoder decoder(stdout);
+	int res = 0;
+
+	if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) {
+		printf("Usage: %s [file" LOG_BIN_SUFFIX " ...]\n"
+			   "Prints binary log records as text log lines.\n", argv[0]);
+		return 0;
+	}
+
+	if (argc == 1)
+		return decoder.decode(stdin, "<stdin>");
+
+	for (int i = 1; i < argc; ++i) {
+		FILE* f = fopen(argv[i], "rb");
+		if (f == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+			res = 1;
+			continue;
+		}
+		res |= decoder.decode(f, argv[i]);
+		fclose(f);
+	}
+	return res;
+}